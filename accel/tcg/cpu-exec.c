@@ -27,6 +27,7 @@
 #include "disas/disas.h"
 #include "exec/cpu-common.h"
 #include "exec/page-protection.h"
+#include "exec/ram_addr.h"
 #include "exec/translation-block.h"
 #include "tcg/tcg.h"
 #include "qemu/atomic.h"
@@ -485,6 +486,10 @@ cpu_tb_exec(CPUState *cpu, TranslationBlock *itb, int *tb_exit)
 
     trace_exec_tb_exit(last_tb, *tb_exit);
 
+    if (unlikely(tb_profile_enabled) && last_tb && *tb_exit <= TB_EXIT_IDX1) {
+        last_tb->exit_count++;
+    }
+
     if (*tb_exit > TB_EXIT_IDX1) {
         /* We didn't start executing this TB (eg because the instruction
          * counter hit zero); we must restore the guest PC to the address
@@ -1102,6 +1107,7 @@ bool tcg_exec_realizefn(CPUState *cpu, Error **errp)
     tlb_init(cpu);
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_init_notifier_list(cpu);
+    tcg_dirty_ring_alloc(cpu);
 #endif /* !CONFIG_USER_ONLY */
     /* qemu_plugin_vcpu_init_hook delayed until cpu_index assigned. */
 
@@ -1113,6 +1119,7 @@ void tcg_exec_unrealizefn(CPUState *cpu)
 {
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_free_notifier_list(cpu);
+    tcg_dirty_ring_free(cpu);
 #endif /* !CONFIG_USER_ONLY */
 
     tlb_destroy(cpu);
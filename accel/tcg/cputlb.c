@@ -288,8 +288,7 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
-    desc->large_page_addr = -1;
-    desc->large_page_mask = -1;
+    desc->n_large_pages = 0;
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
@@ -508,25 +507,61 @@ static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(cpu, mmu_idx, page, -1);
 }
 
-static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
+/*
+ * Flush every large page region of @midx that overlaps [addr, last].
+ * Each such region is widened to a flush of all entries within it,
+ * and then forgotten.
+ */
+static void tlb_flush_large_pages_locked(CPUState *cpu, int midx,
+                                        vaddr addr, vaddr last)
 {
-    vaddr lp_addr = cpu->neg.tlb.d[midx].large_page_addr;
-    vaddr lp_mask = cpu->neg.tlb.d[midx].large_page_mask;
+    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
+    CPUTLBDescFast *f = &cpu->neg.tlb.f[midx];
+    size_t n_entries = tlb_n_entries(f);
+    unsigned int i = 0;
 
-    /* Check if we need to flush due to large pages.  */
-    if ((page & lp_mask) == lp_addr) {
-        tlb_debug("forcing full flush midx %d (%016"
+    while (i < d->n_large_pages) {
+        vaddr lp_addr = d->large_page[i].addr;
+        vaddr lp_mask = d->large_page[i].mask;
+
+        if (last < lp_addr || addr > (lp_addr | ~lp_mask)) {
+            i++;
+            continue;
+        }
+
+        tlb_debug("flushing large page region midx %d (%016"
                   VADDR_PRIx "/%016" VADDR_PRIx ")\n",
                   midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
-    } else {
-        if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
-            tlb_n_used_entries_dec(cpu, midx);
+
+        for (size_t k = 0; k < n_entries; k++) {
+            if (tlb_flush_entry_mask_locked(&f->table[k], lp_addr, lp_mask)) {
+                tlb_n_used_entries_dec(cpu, midx);
+            }
         }
-        tlb_flush_vtlb_page_locked(cpu, midx, page);
+        tlb_flush_vtlb_page_mask_locked(cpu, midx, lp_addr, lp_mask);
+
+        /* The region is now empty; drop it without preserving order. */
+        d->large_page[i] = d->large_page[--d->n_large_pages];
+
+        qatomic_set(&cpu->neg.tlb.c.large_page_flush_count,
+                    cpu->neg.tlb.c.large_page_flush_count + 1);
     }
 }
 
+static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
+{
+    qatomic_set(&cpu->neg.tlb.c.page_flush_count,
+                cpu->neg.tlb.c.page_flush_count + 1);
+
+    /* Check if we need to flush due to large pages.  */
+    tlb_flush_large_pages_locked(cpu, midx, page, page + TARGET_PAGE_SIZE - 1);
+
+    if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
+        tlb_n_used_entries_dec(cpu, midx);
+    }
+    tlb_flush_vtlb_page_locked(cpu, midx, page);
+}
+
 /**
  * tlb_flush_page_by_mmuidx_async_0:
  * @cpu: cpu on which to flush
@@ -673,7 +708,6 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
                                    vaddr addr, vaddr len,
                                    unsigned bits)
 {
-    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
     CPUTLBDescFast *f = &cpu->neg.tlb.f[midx];
     vaddr mask = MAKE_64BIT_MASK(0, bits);
 
@@ -695,18 +729,14 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
         return;
     }
 
+    qatomic_set(&cpu->neg.tlb.c.page_flush_count,
+                cpu->neg.tlb.c.page_flush_count + 1);
+
     /*
-     * Check if we need to flush due to large pages.
-     * Because large_page_mask contains all 1's from the msb,
-     * we only need to test the end of the range.
+     * Flush any large page regions overlapping the range.  Pages that
+     * are not covered by a region are handled individually below.
      */
-    if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  "%016" VADDR_PRIx "/%016" VADDR_PRIx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
-        return;
-    }
+    tlb_flush_large_pages_locked(cpu, midx, addr, addr + len - 1);
 
     for (vaddr i = 0; i < len; i += TARGET_PAGE_SIZE) {
         vaddr page = addr + i;
@@ -986,28 +1016,50 @@ static void tlb_set_dirty(CPUState *cpu, vaddr addr)
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
+/* Our TLB does not support large pages, so remember the areas covered by
+   large pages and flush every entry of an area if any part of it is
+   invalidated.  */
 static void tlb_add_large_page(CPUState *cpu, int mmu_idx,
                                vaddr addr, uint64_t size)
 {
-    vaddr lp_addr = cpu->neg.tlb.d[mmu_idx].large_page_addr;
+    CPUTLBDesc *d = &cpu->neg.tlb.d[mmu_idx];
     vaddr lp_mask = ~(size - 1);
+    vaddr best_mask = 0;
+    unsigned int i, best = 0;
 
-    if (lp_addr == (vaddr)-1) {
-        /* No previous large page.  */
-        lp_addr = addr;
-    } else {
-        /* Extend the existing region to include the new page.
-           This is a compromise between unnecessary flushes and
-           the cost of maintaining a full variable size TLB.  */
-        lp_mask &= cpu->neg.tlb.d[mmu_idx].large_page_mask;
-        while (((lp_addr ^ addr) & lp_mask) != 0) {
-            lp_mask <<= 1;
+    for (i = 0; i < d->n_large_pages; i++) {
+        CPUTLBLargePage *lp = &d->large_page[i];
+
+        /* Already covered by an existing region?  */
+        if ((addr & lp->mask) == lp->addr && (lp->mask | lp_mask) == lp_mask) {
+            return;
+        }
+    }
+
+    if (d->n_large_pages < CPU_TLB_LARGE_PAGE_RANGES) {
+        d->large_page[d->n_large_pages].addr = addr & lp_mask;
+        d->large_page[d->n_large_pages].mask = lp_mask;
+        d->n_large_pages++;
+        return;
+    }
+
+    /* Extend the region that grows the least to include the new page.
+       This is a compromise between unnecessary flushes and
+       the cost of maintaining a full variable size TLB.  */
+    for (i = 0; i < CPU_TLB_LARGE_PAGE_RANGES; i++) {
+        CPUTLBLargePage *lp = &d->large_page[i];
+        vaddr mask = lp_mask & lp->mask;
+
+        while (((lp->addr ^ addr) & mask) != 0) {
+            mask <<= 1;
+        }
+        if (i == 0 || mask > best_mask) {
+            best = i;
+            best_mask = mask;
         }
     }
-    cpu->neg.tlb.d[mmu_idx].large_page_addr = lp_addr & lp_mask;
-    cpu->neg.tlb.d[mmu_idx].large_page_mask = lp_mask;
+    d->large_page[best].addr &= best_mask;
+    d->large_page[best].mask = best_mask;
 }
 
 static inline void tlb_set_compare(CPUTLBEntryFull *full, CPUTLBEntry *ent,
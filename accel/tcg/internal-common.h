@@ -16,6 +16,16 @@ extern int64_t max_delay;
 extern int64_t max_advance;
 
 extern bool one_insn_per_tb;
+extern bool tcg_dense_enabled;
+
+/* Round robin scheduling with thread=dense, for x-query-jit */
+typedef struct TCGDenseStats {
+    uint64_t kicks;         /* vCPUs preempted at the end of their slice */
+    int64_t slice_ns;       /* current slice */
+} TCGDenseStats;
+
+extern TCGDenseStats tcg_dense_stats;
+extern bool tb_profile_enabled;
 
 /*
  * Return true if CS is not running in parallel with other cpus, either
@@ -53,6 +63,9 @@ TranslationBlock *tb_link_page(TranslationBlock *tb);
 void cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
                                uintptr_t host_pc);
 
+void tb_profile_init(void);
+unsigned int tb_profile_translations(tb_page_addr_t phys_pc, vaddr *pc);
+
 bool tcg_exec_realizefn(CPUState *cpu, Error **errp);
 void tcg_exec_unrealizefn(CPUState *cpu);
 
@@ -12,7 +12,9 @@
 #include "qapi/error.h"
 #include "qapi/type-helpers.h"
 #include "qapi/qapi-commands-machine.h"
+#include "qapi/qmp/qdict.h"
 #include "monitor/monitor.h"
+#include "monitor/hmp.h"
 #include "system/cpus.h"
 #include "system/cpu-timers.h"
 #include "system/tcg.h"
@@ -52,6 +54,19 @@ static void dump_accel_info(GString *buf)
                            one_insn_per_tb ? "on" : "off");
 }
 
+static void dump_dense_info(GString *buf)
+{
+    if (!tcg_dense_enabled) {
+        return;
+    }
+
+    g_string_append_printf(buf, "\nDense scheduling:\n");
+    g_string_append_printf(buf, "slice kicks         %"PRIu64"\n",
+                           tcg_dense_stats.kicks);
+    g_string_append_printf(buf, "current slice       %"PRIi64" us\n",
+                           tcg_dense_stats.slice_ns / SCALE_US);
+}
+
 static void print_qht_statistics(struct qht_stats hst, GString *buf)
 {
     uint32_t hgram_opts;
@@ -126,19 +141,26 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
-static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
+struct tlb_flush_stats {
+    size_t full;
+    size_t part;
+    size_t elide;
+    size_t page;
+    size_t large_page;
+};
+
+static void tlb_flush_counts(struct tlb_flush_stats *st)
 {
     CPUState *cpu;
-    size_t full = 0, part = 0, elide = 0;
 
     CPU_FOREACH(cpu) {
-        full += qatomic_read(&cpu->neg.tlb.c.full_flush_count);
-        part += qatomic_read(&cpu->neg.tlb.c.part_flush_count);
-        elide += qatomic_read(&cpu->neg.tlb.c.elide_flush_count);
+        st->full += qatomic_read(&cpu->neg.tlb.c.full_flush_count);
+        st->part += qatomic_read(&cpu->neg.tlb.c.part_flush_count);
+        st->elide += qatomic_read(&cpu->neg.tlb.c.elide_flush_count);
+        st->page += qatomic_read(&cpu->neg.tlb.c.page_flush_count);
+        st->large_page +=
+            qatomic_read(&cpu->neg.tlb.c.large_page_flush_count);
     }
-    *pfull = full;
-    *ppart = part;
-    *pelide = elide;
 }
 
 static void tcg_dump_info(GString *buf)
@@ -149,8 +171,9 @@ static void tcg_dump_info(GString *buf)
 static void dump_exec_info(GString *buf)
 {
     struct tb_tree_stats tst = {};
+    struct tlb_flush_stats fst = {};
     struct qht_stats hst;
-    size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t nb_tbs;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -192,10 +215,13 @@ static void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
 
-    tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
-    g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
-    g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
-    g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    tlb_flush_counts(&fst);
+    g_string_append_printf(buf, "TLB full flushes    %zu\n", fst.full);
+    g_string_append_printf(buf, "TLB partial flushes %zu\n", fst.part);
+    g_string_append_printf(buf, "TLB elided flushes  %zu\n", fst.elide);
+    g_string_append_printf(buf, "TLB page flushes    %zu\n", fst.page);
+    g_string_append_printf(buf, "TLB large page region flushes %zu\n",
+                           fst.large_page);
     tcg_dump_info(buf);
 }
 
@@ -210,6 +236,7 @@ HumanReadableText *qmp_x_query_jit(Error **errp)
 
     dump_accel_info(buf);
     dump_exec_info(buf);
+    dump_dense_info(buf);
     dump_drift_info(buf);
 
     return human_readable_text_from_str(buf);
@@ -235,10 +262,115 @@ HumanReadableText *qmp_x_query_opcount(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+static gboolean tb_hot_iter(gpointer key, gpointer value, gpointer data)
+{
+    const TranslationBlock *tb = value;
+    GArray *blocks = data;
+    JitHotBlock b = {
+        .pc = tb->pc,
+        .phys_pc = tb->page_addr[0],
+        .size = tb->size,
+        .host_size = tb->tc.size,
+        .exec_count = tb->exec_count,
+        .exit_count = tb->exit_count,
+    };
+
+    /*
+     * Copy the counters while the region trees are locked; the TB itself
+     * may be reused by a concurrent flush once we drop the locks.
+     */
+    if (b.exec_count) {
+        g_array_append_val(blocks, b);
+    }
+    return false;
+}
+
+static gint tb_hot_cmp(gconstpointer a, gconstpointer b)
+{
+    const JitHotBlock *ba = a, *bb = b;
+
+    if (ba->exec_count != bb->exec_count) {
+        return ba->exec_count > bb->exec_count ? -1 : 1;
+    }
+    return ba->phys_pc < bb->phys_pc ? -1 : ba->phys_pc > bb->phys_pc;
+}
+
+JitHotBlockList *qmp_x_query_jit_hot(bool has_count, int64_t count,
+                                     Error **errp)
+{
+    g_autoptr(GArray) blocks = NULL;
+    JitHotBlockList *head = NULL, **tail = &head;
+    guint i;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "JIT information is only available with accel=tcg");
+        return NULL;
+    }
+    if (!tb_profile_enabled) {
+        error_setg(errp, "TB profiling is not enabled");
+        error_append_hint(errp, "Use -accel tcg,profile-tb=on\n");
+        return NULL;
+    }
+    if (!has_count) {
+        count = 16;
+    } else if (count <= 0) {
+        error_setg(errp, "Parameter 'count' must be positive");
+        return NULL;
+    }
+
+    blocks = g_array_new(false, false, sizeof(JitHotBlock));
+    tcg_tb_foreach(tb_hot_iter, blocks);
+    g_array_sort(blocks, tb_hot_cmp);
+
+    for (i = 0; i < blocks->len && i < count; i++) {
+        JitHotBlock *b = g_memdup2(&g_array_index(blocks, JitHotBlock, i),
+                                   sizeof(JitHotBlock));
+        vaddr first_pc = b->pc;
+
+        b->translations = tb_profile_translations(b->phys_pc, &first_pc);
+        if (!b->pc) {
+            b->pc = first_pc;
+        }
+        QAPI_LIST_APPEND(tail, b);
+    }
+
+    return head;
+}
+
+static void hmp_info_jit_hot(Monitor *mon, const QDict *qdict)
+{
+    int64_t count = qdict_get_try_int(qdict, "count", 16);
+    g_autoptr(JitHotBlockList) list = NULL;
+    JitHotBlockList *l;
+    Error *err = NULL;
+
+    list = qmp_x_query_jit_hot(true, count, &err);
+    if (hmp_handle_error(mon, err)) {
+        return;
+    }
+
+    monitor_printf(mon, "%-18s %-18s %5s %5s %14s %6s %5s\n",
+                   "pc", "phys-pc", "size", "host", "exec", "chain%",
+                   "xlat");
+    for (l = list; l; l = l->next) {
+        JitHotBlock *b = l->value;
+        uint64_t chained = b->exec_count > b->exit_count ?
+                           b->exec_count - b->exit_count : 0;
+
+        monitor_printf(mon, "0x%016" PRIx64 " 0x%016" PRIx64
+                       " %5" PRIu32 " %5" PRIu32 " %14" PRIu64
+                       " %5" PRIu64 "%% %5" PRIu32 "\n",
+                       b->pc, b->phys_pc, b->size, b->host_size,
+                       b->exec_count, chained * 100 / b->exec_count,
+                       b->translations);
+    }
+}
+
 static void hmp_tcg_register(void)
 {
     monitor_register_hmp_info_hrt("jit", qmp_x_query_jit);
     monitor_register_hmp_info_hrt("opcount", qmp_x_query_opcount);
+    monitor_register_hmp("jit-hot", true, hmp_info_jit_hot);
 }
 
 type_init(hmp_tcg_register);
@@ -33,15 +33,20 @@
 #include "qemu/guest-random.h"
 #include "exec/exec-all.h"
 #include "tcg/startup.h"
+#include "internal-common.h"
 #include "tcg-accel-ops.h"
 #include "tcg-accel-ops-rr.h"
 #include "tcg-accel-ops-icount.h"
 
+/* Something woke up a vCPU or made it go idle, see rr_kick_thread() */
+static unsigned int rr_sched_events;
+
 /* Kick all RR vCPUs */
 void rr_kick_vcpu_thread(CPUState *unused)
 {
     CPUState *cpu;
 
+    qatomic_inc(&rr_sched_events);
     CPU_FOREACH(cpu) {
         cpu_exit(cpu);
     };
@@ -57,14 +62,50 @@ void rr_kick_vcpu_thread(CPUState *unused)
  *
  * The timer is removed if all vCPUs are idle and restarted again once
  * idleness is complete.
+ *
+ * With thread=dense, meant for hosts packed with small guests, the timer
+ * is only armed while at least two vCPUs are runnable: a vCPU alone has
+ * nobody to make room for, and the others are kicked out of idleness by
+ * rr_kick_vcpu_thread(). The slice also adapts: it doubles, up to
+ * TCG_KICK_PERIOD, for as long as vCPUs keep competing without any
+ * of them going idle or being woken up, and drops back to
+ * TCG_DENSE_MIN_SLICE as soon as one does so that the newly runnable
+ * vCPU gets its turn quickly.
  */
 
 static QEMUTimer *rr_kick_vcpu_timer;
 static CPUState *rr_current_cpu;
+static int64_t rr_slice = TCG_KICK_PERIOD;
+static unsigned int rr_sched_events_seen;
 
 static inline int64_t rr_next_kick_time(void)
 {
-    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + TCG_KICK_PERIOD;
+    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + rr_slice;
+}
+
+static bool rr_dense_contended(void)
+{
+    CPUState *cpu;
+    int runnable = 0;
+
+    CPU_FOREACH(cpu) {
+        if (!cpu_thread_is_idle(cpu) && ++runnable > 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void rr_dense_adapt_slice(void)
+{
+    unsigned int events = qatomic_read(&rr_sched_events);
+
+    if (events != rr_sched_events_seen) {
+        rr_sched_events_seen = events;
+        rr_slice = TCG_DENSE_MIN_SLICE;
+    } else {
+        rr_slice = MIN(rr_slice * 2, TCG_KICK_PERIOD);
+    }
 }
 
 /* Kick the currently round-robin scheduled vCPU to next */
@@ -83,17 +124,32 @@ static void rr_kick_next_cpu(void)
 
 static void rr_kick_thread(void *opaque)
 {
+    if (tcg_dense_enabled) {
+        if (!rr_dense_contended()) {
+            return;
+        }
+        rr_dense_adapt_slice();
+        tcg_dense_stats.kicks++;
+        tcg_dense_stats.slice_ns = rr_slice;
+    }
     timer_mod(rr_kick_vcpu_timer, rr_next_kick_time());
     rr_kick_next_cpu();
 }
 
 static void rr_start_kick_timer(void)
 {
+    if (tcg_dense_enabled && !rr_dense_contended()) {
+        return;
+    }
     if (!rr_kick_vcpu_timer && CPU_NEXT(first_cpu)) {
         rr_kick_vcpu_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
                                            rr_kick_thread, NULL);
     }
     if (rr_kick_vcpu_timer && !timer_pending(rr_kick_vcpu_timer)) {
+        if (tcg_dense_enabled) {
+            rr_slice = TCG_DENSE_MIN_SLICE;
+            tcg_dense_stats.slice_ns = rr_slice;
+        }
         timer_mod(rr_kick_vcpu_timer, rr_next_kick_time());
     }
 }
@@ -248,6 +304,12 @@ static void *rr_cpu_thread_fn(void *arg)
 
             current_cpu = cpu;
 
+            /* Idle vCPUs are woken up through rr_kick_vcpu_thread() */
+            if (tcg_dense_enabled && cpu_thread_is_idle(cpu)) {
+                cpu = CPU_NEXT(cpu);
+                continue;
+            }
+
             qemu_clock_enable(QEMU_CLOCK_VIRTUAL,
                               (cpu->singlestep_enabled & SSTEP_NOTIMER) == 0);
 
@@ -264,7 +326,9 @@ static void *rr_cpu_thread_fn(void *arg)
                 }
                 bql_lock();
 
-                if (r == EXCP_DEBUG) {
+                if (r == EXCP_HLT) {
+                    qatomic_inc(&rr_sched_events);
+                } else if (r == EXCP_DEBUG) {
                     cpu_handle_guest_debug(cpu);
                     break;
                 } else if (r == EXCP_ATOMIC) {
@@ -11,6 +11,7 @@
 #define TCG_ACCEL_OPS_RR_H
 
 #define TCG_KICK_PERIOD (NANOSECONDS_PER_SECOND / 10)
+#define TCG_DENSE_MIN_SLICE (NANOSECONDS_PER_SECOND / 100)
 
 /* Kick all RR vCPUs. */
 void rr_kick_vcpu_thread(CPUState *unused);
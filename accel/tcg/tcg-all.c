@@ -26,6 +26,7 @@
 #include "qemu/osdep.h"
 #include "system/tcg.h"
 #include "exec/replay-core.h"
+#include "exec/ram_addr.h"
 #include "system/cpu-timers.h"
 #include "tcg/startup.h"
 #include "tcg/oversized-guest.h"
@@ -39,6 +40,7 @@
 #include "hw/qdev-core.h"
 #else
 #include "hw/boards.h"
+#include "qemu/main-loop.h"
 #endif
 #include "internal-common.h"
 
@@ -46,9 +48,15 @@ struct TCGState {
     AccelState parent_obj;
 
     bool mttcg_enabled;
+    bool dense_enabled;
     bool one_insn_per_tb;
     int splitwx_enabled;
     unsigned long tb_size;
+    TCGHugepages hugepages;
+    bool numa;
+    bool profile_tb;
+    uint32_t dirty_ring_size;
+    int64_t timer_slack_us;
 };
 typedef struct TCGState TCGState;
 
@@ -90,6 +98,7 @@ static void tcg_accel_instance_init(Object *obj)
     TCGState *s = TCG_STATE(obj);
 
     s->mttcg_enabled = default_mttcg_enabled();
+    s->timer_slack_us = -1;
 
     /* If debugging enabled, default "auto on", otherwise off. */
 #if defined(CONFIG_DEBUG_TCG) && !defined(CONFIG_USER_ONLY)
@@ -100,8 +109,21 @@ static void tcg_accel_instance_init(Object *obj)
 }
 
 bool mttcg_enabled;
+bool tcg_dense_enabled;
+TCGDenseStats tcg_dense_stats;
 bool one_insn_per_tb;
 
+/* Wakeups of the main loop for timers are batched by 1ms with thread=dense */
+#define TCG_DENSE_TIMER_SLACK_US 1000
+
+static int64_t tcg_timer_slack_us(TCGState *s)
+{
+    if (s->timer_slack_us >= 0) {
+        return s->timer_slack_us;
+    }
+    return s->dense_enabled ? TCG_DENSE_TIMER_SLACK_US : 0;
+}
+
 static int tcg_init_machine(MachineState *ms)
 {
     TCGState *s = TCG_STATE(current_accel());
@@ -113,10 +135,15 @@ static int tcg_init_machine(MachineState *ms)
 
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+    tcg_dense_enabled = s->dense_enabled;
 
     page_init();
     tb_htable_init();
-    tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
+    if (s->profile_tb) {
+        tb_profile_init();
+    }
+    tcg_init(s->tb_size * MiB, s->splitwx_enabled, s->hugepages, s->numa,
+             max_cpus);
 
 #if defined(CONFIG_SOFTMMU)
     /*
@@ -126,6 +153,13 @@ static int tcg_init_machine(MachineState *ms)
     tcg_prologue_init();
 #endif
 
+#ifndef CONFIG_USER_ONLY
+    if (s->dirty_ring_size) {
+        tcg_dirty_ring_init(s->dirty_ring_size);
+    }
+    main_loop_set_timer_slack(tcg_timer_slack_us(s) * SCALE_US);
+#endif
+
 #ifdef CONFIG_USER_ONLY
     qdev_create_fake_machine();
 #endif
@@ -137,6 +171,9 @@ static char *tcg_get_thread(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
 
+    if (s->dense_enabled) {
+        return g_strdup("dense");
+    }
     return g_strdup(s->mttcg_enabled ? "multi" : "single");
 }
 
@@ -155,9 +192,18 @@ static void tcg_set_thread(Object *obj, const char *value, Error **errp)
                         "you may get unexpected results");
 #endif
             s->mttcg_enabled = true;
+            s->dense_enabled = false;
         }
     } else if (strcmp(value, "single") == 0) {
         s->mttcg_enabled = false;
+        s->dense_enabled = false;
+    } else if (strcmp(value, "dense") == 0) {
+        if (icount_enabled()) {
+            error_setg(errp, "No dense scheduling when icount is enabled");
+        } else {
+            s->mttcg_enabled = false;
+            s->dense_enabled = true;
+        }
     } else {
         error_setg(errp, "Invalid 'thread' setting %s", value);
     }
@@ -187,6 +233,58 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static void tcg_get_dirty_ring_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->dirty_ring_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_dirty_ring_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value & (value - 1)) {
+        error_setg(errp, "dirty-ring-size must be a power of two");
+        return;
+    }
+
+    s->dirty_ring_size = value;
+}
+
+static void tcg_get_timer_slack(Object *obj, Visitor *v,
+                                const char *name, void *opaque,
+                                Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = tcg_timer_slack_us(s);
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_timer_slack(Object *obj, Visitor *v,
+                                const char *name, void *opaque,
+                                Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->timer_slack_us = value;
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -199,6 +297,66 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+static char *tcg_get_hugepages(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    switch (s->hugepages) {
+    case TCG_HUGEPAGES_THP:
+        return g_strdup("thp");
+    case TCG_HUGEPAGES_EXPLICIT:
+        return g_strdup("explicit");
+    default:
+        return g_strdup("advise");
+    }
+}
+
+static void tcg_set_hugepages(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    if (strcmp(value, "advise") == 0) {
+        s->hugepages = TCG_HUGEPAGES_ADVISE;
+    } else if (strcmp(value, "thp") == 0) {
+        s->hugepages = TCG_HUGEPAGES_THP;
+    } else if (strcmp(value, "explicit") == 0) {
+        s->hugepages = TCG_HUGEPAGES_EXPLICIT;
+    } else {
+        error_setg(errp, "Invalid 'code-hugepages' setting %s", value);
+    }
+}
+
+static bool tcg_get_numa(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->numa;
+}
+
+static void tcg_set_numa(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+#ifndef CONFIG_NUMA
+    if (value) {
+        error_setg(errp, "NUMA support is not available in this build");
+        return;
+    }
+#endif
+    s->numa = value;
+}
+
+static bool tcg_get_profile_tb(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->profile_tb;
+}
+
+static void tcg_set_profile_tb(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->profile_tb = value;
+}
+
 static bool tcg_get_one_insn_per_tb(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -248,11 +406,42 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add(oc, "dirty-ring-size", "uint32",
+        tcg_get_dirty_ring_size, tcg_set_dirty_ring_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "dirty-ring-size",
+        "Size of the per-vCPU ring of pages dirtied for migration "
+        "(0 = walk the dirty bitmap)");
+
+    object_class_property_add(oc, "timer-slack", "uint32",
+        tcg_get_timer_slack, tcg_set_timer_slack,
+        NULL, NULL);
+    object_class_property_set_description(oc, "timer-slack",
+        "Granularity in microseconds of the main loop wakeups for timers "
+        "(0 = wake up at each deadline)");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
 
+    object_class_property_add_str(oc, "code-hugepages",
+                                  tcg_get_hugepages,
+                                  tcg_set_hugepages);
+    object_class_property_set_description(oc, "code-hugepages",
+        "Huge page backing of the jit buffer (advise, thp or explicit)");
+
+    object_class_property_add_bool(oc, "code-numa",
+        tcg_get_numa, tcg_set_numa);
+    object_class_property_set_description(oc, "code-numa",
+        "Place jit regions on the host node of the vCPU thread filling them");
+
+    object_class_property_add_bool(oc, "profile-tb",
+                                   tcg_get_profile_tb,
+                                   tcg_set_profile_tb);
+    object_class_property_set_description(oc, "profile-tb",
+        "Count executions and exits of each translation block");
+
     object_class_property_add_bool(oc, "one-insn-per-tb",
                                    tcg_get_one_insn_per_tb,
                                    tcg_set_one_insn_per_tb);
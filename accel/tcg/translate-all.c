@@ -287,6 +287,77 @@ static int setjmp_gen_code(CPUArchState *env, TranslationBlock *tb,
     return tcg_gen_code(tcg_ctx, tb, pc);
 }
 
+/*
+ * With -accel tcg,profile-tb=on, count how often each guest physical
+ * address has been translated.  This outlives the TBs themselves so
+ * that retranslations after invalidation or a flush can be reported.
+ */
+bool tb_profile_enabled;
+
+typedef struct TBProfileEntry {
+    tb_page_addr_t phys_pc; /* key; must be first */
+    vaddr pc;               /* virtual address of the first translation */
+    unsigned int translations;
+} TBProfileEntry;
+
+static QemuMutex tb_profile_lock;
+static GHashTable *tb_profile_xlat;
+
+static guint tb_profile_hash(gconstpointer key)
+{
+    const tb_page_addr_t *phys_pc = key;
+
+    return qemu_xxhash2(*phys_pc);
+}
+
+static gboolean tb_profile_equal(gconstpointer a, gconstpointer b)
+{
+    return *(const tb_page_addr_t *)a == *(const tb_page_addr_t *)b;
+}
+
+void tb_profile_init(void)
+{
+    qemu_mutex_init(&tb_profile_lock);
+    tb_profile_xlat = g_hash_table_new_full(tb_profile_hash, tb_profile_equal,
+                                            NULL, g_free);
+    tb_profile_enabled = true;
+}
+
+static void tb_profile_note_translation(tb_page_addr_t phys_pc, vaddr pc)
+{
+    TBProfileEntry *e;
+
+    qemu_mutex_lock(&tb_profile_lock);
+    e = g_hash_table_lookup(tb_profile_xlat, &phys_pc);
+    if (!e) {
+        e = g_new0(TBProfileEntry, 1);
+        e->phys_pc = phys_pc;
+        e->pc = pc;
+        g_hash_table_insert(tb_profile_xlat, &e->phys_pc, e);
+    }
+    e->translations++;
+    qemu_mutex_unlock(&tb_profile_lock);
+}
+
+/*
+ * Return the number of times @phys_pc has been translated, and store the
+ * virtual address of its first translation to @pc.
+ */
+unsigned int tb_profile_translations(tb_page_addr_t phys_pc, vaddr *pc)
+{
+    TBProfileEntry *e;
+    unsigned int ret = 0;
+
+    qemu_mutex_lock(&tb_profile_lock);
+    e = g_hash_table_lookup(tb_profile_xlat, &phys_pc);
+    if (e) {
+        *pc = e->pc;
+        ret = e->translations;
+    }
+    qemu_mutex_unlock(&tb_profile_lock);
+    return ret;
+}
+
 /* Called with mmap_lock held for user mode emulation.  */
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               vaddr pc, uint64_t cs_base,
@@ -336,6 +407,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
+    tb->exec_count = 0;
+    tb->exit_count = 0;
     tb_set_page_addr0(tb, phys_pc);
     tb_set_page_addr1(tb, -1);
     if (phys_pc != -1) {
@@ -564,6 +637,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         tcg_tb_remove(tb);
         return existing_tb;
     }
+
+    if (tb_profile_enabled) {
+        tb_profile_note_translation(phys_pc, pc);
+    }
     return tb;
 }
 
@@ -20,6 +20,7 @@
 #include "internal-target.h"
 #include "disas/disas.h"
 #include "tb-internal.h"
+#include "internal-common.h"
 
 static void set_can_do_io(DisasContextBase *db, bool val)
 {
@@ -83,6 +84,20 @@ static TCGOp *gen_tb_start(DisasContextBase *db, uint32_t cflags)
                          - offsetof(ArchCPU, env));
     }
 
+    /*
+     * Count executions of the TB once we know it will run.  The TB is
+     * addressed through its read-write mapping, as for split-wx the
+     * read-execute one cannot be written.
+     */
+    if (tb_profile_enabled) {
+        TCGv_ptr ptr = tcg_constant_ptr(&db->tb->exec_count);
+        TCGv_i64 exec_count = tcg_temp_new_i64();
+
+        tcg_gen_ld_i64(exec_count, ptr, 0);
+        tcg_gen_addi_i64(exec_count, exec_count, 1);
+        tcg_gen_st_i64(exec_count, ptr, 0);
+    }
+
     return icount_start_insn;
 }
 
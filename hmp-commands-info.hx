@@ -256,6 +256,21 @@ SRST
     Show dynamic compiler info.
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "jit-hot",
+        .args_type  = "count:i?",
+        .params     = "[count]",
+        .help       = "show the most executed translation blocks",
+    },
+#endif
+
+SRST
+  ``info jit-hot`` [*count*]
+    Show the *count* (default 16) most executed translation blocks.
+    Requires ``-accel tcg,profile-tb=on``.
+ERST
+
 #if defined(CONFIG_TCG)
     {
         .name       = "opcount",
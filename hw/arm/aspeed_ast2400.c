@@ -130,6 +130,7 @@ static const int aspeed_soc_ast2400_irqmap[] = {
     [ASPEED_DEV_XDMA]   = 6,
     [ASPEED_DEV_SDHCI]  = 26,
     [ASPEED_DEV_HACE]   = 4,
+    [ASPEED_DEV_VIDEO]  = 7,
 };
 
 #define aspeed_soc_ast2500_irqmap aspeed_soc_ast2400_irqmap
@@ -240,8 +241,10 @@ static void aspeed_ast2400_soc_init(Object *obj)
     snprintf(typename, sizeof(typename), "aspeed.hace-%s", socname);
     object_initialize_child(obj, "hace", &s->hace, typename);
 
+    snprintf(typename, sizeof(typename), "aspeed.video-%s", socname);
+    object_initialize_child(obj, "video", &s->video, typename);
+
     object_initialize_child(obj, "iomem", &s->iomem, TYPE_UNIMPLEMENTED_DEVICE);
-    object_initialize_child(obj, "video", &s->video, TYPE_UNIMPLEMENTED_DEVICE);
 }
 
 static void aspeed_ast2400_soc_realize(DeviceState *dev, Error **errp)
@@ -263,10 +266,6 @@ static void aspeed_ast2400_soc_realize(DeviceState *dev, Error **errp)
                                   sc->memmap[ASPEED_DEV_IOMEM],
                                   ASPEED_SOC_IOMEM_SIZE);
 
-    /* Video engine stub */
-    aspeed_mmio_map_unimplemented(s, SYS_BUS_DEVICE(&s->video), "aspeed.video",
-                                  sc->memmap[ASPEED_DEV_VIDEO], 0x1000);
-
     /* CPU */
     for (i = 0; i < sc->num_cpus; i++) {
         object_property_set_link(OBJECT(&a->cpu[i]), "memory",
@@ -433,6 +432,8 @@ static void aspeed_ast2400_soc_realize(DeviceState *dev, Error **errp)
     }
 
     /* XDMA */
+    object_property_set_link(OBJECT(&s->xdma), "dram", OBJECT(s->dram_mr),
+                             &error_abort);
     if (!sysbus_realize(SYS_BUS_DEVICE(&s->xdma), errp)) {
         return;
     }
@@ -490,6 +491,9 @@ static void aspeed_ast2400_soc_realize(DeviceState *dev, Error **errp)
     sysbus_connect_irq(SYS_BUS_DEVICE(&s->lpc), 1 + aspeed_lpc_kcs_4,
                        qdev_get_gpio_in(DEVICE(&s->lpc), aspeed_lpc_kcs_4));
 
+    sysbus_connect_irq(SYS_BUS_DEVICE(&s->lpc), 1 + aspeed_lpc_ibt,
+                       qdev_get_gpio_in(DEVICE(&s->lpc), aspeed_lpc_ibt));
+
     /* HACE */
     object_property_set_link(OBJECT(&s->hace), "dram", OBJECT(s->dram_mr),
                              &error_abort);
@@ -500,6 +504,17 @@ static void aspeed_ast2400_soc_realize(DeviceState *dev, Error **errp)
                     sc->memmap[ASPEED_DEV_HACE]);
     sysbus_connect_irq(SYS_BUS_DEVICE(&s->hace), 0,
                        aspeed_soc_get_irq(s, ASPEED_DEV_HACE));
+
+    /* Video engine */
+    object_property_set_link(OBJECT(&s->video), "dram", OBJECT(s->dram_mr),
+                             &error_abort);
+    if (!sysbus_realize(SYS_BUS_DEVICE(&s->video), errp)) {
+        return;
+    }
+    aspeed_mmio_map(s, SYS_BUS_DEVICE(&s->video), 0,
+                    sc->memmap[ASPEED_DEV_VIDEO]);
+    sysbus_connect_irq(SYS_BUS_DEVICE(&s->video), 0,
+                       aspeed_soc_get_irq(s, ASPEED_DEV_VIDEO));
 }
 
 static void aspeed_soc_ast2400_class_init(ObjectClass *oc, void *data)
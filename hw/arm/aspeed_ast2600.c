@@ -31,6 +31,7 @@ static const hwaddr aspeed_soc_ast2600_memmap[] = {
     [ASPEED_DEV_FMC]       = 0x1E620000,
     [ASPEED_DEV_SPI1]      = 0x1E630000,
     [ASPEED_DEV_SPI2]      = 0x1E631000,
+    [ASPEED_DEV_VHUB]      = 0x1E6A0000,
     [ASPEED_DEV_EHCI1]     = 0x1E6A1000,
     [ASPEED_DEV_EHCI2]     = 0x1E6A3000,
     [ASPEED_DEV_MII1]      = 0x1E650000,
@@ -109,6 +110,7 @@ static const int aspeed_soc_ast2600_irqmap[] = {
     [ASPEED_DEV_XDMA]      = 6,
     [ASPEED_DEV_SDHCI]     = 43,
     [ASPEED_DEV_EHCI1]     = 5,
+    [ASPEED_DEV_VHUB]      = 5,
     [ASPEED_DEV_EHCI2]     = 9,
     [ASPEED_DEV_EMMC]      = 15,
     [ASPEED_DEV_GPIO]      = 40,
@@ -131,6 +133,7 @@ static const int aspeed_soc_ast2600_irqmap[] = {
     [ASPEED_DEV_ETH1]      = 2,
     [ASPEED_DEV_ETH2]      = 3,
     [ASPEED_DEV_HACE]      = 4,
+    [ASPEED_DEV_VIDEO]     = 7,
     [ASPEED_DEV_ETH3]      = 32,
     [ASPEED_DEV_ETH4]      = 33,
     [ASPEED_DEV_KCS]       = 138,   /* 138 -> 142 */
@@ -193,6 +196,8 @@ static void aspeed_soc_ast2600_init(Object *obj)
 
     object_initialize_child(obj, "peci", &s->peci, TYPE_ASPEED_PECI);
 
+    object_initialize_child(obj, "pwm", &s->pwm_tach, TYPE_ASPEED_PWM);
+
     snprintf(typename, sizeof(typename), "aspeed.fmc-%s", socname);
     object_initialize_child(obj, "fmc", &s->fmc, typename);
 
@@ -206,6 +211,10 @@ static void aspeed_soc_ast2600_init(Object *obj)
                                 TYPE_PLATFORM_EHCI);
     }
 
+    snprintf(typename, sizeof(typename), TYPE_ASPEED_VHUB "-%s", socname);
+    object_initialize_child(obj, "vhub", &s->vhub, typename);
+    object_initialize_child(obj, "usb-a-irq", &a->usb_a_irq, TYPE_OR_IRQ);
+
     snprintf(typename, sizeof(typename), "aspeed.sdmc-%s", socname);
     object_initialize_child(obj, "sdmc", &s->sdmc, typename);
     object_property_add_alias(obj, "ram-size", OBJECT(&s->sdmc),
@@ -259,12 +268,14 @@ static void aspeed_soc_ast2600_init(Object *obj)
     snprintf(typename, sizeof(typename), "aspeed.hace-%s", socname);
     object_initialize_child(obj, "hace", &s->hace, typename);
 
+    snprintf(typename, sizeof(typename), "aspeed.video-%s", socname);
+    object_initialize_child(obj, "video", &s->video, typename);
+
     object_initialize_child(obj, "i3c", &s->i3c, TYPE_ASPEED_I3C);
 
     object_initialize_child(obj, "sbc", &s->sbc, TYPE_ASPEED_SBC);
 
     object_initialize_child(obj, "iomem", &s->iomem, TYPE_UNIMPLEMENTED_DEVICE);
-    object_initialize_child(obj, "video", &s->video, TYPE_UNIMPLEMENTED_DEVICE);
     object_initialize_child(obj, "dpmcu", &s->dpmcu, TYPE_UNIMPLEMENTED_DEVICE);
     object_initialize_child(obj, "emmc-boot-controller",
                             &s->emmc_boot_controller,
@@ -305,10 +316,6 @@ static void aspeed_soc_ast2600_realize(DeviceState *dev, Error **errp)
                                   sc->memmap[ASPEED_DEV_IOMEM],
                                   ASPEED_SOC_IOMEM_SIZE);
 
-    /* Video engine stub */
-    aspeed_mmio_map_unimplemented(s, SYS_BUS_DEVICE(&s->video), "aspeed.video",
-                                  sc->memmap[ASPEED_DEV_VIDEO], 0x1000);
-
     /* eMMC Boot Controller stub */
     aspeed_mmio_map_unimplemented(s, SYS_BUS_DEVICE(&s->emmc_boot_controller),
                                   "aspeed.emmc-boot-controller",
@@ -438,6 +445,15 @@ static void aspeed_soc_ast2600_realize(DeviceState *dev, Error **errp)
     sysbus_connect_irq(SYS_BUS_DEVICE(&s->peci), 0,
                        aspeed_soc_get_irq(s, ASPEED_DEV_PECI));
 
+    /* PWM and Fan Tach */
+    if (!sysbus_realize(SYS_BUS_DEVICE(&s->pwm_tach), errp)) {
+        return;
+    }
+    aspeed_mmio_map(s, SYS_BUS_DEVICE(&s->pwm_tach), 0,
+                    sc->memmap[ASPEED_DEV_PWM]);
+    sysbus_connect_irq(SYS_BUS_DEVICE(&s->pwm_tach), 0,
+                       aspeed_soc_get_irq(s, ASPEED_DEV_PWM));
+
     /* FMC, The number of CS is set at the board level */
     object_property_set_link(OBJECT(&s->fmc), "dram", OBJECT(s->dram_mr),
                              &error_abort);
@@ -469,6 +485,15 @@ static void aspeed_soc_ast2600_realize(DeviceState *dev, Error **errp)
                         ASPEED_SMC_GET_CLASS(&s->spi[i])->flash_window_base);
     }
 
+    /* Port A is either the first EHCI or the virtual hub, on one line */
+    object_property_set_int(OBJECT(&a->usb_a_irq), "num-lines", 2,
+                            &error_abort);
+    if (!qdev_realize(DEVICE(&a->usb_a_irq), NULL, errp)) {
+        return;
+    }
+    qdev_connect_gpio_out(DEVICE(&a->usb_a_irq), 0,
+                          aspeed_soc_get_irq(s, ASPEED_DEV_EHCI1));
+
     /* EHCI */
     for (i = 0; i < sc->ehcis_num; i++) {
         if (!sysbus_realize(SYS_BUS_DEVICE(&s->ehci[i]), errp)) {
@@ -476,10 +501,22 @@ static void aspeed_soc_ast2600_realize(DeviceState *dev, Error **errp)
         }
         aspeed_mmio_map(s, SYS_BUS_DEVICE(&s->ehci[i]), 0,
                         sc->memmap[ASPEED_DEV_EHCI1 + i]);
-        sysbus_connect_irq(SYS_BUS_DEVICE(&s->ehci[i]), 0,
-                           aspeed_soc_get_irq(s, ASPEED_DEV_EHCI1 + i));
+        sysbus_connect_irq(SYS_BUS_DEVICE(&s->ehci[i]), 0, i ?
+                           aspeed_soc_get_irq(s, ASPEED_DEV_EHCI1 + i) :
+                           qdev_get_gpio_in(DEVICE(&a->usb_a_irq), 0));
     }
 
+    /* USB Virtual Hub */
+    object_property_set_link(OBJECT(&s->vhub), "dram", OBJECT(s->dram_mr),
+                             &error_abort);
+    if (!sysbus_realize(SYS_BUS_DEVICE(&s->vhub), errp)) {
+        return;
+    }
+    aspeed_mmio_map(s, SYS_BUS_DEVICE(&s->vhub), 0,
+                    sc->memmap[ASPEED_DEV_VHUB]);
+    sysbus_connect_irq(SYS_BUS_DEVICE(&s->vhub), 0,
+                       qdev_get_gpio_in(DEVICE(&a->usb_a_irq), 1));
+
     /* SDMC - SDRAM Memory Controller */
     if (!sysbus_realize(SYS_BUS_DEVICE(&s->sdmc), errp)) {
         return;
@@ -528,6 +565,8 @@ static void aspeed_soc_ast2600_realize(DeviceState *dev, Error **errp)
     }
 
     /* XDMA */
+    object_property_set_link(OBJECT(&s->xdma), "dram", OBJECT(s->dram_mr),
+                             &error_abort);
     if (!sysbus_realize(SYS_BUS_DEVICE(&s->xdma), errp)) {
         return;
     }
@@ -605,6 +644,9 @@ static void aspeed_soc_ast2600_realize(DeviceState *dev, Error **errp)
                        qdev_get_gpio_in(DEVICE(&a->a7mpcore),
                                 sc->irqmap[ASPEED_DEV_KCS] + aspeed_lpc_kcs_4));
 
+    sysbus_connect_irq(SYS_BUS_DEVICE(&s->lpc), 1 + aspeed_lpc_ibt,
+                       aspeed_soc_get_irq(s, ASPEED_DEV_IBT));
+
     /* HACE */
     object_property_set_link(OBJECT(&s->hace), "dram", OBJECT(s->dram_mr),
                              &error_abort);
@@ -616,6 +658,17 @@ static void aspeed_soc_ast2600_realize(DeviceState *dev, Error **errp)
     sysbus_connect_irq(SYS_BUS_DEVICE(&s->hace), 0,
                        aspeed_soc_get_irq(s, ASPEED_DEV_HACE));
 
+    /* Video engine */
+    object_property_set_link(OBJECT(&s->video), "dram", OBJECT(s->dram_mr),
+                             &error_abort);
+    if (!sysbus_realize(SYS_BUS_DEVICE(&s->video), errp)) {
+        return;
+    }
+    aspeed_mmio_map(s, SYS_BUS_DEVICE(&s->video), 0,
+                    sc->memmap[ASPEED_DEV_VIDEO]);
+    sysbus_connect_irq(SYS_BUS_DEVICE(&s->video), 0,
+                       aspeed_soc_get_irq(s, ASPEED_DEV_VIDEO));
+
     /* I3C */
     if (!sysbus_realize(SYS_BUS_DEVICE(&s->i3c), errp)) {
         return;
@@ -6,11 +6,17 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
 #include "qemu/units.h"
 #include "qapi/error.h"
 #include "system/system.h"
 #include "system/block-backend.h"
+#include "system/tcg.h"
 #include "hw/boards.h"
+#include "hw/core/cpu.h"
+#include "hw/cpu/cluster.h"
 #include "hw/qdev-clock.h"
 #include "hw/arm/aspeed_soc.h"
 #include "hw/arm/boot.h"
@@ -18,6 +24,13 @@
 #define TYPE_FBY35 MACHINE_TYPE_NAME("fby35")
 OBJECT_DECLARE_SIMPLE_TYPE(Fby35State, FBY35);
 
+/* A set of host CPUs, as given by the user and parsed */
+typedef struct Fby35HostCpus {
+    char *list;
+    unsigned long *bitmap;
+    int nbits;
+} Fby35HostCpus;
+
 struct Fby35State {
     MachineState parent_obj;
 
@@ -27,12 +40,19 @@ struct Fby35State {
     MemoryRegion bic_memory;
     Clock *bic_sysclk;
 
+    /* Each SoC is its own execution domain */
+    CPUClusterState bmc_cluster;
+    CPUClusterState bic_cluster;
     Aspeed2600SoCState bmc;
     Aspeed10x0SoCState bic;
 
     bool mmio_exec;
+    Fby35HostCpus bmc_host_cpus;
+    Fby35HostCpus bic_host_cpus;
 };
 
+#define FBY35_MAX_HOST_CPUS     4096
+
 #define FBY35_BMC_RAM_SIZE (2 * GiB)
 #define FBY35_BMC_FIRMWARE_ADDR 0x0
 
@@ -68,11 +88,51 @@ static void fby35_bmc_write_boot_rom(DriveInfo *dinfo, MemoryRegion *mr,
     memcpy(memory_region_get_ram_ptr(mr) + offset, storage, rom_size);
 }
 
+static int fby35_bind_cpu(Object *obj, void *opaque)
+{
+    CPUState *cpu = (CPUState *)object_dynamic_cast(obj, TYPE_CPU);
+    Fby35HostCpus *host = opaque;
+    int ret;
+
+    if (!cpu) {
+        return 0;
+    }
+
+    ret = qemu_thread_set_affinity(cpu->thread, host->bitmap, host->nbits);
+    if (ret) {
+        error_report("fby35: setting the affinity of vCPU %d failed: %s",
+                     cpu->cpu_index, strerror(abs(ret)));
+        exit(1);
+    }
+    return 0;
+}
+
+/* Pin the vCPU threads of a domain to a set of host CPUs */
+static void fby35_bind_domain(CPUClusterState *cluster,
+                              Fby35HostCpus *host_cpus)
+{
+    if (!host_cpus->bitmap) {
+        return;
+    }
+
+    if (tcg_enabled() && !qemu_tcg_mttcg_enabled()) {
+        error_report("fby35: host CPU affinity of the SoCs needs one thread "
+                     "per vCPU, use -accel tcg,thread=multi");
+        exit(1);
+    }
+
+    object_child_foreach_recursive(OBJECT(cluster), fby35_bind_cpu, host_cpus);
+}
+
 static void fby35_bmc_init(Fby35State *s)
 {
     AspeedSoCState *soc;
 
-    object_initialize_child(OBJECT(s), "bmc", &s->bmc, "ast2600-a3");
+    object_initialize_child(OBJECT(s), "bmc-cluster", &s->bmc_cluster,
+                            TYPE_CPU_CLUSTER);
+    qdev_prop_set_uint32(DEVICE(&s->bmc_cluster), "cluster-id", 0);
+    object_initialize_child(OBJECT(&s->bmc_cluster), "bmc", &s->bmc,
+                            "ast2600-a3");
     soc = ASPEED_SOC(&s->bmc);
 
     memory_region_init(&s->bmc_memory, OBJECT(&s->bmc), "bmc-memory",
@@ -91,7 +151,14 @@ static void fby35_bmc_init(Fby35State *s)
     object_property_set_int(OBJECT(&s->bmc), "hw-strap2", 0x00000003,
                             &error_abort);
     aspeed_soc_uart_set_chr(soc, ASPEED_DEV_UART5, serial_hd(0));
+    /*
+     * The Cortex-A7s exist from the SoC instance init, so the cluster
+     * can be realized before them and their TBs are kept apart from
+     * the ones of the Cortex-M4 of the BIC.
+     */
+    qdev_realize(DEVICE(&s->bmc_cluster), NULL, &error_abort);
     qdev_realize(DEVICE(&s->bmc), NULL, &error_abort);
+    fby35_bind_domain(&s->bmc_cluster, &s->bmc_host_cpus);
 
     aspeed_board_init_flashes(&soc->fmc, "n25q00", 2, 0);
 
@@ -121,7 +188,11 @@ static void fby35_bic_init(Fby35State *s)
     s->bic_sysclk = clock_new(OBJECT(s), "SYSCLK");
     clock_set_hz(s->bic_sysclk, 200000000ULL);
 
-    object_initialize_child(OBJECT(s), "bic", &s->bic, "ast1030-a1");
+    object_initialize_child(OBJECT(s), "bic-cluster", &s->bic_cluster,
+                            TYPE_CPU_CLUSTER);
+    qdev_prop_set_uint32(DEVICE(&s->bic_cluster), "cluster-id", 1);
+    object_initialize_child(OBJECT(&s->bic_cluster), "bic", &s->bic,
+                            "ast1030-a1");
     soc = ASPEED_SOC(&s->bic);
 
     memory_region_init(&s->bic_memory, OBJECT(&s->bic), "bic-memory",
@@ -132,6 +203,9 @@ static void fby35_bic_init(Fby35State *s)
                              &error_abort);
     aspeed_soc_uart_set_chr(soc, ASPEED_DEV_UART5, serial_hd(1));
     qdev_realize(DEVICE(&s->bic), NULL, &error_abort);
+    /* The armv7m container only creates its CPU on realize */
+    qdev_realize(DEVICE(&s->bic_cluster), NULL, &error_abort);
+    fby35_bind_domain(&s->bic_cluster, &s->bic_host_cpus);
 
     aspeed_board_init_flashes(&soc->fmc, "sst25vf032b", 2, 2);
     aspeed_board_init_flashes(&soc->spi[0], "sst25vf032b", 2, 4);
@@ -157,11 +231,103 @@ static void fby35_set_mmio_exec(Object *obj, bool value, Error **errp)
     FBY35(obj)->mmio_exec = value;
 }
 
+/*
+ * Parse a list of host CPUs in the format of taskset(1), such as
+ * "0-1,4".  On the command line the commas must be doubled.
+ */
+static unsigned long *fby35_parse_host_cpus(const char *list, int *nbits,
+                                            Error **errp)
+{
+    g_auto(GStrv) ranges = g_strsplit(list, ",", -1);
+    g_autofree unsigned long *bitmap = bitmap_new(FBY35_MAX_HOST_CPUS);
+    unsigned long first, last;
+    const char *end;
+    int i;
+
+    *nbits = 0;
+    for (i = 0; ranges[i]; i++) {
+        if (qemu_strtoul(ranges[i], &end, 10, &first) < 0) {
+            goto bad;
+        }
+        last = first;
+        if (*end == '-' && qemu_strtoul(end + 1, NULL, 10, &last) < 0) {
+            goto bad;
+        } else if (*end != '-' && *end) {
+            goto bad;
+        }
+        if (first > last || last >= FBY35_MAX_HOST_CPUS) {
+            goto bad;
+        }
+        bitmap_set(bitmap, first, last - first + 1);
+        *nbits = MAX(*nbits, last + 1);
+    }
+    if (!*nbits) {
+        error_setg(errp, "CPU list is empty");
+        return NULL;
+    }
+    return g_steal_pointer(&bitmap);
+
+bad:
+    error_setg(errp, "invalid host CPU list '%s', expected for instance "
+               "'0-1,4'", list);
+    return NULL;
+}
+
+static void fby35_set_host_cpus(Fby35HostCpus *host_cpus, const char *value,
+                                Error **errp)
+{
+    unsigned long *bitmap;
+    int nbits;
+
+    bitmap = fby35_parse_host_cpus(value, &nbits, errp);
+    if (!bitmap) {
+        return;
+    }
+
+    g_free(host_cpus->list);
+    g_free(host_cpus->bitmap);
+    host_cpus->list = g_strdup(value);
+    host_cpus->bitmap = bitmap;
+    host_cpus->nbits = nbits;
+}
+
+static char *fby35_get_bmc_host_cpus(Object *obj, Error **errp)
+{
+    return g_strdup(FBY35(obj)->bmc_host_cpus.list ?: "");
+}
+
+static void fby35_set_bmc_host_cpus(Object *obj, const char *value,
+                                    Error **errp)
+{
+    fby35_set_host_cpus(&FBY35(obj)->bmc_host_cpus, value, errp);
+}
+
+static char *fby35_get_bic_host_cpus(Object *obj, Error **errp)
+{
+    return g_strdup(FBY35(obj)->bic_host_cpus.list ?: "");
+}
+
+static void fby35_set_bic_host_cpus(Object *obj, const char *value,
+                                    Error **errp)
+{
+    fby35_set_host_cpus(&FBY35(obj)->bic_host_cpus, value, errp);
+}
+
 static void fby35_instance_init(Object *obj)
 {
     FBY35(obj)->mmio_exec = false;
 }
 
+static void fby35_instance_finalize(Object *obj)
+{
+    Fby35State *s = FBY35(obj);
+
+    g_free(s->bmc_host_cpus.list);
+    g_free(s->bmc_host_cpus.bitmap);
+    g_free(s->bic_host_cpus.list);
+    g_free(s->bic_host_cpus.bitmap);
+}
+
 static void fby35_class_init(ObjectClass *oc, void *data)
 {
     MachineClass *mc = MACHINE_CLASS(oc);
@@ -177,6 +343,19 @@ static void fby35_class_init(ObjectClass *oc, void *data)
                                    fby35_set_mmio_exec);
     object_class_property_set_description(oc, "execute-in-place",
                            "boot directly from CE0 flash device");
+
+    object_class_property_add_str(oc, "bmc-host-cpus",
+                                  fby35_get_bmc_host_cpus,
+                                  fby35_set_bmc_host_cpus);
+    object_class_property_set_description(oc, "bmc-host-cpus",
+                           "host CPUs running the vCPUs of the BMC, "
+                           "as in '0-1,,4'");
+    object_class_property_add_str(oc, "bic-host-cpus",
+                                  fby35_get_bic_host_cpus,
+                                  fby35_set_bic_host_cpus);
+    object_class_property_set_description(oc, "bic-host-cpus",
+                           "host CPUs running the vCPU of the BIC, "
+                           "as in '0-1,,4'");
 }
 
 static const TypeInfo fby35_types[] = {
@@ -186,6 +365,7 @@ static const TypeInfo fby35_types[] = {
         .class_init = fby35_class_init,
         .instance_size = sizeof(Fby35State),
         .instance_init = fby35_instance_init,
+        .instance_finalize = fby35_instance_finalize,
     },
 };
 
@@ -62,6 +62,7 @@
 #include "hw/boards.h"
 #include "qemu/cutils.h"
 #include "system/runstate.h"
+#include "qemu/timer.h"
 #include "tcg/debuginfo.h"
 
 #include <zlib.h>
@@ -963,6 +964,12 @@ struct Rom {
     char *fw_dir;
     char *fw_file;
     GMappedFile *mapped_file;
+    /*
+     * File mapped by rom_add_file(), kept open to check that it still
+     * covers the mapping before the data is used
+     */
+    int file_fd;
+    bool file_mapped;
 
     bool committed;
 
@@ -979,6 +986,10 @@ static QTAILQ_HEAD(, Rom) roms = QTAILQ_HEAD_INITIALIZER(roms);
  */
 static void rom_free_data(Rom *rom)
 {
+    if (rom->file_mapped) {
+        close(rom->file_fd);
+        rom->file_mapped = false;
+    }
     if (rom->mapped_file) {
         g_mapped_file_unref(rom->mapped_file);
         rom->mapped_file = NULL;
@@ -1066,6 +1077,7 @@ ssize_t rom_add_file(const char *file, const char *fw_dir,
     gsize size;
     g_autoptr(GError) gerr = NULL;
     char devpath[100];
+    int fd;
 
     if (as && mr) {
         fprintf(stderr, "Specifying an Address Space and Memory Region is " \
@@ -1082,12 +1094,36 @@ ssize_t rom_add_file(const char *file, const char *fw_dir,
         rom->path = g_strdup(file);
     }
 
-    if (!g_file_get_contents(rom->path, (gchar **) &rom->data,
-                             &size, &gerr)) {
+    fd = open(rom->path, O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        fprintf(stderr, "rom: file %-20s: error %s\n",
+                rom->name, strerror(errno));
+        goto err;
+    }
+
+    /*
+     * Map the file privately instead of reading it into a heap copy, so
+     * that the kernel can read it ahead while the rest of the machine is
+     * being built.  Writes through rom_ptr() stay private to QEMU.  Pages
+     * are only read when the ROM is used, and the image should not be
+     * modified while QEMU runs; rom_check_file() makes sure that it was
+     * not truncated, which would fault on the pages past its new end.
+     */
+    rom->mapped_file = g_mapped_file_new_from_fd(fd, true, &gerr);
+    if (!rom->mapped_file) {
+        close(fd);
         fprintf(stderr, "rom: file %-20s: error %s\n",
                 rom->name, gerr->message);
         goto err;
     }
+    rom->file_fd = fd;
+    rom->file_mapped = true;
+    rom->data = (uint8_t *)g_mapped_file_get_contents(rom->mapped_file);
+    size = g_mapped_file_get_length(rom->mapped_file);
+    if (size) {
+        qemu_madvise(rom->data, size, QEMU_MADV_WILLNEED);
+    }
+    trace_loader_add_file(rom->name, size);
 
     if (fw_dir) {
         rom->fw_dir  = g_strdup(fw_dir);
@@ -1115,7 +1151,10 @@ ssize_t rom_add_file(const char *file, const char *fw_dir,
         if ((!has_option_rom || mc->option_rom_has_mr) && mc->rom_file_has_mr) {
             data = rom_set_mr(rom, OBJECT(fw_cfg), devpath, true);
         } else {
-            data = rom->data;
+            /* fw_cfg reads it at any time, without rom_check_file() */
+            data = g_memdup2(rom->data, rom->datasize);
+            rom_free_data(rom);
+            rom->data = data;
         }
 
         fw_cfg_add_file(fw_cfg, fw_file_name, data, rom->romsize);
@@ -1217,8 +1256,111 @@ ssize_t rom_add_option(const char *file, int32_t bootindex)
     return rom_add_file(file, "genroms", 0, bootindex, true, NULL, NULL);
 }
 
+/*
+ * Write @len bytes of @data (or zeroes if @data is NULL) at @addr, leaving
+ * alone the host pages of RAM that already hold the right contents.  Most
+ * of a kernel or firmware image is not modified by the guest between two
+ * resets, so this avoids dirtying those pages for migration and throwing
+ * away the code translated from them.  Returns the number of bytes
+ * actually written.
+ */
+static uint64_t rom_write_changed(AddressSpace *as, hwaddr addr,
+                                  const uint8_t *data, hwaddr len)
+{
+    size_t page_size = qemu_real_host_page_size();
+    uint64_t written = 0;
+    hwaddr done = 0;
+
+    RCU_READ_LOCK_GUARD();
+    while (done < len) {
+        hwaddr xlat, l = len - done;
+        MemoryRegion *mr;
+        uint8_t *host;
+        hwaddr off, run_start = 0;
+        bool in_run = false;
+
+        mr = address_space_translate(as, addr + done, &xlat, &l, true,
+                                     MEMTXATTRS_UNSPECIFIED);
+        if (!memory_region_is_ram(mr) || memory_region_is_ram_device(mr)) {
+            if (data) {
+                address_space_write_rom(as, addr + done,
+                                        MEMTXATTRS_UNSPECIFIED,
+                                        data + done, l);
+            } else {
+                address_space_set(as, addr + done, 0, l,
+                                  MEMTXATTRS_UNSPECIFIED);
+            }
+            written += l;
+            done += l;
+            continue;
+        }
+
+        host = memory_region_get_ram_ptr(mr) + xlat;
+        for (off = 0; off <= l; ) {
+            hwaddr chunk = 0;
+            bool same = true;
+
+            if (off < l) {
+                /* Chunks end on host page boundaries of the RAM block */
+                chunk = MIN(l - off,
+                            page_size - ((uintptr_t)(host + off) &
+                                         (page_size - 1)));
+                same = data ? !memcmp(host + off, data + done + off, chunk)
+                            : buffer_is_zero(host + off, chunk);
+            }
+            if (!same && !in_run) {
+                run_start = off;
+                in_run = true;
+            } else if (same && in_run) {
+                if (data) {
+                    address_space_write_rom(as, addr + done + run_start,
+                                            MEMTXATTRS_UNSPECIFIED,
+                                            data + done + run_start,
+                                            off - run_start);
+                } else {
+                    address_space_set(as, addr + done + run_start, 0,
+                                      off - run_start,
+                                      MEMTXATTRS_UNSPECIFIED);
+                }
+                written += off - run_start;
+                in_run = false;
+            }
+            if (off == l) {
+                break;
+            }
+            off += chunk;
+        }
+        done += l;
+    }
+
+    return written;
+}
+
+/*
+ * A private mapping faults on the pages beyond the end of the file if it
+ * is truncated.  Check that a ROM mapped by rom_add_file() is still
+ * covered by its file before reading pages that were never touched.
+ */
+static int rom_check_file(Rom *rom)
+{
+    struct stat st;
+
+    if (!rom->file_mapped) {
+        return 0;
+    }
+    if (fstat(rom->file_fd, &st) < 0 ||
+        (uint64_t)st.st_size < rom->datasize) {
+        error_report("rom: file %s was truncated, not loading it",
+                     rom->name);
+        return -1;
+    }
+    return 0;
+}
+
 static void rom_reset(void *unused)
 {
+    int64_t start = get_clock();
+    uint64_t total = 0, written = 0;
     Rom *rom;
 
     QTAILQ_FOREACH(rom, &roms, next) {
@@ -1241,20 +1383,21 @@ static void rom_reset(void *unused)
             continue;
         }
 
-        if (rom->data == NULL) {
+        if (rom->data == NULL || rom_check_file(rom) < 0) {
             continue;
         }
         if (rom->mr) {
             void *host = memory_region_get_ram_ptr(rom->mr);
             memcpy(host, rom->data, rom->datasize);
             memset(host + rom->datasize, 0, rom->romsize - rom->datasize);
+            written += rom->romsize;
         } else {
-            address_space_write_rom(rom->as, rom->addr, MEMTXATTRS_UNSPECIFIED,
-                                    rom->data, rom->datasize);
-            address_space_set(rom->as, rom->addr + rom->datasize, 0,
-                              rom->romsize - rom->datasize,
-                              MEMTXATTRS_UNSPECIFIED);
+            written += rom_write_changed(rom->as, rom->addr, rom->data,
+                                         rom->datasize);
+            written += rom_write_changed(rom->as, rom->addr + rom->datasize,
+                                         NULL, rom->romsize - rom->datasize);
         }
+        total += rom->romsize;
         if (rom->isrom) {
             /* rom needs to be written only once */
             rom_free_data(rom);
@@ -1269,6 +1412,8 @@ static void rom_reset(void *unused)
 
         trace_loader_write_rom(rom->name, rom->addr, rom->datasize, rom->isrom);
     }
+
+    trace_loader_reset(total, written, get_clock() - start);
 }
 
 /* Return true if two consecutive ROMs in the ROM list overlap */
@@ -1319,6 +1464,9 @@ int rom_check_and_register_reset(void)
     bool found_overlap = false;
 
     QTAILQ_FOREACH(rom, &roms, next) {
+        if (rom_check_file(rom) < 0) {
+            return -1;
+        }
         if (rom->fw_file) {
             continue;
         }
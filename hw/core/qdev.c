@@ -32,6 +32,7 @@
 #include "qapi/visitor.h"
 #include "qemu/error-report.h"
 #include "qemu/option.h"
+#include "qemu/startup-profile.h"
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
 #include "hw/boards.h"
@@ -491,7 +492,10 @@ static void device_set_realized(Object *obj, bool value, Error **errp)
         }
 
         if (dc->realize) {
+            int64_t start = startup_profile_start();
+
             dc->realize(dev, &local_err);
+            startup_profile_end("realize", object_get_typename(obj), start);
             if (local_err != NULL) {
                 goto fail;
             }
@@ -12,6 +12,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/module.h"
+#include "qemu/startup-profile.h"
 #include "hw/resettable.h"
 #include "trace.h"
 
@@ -133,7 +134,10 @@ static void resettable_phase_enter(Object *obj, void *opaque, ResetType type)
         trace_resettable_phase_enter_exec(obj, obj_typename, type,
                                           !!rc->phases.enter);
         if (rc->phases.enter) {
+            int64_t start = startup_profile_start();
+
             rc->phases.enter(obj, type);
+            startup_profile_end("reset", obj_typename, start);
         }
         s->hold_phase_pending = true;
     }
@@ -159,7 +163,10 @@ static void resettable_phase_hold(Object *obj, void *opaque, ResetType type)
         s->hold_phase_pending = false;
         trace_resettable_phase_hold_exec(obj, obj_typename, !!rc->phases.hold);
         if (rc->phases.hold) {
+            int64_t start = startup_profile_start();
+
             rc->phases.hold(obj, type);
+            startup_profile_end("reset", obj_typename, start);
         }
     }
     trace_resettable_phase_hold_end(obj, obj_typename, s->count);
@@ -182,7 +189,10 @@ static void resettable_phase_exit(Object *obj, void *opaque, ResetType type)
     if (--s->count == 0) {
         trace_resettable_phase_exit_exec(obj, obj_typename, !!rc->phases.exit);
         if (rc->phases.exit) {
+            int64_t start = startup_profile_start();
+
             rc->phases.exit(obj, type);
+            startup_profile_end("reset", obj_typename, start);
         }
     }
     s->exit_phase_in_progress = false;
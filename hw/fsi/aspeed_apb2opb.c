@@ -8,12 +8,15 @@
 
 #include "qemu/osdep.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
 #include "qom/object.h"
 #include "qapi/error.h"
 #include "trace.h"
 
 #include "hw/fsi/aspeed_apb2opb.h"
 #include "hw/qdev-core.h"
+#include "hw/qdev-properties.h"
 
 #define TO_REG(x) (x >> 2)
 
@@ -45,6 +48,9 @@
 #define APB2OPB_OPB1_ADDR                  TO_REG(0x34)
 #define APB2OPB_OPB1_WRITE_DATA                  TO_REG(0x38)
 
+#define APB2OPB_IRQ_CLEAR                  TO_REG(0x40)
+#define   APB2OPB_IRQ_CLEAR_EN             BIT(0)
+
 #define APB2OPB_IRQ_STS                    TO_REG(0x48)
 #define   APB2OPB_IRQ_STS_OPB1_TX_ACK      BIT(17)
 #define   APB2OPB_IRQ_STS_OPB0_TX_ACK      BIT(16)
@@ -59,9 +65,15 @@
 #define APB2OPB_OPB1_READ_BYTE_ENDIAN      TO_REG(0x60)
 #define   APB2OPB_OPB0_READ_WORD_ENDIAN_BE  0x00030b1b
 
+#define APB2OPB_OPB0_STATUS            TO_REG(0x80)
+#define   APB2OPB_OPB_STATUS_ERR_ACK   BIT(2)
 #define APB2OPB_OPB0_READ_DATA         TO_REG(0x84)
+#define APB2OPB_OPB1_STATUS            TO_REG(0x8c)
 #define APB2OPB_OPB1_READ_DATA         TO_REG(0x90)
 
+/* Time a posted write waits for a write to the next address */
+#define APB2OPB_POST_NS                1000
+
 /*
  * The following magic values came from AST2600 data sheet
  * The register values are defined under section "FSI controller"
@@ -91,24 +103,6 @@ static void fsi_opb_opb2fsi_address(FSIMasterState *fsi, hwaddr addr)
     memory_region_transaction_commit();
 }
 
-static uint64_t fsi_aspeed_apb2opb_read(void *opaque, hwaddr addr,
-                                        unsigned size)
-{
-    AspeedAPB2OPBState *s = ASPEED_APB2OPB(opaque);
-    unsigned int reg = TO_REG(addr);
-
-    trace_fsi_aspeed_apb2opb_read(addr, size);
-
-    if (reg >= ASPEED_APB2OPB_NR_REGS) {
-        qemu_log_mask(LOG_GUEST_ERROR,
-                      "%s: Out of bounds read: 0x%"HWADDR_PRIx" for %u\n",
-                      __func__, addr, size);
-        return 0;
-    }
-
-    return s->regs[reg];
-}
-
 static MemTxResult fsi_aspeed_apb2opb_rw(AddressSpace *as, hwaddr addr,
                                          MemTxAttrs attrs, uint32_t *data,
                                          uint32_t size, bool is_write)
@@ -147,6 +141,177 @@ static MemTxResult fsi_aspeed_apb2opb_rw(AddressSpace *as, hwaddr addr,
     return res;
 }
 
+/*
+ * Transaction level access to an OPB: @count transfers of @size bytes
+ * at consecutive addresses from @addr, in one call. The target is only
+ * looked up once for all the addresses landing in the same region,
+ * which is what CFAM engines and SCOM accesses, always made of runs of
+ * registers, spend most of their time on otherwise. @data holds one
+ * value per transfer, as the OPB read data and write data registers
+ * would.
+ */
+MemTxResult aspeed_apb2opb_transfer(AspeedAPB2OPBState *s, int opb,
+                                    uint32_t addr, uint32_t *data,
+                                    unsigned int count, unsigned int size,
+                                    bool is_write)
+{
+    AddressSpace *as = &s->opb[opb].as;
+    MemTxAttrs attrs = MEMTXATTRS_UNSPECIFIED;
+    MemOp op = size_memop(size) | MO_LE;
+    MemTxResult res = MEMTX_OK;
+
+    assert(opb < ASPEED_FSI_NUM);
+    assert(size == 1 || size == 2 || size == 4);
+
+    s->transfers++;
+
+    RCU_READ_LOCK_GUARD();
+    while (count && res == MEMTX_OK) {
+        hwaddr xlat, len = (hwaddr)count * size;
+        MemoryRegion *mr;
+        unsigned int n, i;
+
+        mr = address_space_translate(as, addr, &xlat, &len, is_write, attrs);
+        n = MAX(len / size, 1);
+        n = MIN(n, count);
+
+        if (memory_region_is_ram(mr)) {
+            /* Not a bus of registers, take the usual route */
+            for (i = 0; i < n && res == MEMTX_OK; i++) {
+                res = fsi_aspeed_apb2opb_rw(as, addr + i * size, attrs,
+                                            &data[i], size, is_write);
+            }
+        } else {
+            for (i = 0; i < n && res == MEMTX_OK; i++) {
+                uint64_t val = data[i];
+
+                if (is_write) {
+                    res = memory_region_dispatch_write(mr, xlat + i * size,
+                                                       val, op, attrs);
+                } else {
+                    res = memory_region_dispatch_read(mr, xlat + i * size,
+                                                      &val, op, attrs);
+                    data[i] = val;
+                }
+            }
+        }
+
+        s->words += i;
+        addr += n * size;
+        data += n;
+        count -= n;
+    }
+
+    return res;
+}
+
+static uint32_t fsi_aspeed_apb2opb_tx_ack(int opb)
+{
+    return opb ? APB2OPB_IRQ_STS_OPB1_TX_ACK : APB2OPB_IRQ_STS_OPB0_TX_ACK;
+}
+
+static unsigned int fsi_aspeed_apb2opb_status(int opb)
+{
+    return opb ? APB2OPB_OPB1_STATUS : APB2OPB_OPB0_STATUS;
+}
+
+/*
+ * Run the transfer latched by the last trigger, or the writes posted by
+ * the last triggers, in one OPB transfer.
+ */
+static void fsi_aspeed_apb2opb_complete(AspeedAPB2OPBState *s)
+{
+    int opb = s->pending_opb;
+    MemTxResult result;
+
+    if (opb < 0) {
+        return;
+    }
+    s->pending_opb = -1;
+    qemu_bh_cancel(s->bh);
+    timer_del(s->post_timer);
+
+    result = aspeed_apb2opb_transfer(s, opb, s->pending_addr,
+                                     s->pending_data, s->pending_count,
+                                     s->pending_size, s->pending_write);
+    trace_fsi_aspeed_apb2opb_transfer(opb, s->pending_addr,
+                                      s->pending_size, s->pending_write,
+                                      s->pending_count, s->pending_data[0]);
+    if (result != MEMTX_OK) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: OPB %s failed @%08x\n",
+                      __func__, s->pending_write ? "write" : "read",
+                      s->pending_addr);
+        /*
+         * Latched until the status is read, as a posted write failing
+         * has already been acknowledged to the firmware.
+         */
+        s->regs[fsi_aspeed_apb2opb_status(opb)] |= APB2OPB_OPB_STATUS_ERR_ACK;
+        return;
+    }
+
+    if (!s->pending_write) {
+        s->regs[opb ? APB2OPB_OPB1_READ_DATA : APB2OPB_OPB0_READ_DATA] =
+            s->pending_data[0];
+    }
+
+    /* Posted writes were acknowledged by their trigger */
+    if (!s->pending_write || !s->async) {
+        s->regs[APB2OPB_IRQ_STS] |= fsi_aspeed_apb2opb_tx_ack(opb);
+    }
+}
+
+/* Only a read has a completion the firmware can wait for */
+static void fsi_aspeed_apb2opb_complete_read(AspeedAPB2OPBState *s)
+{
+    if (s->pending_opb >= 0 && !s->pending_write) {
+        fsi_aspeed_apb2opb_complete(s);
+    }
+}
+
+static void fsi_aspeed_apb2opb_bh(void *opaque)
+{
+    fsi_aspeed_apb2opb_complete(ASPEED_APB2OPB(opaque));
+}
+
+static void fsi_aspeed_apb2opb_post_timer(void *opaque)
+{
+    fsi_aspeed_apb2opb_complete(ASPEED_APB2OPB(opaque));
+}
+
+static uint64_t fsi_aspeed_apb2opb_read(void *opaque, hwaddr addr,
+                                        unsigned size)
+{
+    AspeedAPB2OPBState *s = ASPEED_APB2OPB(opaque);
+    unsigned int reg = TO_REG(addr);
+    uint32_t val;
+
+    trace_fsi_aspeed_apb2opb_read(addr, size);
+
+    if (reg >= ASPEED_APB2OPB_NR_REGS) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Out of bounds read: 0x%"HWADDR_PRIx" for %u\n",
+                      __func__, addr, size);
+        return 0;
+    }
+
+    switch (reg) {
+    case APB2OPB_IRQ_STS:
+    case APB2OPB_OPB0_STATUS:
+    case APB2OPB_OPB0_READ_DATA:
+    case APB2OPB_OPB1_STATUS:
+    case APB2OPB_OPB1_READ_DATA:
+        /* Never let the firmware see a read half done */
+        fsi_aspeed_apb2opb_complete_read(s);
+        break;
+    }
+
+    val = s->regs[reg];
+    if (reg == APB2OPB_OPB0_STATUS || reg == APB2OPB_OPB1_STATUS) {
+        s->regs[reg] &= ~APB2OPB_OPB_STATUS_ERR_ACK;
+    }
+    return val;
+}
+
 static void fsi_aspeed_apb2opb_write(void *opaque, hwaddr addr, uint64_t data,
                                      unsigned size)
 {
@@ -192,13 +357,15 @@ static void fsi_aspeed_apb2opb_write(void *opaque, hwaddr addr, uint64_t data,
                           __func__, APB2OPB_OPB0_READ_WORD_ENDIAN_BE);
         }
         break;
+    case APB2OPB_IRQ_CLEAR:
+        if (data & APB2OPB_IRQ_CLEAR_EN) {
+            fsi_aspeed_apb2opb_complete_read(s);
+            s->regs[APB2OPB_IRQ_STS] = 0;
+        }
+        break;
     case APB2OPB_TRIGGER:
     {
         uint32_t opb, op_mode, op_size, op_addr, op_data;
-        MemTxResult result;
-        bool is_write;
-        int index;
-        AddressSpace *as;
 
         assert((s->regs[APB2OPB_OPB0_SEL] & APB2OPB_OPB_SEL_EN) ^
                (s->regs[APB2OPB_OPB1_SEL] & APB2OPB_OPB_SEL_EN));
@@ -229,25 +396,40 @@ static void fsi_aspeed_apb2opb_write(void *opaque, hwaddr addr, uint64_t data,
             return;
         }
 
-        op_size += 1;
-        is_write = !(op_mode & APB2OPB_OPB_MODE_RD);
-        index = opb ? APB2OPB_OPB1_READ_DATA : APB2OPB_OPB0_READ_DATA;
-        as = &s->opb[opb].as;
-
-        result = fsi_aspeed_apb2opb_rw(as, op_addr, MEMTXATTRS_UNSPECIFIED,
-                                       &op_data, op_size, is_write);
-        if (result != MEMTX_OK) {
-            qemu_log_mask(LOG_GUEST_ERROR, "%s: OPB %s failed @%08x\n",
-                          __func__, is_write ? "write" : "read", op_addr);
-            return;
+        /*
+         * With async, a write to the address following the writes already
+         * posted on the same OPB joins them. Anything else runs what is
+         * pending first, one transfer at a time as the engine.
+         */
+        if (s->async && !(op_mode & APB2OPB_OPB_MODE_RD) &&
+            s->pending_opb == opb && s->pending_write &&
+            s->pending_size == op_size + 1 &&
+            s->pending_count < ASPEED_APB2OPB_MAX_POSTED &&
+            op_addr == s->pending_addr + s->pending_count * s->pending_size) {
+            s->pending_data[s->pending_count++] = op_data;
+        } else {
+            fsi_aspeed_apb2opb_complete(s);
+
+            s->pending_opb = opb;
+            s->pending_addr = op_addr;
+            s->pending_data[0] = op_data;
+            s->pending_count = 1;
+            s->pending_size = op_size + 1;
+            s->pending_write = !(op_mode & APB2OPB_OPB_MODE_RD);
         }
 
-        if (!is_write) {
-            s->regs[index] = op_data;
+        if (!s->async) {
+            fsi_aspeed_apb2opb_complete(s);
+        } else if (s->pending_write) {
+            s->regs[APB2OPB_IRQ_STS] |= fsi_aspeed_apb2opb_tx_ack(opb);
+            if (!timer_pending(s->post_timer)) {
+                timer_mod(s->post_timer,
+                          qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                          APB2OPB_POST_NS);
+            }
+        } else {
+            qemu_bh_schedule(s->bh);
         }
-
-        s->regs[APB2OPB_IRQ_STS] |= opb ? APB2OPB_IRQ_STS_OPB1_TX_ACK
-            : APB2OPB_IRQ_STS_OPB0_TX_ACK;
         break;
     }
     }
@@ -274,6 +456,12 @@ static void fsi_aspeed_apb2opb_init(Object *o)
         object_initialize_child(o, "fsi-master[*]", &s->fsi[i],
                                 TYPE_FSI_MASTER);
     }
+
+    s->pending_opb = -1;
+    object_property_add_uint64_ptr(o, "transfers", &s->transfers,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(o, "words", &s->words,
+                                   OBJ_PROP_FLAG_READ);
 }
 
 static void fsi_aspeed_apb2opb_realize(DeviceState *dev, Error **errp)
@@ -296,6 +484,11 @@ static void fsi_aspeed_apb2opb_realize(DeviceState *dev, Error **errp)
 
     sysbus_init_irq(sbd, &s->irq);
 
+    s->bh = qemu_bh_new_guarded(fsi_aspeed_apb2opb_bh, s,
+                                &dev->mem_reentrancy_guard);
+    s->post_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                 fsi_aspeed_apb2opb_post_timer, s);
+
     memory_region_init_io(&s->iomem, OBJECT(s), &aspeed_apb2opb_ops, s,
                           TYPE_ASPEED_APB2OPB, 0x1000);
     sysbus_init_mmio(sbd, &s->iomem);
@@ -313,20 +506,37 @@ static void fsi_aspeed_apb2opb_realize(DeviceState *dev, Error **errp)
     }
 }
 
+static void fsi_aspeed_apb2opb_unrealize(DeviceState *dev)
+{
+    AspeedAPB2OPBState *s = ASPEED_APB2OPB(dev);
+
+    qemu_bh_delete(s->bh);
+    timer_free(s->post_timer);
+}
+
 static void fsi_aspeed_apb2opb_reset(DeviceState *dev)
 {
     AspeedAPB2OPBState *s = ASPEED_APB2OPB(dev);
 
     memcpy(s->regs, aspeed_apb2opb_reset, ASPEED_APB2OPB_NR_REGS);
+    s->pending_opb = -1;
+    qemu_bh_cancel(s->bh);
+    timer_del(s->post_timer);
 }
 
+static const Property fsi_aspeed_apb2opb_properties[] = {
+    DEFINE_PROP_BOOL("async-completion", AspeedAPB2OPBState, async, false),
+};
+
 static void fsi_aspeed_apb2opb_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
 
     dc->desc = "ASPEED APB2OPB Bridge";
     dc->realize = fsi_aspeed_apb2opb_realize;
+    dc->unrealize = fsi_aspeed_apb2opb_unrealize;
     device_class_set_legacy_reset(dc, fsi_aspeed_apb2opb_reset);
+    device_class_set_props(dc, fsi_aspeed_apb2opb_properties);
 }
 
 static const TypeInfo aspeed_apb2opb_info = {
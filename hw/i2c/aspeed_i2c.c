@@ -252,14 +252,21 @@ static int aspeed_i2c_bus_send(AspeedI2CBus *bus)
     uint32_t reg_dma_len = aspeed_i2c_bus_dma_len_offset(bus);
     int pool_tx_count = SHARED_ARRAY_FIELD_EX32(bus->regs, reg_pool_ctrl,
                                                 TX_COUNT) + 1;
+    bool resume = bus->stretched;
+
+    bus->stretched = false;
 
     if (SHARED_ARRAY_FIELD_EX32(bus->regs, reg_cmd, TX_BUFF_EN)) {
-        for (i = 0; i < pool_tx_count; i++) {
+        for (i = resume ? bus->stretch_pos : 0; i < pool_tx_count; i++) {
             uint8_t *pool_base = aic->bus_pool_base(bus);
 
             trace_aspeed_i2c_bus_send("BUF", i + 1, pool_tx_count,
                                       pool_base[i]);
             ret = i2c_send(bus->bus, pool_base[i]);
+            if (i2c_stretched(bus->bus)) {
+                bus->stretch_pos = i;
+                return 0;
+            }
             if (ret) {
                 break;
             }
@@ -267,15 +274,26 @@ static int aspeed_i2c_bus_send(AspeedI2CBus *bus)
         SHARED_ARRAY_FIELD_DP32(bus->regs, reg_cmd, TX_BUFF_EN, 0);
     } else if (SHARED_ARRAY_FIELD_EX32(bus->regs, reg_cmd, TX_DMA_EN)) {
         /* In new mode, clear how many bytes we TXed */
-        if (aspeed_i2c_is_new_mode(bus->controller)) {
+        if (aspeed_i2c_is_new_mode(bus->controller) && !resume) {
             ARRAY_FIELD_DP32(bus->regs, I2CM_DMA_LEN_STS, TX_LEN, 0);
         }
-        while (bus->regs[reg_dma_len]) {
+        while (bus->regs[reg_dma_len] || resume) {
             uint8_t data;
-            aspeed_i2c_dma_read(bus, &data);
+
+            /* The byte held by the target was already read from DRAM */
+            if (resume) {
+                data = bus->stretch_byte;
+                resume = false;
+            } else {
+                aspeed_i2c_dma_read(bus, &data);
+            }
             trace_aspeed_i2c_bus_send("DMA", bus->regs[reg_dma_len],
                                       bus->regs[reg_dma_len], data);
             ret = i2c_send(bus->bus, data);
+            if (i2c_stretched(bus->bus)) {
+                bus->stretch_byte = data;
+                return 0;
+            }
             if (ret) {
                 break;
             }
@@ -308,6 +326,9 @@ static void aspeed_i2c_bus_recv(AspeedI2CBus *bus)
     uint32_t reg_dma_len = aspeed_i2c_bus_dma_len_offset(bus);
     int pool_rx_count = SHARED_ARRAY_FIELD_EX32(bus->regs, reg_pool_ctrl,
                                                 RX_SIZE) + 1;
+    bool resume = bus->stretched;
+
+    bus->stretched = false;
 
     if (SHARED_ARRAY_FIELD_EX32(bus->regs, reg_cmd, RX_BUFF_EN)) {
         uint8_t *pool_base = aic->bus_pool_base(bus);
@@ -316,8 +337,13 @@ static void aspeed_i2c_bus_recv(AspeedI2CBus *bus)
             pool_base += 16;
         }
 
-        for (i = 0; i < pool_rx_count; i++) {
-            pool_base[i] = i2c_recv(bus->bus);
+        for (i = resume ? bus->stretch_pos : 0; i < pool_rx_count; i++) {
+            data = i2c_recv(bus->bus);
+            if (i2c_stretched(bus->bus)) {
+                bus->stretch_pos = i;
+                return;
+            }
+            pool_base[i] = data;
             trace_aspeed_i2c_bus_recv("BUF", i + 1, pool_rx_count,
                                       pool_base[i]);
         }
@@ -327,7 +353,7 @@ static void aspeed_i2c_bus_recv(AspeedI2CBus *bus)
         SHARED_ARRAY_FIELD_DP32(bus->regs, reg_cmd, RX_BUFF_EN, 0);
     } else if (SHARED_ARRAY_FIELD_EX32(bus->regs, reg_cmd, RX_DMA_EN)) {
         /* In new mode, clear how many bytes we RXed */
-        if (aspeed_i2c_is_new_mode(bus->controller)) {
+        if (aspeed_i2c_is_new_mode(bus->controller) && !resume) {
             ARRAY_FIELD_DP32(bus->regs, I2CM_DMA_LEN_STS, RX_LEN, 0);
         }
 
@@ -335,6 +361,9 @@ static void aspeed_i2c_bus_recv(AspeedI2CBus *bus)
             MemTxResult result;
 
             data = i2c_recv(bus->bus);
+            if (i2c_stretched(bus->bus)) {
+                return;
+            }
             trace_aspeed_i2c_bus_recv("DMA", bus->regs[reg_dma_len],
                                       bus->regs[reg_dma_len], data);
 
@@ -371,6 +400,10 @@ static void aspeed_i2c_handle_rx_cmd(AspeedI2CBus *bus)
 
     aspeed_i2c_set_state(bus, I2CD_MRXD);
     aspeed_i2c_bus_recv(bus);
+    if (i2c_stretched(bus->bus)) {
+        bus->stretched = true;
+        return;
+    }
     SHARED_ARRAY_FIELD_DP32(bus->regs, reg_intr_sts, RX_DONE, 1);
     if (SHARED_ARRAY_FIELD_EX32(bus->regs, reg_cmd, M_S_RX_CMD_LAST)) {
         i2c_nack(bus->bus);
@@ -460,15 +493,40 @@ static void aspeed_i2c_bus_cmd_dump(AspeedI2CBus *bus)
                              bus->regs[reg_intr_sts]);
 }
 
+/* The command is dropped, as when losing the bus to another master */
+static void aspeed_i2c_bus_arbit_loss(AspeedI2CBus *bus)
+{
+    uint32_t reg_intr_sts = aspeed_i2c_bus_intr_sts_offset(bus);
+    uint32_t reg_cmd = aspeed_i2c_bus_cmd_offset(bus);
+
+    qemu_log_mask(LOG_GUEST_ERROR, "%s: bus %d is mastered by a device\n",
+                  __func__, bus->id);
+    SHARED_ARRAY_FIELD_DP32(bus->regs, reg_intr_sts, ARBIT_LOSS, 1);
+    if (aspeed_i2c_bus_pkt_mode_en(bus)) {
+        ARRAY_FIELD_DP32(bus->regs, I2CM_INTR_STS, PKT_CMD_FAIL, 1);
+        ARRAY_FIELD_DP32(bus->regs, I2CM_INTR_STS, PKT_CMD_DONE, 1);
+    }
+    SHARED_ARRAY_FIELD_DP32(bus->regs, reg_cmd, M_START_CMD, 0);
+    SHARED_ARRAY_FIELD_DP32(bus->regs, reg_cmd, M_TX_CMD, 0);
+    SHARED_ARRAY_FIELD_DP32(bus->regs, reg_cmd, M_RX_CMD, 0);
+    SHARED_ARRAY_FIELD_DP32(bus->regs, reg_cmd, M_S_RX_CMD_LAST, 0);
+    SHARED_ARRAY_FIELD_DP32(bus->regs, reg_cmd, M_STOP_CMD, 0);
+}
+
 /*
  * The state machine needs some refinement. It is only used to track
  * invalid STOP commands for the moment.
+ *
+ * A target stretching the clock holds the command where it is, with
+ * no status raised.  It is run again from the stretch BH, which picks
+ * up the operation that was held.
  */
 static void aspeed_i2c_bus_handle_cmd(AspeedI2CBus *bus, uint64_t value)
 {
     uint32_t reg_intr_sts = aspeed_i2c_bus_intr_sts_offset(bus);
     uint32_t reg_cmd = aspeed_i2c_bus_cmd_offset(bus);
     uint32_t reg_dma_len = aspeed_i2c_bus_dma_len_offset(bus);
+    int ret;
 
     if (!aspeed_i2c_check_sram(bus)) {
         return;
@@ -479,15 +537,39 @@ static void aspeed_i2c_bus_handle_cmd(AspeedI2CBus *bus, uint64_t value)
     }
 
     if (SHARED_ARRAY_FIELD_EX32(bus->regs, reg_cmd, M_START_CMD)) {
-        uint8_t state = aspeed_i2c_get_state(bus) & I2CD_MACTIVE ?
-            I2CD_MSTARTR : I2CD_MSTART;
+        bool resume = bus->stretched;
         uint8_t addr;
 
-        aspeed_i2c_set_state(bus, state);
+        bus->stretched = false;
+        if (resume) {
+            /* The address may have been read from DRAM already */
+            addr = bus->stretch_byte;
+        } else if (bus->bus->bh) {
+            /* Another master, a bridge replaying a transfer say, has it */
+            aspeed_i2c_bus_arbit_loss(bus);
+            return;
+        } else {
+            aspeed_i2c_set_state(bus, aspeed_i2c_get_state(bus) &
+                                 I2CD_MACTIVE ? I2CD_MSTARTR : I2CD_MSTART);
+            addr = aspeed_i2c_get_addr(bus);
+            bus->stretch_repeated = i2c_bus_busy(bus->bus);
+        }
 
-        addr = aspeed_i2c_get_addr(bus);
-        if (i2c_start_transfer(bus->bus, extract32(addr, 1, 7),
-                               extract32(addr, 0, 1))) {
+        ret = i2c_start_transfer(bus->bus, extract32(addr, 1, 7),
+                                 extract32(addr, 0, 1));
+        if (i2c_stretched(bus->bus)) {
+            bus->stretch_byte = addr;
+            bus->stretched = true;
+            return;
+        }
+        if (ret) {
+            /*
+             * The core ends a transfer NACKed when it starts it, not
+             * when the START comes again after the target held it.
+             */
+            if (resume && !bus->stretch_repeated) {
+                i2c_end_transfer(bus->bus);
+            }
             SHARED_ARRAY_FIELD_DP32(bus->regs, reg_intr_sts, TX_NAK, 1);
             if (aspeed_i2c_bus_pkt_mode_en(bus)) {
                 ARRAY_FIELD_DP32(bus->regs, I2CM_INTR_STS, PKT_CMD_FAIL, 1);
@@ -522,7 +604,12 @@ static void aspeed_i2c_bus_handle_cmd(AspeedI2CBus *bus, uint64_t value)
 
     if (SHARED_ARRAY_FIELD_EX32(bus->regs, reg_cmd, M_TX_CMD)) {
         aspeed_i2c_set_state(bus, I2CD_MTXD);
-        if (aspeed_i2c_bus_send(bus)) {
+        ret = aspeed_i2c_bus_send(bus);
+        if (i2c_stretched(bus->bus)) {
+            bus->stretched = true;
+            return;
+        }
+        if (ret) {
             SHARED_ARRAY_FIELD_DP32(bus->regs, reg_intr_sts, TX_NAK, 1);
             i2c_end_transfer(bus->bus);
         } else {
@@ -536,6 +623,9 @@ static void aspeed_i2c_bus_handle_cmd(AspeedI2CBus *bus, uint64_t value)
          SHARED_ARRAY_FIELD_EX32(bus->regs, reg_cmd, M_S_RX_CMD_LAST)) &&
         !SHARED_ARRAY_FIELD_EX32(bus->regs, reg_intr_sts, RX_DONE)) {
         aspeed_i2c_handle_rx_cmd(bus);
+        if (bus->stretched) {
+            return;
+        }
     }
 
     if (SHARED_ARRAY_FIELD_EX32(bus->regs, reg_cmd, M_STOP_CMD)) {
@@ -547,7 +637,10 @@ static void aspeed_i2c_bus_handle_cmd(AspeedI2CBus *bus, uint64_t value)
             }
         } else {
             aspeed_i2c_set_state(bus, I2CD_MSTOP);
-            i2c_end_transfer(bus->bus);
+            /* After a NACK, the bus may have gone to another master */
+            if (!bus->bus->bh) {
+                i2c_end_transfer(bus->bus);
+            }
             SHARED_ARRAY_FIELD_DP32(bus->regs, reg_intr_sts, NORMAL_STOP, 1);
         }
         SHARED_ARRAY_FIELD_DP32(bus->regs, reg_cmd, M_STOP_CMD, 0);
@@ -561,6 +654,30 @@ static void aspeed_i2c_bus_handle_cmd(AspeedI2CBus *bus, uint64_t value)
     }
 }
 
+static void aspeed_i2c_bus_stretch_bh(void *opaque)
+{
+    AspeedI2CBus *bus = opaque;
+
+    /* Dropped by a reset in the meantime */
+    if (!bus->stretched) {
+        return;
+    }
+
+    aspeed_i2c_bus_handle_cmd(bus, bus->regs[aspeed_i2c_bus_cmd_offset(bus)]);
+    aspeed_i2c_bus_raise_interrupt(bus);
+}
+
+/* Nothing is taken while a command is held */
+static bool aspeed_i2c_bus_check_stretched(AspeedI2CBus *bus)
+{
+    if (bus->stretched) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bus %d is busy\n", __func__,
+                      bus->id);
+        return false;
+    }
+    return true;
+}
+
 static void aspeed_i2c_bus_new_write(AspeedI2CBus *bus, hwaddr offset,
                                      uint64_t value, unsigned size)
 {
@@ -608,8 +725,8 @@ static void aspeed_i2c_bus_new_write(AspeedI2CBus *bus, hwaddr offset,
             bus->controller->intr_status &= ~(1 << bus->id);
             qemu_irq_lower(aic->bus_get_irq(bus));
         }
-        if (handle_rx && (SHARED_ARRAY_FIELD_EX32(bus->regs, R_I2CM_CMD,
-                                                  M_RX_CMD) ||
+        if (handle_rx && !bus->stretched &&
+            (SHARED_ARRAY_FIELD_EX32(bus->regs, R_I2CM_CMD, M_RX_CMD) ||
                           SHARED_ARRAY_FIELD_EX32(bus->regs, R_I2CM_CMD,
                                                   M_S_RX_CMD_LAST))) {
             aspeed_i2c_handle_rx_cmd(bus);
@@ -640,6 +757,10 @@ static void aspeed_i2c_bus_new_write(AspeedI2CBus *bus, hwaddr offset,
             break;
         }
 
+        if (!aspeed_i2c_bus_check_stretched(bus)) {
+            break;
+        }
+
         value &= 0xff0ffbfb;
         if (ARRAY_FIELD_EX32(bus->regs, I2CM_CMD, W1_CTRL)) {
             bus->regs[R_I2CM_CMD] |= value;
@@ -830,7 +951,7 @@ static void aspeed_i2c_bus_old_write(AspeedI2CBus *bus, hwaddr offset,
             bus->controller->intr_status &= ~(1 << bus->id);
             qemu_irq_lower(aic->bus_get_irq(bus));
         }
-        if (handle_rx) {
+        if (handle_rx && !bus->stretched) {
             if (SHARED_ARRAY_FIELD_EX32(bus->regs, R_I2CD_CMD, M_RX_CMD) ||
                 SHARED_ARRAY_FIELD_EX32(bus->regs, R_I2CD_CMD,
                                         M_S_RX_CMD_LAST)) {
@@ -870,6 +991,10 @@ static void aspeed_i2c_bus_old_write(AspeedI2CBus *bus, hwaddr offset,
             break;
         }
 
+        if (!aspeed_i2c_bus_check_stretched(bus)) {
+            break;
+        }
+
         bus->regs[R_I2CD_CMD] &= ~0xFFFF;
         bus->regs[R_I2CD_CMD] |= value & 0xFFFF;
 
@@ -1064,6 +1189,7 @@ static const VMStateDescription aspeed_i2c_vmstate = {
     .name = TYPE_ASPEED_I2C,
     .version_id = 3,
     .minimum_version_id = 3,
+    .independent = true,
     .fields = (const VMStateField[]) {
         VMSTATE_UINT32(intr_status, AspeedI2CState),
         VMSTATE_STRUCT_ARRAY(busses, AspeedI2CState,
@@ -1413,6 +1539,7 @@ static void aspeed_i2c_bus_reset(DeviceState *dev)
     AspeedI2CBus *s = ASPEED_I2C_BUS(dev);
 
     memset(s->regs, 0, sizeof(s->regs));
+    s->stretched = false;
     i2c_end_transfer(s->bus);
 }
 
@@ -1435,6 +1562,8 @@ static void aspeed_i2c_bus_realize(DeviceState *dev, Error **errp)
     s->bus = i2c_init_bus(dev, name);
     s->slave = i2c_slave_create_simple(s->bus, TYPE_ASPEED_I2C_BUS_SLAVE,
                                        0xff);
+    s->stretch_bh = qemu_bh_new(aspeed_i2c_bus_stretch_bh, s);
+    i2c_bus_set_stretch_bh(s->bus, s->stretch_bh);
 
     memory_region_init_io(&s->mr, OBJECT(s), &aspeed_i2c_bus_ops,
                           s, name, aic->reg_size);
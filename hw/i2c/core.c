@@ -250,6 +250,7 @@ void i2c_end_transfer(I2CBus *bus)
         g_free(node);
     }
     bus->broadcast = false;
+    bus->stretched = false;
 }
 
 int i2c_send(I2CBus *bus, uint8_t data)
@@ -326,6 +327,39 @@ void i2c_nack(I2CBus *bus)
     }
 }
 
+void i2c_bus_set_stretch_bh(I2CBus *bus, QEMUBH *bh)
+{
+    bus->stretch_bh = bh;
+}
+
+bool i2c_stretch(I2CBus *bus)
+{
+    /* Masters driven by a BH run each operation to completion */
+    if (!bus->stretch_bh || bus->bh) {
+        return false;
+    }
+
+    trace_i2c_stretch();
+    bus->stretched = true;
+    return true;
+}
+
+void i2c_stretch_release(I2CBus *bus)
+{
+    if (!bus->stretched) {
+        return;
+    }
+
+    trace_i2c_stretch_release();
+    bus->stretched = false;
+    qemu_bh_schedule(bus->stretch_bh);
+}
+
+bool i2c_stretched(I2CBus *bus)
+{
+    return bus->stretched;
+}
+
 void i2c_ack(I2CBus *bus)
 {
     if (!bus->bh) {
@@ -0,0 +1,870 @@
+/*
+ * I2C bridge between two QEMU processes over shared memory
+ *
+ * Each side sits on a local bus at the address of a device living on
+ * the other side's bus.  Each bus operation of a local master towards
+ * it, START, byte sent or received, NACK and STOP, goes as a message
+ * through a ring in a shared host memory backend.  The other side
+ * replays it on its bus, which it masters like any other multi-master
+ * device from the first START to the STOP.
+ *
+ * STARTs and bytes are answered with what the remote device did.  Until
+ * the answer is in, the bridge stretches the clock: the local master
+ * holds the operation with the bus busy, and runs it again once the
+ * bridge releases it, getting the ACK, NACK or byte of the remote.
+ * Nothing blocks in the meantime.  A master that can not be held, or a
+ * remote that does not answer within timeout-ms, gets a NACK.  NACKs
+ * of the master and STOPs are posted.
+ *
+ * The two sides agree on the layout through a magic and a version in
+ * the header, and each one announces itself with a new epoch when it
+ * comes up.  The link is up once each side has acknowledged the epoch
+ * of the other one, which drops whatever was in flight with a previous
+ * instance of the peer.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/futex.h"
+#include "qemu/log.h"
+#include "qemu/main-loop.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "hw/i2c/i2c.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+#include "system/hostmem.h"
+#include "trace.h"
+
+#define TYPE_I2C_BRIDGE "i2c-bridge"
+OBJECT_DECLARE_SIMPLE_TYPE(I2CBridgeState, I2C_BRIDGE)
+
+#define I2C_BRIDGE_MAGIC        0x42433249      /* "I2CB" */
+#define I2C_BRIDGE_VERSION      2
+#define I2C_BRIDGE_RING_SIZE    16
+
+enum i2c_bridge_msg_type {
+    I2C_BRIDGE_MSG_START_SEND = 1,
+    I2C_BRIDGE_MSG_START_RECV,
+    I2C_BRIDGE_MSG_SEND,
+    I2C_BRIDGE_MSG_RECV,
+    I2C_BRIDGE_MSG_NACK,
+    I2C_BRIDGE_MSG_STOP,
+};
+
+/*
+ * A bus operation of a master.  All but NACK and STOP are answered
+ * through the reply mailbox of the other side with the same seq.
+ */
+typedef struct I2CBridgeMsg {
+    uint8_t type;
+    uint8_t address;
+    uint8_t data;
+    uint8_t reserved;
+    uint32_t seq;
+} I2CBridgeMsg;
+
+/*
+ * Answer to the last operation of the other side, valid once seq
+ * matches.  The other side waits for it before posting the next one.
+ */
+typedef struct I2CBridgeReply {
+    uint32_t seq QEMU_ALIGNED(64);
+    uint8_t nack;
+    uint8_t data;
+} I2CBridgeReply;
+
+/* One direction of the link, filled by one side and run by the other */
+typedef struct I2CBridgeRing {
+    uint32_t head QEMU_ALIGNED(64);
+    uint32_t tail QEMU_ALIGNED(64);
+    I2CBridgeMsg msgs[I2C_BRIDGE_RING_SIZE] QEMU_ALIGNED(64);
+} I2CBridgeRing;
+
+enum {
+    I2C_BRIDGE_PORT_DOWN,
+    I2C_BRIDGE_PORT_READY,
+};
+
+/*
+ * Handshake state of a side.  peer_epoch is the epoch of the other side
+ * this one has acknowledged.  doorbell is bumped by the other side when
+ * there is something to look at, and waited on with a futex.
+ */
+typedef struct I2CBridgePort {
+    uint32_t state QEMU_ALIGNED(64);
+    uint32_t epoch;
+    uint32_t peer_epoch;
+    uint32_t doorbell QEMU_ALIGNED(64);
+    uint32_t waiting;
+} I2CBridgePort;
+
+/* Ring and reply n are written by port n */
+typedef struct I2CBridgeShared {
+    uint32_t magic;
+    uint32_t version;
+    I2CBridgePort port[2];
+    I2CBridgeRing ring[2];
+    I2CBridgeReply reply[2];
+} I2CBridgeShared;
+
+typedef struct I2CBridgeStats {
+    uint64_t transfers;
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+    uint64_t nacks;
+    uint64_t timeouts;
+    uint64_t collisions;
+    uint64_t remote_transfers;
+    uint64_t remote_nacks;
+} I2CBridgeStats;
+
+enum i2c_bridge_op {
+    I2C_BRIDGE_OP_IDLE,
+    I2C_BRIDGE_OP_WAIT,
+    I2C_BRIDGE_OP_DONE,
+};
+
+enum i2c_bridge_replay {
+    I2C_BRIDGE_REPLAY_IDLE,
+    I2C_BRIDGE_REPLAY_WAIT_BUS,
+    I2C_BRIDGE_REPLAY_ACTIVE,
+    I2C_BRIDGE_REPLAY_WAIT_ACK,
+};
+
+typedef struct I2CBridgeState {
+    I2CSlave parent_obj;
+
+    I2CBus *bus;
+    HostMemoryBackend *memdev;
+    uint8_t port;
+    uint32_t timeout_ms;
+
+    I2CBridgeShared *shm;
+    I2CBridgePort *self;
+    I2CBridgePort *peer;
+    I2CBridgeRing *tx;
+    I2CBridgeRing *rx;
+    uint32_t peer_epoch;
+
+    /* Local master to remote device */
+    uint32_t head;
+    uint32_t seq;
+    bool session;
+    uint8_t op;
+    uint8_t op_type;
+    uint32_t op_seq;
+    int op_ret;
+    uint8_t op_data;
+    QEMUTimer *timer;
+
+    /* Remote master to local devices */
+    uint32_t tail;
+    uint8_t replay;
+    bool replay_async;
+    QEMUBH *bus_bh;
+    QEMUBH *doorbell_bh;
+    QemuThread thread;
+    bool quit;
+
+    I2CBridgeStats stats;
+} I2CBridgeState;
+
+static void i2c_bridge_kick(I2CBridgeState *s)
+{
+    I2CBridgePort *peer = s->peer;
+
+    qatomic_inc(&peer->doorbell);
+    smp_mb();
+    if (qatomic_read(&peer->waiting)) {
+        qemu_futex_wake(&peer->doorbell, 1);
+    }
+}
+
+static bool i2c_bridge_link_up(I2CBridgeState *s)
+{
+    I2CBridgePort *peer = s->peer;
+
+    return s->peer_epoch &&
+           qatomic_load_acquire(&peer->state) == I2C_BRIDGE_PORT_READY &&
+           qatomic_load_acquire(&peer->epoch) == s->peer_epoch &&
+           qatomic_load_acquire(&peer->peer_epoch) ==
+           qatomic_read(&s->self->epoch);
+}
+
+/* The held operation of the local master is over, it may run it again */
+static void i2c_bridge_complete(I2CBridgeState *s, int ret, uint8_t data)
+{
+    timer_del(s->timer);
+    s->op = I2C_BRIDGE_OP_DONE;
+    s->op_ret = ret;
+    s->op_data = data;
+    trace_i2c_bridge_complete(s->port, s->op_type, s->op_seq, ret, data);
+    i2c_stretch_release(s->bus);
+}
+
+/*
+ * Forget the transfers in flight with the peer, both ways.  A byte
+ * with an asynchronous target is waited for by the caller.
+ */
+static void i2c_bridge_drop(I2CBridgeState *s)
+{
+    s->session = false;
+    if (s->op == I2C_BRIDGE_OP_WAIT) {
+        i2c_bridge_complete(s, -1, 0xff);
+    }
+    if (s->replay == I2C_BRIDGE_REPLAY_ACTIVE) {
+        i2c_end_transfer(s->bus);
+        i2c_bus_release(s->bus);
+        s->replay = I2C_BRIDGE_REPLAY_IDLE;
+    }
+}
+
+/*
+ * Follow the handshake of the peer.  A new epoch means a new instance
+ * of the peer: what it left in our ring is dropped before its epoch is
+ * acknowledged, after which it may post again.
+ */
+static void i2c_bridge_sync(I2CBridgeState *s)
+{
+    I2CBridgePort *peer = s->peer;
+    bool ready = qatomic_load_acquire(&peer->state) == I2C_BRIDGE_PORT_READY;
+    uint32_t epoch = qatomic_read(&peer->epoch);
+
+    if (s->replay == I2C_BRIDGE_REPLAY_WAIT_ACK) {
+        return;
+    }
+
+    if (ready && epoch != s->peer_epoch) {
+        i2c_bridge_drop(s);
+        s->tail = qatomic_load_acquire(&s->rx->head);
+        qatomic_store_release(&s->rx->tail, s->tail);
+        s->peer_epoch = epoch;
+        qatomic_store_release(&s->self->peer_epoch, epoch);
+        trace_i2c_bridge_link(s->port, epoch, true);
+        i2c_bridge_kick(s);
+    } else if (!ready && s->peer_epoch) {
+        i2c_bridge_drop(s);
+        s->peer_epoch = 0;
+        trace_i2c_bridge_link(s->port, epoch, false);
+    }
+}
+
+/* The next free slot of our ring, NULL when the ring is full */
+static I2CBridgeMsg *i2c_bridge_slot(I2CBridgeState *s)
+{
+    if (s->head - qatomic_load_acquire(&s->tx->tail) >= I2C_BRIDGE_RING_SIZE) {
+        return NULL;
+    }
+    return &s->tx->msgs[s->head % I2C_BRIDGE_RING_SIZE];
+}
+
+static uint32_t i2c_bridge_post(I2CBridgeState *s, I2CBridgeMsg *m,
+                                uint8_t type, uint8_t data)
+{
+    m->type = type;
+    m->address = I2C_SLAVE(s)->address;
+    m->data = data;
+    m->seq = ++s->seq;
+
+    trace_i2c_bridge_post(s->port, type, m->address, data, m->seq);
+    qatomic_store_release(&s->tx->head, ++s->head);
+    i2c_bridge_kick(s);
+    return m->seq;
+}
+
+/* NACKs and STOPs are not answered, a full ring drops them */
+static void i2c_bridge_post_event(I2CBridgeState *s, uint8_t type)
+{
+    I2CBridgeMsg *m;
+
+    if (!s->session || !i2c_bridge_link_up(s)) {
+        return;
+    }
+    m = i2c_bridge_slot(s);
+    if (m) {
+        i2c_bridge_post(s, m, type, 0);
+    }
+}
+
+/*
+ * A START of the peer is in our ring, which it gave up on with a STOP
+ * before we got the bus for it.
+ */
+static bool i2c_bridge_withdrawn(I2CBridgeState *s)
+{
+    I2CBridgeMsg *next;
+
+    if (s->tail + 1 == qatomic_load_acquire(&s->rx->head)) {
+        return false;
+    }
+    next = &s->rx->msgs[(s->tail + 1) % I2C_BRIDGE_RING_SIZE];
+    return next->type == I2C_BRIDGE_MSG_STOP;
+}
+
+/*
+ * Our master holds our bus waiting on the peer, whose own master holds
+ * its bus waiting on us.  Port 1 backs off, as if it had lost the
+ * arbitration.
+ */
+static bool i2c_bridge_collides(I2CBridgeState *s)
+{
+    return s->port == 1 && s->replay == I2C_BRIDGE_REPLAY_WAIT_BUS &&
+           !i2c_bridge_withdrawn(s);
+}
+
+static void i2c_bridge_count(I2CBridgeState *s, uint8_t type, int ret)
+{
+    if (ret) {
+        s->stats.nacks++;
+        return;
+    }
+
+    switch (type) {
+    case I2C_BRIDGE_MSG_START_SEND:
+    case I2C_BRIDGE_MSG_START_RECV:
+        s->stats.transfers++;
+        break;
+    case I2C_BRIDGE_MSG_SEND:
+        s->stats.tx_bytes++;
+        break;
+    case I2C_BRIDGE_MSG_RECV:
+        s->stats.rx_bytes++;
+        break;
+    }
+}
+
+/*
+ * Run an operation of the local master on the remote bus.  The first
+ * call posts it and stretches the clock, the master calls again with
+ * the same operation once the answer is in.
+ */
+static int i2c_bridge_op(I2CBridgeState *s, uint8_t type, uint8_t data,
+                         uint8_t *rdata)
+{
+    I2CBridgeMsg *m;
+    int ret = -1;
+
+    if (s->op == I2C_BRIDGE_OP_DONE && s->op_type == type) {
+        s->op = I2C_BRIDGE_OP_IDLE;
+        if (rdata) {
+            *rdata = s->op_data;
+        }
+        i2c_bridge_count(s, type, s->op_ret);
+        return s->op_ret;
+    }
+    s->op = I2C_BRIDGE_OP_IDLE;
+
+    if (!i2c_bridge_link_up(s)) {
+        goto out;
+    }
+    if (i2c_bridge_collides(s)) {
+        s->stats.collisions++;
+        goto out;
+    }
+    m = i2c_bridge_slot(s);
+    if (!m) {
+        goto out;
+    }
+    if (!i2c_stretch(s->bus)) {
+        qemu_log_mask(LOG_UNIMP, "%s: the master can not be held\n",
+                      __func__);
+        goto out;
+    }
+
+    if (type == I2C_BRIDGE_MSG_START_SEND ||
+        type == I2C_BRIDGE_MSG_START_RECV) {
+        s->session = true;
+    }
+    s->op = I2C_BRIDGE_OP_WAIT;
+    s->op_type = type;
+    s->op_seq = i2c_bridge_post(s, m, type, data);
+    timer_mod(s->timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+              s->timeout_ms);
+    return 0;
+
+out:
+    i2c_bridge_count(s, type, ret);
+    return ret;
+}
+
+static int i2c_bridge_event(I2CSlave *i2c, enum i2c_event event)
+{
+    I2CBridgeState *s = I2C_BRIDGE(i2c);
+
+    switch (event) {
+    case I2C_START_SEND:
+        return i2c_bridge_op(s, I2C_BRIDGE_MSG_START_SEND, 0, NULL);
+    case I2C_START_RECV:
+        return i2c_bridge_op(s, I2C_BRIDGE_MSG_START_RECV, 0, NULL);
+    case I2C_FINISH:
+        /* An operation held at the time is abandoned */
+        timer_del(s->timer);
+        s->op = I2C_BRIDGE_OP_IDLE;
+        i2c_bridge_post_event(s, I2C_BRIDGE_MSG_STOP);
+        s->session = false;
+        /* The bus may be free for a replay now */
+        if (s->replay == I2C_BRIDGE_REPLAY_WAIT_BUS) {
+            qemu_bh_schedule(s->doorbell_bh);
+        }
+        return 0;
+    case I2C_NACK:
+        i2c_bridge_post_event(s, I2C_BRIDGE_MSG_NACK);
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static int i2c_bridge_send(I2CSlave *i2c, uint8_t data)
+{
+    I2CBridgeState *s = I2C_BRIDGE(i2c);
+
+    return i2c_bridge_op(s, I2C_BRIDGE_MSG_SEND, data, NULL);
+}
+
+static uint8_t i2c_bridge_recv(I2CSlave *i2c)
+{
+    I2CBridgeState *s = I2C_BRIDGE(i2c);
+    uint8_t data = 0xff;
+
+    if (i2c_bridge_op(s, I2C_BRIDGE_MSG_RECV, 0, &data)) {
+        return 0xff;
+    }
+    return data;
+}
+
+/* The remote does not answer, the held operation is NACKed */
+static void i2c_bridge_timeout(void *opaque)
+{
+    I2CBridgeState *s = opaque;
+
+    if (s->op == I2C_BRIDGE_OP_WAIT) {
+        s->stats.timeouts++;
+        i2c_bridge_complete(s, -1, 0xff);
+    }
+}
+
+static void i2c_bridge_check_reply(I2CBridgeState *s)
+{
+    I2CBridgeReply *reply = &s->shm->reply[!s->port];
+
+    if (s->op != I2C_BRIDGE_OP_WAIT ||
+        qatomic_load_acquire(&reply->seq) != s->op_seq) {
+        return;
+    }
+    i2c_bridge_complete(s, reply->nack ? -1 : 0, reply->data);
+}
+
+static bool i2c_bridge_target_async(I2CBridgeState *s, uint8_t address)
+{
+    I2CNodeList devs = QLIST_HEAD_INITIALIZER(devs);
+    I2CNode *node, *next;
+    bool async = false;
+
+    i2c_scan_bus(s->bus, address, false, &devs);
+    QLIST_FOREACH_SAFE(node, &devs, next, next) {
+        async = !!I2C_SLAVE_GET_CLASS(node->elt)->send_async;
+        QLIST_REMOVE(node, next);
+        g_free(node);
+    }
+    return async;
+}
+
+static void i2c_bridge_consume(I2CBridgeState *s)
+{
+    qatomic_store_release(&s->rx->tail, ++s->tail);
+}
+
+static void i2c_bridge_answer(I2CBridgeState *s, I2CBridgeMsg *m, int ret,
+                              uint8_t data)
+{
+    I2CBridgeReply *reply = &s->shm->reply[s->port];
+
+    trace_i2c_bridge_replay(s->port, m->type, m->address, m->seq, ret);
+    if (ret) {
+        s->stats.remote_nacks++;
+    }
+
+    reply->nack = !!ret;
+    reply->data = data;
+    qatomic_store_release(&reply->seq, m->seq);
+    i2c_bridge_consume(s);
+    i2c_bridge_kick(s);
+}
+
+/*
+ * Run the message at the tail of the ring on the bus, which is ours.
+ * Returns false while an asynchronous target has the byte.
+ */
+static bool i2c_bridge_replay(I2CBridgeState *s, I2CBridgeMsg *m)
+{
+    bool self = m->address == I2C_SLAVE(s)->address;
+    bool idle = QLIST_EMPTY(&s->bus->current_devs);
+    uint8_t data = 0xff;
+    int ret = -1;
+
+    switch (m->type) {
+    case I2C_BRIDGE_MSG_START_SEND:
+        s->stats.remote_transfers++;
+        s->replay_async = false;
+        /* Not towards ourselves, that would loop */
+        if (self) {
+            break;
+        }
+        if (i2c_bridge_target_async(s, m->address)) {
+            ret = i2c_start_send_async(s->bus, m->address);
+            s->replay_async = !ret;
+        } else {
+            ret = i2c_start_send(s->bus, m->address);
+        }
+        break;
+    case I2C_BRIDGE_MSG_START_RECV:
+        s->stats.remote_transfers++;
+        s->replay_async = false;
+        if (!self) {
+            ret = i2c_start_recv(s->bus, m->address);
+        }
+        break;
+    case I2C_BRIDGE_MSG_SEND:
+        if (idle) {
+            break;
+        }
+        if (!s->replay_async) {
+            ret = i2c_send(s->bus, m->data);
+            break;
+        }
+        /* Answered from bus_bh on the ack of the target */
+        if (!i2c_send_async(s->bus, m->data)) {
+            s->replay = I2C_BRIDGE_REPLAY_WAIT_ACK;
+            return false;
+        }
+        break;
+    case I2C_BRIDGE_MSG_RECV:
+        if (!idle) {
+            data = i2c_recv(s->bus);
+            ret = 0;
+        }
+        break;
+    case I2C_BRIDGE_MSG_NACK:
+        trace_i2c_bridge_replay(s->port, m->type, m->address, m->seq, 0);
+        if (!idle) {
+            i2c_nack(s->bus);
+        }
+        i2c_bridge_consume(s);
+        return true;
+    case I2C_BRIDGE_MSG_STOP:
+        trace_i2c_bridge_replay(s->port, m->type, m->address, m->seq, 0);
+        i2c_end_transfer(s->bus);
+        i2c_bus_release(s->bus);
+        s->replay = I2C_BRIDGE_REPLAY_IDLE;
+        i2c_bridge_consume(s);
+        return true;
+    }
+
+    i2c_bridge_answer(s, m, ret, data);
+    return true;
+}
+
+/* Run what the peer posted, as far as the local bus lets us */
+static void i2c_bridge_run(I2CBridgeState *s)
+{
+    while (s->peer_epoch && s->tail != qatomic_load_acquire(&s->rx->head)) {
+        I2CBridgeMsg *m = &s->rx->msgs[s->tail % I2C_BRIDGE_RING_SIZE];
+
+        if (s->replay == I2C_BRIDGE_REPLAY_ACTIVE) {
+            if (!i2c_bridge_replay(s, m)) {
+                return;
+            }
+        } else if (s->replay != I2C_BRIDGE_REPLAY_IDLE) {
+            return;
+        } else if (m->type == I2C_BRIDGE_MSG_START_SEND ||
+                   m->type == I2C_BRIDGE_MSG_START_RECV) {
+            if (i2c_bridge_withdrawn(s)) {
+                i2c_bridge_consume(s);
+                i2c_bridge_consume(s);
+                continue;
+            }
+            /* Continued from bus_bh once the bus is ours */
+            s->replay = I2C_BRIDGE_REPLAY_WAIT_BUS;
+            i2c_bus_master(s->bus, s->bus_bh);
+            i2c_schedule_pending_master(s->bus);
+            return;
+        } else {
+            /* What is left of a transfer we never got the bus for */
+            i2c_bridge_consume(s);
+        }
+    }
+}
+
+/* Runs when the local bus is granted and on acks of asynchronous targets */
+static void i2c_bridge_bus_bh(void *opaque)
+{
+    I2CBridgeState *s = opaque;
+    I2CBridgeMsg *m = &s->rx->msgs[s->tail % I2C_BRIDGE_RING_SIZE];
+
+    switch (s->replay) {
+    case I2C_BRIDGE_REPLAY_WAIT_BUS:
+        /* The peer went away or gave up in the meantime */
+        if (!s->peer_epoch ||
+            s->tail == qatomic_load_acquire(&s->rx->head) ||
+            i2c_bridge_withdrawn(s)) {
+            i2c_bus_release(s->bus);
+            s->replay = I2C_BRIDGE_REPLAY_IDLE;
+            qemu_bh_schedule(s->doorbell_bh);
+            return;
+        }
+        s->replay = I2C_BRIDGE_REPLAY_ACTIVE;
+        break;
+    case I2C_BRIDGE_REPLAY_WAIT_ACK:
+        s->replay = I2C_BRIDGE_REPLAY_ACTIVE;
+        i2c_bridge_answer(s, m, 0, 0xff);
+        /* The peer may have restarted while the target had the byte */
+        i2c_bridge_sync(s);
+        break;
+    default:
+        return;
+    }
+    i2c_bridge_run(s);
+}
+
+static void i2c_bridge_doorbell_bh(void *opaque)
+{
+    I2CBridgeState *s = opaque;
+
+    i2c_bridge_sync(s);
+    i2c_bridge_check_reply(s);
+    i2c_bridge_run(s);
+
+    if (s->replay == I2C_BRIDGE_REPLAY_WAIT_BUS) {
+        if (s->op == I2C_BRIDGE_OP_WAIT && i2c_bridge_collides(s)) {
+            s->stats.collisions++;
+            i2c_bridge_complete(s, -1, 0xff);
+        }
+        if (!s->bus->bh) {
+            i2c_schedule_pending_master(s->bus);
+        }
+    }
+}
+
+/* Turns doorbells of the peer into BHs in the main loop */
+static void *i2c_bridge_thread(void *opaque)
+{
+    I2CBridgeState *s = opaque;
+    I2CBridgePort *self = s->self;
+    uint32_t seen = qatomic_read(&self->doorbell);
+
+    while (!qatomic_read(&s->quit)) {
+        uint32_t bell = qatomic_load_acquire(&self->doorbell);
+        struct timespec ts = { .tv_nsec = 100 * SCALE_MS };
+
+        if (bell != seen) {
+            seen = bell;
+            qemu_bh_schedule(s->doorbell_bh);
+            continue;
+        }
+
+        qatomic_set(&self->waiting, 1);
+        smp_mb();
+        if (qatomic_read(&self->doorbell) == bell && !qatomic_read(&s->quit)) {
+            qemu_futex(&self->doorbell, FUTEX_WAIT, bell, &ts, NULL, 0);
+        }
+        qatomic_set(&self->waiting, 0);
+    }
+
+    return NULL;
+}
+
+/* The first side to come writes the header, both check it */
+static bool i2c_bridge_check_header(I2CBridgeShared *shm, Error **errp)
+{
+    uint32_t version;
+
+    if (!qatomic_read(&shm->magic)) {
+        qatomic_set(&shm->version, I2C_BRIDGE_VERSION);
+        smp_wmb();
+        qatomic_cmpxchg(&shm->magic, 0, I2C_BRIDGE_MAGIC);
+    }
+
+    if (qatomic_load_acquire(&shm->magic) != I2C_BRIDGE_MAGIC) {
+        error_setg(errp, "memdev does not hold an I2C bridge");
+        return false;
+    }
+    version = qatomic_read(&shm->version);
+    if (version != I2C_BRIDGE_VERSION) {
+        error_setg(errp, "I2C bridge version %u in memdev, %u expected",
+                   version, I2C_BRIDGE_VERSION);
+        return false;
+    }
+    return true;
+}
+
+static void i2c_bridge_realize(DeviceState *dev, Error **errp)
+{
+    I2CBridgeState *s = I2C_BRIDGE(dev);
+    I2CBridgeShared *shm;
+    MemoryRegion *mr;
+    uint32_t epoch;
+
+    if (!s->memdev) {
+        error_setg(errp, "'memdev' property is not set");
+        return;
+    }
+    if (host_memory_backend_is_mapped(s->memdev)) {
+        error_setg(errp, "can't use already busy memdev: %s",
+                   object_get_canonical_path_component(OBJECT(s->memdev)));
+        return;
+    }
+    if (!s->memdev->share) {
+        error_setg(errp, "memdev %s must be shared (share=on)",
+                   object_get_canonical_path_component(OBJECT(s->memdev)));
+        return;
+    }
+    mr = host_memory_backend_get_memory(s->memdev);
+    if (memory_region_size(mr) < sizeof(I2CBridgeShared)) {
+        error_setg(errp, "memdev is too small, at least %zu bytes needed",
+                   sizeof(I2CBridgeShared));
+        return;
+    }
+    if (s->port > 1) {
+        error_setg(errp, "'port' must be 0 or 1");
+        return;
+    }
+    if (!s->timeout_ms) {
+        error_setg(errp, "'timeout-ms' must not be 0");
+        return;
+    }
+
+    shm = memory_region_get_ram_ptr(mr);
+    if (!i2c_bridge_check_header(shm, errp)) {
+        return;
+    }
+
+    host_memory_backend_set_mapped(s->memdev, true);
+    s->shm = shm;
+    s->self = &shm->port[s->port];
+    s->peer = &shm->port[!s->port];
+    s->tx = &shm->ring[s->port];
+    s->rx = &shm->ring[!s->port];
+    s->head = qatomic_read(&s->tx->head);
+
+    /* Whatever the peer acknowledged was for a previous instance */
+    qatomic_set(&s->self->state, I2C_BRIDGE_PORT_DOWN);
+    qatomic_set(&s->self->peer_epoch, 0);
+    do {
+        epoch = qatomic_inc_fetch(&s->self->epoch);
+    } while (!epoch);
+    s->seq = epoch << 16;
+
+    s->bus = I2C_BUS(qdev_get_parent_bus(dev));
+    s->bus_bh = qemu_bh_new(i2c_bridge_bus_bh, s);
+    s->doorbell_bh = qemu_bh_new(i2c_bridge_doorbell_bh, s);
+    s->timer = timer_new_ms(QEMU_CLOCK_REALTIME, i2c_bridge_timeout, s);
+
+    qemu_thread_create(&s->thread, "i2c-bridge", i2c_bridge_thread, s,
+                       QEMU_THREAD_JOINABLE);
+
+    qatomic_store_release(&s->self->state, I2C_BRIDGE_PORT_READY);
+    i2c_bridge_kick(s);
+
+    /* The peer may be up already */
+    qemu_bh_schedule(s->doorbell_bh);
+}
+
+static void i2c_bridge_unrealize(DeviceState *dev)
+{
+    I2CBridgeState *s = I2C_BRIDGE(dev);
+
+    qatomic_store_release(&s->self->state, I2C_BRIDGE_PORT_DOWN);
+    i2c_bridge_kick(s);
+
+    qatomic_set(&s->quit, true);
+    qemu_futex_wake(&s->self->doorbell, INT_MAX);
+    qemu_thread_join(&s->thread);
+
+    timer_free(s->timer);
+    qemu_bh_delete(s->doorbell_bh);
+    qemu_bh_delete(s->bus_bh);
+    host_memory_backend_set_mapped(s->memdev, false);
+}
+
+static bool i2c_bridge_get_connected(Object *obj, Error **errp)
+{
+    I2CBridgeState *s = I2C_BRIDGE(obj);
+
+    return s->shm && i2c_bridge_link_up(s);
+}
+
+static void i2c_bridge_init(Object *obj)
+{
+    I2CBridgeState *s = I2C_BRIDGE(obj);
+
+    object_property_add_bool(obj, "connected", i2c_bridge_get_connected,
+                             NULL);
+    object_property_add_uint64_ptr(obj, "transfers", &s->stats.transfers,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "tx-bytes", &s->stats.tx_bytes,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "rx-bytes", &s->stats.rx_bytes,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "nacks", &s->stats.nacks,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "timeouts", &s->stats.timeouts,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "collisions", &s->stats.collisions,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "remote-transfers",
+                                   &s->stats.remote_transfers,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "remote-nacks",
+                                   &s->stats.remote_nacks,
+                                   OBJ_PROP_FLAG_READ);
+}
+
+/* The remote side can not be brought along */
+static const VMStateDescription vmstate_i2c_bridge = {
+    .name = TYPE_I2C_BRIDGE,
+    .unmigratable = 1,
+};
+
+static const Property i2c_bridge_properties[] = {
+    DEFINE_PROP_LINK("memdev", I2CBridgeState, memdev, TYPE_MEMORY_BACKEND,
+                     HostMemoryBackend *),
+    DEFINE_PROP_UINT8("port", I2CBridgeState, port, 0),
+    DEFINE_PROP_UINT32("timeout-ms", I2CBridgeState, timeout_ms, 1000),
+};
+
+static void i2c_bridge_class_init(ObjectClass *oc, void *data)
+{
+    I2CSlaveClass *sc = I2C_SLAVE_CLASS(oc);
+    DeviceClass *dc = DEVICE_CLASS(oc);
+
+    dc->realize = i2c_bridge_realize;
+    dc->unrealize = i2c_bridge_unrealize;
+    dc->vmsd = &vmstate_i2c_bridge;
+    dc->desc = "I2C bridge to another process";
+    device_class_set_props(dc, i2c_bridge_properties);
+    set_bit(DEVICE_CATEGORY_MISC, dc->categories);
+
+    sc->event = i2c_bridge_event;
+    sc->recv = i2c_bridge_recv;
+    sc->send = i2c_bridge_send;
+}
+
+static const TypeInfo i2c_bridge_info = {
+    .name = TYPE_I2C_BRIDGE,
+    .parent = TYPE_I2C_SLAVE,
+    .instance_size = sizeof(I2CBridgeState),
+    .instance_init = i2c_bridge_init,
+    .class_init = i2c_bridge_class_init,
+};
+
+static void i2c_bridge_register_types(void)
+{
+    type_register_static(&i2c_bridge_info);
+}
+
+type_init(i2c_bridge_register_types);
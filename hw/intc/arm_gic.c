@@ -82,6 +82,12 @@ static inline bool gic_cpu_ns_access(GICState *s, int cpu, MemTxAttrs attrs)
     return !gic_is_vcpu(cpu) && s->security_extn && !attrs.secure;
 }
 
+/*
+ * Only the interrupts of irq_maybe_pending are visited, so the search is
+ * linear in the number of interrupts which may be pending rather than in
+ * num_irq. It is not O(1): a storm with many interrupts pending at once
+ * still visits each of them on every update.
+ */
 static inline void gic_get_best_irq(GICState *s, int cpu,
                                     int *best_irq, int *best_prio, int *group)
 {
@@ -91,7 +97,14 @@ static inline void gic_get_best_irq(GICState *s, int cpu,
     *best_irq = 1023;
     *best_prio = 0x100;
 
-    for (irq = 0; irq < s->num_irq; irq++) {
+    for (irq = find_first_bit(s->irq_maybe_pending, s->num_irq);
+         irq < s->num_irq;
+         irq = find_next_bit(s->irq_maybe_pending, s->num_irq, irq + 1)) {
+        if (!s->irq_state[irq].pending && !s->irq_state[irq].level) {
+            /* Not pending on any CPU any more; drop it from the set. */
+            clear_bit(irq, s->irq_maybe_pending);
+            continue;
+        }
         if (GIC_DIST_TEST_ENABLED(irq, cm) && gic_test_pending(s, irq, cm) &&
             (!GIC_DIST_TEST_ACTIVE(irq, cm)) &&
             (irq < GIC_INTERNAL || GIC_DIST_TARGET(irq) & cm)) {
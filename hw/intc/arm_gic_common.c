@@ -45,6 +45,8 @@ static int gic_post_load(void *opaque, int version_id)
     GICState *s = (GICState *)opaque;
     ARMGICCommonClass *c = ARM_GIC_COMMON_GET_CLASS(s);
 
+    bitmap_fill(s->irq_maybe_pending, GIC_MAXIRQ);
+
     if (c->post_load) {
         c->post_load(s);
     }
@@ -283,6 +285,7 @@ static void arm_gic_common_reset_hold(Object *obj, ResetType type)
     }
 
     memset(s->irq_state, 0, GIC_MAXIRQ * sizeof(gic_irq_state));
+    bitmap_zero(s->irq_maybe_pending, GIC_MAXIRQ);
     arm_gic_common_reset_irq_state(s, 0, resetprio);
 
     if (s->virt_extn) {
@@ -80,6 +80,60 @@ static void signal_sysresetreq(NVICState *s)
     }
 }
 
+/* Update the irq_* bitmaps after a change to the pending, enabled or
+ * active state of vectors[irq]. Internal exceptions are not tracked
+ * (they are always scanned) so this is a no-op for them.
+ */
+static void nvic_track_irq(NVICState *s, int irq)
+{
+    VecInfo *vec = &s->vectors[irq];
+
+    if (irq < NVIC_FIRST_IRQ) {
+        return;
+    }
+
+    if (vec->pending) {
+        set_bit(irq, s->irq_pending);
+    } else {
+        clear_bit(irq, s->irq_pending);
+    }
+    if (vec->active) {
+        set_bit(irq, s->irq_active);
+    } else {
+        clear_bit(irq, s->irq_active);
+    }
+    if (vec->active || (vec->pending && vec->enabled)) {
+        set_bit(irq, s->irq_live);
+    } else {
+        clear_bit(irq, s->irq_live);
+    }
+}
+
+/* Rebuild the irq_* bitmaps from scratch, eg after reset or migration */
+static void nvic_track_all_irqs(NVICState *s)
+{
+    int irq;
+
+    bitmap_zero(s->irq_pending, NVIC_MAX_VECTORS);
+    bitmap_zero(s->irq_active, NVIC_MAX_VECTORS);
+    bitmap_zero(s->irq_live, NVIC_MAX_VECTORS);
+    for (irq = NVIC_FIRST_IRQ; irq < s->num_irq; irq++) {
+        nvic_track_irq(s, irq);
+    }
+}
+
+/* Return the next exception number after @exc which might affect
+ * vectpending or exception_prio: every internal exception, then only
+ * the live external interrupts. Returns num_irq if there are no more.
+ */
+static inline int nvic_next_live(NVICState *s, int exc)
+{
+    if (exc + 1 < NVIC_FIRST_IRQ) {
+        return exc + 1;
+    }
+    return find_next_bit(s->irq_live, s->num_irq, exc + 1);
+}
+
 static int nvic_pending_prio(NVICState *s)
 {
     /* return the group priority of the current pending interrupt,
@@ -107,18 +161,20 @@ static bool nvic_rettobase(NVICState *s)
     int irq, nhand = 0;
     bool check_sec = arm_feature(&s->cpu->env, ARM_FEATURE_M_SECURITY);
 
-    for (irq = ARMV7M_EXCP_RESET; irq < s->num_irq; irq++) {
+    for (irq = ARMV7M_EXCP_RESET; irq < NVIC_FIRST_IRQ; irq++) {
         if (s->vectors[irq].active ||
-            (check_sec && irq < NVIC_INTERNAL_VECTORS &&
-             s->sec_vectors[irq].active)) {
+            (check_sec && s->sec_vectors[irq].active)) {
             nhand++;
-            if (nhand == 2) {
-                return 0;
-            }
         }
     }
 
-    return 1;
+    irq = find_first_bit(s->irq_active, s->num_irq);
+    while (irq < s->num_irq && nhand < 2) {
+        nhand++;
+        irq = find_next_bit(s->irq_active, s->num_irq, irq + 1);
+    }
+
+    return nhand < 2;
 }
 
 /* Return the value of the ISCR ISRPENDING bit:
@@ -138,12 +194,8 @@ static bool nvic_isrpending(NVICState *s)
         return true;
     }
 
-    for (irq = NVIC_FIRST_IRQ; irq < s->num_irq; irq++) {
-        if (s->vectors[irq].pending) {
-            return true;
-        }
-    }
-    return false;
+    irq = find_next_bit(s->irq_pending, s->num_irq, NVIC_FIRST_IRQ);
+    return irq < s->num_irq;
 }
 
 static bool exc_is_banked(int exc)
@@ -242,7 +294,7 @@ static void nvic_recompute_state_secure(NVICState *s)
      * Annoyingly, now we have two prigroup values (for S and NS)
      * we can't do the loop comparison on raw priority values.
      */
-    for (i = 1; i < s->num_irq; i++) {
+    for (i = 1; i < s->num_irq; i = nvic_next_live(s, i)) {
         for (bank = M_REG_S; bank >= M_REG_NS; bank--) {
             VecInfo *vec;
             int prio, subprio;
@@ -306,7 +358,7 @@ static void nvic_recompute_state(NVICState *s)
         return;
     }
 
-    for (i = 1; i < s->num_irq; i++) {
+    for (i = 1; i < s->num_irq; i = nvic_next_live(s, i)) {
         VecInfo *vec = &s->vectors[i];
 
         if (vec->enabled && vec->pending && vec->prio < pend_prio) {
@@ -517,6 +569,7 @@ static void armv7m_nvic_clear_pending(NVICState *s, int irq, bool secure)
     trace_nvic_clear_pending(irq, secure, vec->enabled, vec->prio);
     if (vec->pending) {
         vec->pending = 0;
+        nvic_track_irq(s, irq);
         nvic_irq_update(s);
     }
 }
@@ -657,6 +710,7 @@ static void do_armv7m_nvic_set_pending(void *opaque, int irq, bool secure,
 
     if (!vec->pending) {
         vec->pending = 1;
+        nvic_track_irq(s, irq);
         nvic_irq_update(s);
     }
 }
@@ -754,6 +808,7 @@ void armv7m_nvic_set_pending_lazyfp(NVICState *s, int irq, bool secure)
     }
     if (!vec->pending) {
         vec->pending = 1;
+        nvic_track_irq(s, irq);
         /*
          * We do not call nvic_irq_update(), because we know our caller
          * is going to handle causing us to take the exception by
@@ -791,6 +846,7 @@ void armv7m_nvic_acknowledge_irq(NVICState *s)
 
     vec->active = 1;
     vec->pending = 0;
+    nvic_track_irq(s, pending);
 
     write_v7m_exception(env, s->vectpending);
 
@@ -900,6 +956,7 @@ int armv7m_nvic_complete_irq(NVICState *s, int irq, bool secure)
         assert(irq >= NVIC_FIRST_IRQ);
         vec->pending = 1;
     }
+    nvic_track_irq(s, irq);
 
     nvic_irq_update(s);
 
@@ -2364,6 +2421,7 @@ static MemTxResult nvic_sysreg_write(void *opaque, hwaddr addr,
             if (value & (1 << i) &&
                 (attrs.secure || s->itns[startvec + i])) {
                 s->vectors[startvec + i].enabled = setval;
+                nvic_track_irq(s, startvec + i);
             }
         }
         nvic_irq_update(s);
@@ -2389,6 +2447,7 @@ static MemTxResult nvic_sysreg_write(void *opaque, hwaddr addr,
                 !(setval == 0 && s->vectors[startvec + i].level &&
                   !s->vectors[startvec + i].active)) {
                 s->vectors[startvec + i].pending = setval;
+                nvic_track_irq(s, startvec + i);
             }
         }
         nvic_irq_update(s);
@@ -2489,6 +2548,7 @@ static int nvic_post_load(void *opaque, int version_id)
         }
     }
 
+    nvic_track_all_irqs(s);
     nvic_recompute_state(s);
 
     return 0;
@@ -2586,6 +2646,7 @@ static void armv7m_nvic_reset(DeviceState *dev)
 
     memset(s->vectors, 0, sizeof(s->vectors));
     memset(s->sec_vectors, 0, sizeof(s->sec_vectors));
+    nvic_track_all_irqs(s);
     s->prigroup[M_REG_NS] = 0;
     s->prigroup[M_REG_S] = 0;
 
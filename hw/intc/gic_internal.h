@@ -29,7 +29,8 @@
 #define GIC_DIST_SET_ENABLED(irq, cm) (s->irq_state[irq].enabled |= (cm))
 #define GIC_DIST_CLEAR_ENABLED(irq, cm) (s->irq_state[irq].enabled &= ~(cm))
 #define GIC_DIST_TEST_ENABLED(irq, cm) ((s->irq_state[irq].enabled & (cm)) != 0)
-#define GIC_DIST_SET_PENDING(irq, cm) (s->irq_state[irq].pending |= (cm))
+#define GIC_DIST_SET_PENDING(irq, cm) \
+    (set_bit((irq), s->irq_maybe_pending), s->irq_state[irq].pending |= (cm))
 #define GIC_DIST_CLEAR_PENDING(irq, cm) (s->irq_state[irq].pending &= ~(cm))
 #define GIC_DIST_SET_ACTIVE(irq, cm) (s->irq_state[irq].active |= (cm))
 #define GIC_DIST_CLEAR_ACTIVE(irq, cm) (s->irq_state[irq].active &= ~(cm))
@@ -37,7 +38,8 @@
 #define GIC_DIST_SET_MODEL(irq) (s->irq_state[irq].model = true)
 #define GIC_DIST_CLEAR_MODEL(irq) (s->irq_state[irq].model = false)
 #define GIC_DIST_TEST_MODEL(irq) (s->irq_state[irq].model)
-#define GIC_DIST_SET_LEVEL(irq, cm) (s->irq_state[irq].level |= (cm))
+#define GIC_DIST_SET_LEVEL(irq, cm) \
+    (set_bit((irq), s->irq_maybe_pending), s->irq_state[irq].level |= (cm))
 #define GIC_DIST_CLEAR_LEVEL(irq, cm) (s->irq_state[irq].level &= ~(cm))
 #define GIC_DIST_TEST_LEVEL(irq, cm) ((s->irq_state[irq].level & (cm)) != 0)
 #define GIC_DIST_SET_EDGE_TRIGGER(irq) (s->irq_state[irq].edge_trigger = true)
@@ -10,12 +10,18 @@
 #include "qemu/osdep.h"
 #include "qemu/log.h"
 #include "qemu/error-report.h"
+#include "qemu/host-utils.h"
+#include "qemu/timer.h"
 #include "hw/misc/aspeed_lpc.h"
+#include "hw/ipmi/ipmi_extern.h"
 #include "qapi/error.h"
 #include "qapi/visitor.h"
+#include "qapi/qapi-builtin-visit.h"
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
 #include "migration/vmstate.h"
+#include "trace.h"
 
 #define TO_REG(offset) ((offset) >> 2)
 
@@ -40,7 +46,13 @@
 #define STR1                 TO_REG(0x3C)
 #define   STR_OBF            BIT(0)
 #define   STR_IBF            BIT(1)
+#define   STR_SMS_ATN        BIT(2)
 #define   STR_CMD_DATA       BIT(3)
+#define   STR_STATE_MASK     (0x3 << 6)
+#define   STR_STATE_IDLE     (0x0 << 6)
+#define   STR_STATE_READ     (0x1 << 6)
+#define   STR_STATE_WRITE    (0x2 << 6)
+#define   STR_STATE_ERROR    (0x3 << 6)
 #define STR2                 TO_REG(0x40)
 #define STR3                 TO_REG(0x44)
 #define HICR5                TO_REG(0x80)
@@ -53,6 +65,34 @@
 #define IDR4                 TO_REG(0x114)
 #define ODR4                 TO_REG(0x118)
 #define STR4                 TO_REG(0x11C)
+#define BTCR0                TO_REG(0x140)
+#define   BTCR0_ENABLE_IBT   BIT(0)
+#define BTCR1                TO_REG(0x144)
+#define   BTCR1_IRQ_HBUSY    BIT(6)
+#define   BTCR1_IRQ_H2B      BIT(0)
+#define BTCR2                TO_REG(0x148)
+#define   BTCR2_IRQ_HBUSY    BIT(6)
+#define   BTCR2_IRQ_H2B      BIT(0)
+#define BTCR3                TO_REG(0x14C)
+#define BTCSR                TO_REG(0x150)
+#define   BTCSR_B_BUSY       BIT(7)
+#define   BTCSR_H_BUSY       BIT(6)
+#define   BTCSR_OEM0         BIT(5)
+#define   BTCSR_SMS_ATN      BIT(4)
+#define   BTCSR_B2H_ATN      BIT(3)
+#define   BTCSR_H2B_ATN      BIT(2)
+#define   BTCSR_CLR_RD_PTR   BIT(1)
+#define   BTCSR_CLR_WR_PTR   BIT(0)
+#define BTDR                 TO_REG(0x154)
+#define BTIMSR               TO_REG(0x158)
+
+/* KCS control codes, written by the host to the command register */
+#define KCS_CMD_WRITE_START  0x61
+#define KCS_CMD_WRITE_END    0x62
+#define KCS_CMD_READ_BYTE    0x68
+
+/* Same as the ipmi-bmc-extern response timeout */
+#define ASPEED_IPMI_HOST_TIMEOUT_NS (4 * NANOSECONDS_PER_SECOND)
 
 enum aspeed_kcs_channel_id {
     kcs_channel_1 = 0,
@@ -61,6 +101,20 @@ enum aspeed_kcs_channel_id {
     kcs_channel_4,
 };
 
+enum aspeed_kcs_host_phase {
+    KCS_HOST_IDLE = 0,
+    KCS_HOST_WRITE,
+    KCS_HOST_WRITE_END,
+    KCS_HOST_READ,
+};
+
+static const char *const aspeed_kcs_host_names[] = {
+    [kcs_channel_1] = "kcs1",
+    [kcs_channel_2] = "kcs2",
+    [kcs_channel_3] = "kcs3",
+    [kcs_channel_4] = "kcs4",
+};
+
 static const enum aspeed_lpc_subdevice aspeed_kcs_subdevice_map[] = {
     [kcs_channel_1] = aspeed_lpc_kcs_1,
     [kcs_channel_2] = aspeed_lpc_kcs_2,
@@ -261,6 +315,18 @@ aspeed_kcs_channel_ibf_irq_enabled(AspeedLPCState *s,
     }
 }
 
+static void aspeed_kcs_set_ibf(AspeedLPCState *s,
+                               const struct aspeed_kcs_channel *channel)
+{
+    s->regs[channel->str] |= STR_IBF;
+    if (aspeed_kcs_channel_ibf_irq_enabled(s, channel)) {
+        enum aspeed_lpc_subdevice subdev;
+
+        subdev = aspeed_kcs_subdevice_map[channel->id];
+        qemu_irq_raise(s->subdevice_irqs[subdev]);
+    }
+}
+
 static void aspeed_kcs_set_register_property(Object *obj,
                                              Visitor *v,
                                              const char *name,
@@ -285,13 +351,7 @@ static void aspeed_kcs_set_register_property(Object *obj,
     }
 
     if (!strncmp("idr", name, 3)) {
-        s->regs[data->chan->str] |= STR_IBF;
-        if (aspeed_kcs_channel_ibf_irq_enabled(s, data->chan)) {
-            enum aspeed_lpc_subdevice subdev;
-
-            subdev = aspeed_kcs_subdevice_map[data->chan->id];
-            qemu_irq_raise(s->subdevice_irqs[subdev]);
-        }
+        aspeed_kcs_set_ibf(s, data->chan);
     }
 }
 
@@ -308,6 +368,585 @@ static void aspeed_lpc_set_irq(void *opaque, int irq, int level)
     qemu_set_irq(s->irq, !!s->subdevice_irqs_pending);
 }
 
+static void aspeed_bt_update_irq(AspeedLPCState *s)
+{
+    bool level = (s->regs[BTCR0] & BTCR0_ENABLE_IBT) &&
+                 (s->regs[BTCR1] & s->regs[BTCR2] &
+                  (BTCR2_IRQ_H2B | BTCR2_IRQ_HBUSY));
+
+    qemu_set_irq(s->subdevice_irqs[aspeed_lpc_ibt], level);
+}
+
+/*
+ * BMC side of the BT control register. H2B_ATN is cleared, B2H_ATN,
+ * SMS_ATN and OEM0 are set and B_BUSY is toggled by writing a 1.
+ */
+static uint32_t aspeed_bt_ctrl_write(AspeedLPCState *s, uint32_t val)
+{
+    uint32_t ctrl = s->regs[BTCSR];
+
+    if (val & BTCSR_CLR_WR_PTR) {
+        s->bt_b2h_wr = 0;
+    }
+    if (val & BTCSR_CLR_RD_PTR) {
+        s->bt_h2b_rd = 0;
+    }
+    if (val & BTCSR_H2B_ATN) {
+        ctrl &= ~BTCSR_H2B_ATN;
+    }
+    if (val & BTCSR_B_BUSY) {
+        ctrl ^= BTCSR_B_BUSY;
+    }
+    ctrl |= val & (BTCSR_B2H_ATN | BTCSR_SMS_ATN | BTCSR_OEM0);
+
+    return ctrl;
+}
+
+static void aspeed_ipmi_host_send(AspeedIPMIHost *h, const uint8_t *buf,
+                                  uint32_t len, uint8_t end)
+{
+    uint8_t out[2 * (MAX_IPMI_MSG_SIZE + 2) + 1];
+    uint32_t i, n = 0;
+
+    for (i = 0; i < len; i++) {
+        switch (buf[i]) {
+        case VM_MSG_CHAR:
+        case VM_CMD_CHAR:
+        case VM_ESCAPE_CHAR:
+            out[n++] = VM_ESCAPE_CHAR;
+            out[n++] = buf[i] | 0x10;
+            break;
+        default:
+            out[n++] = buf[i];
+            break;
+        }
+    }
+    out[n++] = end;
+
+    qemu_chr_fe_write_all(&h->chr, out, n);
+}
+
+static void aspeed_ipmi_host_send_cmd(AspeedIPMIHost *h, uint8_t cmd)
+{
+    aspeed_ipmi_host_send(h, &cmd, 1, VM_CMD_CHAR);
+}
+
+static void aspeed_ipmi_host_respond(AspeedIPMIHost *h, uint8_t msg_id,
+                                     const uint8_t *rsp, uint32_t len)
+{
+    uint8_t msg[MAX_IPMI_MSG_SIZE + 2];
+    uint8_t csum = msg_id;
+    uint32_t i;
+
+    msg[0] = msg_id;
+    for (i = 0; i < len; i++) {
+        msg[i + 1] = rsp[i];
+        csum += rsp[i];
+    }
+    msg[len + 1] = -csum;
+
+    aspeed_ipmi_host_send(h, msg, len + 2, VM_MSG_CHAR);
+}
+
+static void aspeed_ipmi_host_respond_err(AspeedIPMIHost *h, uint8_t msg_id,
+                                         const uint8_t *req, uint8_t cc)
+{
+    uint8_t rsp[3] = { req[0] | 0x04, req[1], cc };
+
+    aspeed_ipmi_host_respond(h, msg_id, rsp, sizeof(rsp));
+}
+
+static void aspeed_ipmi_host_complete(AspeedIPMIHost *h,
+                                      AspeedIPMIHostReq *req,
+                                      const uint8_t *rsp, uint32_t len)
+{
+    uint64_t ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - req->start;
+    uint64_t us = ns / SCALE_US;
+    int bucket = us ? 63 - clz64(us) : 0;
+
+    h->inflight[req->msg_id] = NULL;
+    h->n_inflight--;
+    if (!h->n_inflight) {
+        timer_del(h->timer);
+    }
+
+    aspeed_ipmi_host_respond(h, req->msg_id, rsp, len);
+
+    h->stats.responses++;
+    h->stats.latency_ns += ns;
+    h->stats.max_latency_ns = MAX(h->stats.max_latency_ns, ns);
+    h->stats.histogram[MIN(bucket, ASPEED_IPMI_HOST_LAT_BUCKETS - 1)]++;
+    trace_aspeed_ipmi_host_response(h->name, req->msg_id,
+                                    len > 2 ? rsp[2] : 0, ns);
+    g_free(req);
+}
+
+static void aspeed_ipmi_host_fail(AspeedIPMIHost *h, AspeedIPMIHostReq *req,
+                                  uint8_t cc)
+{
+    uint8_t rsp[3] = { req->data[0] | 0x04, req->data[1], cc };
+
+    h->stats.errors++;
+    aspeed_ipmi_host_complete(h, req, rsp, sizeof(rsp));
+}
+
+/* Take the next request off the queue and put it in flight */
+static AspeedIPMIHostReq *aspeed_ipmi_host_next(AspeedIPMIHost *h)
+{
+    AspeedIPMIHostReq *req = QSIMPLEQ_FIRST(&h->queue);
+
+    /* A sequence number can only be in flight once */
+    if (!req || h->inflight[req->msg_id]) {
+        return NULL;
+    }
+
+    QSIMPLEQ_REMOVE_HEAD(&h->queue, next);
+    h->queue_len--;
+    h->inflight[req->msg_id] = req;
+    h->n_inflight++;
+
+    req->sent = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    if (!timer_pending(h->timer)) {
+        timer_mod_ns(h->timer, req->sent + ASPEED_IPMI_HOST_TIMEOUT_NS);
+    }
+    return req;
+}
+
+static void aspeed_kcs_host_write(AspeedLPCState *s,
+                                  const struct aspeed_kcs_channel *channel,
+                                  uint8_t val, bool cmd)
+{
+    s->regs[channel->idr] = val;
+    if (cmd) {
+        s->regs[channel->str] |= STR_CMD_DATA;
+    } else {
+        s->regs[channel->str] &= ~STR_CMD_DATA;
+    }
+    aspeed_kcs_set_ibf(s, channel);
+}
+
+/*
+ * Host side of the KCS write and read transfers, as described in the
+ * IPMI specification. The host only moves when the BMC has consumed
+ * the last byte it was given, so this is called after every access
+ * of the BMC to the channel registers.
+ */
+static void aspeed_kcs_host_kick(AspeedIPMIHost *h)
+{
+    AspeedLPCState *s = h->lpc;
+    const struct aspeed_kcs_channel *channel = &aspeed_kcs_channel_map[h->kcs];
+    AspeedIPMIHostReq *req = h->cur;
+    uint32_t str = s->regs[channel->str];
+    bool atn = str & STR_SMS_ATN;
+
+    if (atn != h->atn) {
+        h->atn = atn;
+        aspeed_ipmi_host_send_cmd(h, atn ? VM_CMD_ATTN : VM_CMD_NOATTN);
+    }
+
+    if (!aspeed_kcs_channel_enabled(s, channel) || (str & STR_IBF)) {
+        return;
+    }
+
+    switch (h->phase) {
+    case KCS_HOST_IDLE:
+        req = aspeed_ipmi_host_next(h);
+        if (!req) {
+            return;
+        }
+        h->cur = req;
+        h->pos = 0;
+        h->rsp_len = 0;
+        h->phase = KCS_HOST_WRITE;
+        aspeed_kcs_host_write(s, channel, KCS_CMD_WRITE_START, true);
+        break;
+
+    case KCS_HOST_WRITE:
+    case KCS_HOST_WRITE_END:
+        if ((str & STR_STATE_MASK) == STR_STATE_ERROR) {
+            goto error;
+        }
+        if ((str & STR_STATE_MASK) != STR_STATE_WRITE) {
+            return;
+        }
+        s->regs[channel->str] &= ~STR_OBF;
+        if (h->phase == KCS_HOST_WRITE_END) {
+            h->phase = KCS_HOST_READ;
+            aspeed_kcs_host_write(s, channel, req->data[h->pos++], false);
+        } else if (h->pos == req->len - 1) {
+            h->phase = KCS_HOST_WRITE_END;
+            aspeed_kcs_host_write(s, channel, KCS_CMD_WRITE_END, true);
+        } else {
+            aspeed_kcs_host_write(s, channel, req->data[h->pos++], false);
+        }
+        break;
+
+    case KCS_HOST_READ:
+        if (!(str & STR_OBF) || (str & STR_STATE_MASK) == STR_STATE_WRITE) {
+            return;
+        }
+        s->regs[channel->str] &= ~STR_OBF;
+
+        switch (str & STR_STATE_MASK) {
+        case STR_STATE_READ:
+            if (h->rsp_len < sizeof(h->rsp)) {
+                h->rsp[h->rsp_len++] = s->regs[channel->odr];
+            }
+            aspeed_kcs_host_write(s, channel, KCS_CMD_READ_BYTE, false);
+            break;
+        case STR_STATE_IDLE:
+            /* The last byte was a dummy, the response is complete */
+            h->cur = NULL;
+            h->phase = KCS_HOST_IDLE;
+            if (h->rsp_len < 3) {
+                trace_aspeed_ipmi_host_error(h->name, req->msg_id,
+                                             "short response");
+                aspeed_ipmi_host_fail(h, req, IPMI_CC_UNSPECIFIED);
+            } else {
+                aspeed_ipmi_host_complete(h, req, h->rsp, h->rsp_len);
+            }
+            aspeed_kcs_host_kick(h);
+            break;
+        default:
+            goto error;
+        }
+        break;
+    }
+    return;
+
+error:
+    trace_aspeed_ipmi_host_error(h->name, req->msg_id, "error state");
+    h->cur = NULL;
+    h->phase = KCS_HOST_IDLE;
+    aspeed_ipmi_host_fail(h, req, IPMI_CC_UNSPECIFIED);
+}
+
+/*
+ * Host side of the BT interface. The BT sequence number carries the
+ * one of the chardev protocol, so a new request is handed to the BMC
+ * as soon as it has picked up the previous one, without waiting for
+ * the response.
+ */
+static void aspeed_bt_host_kick(AspeedIPMIHost *h)
+{
+    AspeedLPCState *s = h->lpc;
+    AspeedIPMIHostReq *req;
+    uint32_t ctrl = s->regs[BTCSR];
+
+    if (!(s->regs[BTCR0] & BTCR0_ENABLE_IBT)) {
+        return;
+    }
+
+    if (ctrl & BTCSR_SMS_ATN) {
+        s->regs[BTCSR] &= ~BTCSR_SMS_ATN;
+        aspeed_ipmi_host_send_cmd(h, VM_CMD_ATTN);
+    }
+
+    if ((ctrl & BTCSR_B2H_ATN) && !(ctrl & BTCSR_H_BUSY)) {
+        const uint8_t *b2h = s->bt_b2h;
+        uint32_t len = b2h[0];
+
+        /* Length, netfn, seq, cmd, completion code, data */
+        req = len >= 4 ? h->inflight[b2h[2]] : NULL;
+        if (req) {
+            uint8_t rsp[ASPEED_BT_FIFO_SIZE];
+
+            rsp[0] = b2h[1];
+            rsp[1] = b2h[3];
+            memcpy(rsp + 2, b2h + 4, len - 3);
+            aspeed_ipmi_host_complete(h, req, rsp, len - 1);
+        } else {
+            trace_aspeed_ipmi_host_error(h->name, len >= 4 ? b2h[2] : 0,
+                                         "unexpected response");
+            h->stats.errors++;
+        }
+
+        /* H_BUSY was set while draining the FIFO */
+        s->regs[BTCSR] &= ~BTCSR_B2H_ATN;
+        s->regs[BTCR2] |= BTCR2_IRQ_HBUSY;
+    }
+
+    ctrl = s->regs[BTCSR];
+    if (!(ctrl & (BTCSR_H2B_ATN | BTCSR_B_BUSY)) &&
+        (req = aspeed_ipmi_host_next(h))) {
+        s->bt_h2b[0] = req->len + 1;
+        s->bt_h2b[1] = req->data[0];
+        s->bt_h2b[2] = req->msg_id;
+        memcpy(s->bt_h2b + 3, req->data + 1, req->len - 1);
+        s->bt_h2b_rd = 0;
+        s->regs[BTCSR] |= BTCSR_H2B_ATN;
+        s->regs[BTCR2] |= BTCR2_IRQ_H2B;
+    }
+
+    aspeed_bt_update_irq(s);
+}
+
+static void aspeed_ipmi_host_kick(AspeedIPMIHost *h)
+{
+    uint32_t queue_len = h->queue_len;
+
+    if (!qemu_chr_fe_backend_connected(&h->chr)) {
+        return;
+    }
+
+    if (h->kcs < 0) {
+        aspeed_bt_host_kick(h);
+    } else {
+        aspeed_kcs_host_kick(h);
+    }
+
+    /* Only once the state is settled, this can call back into us */
+    if (h->queue_len < queue_len) {
+        qemu_chr_fe_accept_input(&h->chr);
+    }
+}
+
+static void aspeed_ipmi_host_kick_all(AspeedLPCState *s)
+{
+    int i;
+
+    for (i = 0; i < ASPEED_LPC_NR_KCS; i++) {
+        aspeed_ipmi_host_kick(&s->kcs_host[i]);
+    }
+    aspeed_ipmi_host_kick(&s->bt_host);
+}
+
+static void aspeed_ipmi_host_timeout(void *opaque)
+{
+    AspeedIPMIHost *h = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int64_t oldest = INT64_MAX;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(h->inflight); i++) {
+        AspeedIPMIHostReq *req = h->inflight[i];
+
+        if (!req) {
+            continue;
+        }
+        if (now - req->sent < ASPEED_IPMI_HOST_TIMEOUT_NS) {
+            oldest = MIN(oldest, req->sent);
+            continue;
+        }
+
+        trace_aspeed_ipmi_host_error(h->name, req->msg_id, "timeout");
+        if (req == h->cur) {
+            h->cur = NULL;
+            h->phase = KCS_HOST_IDLE;
+        }
+        aspeed_ipmi_host_fail(h, req, IPMI_CC_TIMEOUT);
+    }
+
+    if (oldest != INT64_MAX) {
+        timer_mod_ns(h->timer, oldest + ASPEED_IPMI_HOST_TIMEOUT_NS);
+    }
+    aspeed_ipmi_host_kick(h);
+}
+
+static void aspeed_ipmi_host_handle_msg(AspeedIPMIHost *h)
+{
+    uint32_t max_len = h->kcs < 0 ? ASPEED_BT_FIFO_SIZE - 2 : MAX_IPMI_MSG_SIZE;
+    AspeedIPMIHostReq *req;
+    uint8_t csum = 0;
+    uint32_t i;
+
+    /* Sequence number, netfn, command and checksum at least */
+    if (h->in_escape || h->inpos < 4) {
+        trace_aspeed_ipmi_host_error(h->name, 0, "short message");
+        h->stats.errors++;
+        return;
+    }
+
+    if (h->in_too_many || h->inpos - 2 > max_len) {
+        h->stats.errors++;
+        aspeed_ipmi_host_respond_err(h, h->inbuf[0], h->inbuf + 1,
+                                     IPMI_CC_REQUEST_DATA_TRUNCATED);
+        return;
+    }
+
+    for (i = 0; i < h->inpos; i++) {
+        csum += h->inbuf[i];
+    }
+    if (csum) {
+        trace_aspeed_ipmi_host_error(h->name, h->inbuf[0], "bad checksum");
+        h->stats.errors++;
+        return;
+    }
+
+    if (h->queue_len >= ASPEED_IPMI_HOST_QUEUE_LEN) {
+        h->stats.busy++;
+        aspeed_ipmi_host_respond_err(h, h->inbuf[0], h->inbuf + 1,
+                                     IPMI_CC_NODE_BUSY);
+        return;
+    }
+
+    req = g_new(AspeedIPMIHostReq, 1);
+    req->start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    req->msg_id = h->inbuf[0];
+    req->len = h->inpos - 2;
+    memcpy(req->data, h->inbuf + 1, req->len);
+
+    QSIMPLEQ_INSERT_TAIL(&h->queue, req, next);
+    h->queue_len++;
+    h->stats.requests++;
+    trace_aspeed_ipmi_host_request(h->name, req->msg_id, req->data[0],
+                                   req->data[1], h->queue_len);
+
+    aspeed_ipmi_host_kick(h);
+}
+
+static int aspeed_ipmi_host_can_receive(void *opaque)
+{
+    AspeedIPMIHost *h = opaque;
+
+    return h->queue_len < ASPEED_IPMI_HOST_QUEUE_LEN ? sizeof(h->inbuf) : 0;
+}
+
+static void aspeed_ipmi_host_receive(void *opaque, const uint8_t *buf,
+                                     int size)
+{
+    AspeedIPMIHost *h = opaque;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        uint8_t ch = buf[i];
+
+        switch (ch) {
+        case VM_MSG_CHAR:
+            aspeed_ipmi_host_handle_msg(h);
+            /* fall through */
+        case VM_CMD_CHAR:
+            /* Version and capabilities of the host, nothing to do */
+            h->inpos = 0;
+            h->in_escape = false;
+            h->in_too_many = false;
+            break;
+
+        case VM_ESCAPE_CHAR:
+            h->in_escape = true;
+            break;
+
+        default:
+            if (h->in_escape) {
+                ch &= ~0x10;
+                h->in_escape = false;
+            }
+            if (h->inpos >= sizeof(h->inbuf)) {
+                h->in_too_many = true;
+                break;
+            }
+            h->inbuf[h->inpos++] = ch;
+            break;
+        }
+    }
+}
+
+static void aspeed_ipmi_host_event(void *opaque, QEMUChrEvent event)
+{
+    AspeedIPMIHost *h = opaque;
+    AspeedIPMIHostReq *req;
+
+    switch (event) {
+    case CHR_EVENT_OPENED:
+        h->inpos = 0;
+        h->in_escape = false;
+        h->in_too_many = false;
+        if (h->atn) {
+            aspeed_ipmi_host_send_cmd(h, VM_CMD_ATTN);
+        }
+        break;
+
+    case CHR_EVENT_CLOSED:
+        /*
+         * Queued requests have nobody to answer to anymore. The ones in
+         * flight run to completion to keep the BMC in step.
+         */
+        while ((req = QSIMPLEQ_FIRST(&h->queue))) {
+            QSIMPLEQ_REMOVE_HEAD(&h->queue, next);
+            g_free(req);
+        }
+        h->queue_len = 0;
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void aspeed_ipmi_host_reset(AspeedIPMIHost *h)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(h->inflight); i++) {
+        if (h->inflight[i]) {
+            aspeed_ipmi_host_fail(h, h->inflight[i],
+                                  IPMI_CC_BMC_INIT_IN_PROGRESS);
+        }
+    }
+
+    h->cur = NULL;
+    h->phase = KCS_HOST_IDLE;
+    h->atn = false;
+}
+
+static void aspeed_ipmi_host_realize(AspeedIPMIHost *h)
+{
+    if (!qemu_chr_fe_backend_connected(&h->chr)) {
+        return;
+    }
+
+    h->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, aspeed_ipmi_host_timeout, h);
+    qemu_chr_fe_set_handlers(&h->chr, aspeed_ipmi_host_can_receive,
+                             aspeed_ipmi_host_receive, aspeed_ipmi_host_event,
+                             NULL, h, NULL, true);
+}
+
+static void aspeed_ipmi_host_get_histogram(Object *obj, Visitor *v,
+                                           const char *name, void *opaque,
+                                           Error **errp)
+{
+    AspeedIPMIHost *h = opaque;
+    uint64List *list = NULL;
+    int i;
+
+    for (i = ASPEED_IPMI_HOST_LAT_BUCKETS - 1; i >= 0; i--) {
+        QAPI_LIST_PREPEND(list, h->stats.histogram[i]);
+    }
+
+    visit_type_uint64List(v, name, &list, errp);
+    qapi_free_uint64List(list);
+}
+
+static void aspeed_ipmi_host_add_stat(Object *obj, AspeedIPMIHost *h,
+                                      const char *stat, uint64_t *v)
+{
+    g_autofree char *name = g_strdup_printf("%s-%s", h->name, stat);
+
+    object_property_add_uint64_ptr(obj, name, v, OBJ_PROP_FLAG_READ);
+}
+
+static void aspeed_ipmi_host_init(Object *obj, AspeedIPMIHost *h,
+                                  const char *name, int kcs)
+{
+    g_autofree char *histogram = g_strdup_printf("%s-latency-histogram",
+                                                 name);
+
+    h->lpc = ASPEED_LPC(obj);
+    h->name = name;
+    h->kcs = kcs;
+    QSIMPLEQ_INIT(&h->queue);
+
+    aspeed_ipmi_host_add_stat(obj, h, "requests", &h->stats.requests);
+    aspeed_ipmi_host_add_stat(obj, h, "responses", &h->stats.responses);
+    aspeed_ipmi_host_add_stat(obj, h, "errors", &h->stats.errors);
+    aspeed_ipmi_host_add_stat(obj, h, "busy", &h->stats.busy);
+    aspeed_ipmi_host_add_stat(obj, h, "latency-ns", &h->stats.latency_ns);
+    aspeed_ipmi_host_add_stat(obj, h, "max-latency-ns",
+                              &h->stats.max_latency_ns);
+    object_property_add(obj, histogram, "uint64List",
+                        aspeed_ipmi_host_get_histogram, NULL, NULL, h);
+}
+
 static uint64_t aspeed_lpc_read(void *opaque, hwaddr offset, unsigned size)
 {
     AspeedLPCState *s = ASPEED_LPC(opaque);
@@ -327,6 +966,7 @@ static uint64_t aspeed_lpc_read(void *opaque, hwaddr offset, unsigned size)
     case IDR4:
     {
         const struct aspeed_kcs_channel *channel;
+        uint64_t val = s->regs[reg];
 
         channel = aspeed_kcs_get_channel_by_register(reg);
         if (s->regs[channel->str] & STR_IBF) {
@@ -337,8 +977,16 @@ static uint64_t aspeed_lpc_read(void *opaque, hwaddr offset, unsigned size)
         }
 
         s->regs[channel->str] &= ~STR_IBF;
-        break;
+
+        /* The host may have the next byte ready */
+        aspeed_ipmi_host_kick(&s->kcs_host[channel->id]);
+        return val;
     }
+    case BTDR:
+        if (s->bt_h2b_rd < ASPEED_BT_FIFO_SIZE) {
+            return s->bt_h2b[s->bt_h2b_rd++];
+        }
+        return 0;
     default:
         break;
     }
@@ -367,11 +1015,27 @@ static void aspeed_lpc_write(void *opaque, hwaddr offset, uint64_t data,
     case ODR4:
         s->regs[aspeed_kcs_get_channel_by_register(reg)->str] |= STR_OBF;
         break;
+    case BTCR2:
+        data = s->regs[reg] & ~data;
+        break;
+    case BTCSR:
+        data = aspeed_bt_ctrl_write(s, data);
+        break;
+    case BTDR:
+        if (s->bt_b2h_wr < ASPEED_BT_FIFO_SIZE) {
+            s->bt_b2h[s->bt_b2h_wr++] = data;
+        }
+        break;
     default:
         break;
     }
 
     s->regs[reg] = data;
+
+    if (reg >= BTCR0 && reg <= BTIMSR) {
+        aspeed_bt_update_irq(s);
+    }
+    aspeed_ipmi_host_kick_all(s);
 }
 
 static const MemoryRegionOps aspeed_lpc_ops = {
@@ -387,18 +1051,28 @@ static const MemoryRegionOps aspeed_lpc_ops = {
 static void aspeed_lpc_reset(DeviceState *dev)
 {
     struct AspeedLPCState *s = ASPEED_LPC(dev);
+    int i;
 
     s->subdevice_irqs_pending = 0;
 
     memset(s->regs, 0, sizeof(s->regs));
 
     s->regs[HICR7] = s->hicr7;
+
+    s->bt_h2b_rd = 0;
+    s->bt_b2h_wr = 0;
+
+    for (i = 0; i < ASPEED_LPC_NR_KCS; i++) {
+        aspeed_ipmi_host_reset(&s->kcs_host[i]);
+    }
+    aspeed_ipmi_host_reset(&s->bt_host);
 }
 
 static void aspeed_lpc_realize(DeviceState *dev, Error **errp)
 {
     AspeedLPCState *s = ASPEED_LPC(dev);
     SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
+    int i;
 
     sysbus_init_irq(sbd, &s->irq);
     sysbus_init_irq(sbd, &s->subdevice_irqs[aspeed_lpc_kcs_1]);
@@ -413,10 +1087,18 @@ static void aspeed_lpc_realize(DeviceState *dev, Error **errp)
     sysbus_init_mmio(sbd, &s->iomem);
 
     qdev_init_gpio_in(dev, aspeed_lpc_set_irq, ASPEED_LPC_NR_SUBDEVS);
+
+    for (i = 0; i < ASPEED_LPC_NR_KCS; i++) {
+        aspeed_ipmi_host_realize(&s->kcs_host[i]);
+    }
+    aspeed_ipmi_host_realize(&s->bt_host);
 }
 
 static void aspeed_lpc_init(Object *obj)
 {
+    AspeedLPCState *s = ASPEED_LPC(obj);
+    int i;
+
     object_property_add(obj, "idr1", "uint32", aspeed_kcs_get_register_property,
                         aspeed_kcs_set_register_property, NULL, NULL);
     object_property_add(obj, "odr1", "uint32", aspeed_kcs_get_register_property,
@@ -441,8 +1123,52 @@ static void aspeed_lpc_init(Object *obj)
                         aspeed_kcs_set_register_property, NULL, NULL);
     object_property_add(obj, "str4", "uint32", aspeed_kcs_get_register_property,
                         aspeed_kcs_set_register_property, NULL, NULL);
+
+    for (i = 0; i < ASPEED_LPC_NR_KCS; i++) {
+        aspeed_ipmi_host_init(obj, &s->kcs_host[i], aspeed_kcs_host_names[i],
+                              i);
+    }
+    aspeed_ipmi_host_init(obj, &s->bt_host, "ibt", -1);
 }
 
+/*
+ * The iBT FIFOs only hold anything of interest when a host is
+ * attached. The state of the host itself is not migrated, its chardev
+ * connection does not survive the move anyway.
+ */
+static bool aspeed_lpc_bt_needed(void *opaque)
+{
+    AspeedLPCState *s = ASPEED_LPC(opaque);
+
+    return qemu_chr_fe_backend_connected(&s->bt_host.chr);
+}
+
+static int aspeed_lpc_bt_post_load(void *opaque, int version_id)
+{
+    AspeedLPCState *s = ASPEED_LPC(opaque);
+
+    if (s->bt_h2b_rd > ASPEED_BT_FIFO_SIZE ||
+        s->bt_b2h_wr > ASPEED_BT_FIFO_SIZE) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static const VMStateDescription vmstate_aspeed_lpc_bt = {
+    .name = TYPE_ASPEED_LPC "/bt",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = aspeed_lpc_bt_needed,
+    .post_load = aspeed_lpc_bt_post_load,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT8_ARRAY(bt_h2b, AspeedLPCState, ASPEED_BT_FIFO_SIZE),
+        VMSTATE_UINT8_ARRAY(bt_b2h, AspeedLPCState, ASPEED_BT_FIFO_SIZE),
+        VMSTATE_UINT32(bt_h2b_rd, AspeedLPCState),
+        VMSTATE_UINT32(bt_b2h_wr, AspeedLPCState),
+        VMSTATE_END_OF_LIST(),
+    }
+};
+
 static const VMStateDescription vmstate_aspeed_lpc = {
     .name = TYPE_ASPEED_LPC,
     .version_id = 2,
@@ -451,11 +1177,20 @@ static const VMStateDescription vmstate_aspeed_lpc = {
         VMSTATE_UINT32_ARRAY(regs, AspeedLPCState, ASPEED_LPC_NR_REGS),
         VMSTATE_UINT32(subdevice_irqs_pending, AspeedLPCState),
         VMSTATE_END_OF_LIST(),
+    },
+    .subsections = (const VMStateDescription * const []) {
+        &vmstate_aspeed_lpc_bt,
+        NULL
     }
 };
 
 static const Property aspeed_lpc_properties[] = {
     DEFINE_PROP_UINT32("hicr7", AspeedLPCState, hicr7, 0),
+    DEFINE_PROP_CHR("kcs1-chardev", AspeedLPCState, kcs_host[0].chr),
+    DEFINE_PROP_CHR("kcs2-chardev", AspeedLPCState, kcs_host[1].chr),
+    DEFINE_PROP_CHR("kcs3-chardev", AspeedLPCState, kcs_host[2].chr),
+    DEFINE_PROP_CHR("kcs4-chardev", AspeedLPCState, kcs_host[3].chr),
+    DEFINE_PROP_CHR("ibt-chardev", AspeedLPCState, bt_host.chr),
 };
 
 static void aspeed_lpc_class_init(ObjectClass *klass, void *data)
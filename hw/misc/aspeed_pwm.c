@@ -0,0 +1,689 @@
+/*
+ * ASPEED PWM and Fan Tach Controller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * The controller of the AST2600 has 16 channels, each with
+ * a PWM output and a tach input. The tach inputs are not wired to
+ * anything the guest can drive, so they measure fans simulated by a
+ * fan and thermal plant: each fan follows the duty cycle of its PWM
+ * output with a first order lag, and the fans cool thermal zones whose
+ * temperature is written to the temperature sensor models of the
+ * machine. Fan control daemons then run closed loop, as on a real
+ * system.
+ *
+ * The plant is described by a key file given with the "plant" property:
+ *
+ *   [plant]
+ *   # Ambient temperature in C
+ *   ambient=25
+ *
+ *   [fan 0]
+ *   # PWM channel driving the fan
+ *   pwm=0
+ *   max-rpm=12000
+ *   # Time constant in s
+ *   time-constant=1.5
+ *   # Tach pulses per revolution
+ *   pulses=2
+ *
+ *   [zone 0]
+ *   # Heating power in W, heat capacity in J/K
+ *   power=150
+ *   capacitance=600
+ *   # Cooling by still air, in W/K
+ *   conductance=1.5
+ *   # Cooling of each fan at full speed from fan 0, in W/K
+ *   cooling=4
+ *   sensor=/machine/peripheral/cpu-temp
+ *   sensor-property=temperature
+ *
+ * GKeyFile only takes comments on lines of their own.
+ *
+ * Fans and zones are numbered from 0 without holes. Without a file,
+ * each tach channel measures a fan of 10000 RPM driven by the PWM
+ * channel of the same number, and there are no zones.
+ */
+
+#include "qemu/osdep.h"
+#include <math.h>
+#include "qemu/log.h"
+#include "qemu/error-report.h"
+#include "qemu/timer.h"
+#include "hw/misc/aspeed_pwm.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "migration/vmstate.h"
+#include "hw/qdev-properties.h"
+#include "hw/irq.h"
+#include "trace.h"
+
+#define TO_REG(offset) ((offset) >> 2)
+
+#define PWM_CTRL(ch)                    TO_REG((ch) * 0x10 + 0x00)
+#define   PWM_CTRL_CLK_ENABLE           BIT(16)
+#define   PWM_CTRL_LEVEL_OUTPUT         BIT(15)
+#define   PWM_CTRL_INVERSE              BIT(14)
+#define   PWM_CTRL_PIN_ENABLE           BIT(12)
+#define PWM_DUTY_CYCLE(ch)              TO_REG((ch) * 0x10 + 0x04)
+#define   PWM_DUTY_CYCLE_PERIOD(x)      extract32(x, 24, 8)
+#define   PWM_DUTY_CYCLE_FALLING(x)     extract32(x, 8, 8)
+#define   PWM_DUTY_CYCLE_RISING(x)      extract32(x, 0, 8)
+#define TACH_CTRL(ch)                   TO_REG((ch) * 0x10 + 0x08)
+#define   TACH_CTRL_IER                 BIT(31)
+#define   TACH_CTRL_INVERS_LIMIT        BIT(30)
+#define   TACH_CTRL_ENABLE              BIT(28)
+#define   TACH_CTRL_CLK_DIV_T(x)        extract32(x, 20, 4)
+#define   TACH_CTRL_THRESHOLD(x)        extract32(x, 0, 20)
+#define TACH_STS(ch)                    TO_REG((ch) * 0x10 + 0x0C)
+#define   TACH_STS_ISR                  BIT(31)
+#define   TACH_STS_VALUE_UPDATE         BIT(21)
+#define   TACH_STS_FULL_MEASUREMENT     BIT(20)
+#define   TACH_STS_VALUE_MASK           0xfffff
+
+#define ASPEED_PWM_DEFAULT_MAX_RPM      10000
+#define ASPEED_PWM_DEFAULT_PULSES       2
+
+/* Duty cycle of a PWM output, as seen by the fan */
+static float aspeed_pwm_duty(AspeedPWMState *s, unsigned int ch)
+{
+    uint32_t ctrl = s->regs[PWM_CTRL(ch)];
+    uint32_t dc = s->regs[PWM_DUTY_CYCLE(ch)];
+    unsigned int period, high;
+    float duty;
+
+    /* Fans run full speed when their PWM input is left floating */
+    if (!(ctrl & PWM_CTRL_PIN_ENABLE)) {
+        return 1.0f;
+    }
+
+    if (ctrl & PWM_CTRL_CLK_ENABLE) {
+        period = PWM_DUTY_CYCLE_PERIOD(dc) + 1;
+        high = (PWM_DUTY_CYCLE_FALLING(dc) - PWM_DUTY_CYCLE_RISING(dc) +
+                period) % period;
+        /* Equal rising and falling points leave the output high */
+        duty = high ? (float)high / period : 1.0f;
+    } else {
+        duty = ctrl & PWM_CTRL_LEVEL_OUTPUT ? 1.0f : 0.0f;
+    }
+
+    return ctrl & PWM_CTRL_INVERSE ? 1.0f - duty : duty;
+}
+
+static void aspeed_pwm_update_duty(AspeedPWMState *s)
+{
+    AspeedPWMPlant *p = &s->plant;
+    unsigned int i;
+
+    for (i = 0; i < p->nr_fans; i++) {
+        p->duty[i] = aspeed_pwm_duty(s, p->pwm[i]);
+    }
+}
+
+/*
+ * Number of tach clock cycles in a period of the fan signal, as
+ * latched by the controller. 0 when the fan is too slow to be
+ * measured.
+ */
+static uint32_t aspeed_pwm_tach_value(AspeedPWMState *s, unsigned int ch)
+{
+    AspeedPWMPlant *p = &s->plant;
+    uint32_t div = 1 << (2 * TACH_CTRL_CLK_DIV_T(s->regs[TACH_CTRL(ch)]));
+    double value;
+
+    if (ch >= p->nr_fans || p->rpm[ch] < 1.0f) {
+        return 0;
+    }
+
+    value = (double)s->clk_freq * 60 / (p->rpm[ch] * p->pulses[ch] * div);
+    return value > TACH_STS_VALUE_MASK ? 0 : MAX((uint32_t)value, 1);
+}
+
+static uint32_t aspeed_pwm_tach_status(AspeedPWMState *s, unsigned int ch)
+{
+    uint32_t sts = s->regs[TACH_STS(ch)] & TACH_STS_ISR;
+    uint32_t value;
+
+    if (!(s->regs[TACH_CTRL(ch)] & TACH_CTRL_ENABLE)) {
+        return sts;
+    }
+
+    value = aspeed_pwm_tach_value(s, ch);
+    if (!value) {
+        return sts | TACH_STS_VALUE_MASK;
+    }
+
+    return sts | TACH_STS_VALUE_UPDATE | TACH_STS_FULL_MEASUREMENT | value;
+}
+
+static void aspeed_pwm_update_irq(AspeedPWMState *s)
+{
+    bool level = false;
+    unsigned int ch;
+
+    for (ch = 0; ch < ASPEED_PWM_NR_CHANNELS; ch++) {
+        if ((s->regs[TACH_CTRL(ch)] & TACH_CTRL_IER) &&
+            (s->regs[TACH_STS(ch)] & TACH_STS_ISR)) {
+            level = true;
+        }
+    }
+
+    qemu_set_irq(s->irq, level);
+}
+
+/* Flag the fans slower, or faster when inverted, than their limit */
+static void aspeed_pwm_check_limits(AspeedPWMState *s)
+{
+    unsigned int ch;
+
+    for (ch = 0; ch < ASPEED_PWM_NR_CHANNELS; ch++) {
+        uint32_t ctrl = s->regs[TACH_CTRL(ch)];
+        uint32_t value;
+        bool trip;
+
+        if (!(ctrl & TACH_CTRL_ENABLE) || !TACH_CTRL_THRESHOLD(ctrl)) {
+            continue;
+        }
+
+        value = aspeed_pwm_tach_value(s, ch) ?: TACH_STS_VALUE_MASK;
+        if (ctrl & TACH_CTRL_INVERS_LIMIT) {
+            trip = value < TACH_CTRL_THRESHOLD(ctrl);
+        } else {
+            trip = value > TACH_CTRL_THRESHOLD(ctrl);
+        }
+        if (trip) {
+            s->regs[TACH_STS(ch)] |= TACH_STS_ISR;
+        }
+    }
+
+    aspeed_pwm_update_irq(s);
+}
+
+/*
+ * Advance the plant by @dt seconds. Each fan moves towards the speed of
+ * its duty cycle and each zone towards the temperature at which the
+ * still air and the fans carry away its power, both with an implicit
+ * first order step which stays stable whatever the period.
+ */
+static void aspeed_pwm_plant_step(AspeedPWMPlant *p, const uint32_t *power,
+                                  float dt)
+{
+    float g[ASPEED_PWM_MAX_ZONES];
+    unsigned int i, z;
+
+    for (i = 0; i < p->nr_fans; i++) {
+        float a = dt / (p->tau[i] + dt);
+
+        p->rpm[i] += (p->duty[i] * p->max_rpm[i] - p->rpm[i]) * a;
+        p->speed[i] = p->rpm[i] / p->max_rpm[i];
+    }
+
+    for (z = 0; z < p->nr_zones; z++) {
+        g[z] = p->conductance[z];
+    }
+    for (i = 0; i < p->nr_fans; i++) {
+        for (z = 0; z < p->nr_zones; z++) {
+            g[z] += p->cooling[i][z] * p->speed[i];
+        }
+    }
+
+    for (z = 0; z < p->nr_zones; z++) {
+        float target = p->ambient + power[z] / g[z];
+        float a = dt * g[z] / (p->capacitance[z] + dt * g[z]);
+
+        p->temp[z] += (target - p->temp[z]) * a;
+    }
+}
+
+static void aspeed_pwm_feed_sensors(AspeedPWMState *s)
+{
+    AspeedPWMPlant *p = &s->plant;
+    unsigned int z;
+
+    for (z = 0; z < p->nr_zones; z++) {
+        int32_t temp_mc = lrintf(p->temp[z] * 1000);
+        Error *local_err = NULL;
+
+        if (temp_mc == s->temp_mc[z] && p->sensor[z]) {
+            continue;
+        }
+        s->temp_mc[z] = temp_mc;
+
+        if (p->sensor_path[z] && !p->sensor[z]) {
+            /* Sensors are created by the machine after the SoC */
+            p->sensor[z] = object_resolve_path(p->sensor_path[z], NULL);
+            if (!p->sensor[z]) {
+                warn_report(TYPE_ASPEED_PWM ": zone %u: no sensor at '%s'",
+                            z, p->sensor_path[z]);
+                g_clear_pointer(&p->sensor_path[z], g_free);
+                continue;
+            }
+        }
+        if (!p->sensor[z]) {
+            continue;
+        }
+
+        object_property_set_int(p->sensor[z], p->sensor_prop[z], temp_mc,
+                                &local_err);
+        if (local_err) {
+            warn_reportf_err(local_err, TYPE_ASPEED_PWM ": zone %u: ", z);
+            p->sensor[z] = NULL;
+            g_clear_pointer(&p->sensor_path[z], g_free);
+        }
+    }
+}
+
+static void aspeed_pwm_timer(void *opaque)
+{
+    AspeedPWMState *s = ASPEED_PWM(opaque);
+    AspeedPWMPlant *p = &s->plant;
+    int64_t start = get_clock();
+    unsigned int i;
+
+    aspeed_pwm_plant_step(p, s->power, s->period_ms / 1000.0f);
+    for (i = 0; i < p->nr_fans; i++) {
+        s->rpm[i] = lrintf(p->rpm[i]);
+    }
+    s->step_ns += get_clock() - start;
+    s->steps++;
+
+    aspeed_pwm_feed_sensors(s);
+    aspeed_pwm_check_limits(s);
+
+    timer_mod(s->timer,
+              qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+              s->period_ms * SCALE_MS);
+}
+
+static uint64_t aspeed_pwm_read(void *opaque, hwaddr addr, unsigned int size)
+{
+    AspeedPWMState *s = ASPEED_PWM(opaque);
+    unsigned int reg = TO_REG(addr);
+    uint64_t val;
+
+    if (reg >= ASPEED_PWM_NR_REGS) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Out-of-bounds read at offset 0x%" HWADDR_PRIx "\n",
+                      __func__, addr);
+        return 0;
+    }
+
+    if ((addr & 0xf) == 0xc) {
+        val = aspeed_pwm_tach_status(s, reg / 4);
+    } else {
+        val = s->regs[reg];
+    }
+
+    trace_aspeed_pwm_read(addr, val);
+    return val;
+}
+
+static void aspeed_pwm_write(void *opaque, hwaddr addr, uint64_t data,
+                             unsigned int size)
+{
+    AspeedPWMState *s = ASPEED_PWM(opaque);
+    unsigned int reg = TO_REG(addr);
+
+    trace_aspeed_pwm_write(addr, data);
+
+    if (reg >= ASPEED_PWM_NR_REGS) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Out-of-bounds write at offset 0x%" HWADDR_PRIx "\n",
+                      __func__, addr);
+        return;
+    }
+
+    switch (addr & 0xf) {
+    case 0x0:
+    case 0x4:
+        s->regs[reg] = data;
+        aspeed_pwm_update_duty(s);
+        break;
+    case 0x8:
+        s->regs[reg] = data;
+        aspeed_pwm_update_irq(s);
+        break;
+    case 0xc:
+        /* Only the interrupt status is writable, cleared by a 1 */
+        s->regs[reg] &= ~(data & TACH_STS_ISR);
+        aspeed_pwm_update_irq(s);
+        break;
+    }
+}
+
+static const MemoryRegionOps aspeed_pwm_ops = {
+    .read = aspeed_pwm_read,
+    .write = aspeed_pwm_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+static void aspeed_pwm_default_plant(AspeedPWMState *s)
+{
+    AspeedPWMPlant *p = &s->plant;
+    unsigned int i;
+
+    p->nr_fans = ASPEED_PWM_NR_CHANNELS;
+    p->nr_zones = 0;
+    p->ambient = 25;
+
+    for (i = 0; i < p->nr_fans; i++) {
+        p->pwm[i] = i;
+        p->max_rpm[i] = ASPEED_PWM_DEFAULT_MAX_RPM;
+        p->tau[i] = 1;
+        p->pulses[i] = ASPEED_PWM_DEFAULT_PULSES;
+    }
+}
+
+static bool aspeed_pwm_get_double(GKeyFile *kf, const char *group,
+                                  const char *key, double min, double *val,
+                                  Error **errp)
+{
+    g_autoptr(GError) gerr = NULL;
+    double v;
+
+    if (!g_key_file_has_key(kf, group, key, NULL)) {
+        return true;
+    }
+
+    v = g_key_file_get_double(kf, group, key, &gerr);
+    if (gerr || v < min) {
+        error_setg(errp, TYPE_ASPEED_PWM ": [%s] %s: %s", group, key,
+                   gerr ? gerr->message : "value out of range");
+        return false;
+    }
+
+    *val = v;
+    return true;
+}
+
+static bool aspeed_pwm_load_fan(AspeedPWMState *s, GKeyFile *kf,
+                                const char *group, unsigned int i,
+                                Error **errp)
+{
+    AspeedPWMPlant *p = &s->plant;
+    double pwm = i, max_rpm = ASPEED_PWM_DEFAULT_MAX_RPM, tau = 1;
+    double pulses = ASPEED_PWM_DEFAULT_PULSES;
+
+    if (!aspeed_pwm_get_double(kf, group, "pwm", 0, &pwm, errp) ||
+        !aspeed_pwm_get_double(kf, group, "max-rpm", 1, &max_rpm, errp) ||
+        !aspeed_pwm_get_double(kf, group, "time-constant", 0.001, &tau,
+                               errp) ||
+        !aspeed_pwm_get_double(kf, group, "pulses", 1, &pulses, errp)) {
+        return false;
+    }
+
+    if (pwm >= ASPEED_PWM_NR_CHANNELS) {
+        error_setg(errp, TYPE_ASPEED_PWM ": [%s] pwm: no channel %u", group,
+                   (unsigned int)pwm);
+        return false;
+    }
+
+    p->pwm[i] = pwm;
+    p->max_rpm[i] = max_rpm;
+    p->tau[i] = tau;
+    p->pulses[i] = pulses;
+    return true;
+}
+
+static bool aspeed_pwm_load_zone(AspeedPWMState *s, GKeyFile *kf,
+                                 const char *group, unsigned int z,
+                                 Error **errp)
+{
+    AspeedPWMPlant *p = &s->plant;
+    double power = 0, capacitance = 500, conductance = 1;
+    g_autofree double *cooling = NULL;
+    g_autoptr(GError) gerr = NULL;
+    gsize n = 0;
+    unsigned int i;
+
+    if (!aspeed_pwm_get_double(kf, group, "power", 0, &power, errp) ||
+        !aspeed_pwm_get_double(kf, group, "capacitance", 0.001, &capacitance,
+                               errp) ||
+        !aspeed_pwm_get_double(kf, group, "conductance", 0.001, &conductance,
+                               errp)) {
+        return false;
+    }
+
+    if (g_key_file_has_key(kf, group, "cooling", NULL)) {
+        cooling = g_key_file_get_double_list(kf, group, "cooling", &n, &gerr);
+        if (gerr) {
+            error_setg(errp, TYPE_ASPEED_PWM ": [%s] cooling: %s", group,
+                       gerr->message);
+            return false;
+        }
+        if (n > p->nr_fans) {
+            error_setg(errp, TYPE_ASPEED_PWM ": [%s] cooling: %zu fans, "
+                       "only %u described", group, (size_t)n, p->nr_fans);
+            return false;
+        }
+    }
+
+    s->power[z] = power;
+    p->capacitance[z] = capacitance;
+    p->conductance[z] = conductance;
+    for (i = 0; i < p->nr_fans; i++) {
+        p->cooling[i][z] = i < n ? MAX(cooling[i], 0) : 0;
+    }
+
+    p->sensor_path[z] = g_key_file_get_string(kf, group, "sensor", NULL);
+    p->sensor_prop[z] = g_key_file_get_string(kf, group, "sensor-property",
+                                              NULL);
+    if (!p->sensor_prop[z]) {
+        p->sensor_prop[z] = g_strdup("temperature");
+    }
+    return true;
+}
+
+static bool aspeed_pwm_load_plant(AspeedPWMState *s, Error **errp)
+{
+    AspeedPWMPlant *p = &s->plant;
+    g_autoptr(GKeyFile) kf = g_key_file_new();
+    g_autoptr(GError) gerr = NULL;
+    double ambient = 25;
+    unsigned int i;
+
+    if (!g_key_file_load_from_file(kf, s->plant_file, G_KEY_FILE_NONE,
+                                   &gerr)) {
+        error_setg(errp, TYPE_ASPEED_PWM ": failed to load '%s': %s",
+                   s->plant_file, gerr->message);
+        return false;
+    }
+
+    if (!aspeed_pwm_get_double(kf, "plant", "ambient", -273, &ambient,
+                               errp)) {
+        return false;
+    }
+    p->ambient = ambient;
+
+    for (i = 0; i < ASPEED_PWM_NR_CHANNELS; i++) {
+        g_autofree char *group = g_strdup_printf("fan %u", i);
+
+        if (!g_key_file_has_group(kf, group)) {
+            break;
+        }
+        if (!aspeed_pwm_load_fan(s, kf, group, i, errp)) {
+            return false;
+        }
+    }
+    p->nr_fans = i;
+
+    for (i = 0; i < ASPEED_PWM_MAX_ZONES; i++) {
+        g_autofree char *group = g_strdup_printf("zone %u", i);
+
+        if (!g_key_file_has_group(kf, group)) {
+            break;
+        }
+        if (!aspeed_pwm_load_zone(s, kf, group, i, errp)) {
+            return false;
+        }
+    }
+    p->nr_zones = i;
+
+    return true;
+}
+
+static void aspeed_pwm_reset(DeviceState *dev)
+{
+    AspeedPWMState *s = ASPEED_PWM(dev);
+    AspeedPWMPlant *p = &s->plant;
+    unsigned int i;
+
+    memset(s->regs, 0, sizeof(s->regs));
+
+    /* Powered off machine, fans stopped and zones at ambient */
+    for (i = 0; i < p->nr_fans; i++) {
+        p->rpm[i] = 0;
+        p->speed[i] = 0;
+        s->rpm[i] = 0;
+    }
+    for (i = 0; i < p->nr_zones; i++) {
+        p->temp[i] = p->ambient;
+        s->temp_mc[i] = lrintf(p->ambient * 1000);
+    }
+    aspeed_pwm_update_duty(s);
+    aspeed_pwm_update_irq(s);
+
+    timer_mod(s->timer,
+              qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+              s->period_ms * SCALE_MS);
+}
+
+static void aspeed_pwm_realize(DeviceState *dev, Error **errp)
+{
+    AspeedPWMState *s = ASPEED_PWM(dev);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
+
+    if (!s->period_ms) {
+        error_setg(errp, TYPE_ASPEED_PWM ": 'plant-period-ms' must not be 0");
+        return;
+    }
+    if (!s->clk_freq) {
+        error_setg(errp, TYPE_ASPEED_PWM ": 'clock-frequency' must not be 0");
+        return;
+    }
+
+    aspeed_pwm_default_plant(s);
+    if (s->plant_file && !aspeed_pwm_load_plant(s, errp)) {
+        return;
+    }
+
+    sysbus_init_irq(sbd, &s->irq);
+
+    memory_region_init_io(&s->iomem, OBJECT(s), &aspeed_pwm_ops, s,
+                          TYPE_ASPEED_PWM, 0x100);
+    sysbus_init_mmio(sbd, &s->iomem);
+
+    s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, aspeed_pwm_timer, s);
+}
+
+static void aspeed_pwm_unrealize(DeviceState *dev)
+{
+    AspeedPWMState *s = ASPEED_PWM(dev);
+    unsigned int i;
+
+    timer_free(s->timer);
+    for (i = 0; i < ASPEED_PWM_MAX_ZONES; i++) {
+        g_clear_pointer(&s->plant.sensor_path[i], g_free);
+        g_clear_pointer(&s->plant.sensor_prop[i], g_free);
+        s->plant.sensor[i] = NULL;
+    }
+}
+
+static void aspeed_pwm_get_temperature(Object *obj, Visitor *v,
+                                       const char *name, void *opaque,
+                                       Error **errp)
+{
+    visit_type_int32(v, name, opaque, errp);
+}
+
+static void aspeed_pwm_init(Object *obj)
+{
+    AspeedPWMState *s = ASPEED_PWM(obj);
+    unsigned int i;
+
+    for (i = 0; i < ASPEED_PWM_NR_CHANNELS; i++) {
+        object_property_add_uint32_ptr(obj, "rpm[*]", &s->rpm[i],
+                                       OBJ_PROP_FLAG_READ);
+    }
+    for (i = 0; i < ASPEED_PWM_MAX_ZONES; i++) {
+        object_property_add(obj, "temperature[*]", "int",
+                            aspeed_pwm_get_temperature, NULL, NULL,
+                            &s->temp_mc[i]);
+        object_property_add_uint32_ptr(obj, "power[*]", &s->power[i],
+                                       OBJ_PROP_FLAG_READWRITE);
+    }
+    object_property_add_uint64_ptr(obj, "plant-steps", &s->steps,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "plant-step-ns", &s->step_ns,
+                                   OBJ_PROP_FLAG_READ);
+}
+
+static int aspeed_pwm_post_load(void *opaque, int version_id)
+{
+    AspeedPWMState *s = ASPEED_PWM(opaque);
+    AspeedPWMPlant *p = &s->plant;
+    unsigned int i;
+
+    for (i = 0; i < p->nr_fans; i++) {
+        p->rpm[i] = s->rpm[i];
+        p->speed[i] = p->rpm[i] / p->max_rpm[i];
+    }
+    for (i = 0; i < p->nr_zones; i++) {
+        p->temp[i] = s->temp_mc[i] / 1000.0f;
+    }
+    aspeed_pwm_update_duty(s);
+    return 0;
+}
+
+static const VMStateDescription vmstate_aspeed_pwm = {
+    .name = TYPE_ASPEED_PWM,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = aspeed_pwm_post_load,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, AspeedPWMState, ASPEED_PWM_NR_REGS),
+        VMSTATE_UINT32_ARRAY(rpm, AspeedPWMState, ASPEED_PWM_NR_CHANNELS),
+        VMSTATE_INT32_ARRAY(temp_mc, AspeedPWMState, ASPEED_PWM_MAX_ZONES),
+        VMSTATE_UINT32_ARRAY(power, AspeedPWMState, ASPEED_PWM_MAX_ZONES),
+        VMSTATE_TIMER_PTR(timer, AspeedPWMState),
+        VMSTATE_END_OF_LIST(),
+    }
+};
+
+static const Property aspeed_pwm_properties[] = {
+    DEFINE_PROP_STRING("plant", AspeedPWMState, plant_file),
+    DEFINE_PROP_UINT32("plant-period-ms", AspeedPWMState, period_ms, 100),
+    DEFINE_PROP_UINT32("clock-frequency", AspeedPWMState, clk_freq,
+                       200000000),
+};
+
+static void aspeed_pwm_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->desc = "ASPEED PWM and Fan Tach Controller";
+    dc->realize = aspeed_pwm_realize;
+    dc->unrealize = aspeed_pwm_unrealize;
+    device_class_set_legacy_reset(dc, aspeed_pwm_reset);
+    dc->vmsd = &vmstate_aspeed_pwm;
+    device_class_set_props(dc, aspeed_pwm_properties);
+}
+
+static const TypeInfo aspeed_pwm_info = {
+    .name = TYPE_ASPEED_PWM,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(AspeedPWMState),
+    .instance_init = aspeed_pwm_init,
+    .class_init = aspeed_pwm_class_init,
+};
+
+static void aspeed_pwm_register_types(void)
+{
+    type_register_static(&aspeed_pwm_info);
+}
+
+type_init(aspeed_pwm_register_types);
@@ -0,0 +1,1044 @@
+/*
+ * ASPEED Video Engine
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * The engine captures frames from a host side source, a raw XRGB8888
+ * file or shared memory framebuffer which is re-read on every capture,
+ * and compresses them to baseline JPEG in guest memory.
+ *
+ * The JPEG header tables the driver puts at VE_JPEG_ADDR are not parsed.
+ * The output is a complete JPEG with the standard tables, the
+ * quantization being scaled from the DCT quality fields of VE_COMP_CTRL.
+ * The proprietary Aspeed format is not modelled.
+ *
+ * Blocks of the source which did not change since the previous frame
+ * keep their quantized coefficients, so only the changed blocks go
+ * through color conversion and the DCT, and an unchanged frame reuses
+ * the previous bitstream.
+ */
+
+#include "qemu/osdep.h"
+#include <math.h>
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
+#include "qemu/log.h"
+#include "qemu/error-report.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "hw/misc/aspeed_video.h"
+#include "qapi/error.h"
+#include "migration/vmstate.h"
+#include "hw/qdev-properties.h"
+#include "hw/irq.h"
+#include "trace.h"
+
+#define R_PROTECTION_KEY        (0x000 / 4)
+#define  PROTECTION_KEY_UNLOCK          0x1a038aa8
+#define R_SEQ_CTRL              (0x004 / 4)
+#define  SEQ_CTRL_TRIG_MODE_DET         BIT(0)
+#define  SEQ_CTRL_TRIG_CAPTURE          BIT(1)
+#define  SEQ_CTRL_FORCE_IDLE            BIT(2)
+#define  SEQ_CTRL_TRIG_COMP             BIT(4)
+#define  SEQ_CTRL_YUV420                BIT(10)
+#define  SEQ_CTRL_CAP_BUSY              BIT(16)
+#define  SEQ_CTRL_COMP_BUSY             BIT(18)
+#define  SEQ_CTRL_BUSY                  (SEQ_CTRL_CAP_BUSY | SEQ_CTRL_COMP_BUSY)
+#define R_CTRL                  (0x008 / 4)
+#define R_CAP_WINDOW            (0x030 / 4)
+#define R_COMP_WINDOW           (0x034 / 4)
+#define R_JPEG_ADDR             (0x040 / 4)
+#define R_SRC0_ADDR             (0x044 / 4)
+#define R_SRC_SCANLINE_OFFSET   (0x048 / 4)
+#define R_SRC1_ADDR             (0x04c / 4)
+#define R_COMP_ADDR             (0x054 / 4)
+#define R_COMP_CTRL             (0x060 / 4)
+#define  COMP_CTRL_DCT_CHR_SHIFT        6
+#define  COMP_CTRL_DCT_LUM_SHIFT        11
+#define R_SRC_LR_EDGE_DET       (0x090 / 4)
+#define  SRC_LR_EDGE_DET_NO_V           BIT(12)
+#define  SRC_LR_EDGE_DET_NO_H           BIT(13)
+#define  SRC_LR_EDGE_DET_NO_DISP        BIT(14)
+#define  SRC_LR_EDGE_DET_NO_CLK         BIT(15)
+#define  SRC_LR_EDGE_DET_RT_SHIFT       16
+#define R_SRC_TB_EDGE_DET       (0x094 / 4)
+#define  SRC_TB_EDGE_DET_BOT_SHIFT      16
+#define R_MODE_DETECT_STATUS    (0x098 / 4)
+#define  MODE_DETECT_H_STABLE           BIT(13)
+#define  MODE_DETECT_V_STABLE           BIT(14)
+#define  MODE_DETECT_V_LINES_SHIFT      16
+#define  MODE_DETECT_VSYNC_RDY          BIT(30)
+#define  MODE_DETECT_HSYNC_RDY          BIT(31)
+#define R_SYNC_STATUS           (0x09c / 4)
+#define R_H_TOTAL_PIXELS        (0x0a0 / 4)
+#define R_INTERRUPT_CTRL        (0x304 / 4)
+#define R_INTERRUPT_STATUS      (0x308 / 4)
+#define  INTERRUPT_CAPTURE_COMPLETE     BIT(1)
+#define  INTERRUPT_COMP_READY           BIT(2)
+#define  INTERRUPT_COMP_COMPLETE        BIT(3)
+#define  INTERRUPT_MODE_DETECT          BIT(4)
+#define  INTERRUPT_FRAME_COMPLETE       BIT(5)
+
+#define ASPEED_VIDEO_MAX_WIDTH  4096
+#define ASPEED_VIDEO_MAX_HEIGHT 4096
+
+/* Worst case size of one entropy coded block, with byte stuffing */
+#define JPEG_BLOCK_MAX          420
+
+/* ITU T.81 Annex K tables, in natural order */
+static const uint8_t jpeg_luma_quant[64] = {
+    16,  11,  10,  16,  24,  40,  51,  61,
+    12,  12,  14,  19,  26,  58,  60,  55,
+    14,  13,  16,  24,  40,  57,  69,  56,
+    14,  17,  22,  29,  51,  87,  80,  62,
+    18,  22,  37,  56,  68, 109, 103,  77,
+    24,  35,  55,  64,  81, 104, 113,  92,
+    49,  64,  78,  87, 103, 121, 120, 101,
+    72,  92,  95,  98, 112, 100, 103,  99,
+};
+
+static const uint8_t jpeg_chroma_quant[64] = {
+    17,  18,  24,  47,  99,  99,  99,  99,
+    18,  21,  26,  66,  99,  99,  99,  99,
+    24,  26,  56,  99,  99,  99,  99,  99,
+    47,  66,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+};
+
+static const uint8_t jpeg_zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+static const uint8_t jpeg_dc_luma_bits[16] = {
+    0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const uint8_t jpeg_dc_chroma_bits[16] = {
+    0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+};
+
+static const uint8_t jpeg_dc_vals[12] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+};
+
+static const uint8_t jpeg_ac_luma_bits[16] = {
+    0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d,
+};
+
+static const uint8_t jpeg_ac_luma_vals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+    0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+    0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+    0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+    0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+    0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+    0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+    0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+    0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+static const uint8_t jpeg_ac_chroma_bits[16] = {
+    0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77,
+};
+
+static const uint8_t jpeg_ac_chroma_vals[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+    0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+    0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+    0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+    0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+    0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+    0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+    0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+    0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+typedef struct JpegHuffTable {
+    uint16_t code[256];
+    uint8_t size[256];
+} JpegHuffTable;
+
+enum {
+    JPEG_DC_LUMA,
+    JPEG_AC_LUMA,
+    JPEG_DC_CHROMA,
+    JPEG_AC_CHROMA,
+    JPEG_HUFF_NUM,
+};
+
+static JpegHuffTable jpeg_huff[JPEG_HUFF_NUM];
+
+/* DCT-II basis, jpeg_dct[u][x], and its transpose */
+static float jpeg_dct[8][8];
+static float jpeg_dct_t[8][8];
+
+static void jpeg_huff_init(JpegHuffTable *h, const uint8_t *bits,
+                           const uint8_t *vals)
+{
+    unsigned code = 0, k = 0;
+    int len, i;
+
+    for (len = 1; len <= 16; len++) {
+        for (i = 0; i < bits[len - 1]; i++, k++) {
+            h->code[vals[k]] = code++;
+            h->size[vals[k]] = len;
+        }
+        code <<= 1;
+    }
+}
+
+static void jpeg_tables_init(void)
+{
+    int u, x;
+
+    jpeg_huff_init(&jpeg_huff[JPEG_DC_LUMA], jpeg_dc_luma_bits, jpeg_dc_vals);
+    jpeg_huff_init(&jpeg_huff[JPEG_AC_LUMA], jpeg_ac_luma_bits,
+                   jpeg_ac_luma_vals);
+    jpeg_huff_init(&jpeg_huff[JPEG_DC_CHROMA], jpeg_dc_chroma_bits,
+                   jpeg_dc_vals);
+    jpeg_huff_init(&jpeg_huff[JPEG_AC_CHROMA], jpeg_ac_chroma_bits,
+                   jpeg_ac_chroma_vals);
+
+    for (u = 0; u < 8; u++) {
+        for (x = 0; x < 8; x++) {
+            float c = u ? 0.5f : 0.5f * M_SQRT1_2;
+
+            jpeg_dct[u][x] = c * cosf((2 * x + 1) * u * M_PI / 16);
+            jpeg_dct_t[x][u] = jpeg_dct[u][x];
+        }
+    }
+}
+
+/*
+ * Scale an Annex K table the way the IJG library does for a quality
+ * of 1 to 100.
+ */
+static void jpeg_quant_init(uint8_t *table, float *scale,
+                            const uint8_t *base, unsigned quality)
+{
+    unsigned factor = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    int i;
+
+    for (i = 0; i < 64; i++) {
+        unsigned q = (base[i] * factor + 50) / 100;
+
+        table[i] = MIN(MAX(q, 1), 255);
+        scale[i] = 1.0f / table[i];
+    }
+}
+
+/*
+ * Forward DCT and quantization of one 8x8 block, as two passes of
+ * multiplications by the DCT basis. All the inner loops run over 8
+ * independent outputs and the compiler turns them into vector code.
+ */
+static void jpeg_fdct_quant(const float *in, int stride, const float *scale,
+                            int16_t *out)
+{
+    float tmp[64] = { 0 };
+    float res[64] = { 0 };
+    int i, x, y, u, v;
+
+    for (y = 0; y < 8; y++) {
+        for (x = 0; x < 8; x++) {
+            float p = in[y * stride + x];
+
+            for (u = 0; u < 8; u++) {
+                tmp[y * 8 + u] += p * jpeg_dct_t[x][u];
+            }
+        }
+    }
+
+    for (v = 0; v < 8; v++) {
+        for (y = 0; y < 8; y++) {
+            float c = jpeg_dct[v][y];
+
+            for (u = 0; u < 8; u++) {
+                res[v * 8 + u] += c * tmp[y * 8 + u];
+            }
+        }
+    }
+
+    for (i = 0; i < 64; i++) {
+        float f = res[i] * scale[i];
+
+        f = f < 0 ? f - 0.5f : f + 0.5f;
+        f = MIN(MAX(f, -1023.0f), 1023.0f);
+        out[i] = (int16_t)f;
+    }
+}
+
+typedef struct JpegBits {
+    uint8_t *p;
+    uint32_t acc;
+    int n;
+} JpegBits;
+
+static inline void jpeg_put_bits(JpegBits *b, uint32_t code, int size)
+{
+    b->acc = (b->acc << size) | (code & ((1u << size) - 1));
+    b->n += size;
+    while (b->n >= 8) {
+        uint8_t c = b->acc >> (b->n - 8);
+
+        *b->p++ = c;
+        if (c == 0xff) {
+            *b->p++ = 0;
+        }
+        b->n -= 8;
+    }
+}
+
+static inline void jpeg_put_coef(JpegBits *b, const JpegHuffTable *h,
+                                 int run, int v)
+{
+    int mag = v < 0 ? -v : v;
+    int nbits = mag ? 32 - clz32(mag) : 0;
+
+    jpeg_put_bits(b, h->code[(run << 4) | nbits], h->size[(run << 4) | nbits]);
+    if (nbits) {
+        jpeg_put_bits(b, v < 0 ? v - 1 : v, nbits);
+    }
+}
+
+static void jpeg_put_block(JpegBits *b, const int16_t *coefs, int *last_dc,
+                           const JpegHuffTable *dc, const JpegHuffTable *ac)
+{
+    int run = 0;
+    int k;
+
+    jpeg_put_coef(b, dc, 0, coefs[0] - *last_dc);
+    *last_dc = coefs[0];
+
+    for (k = 1; k < 64; k++) {
+        int v = coefs[jpeg_zigzag[k]];
+
+        if (!v) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            jpeg_put_bits(b, ac->code[0xf0], ac->size[0xf0]);
+            run -= 16;
+        }
+        jpeg_put_coef(b, ac, run, v);
+        run = 0;
+    }
+    if (run) {
+        jpeg_put_bits(b, ac->code[0x00], ac->size[0x00]);
+    }
+}
+
+static uint8_t *jpeg_put_dht(uint8_t *p, uint8_t id, const uint8_t *bits,
+                             const uint8_t *vals, int nvals)
+{
+    *p++ = id;
+    memcpy(p, bits, 16);
+    memcpy(p + 16, vals, nvals);
+    return p + 16 + nvals;
+}
+
+static uint8_t *jpeg_put_headers(uint8_t *p, const uint8_t qtable[2][64],
+                                 uint32_t width, uint32_t height, bool yuv420)
+{
+    int t, k;
+
+    /* SOI */
+    *p++ = 0xff;
+    *p++ = 0xd8;
+
+    /* DQT */
+    *p++ = 0xff;
+    *p++ = 0xdb;
+    stw_be_p(p, 2 + 2 * 65);
+    p += 2;
+    for (t = 0; t < 2; t++) {
+        *p++ = t;
+        for (k = 0; k < 64; k++) {
+            *p++ = qtable[t][jpeg_zigzag[k]];
+        }
+    }
+
+    /* SOF0 */
+    *p++ = 0xff;
+    *p++ = 0xc0;
+    stw_be_p(p, 17);
+    stw_be_p(p + 3, height);
+    stw_be_p(p + 5, width);
+    p[2] = 8;
+    p[7] = 3;
+    p += 8;
+    for (k = 0; k < 3; k++) {
+        *p++ = k + 1;
+        *p++ = !k && yuv420 ? 0x22 : 0x11;
+        *p++ = !!k;
+    }
+
+    /* DHT */
+    *p++ = 0xff;
+    *p++ = 0xc4;
+    stw_be_p(p, 2 + 2 * (17 + sizeof(jpeg_dc_vals)) +
+                2 * (17 + sizeof(jpeg_ac_luma_vals)));
+    p += 2;
+    p = jpeg_put_dht(p, 0x00, jpeg_dc_luma_bits, jpeg_dc_vals,
+                     sizeof(jpeg_dc_vals));
+    p = jpeg_put_dht(p, 0x10, jpeg_ac_luma_bits, jpeg_ac_luma_vals,
+                     sizeof(jpeg_ac_luma_vals));
+    p = jpeg_put_dht(p, 0x01, jpeg_dc_chroma_bits, jpeg_dc_vals,
+                     sizeof(jpeg_dc_vals));
+    p = jpeg_put_dht(p, 0x11, jpeg_ac_chroma_bits, jpeg_ac_chroma_vals,
+                     sizeof(jpeg_ac_chroma_vals));
+
+    /* SOS */
+    *p++ = 0xff;
+    *p++ = 0xda;
+    stw_be_p(p, 12);
+    p[2] = 3;
+    p += 3;
+    for (k = 0; k < 3; k++) {
+        *p++ = k + 1;
+        *p++ = k ? 0x11 : 0x00;
+    }
+    *p++ = 0;
+    *p++ = 63;
+    *p++ = 0;
+
+    return p;
+}
+
+static void aspeed_video_update_irq(AspeedVideoState *s)
+{
+    qemu_set_irq(s->irq, !!(s->regs[R_INTERRUPT_STATUS] &
+                            s->regs[R_INTERRUPT_CTRL]));
+}
+
+static void aspeed_video_mode_detect(AspeedVideoState *s)
+{
+    if (!s->fb) {
+        s->regs[R_SRC_LR_EDGE_DET] = SRC_LR_EDGE_DET_NO_V |
+            SRC_LR_EDGE_DET_NO_H | SRC_LR_EDGE_DET_NO_DISP |
+            SRC_LR_EDGE_DET_NO_CLK;
+        s->regs[R_SRC_TB_EDGE_DET] = 0;
+        s->regs[R_MODE_DETECT_STATUS] = 0;
+        s->regs[R_SYNC_STATUS] = 0;
+        s->regs[R_H_TOTAL_PIXELS] = 0;
+        trace_aspeed_video_mode_detect(0, 0);
+        return;
+    }
+
+    s->regs[R_SRC_LR_EDGE_DET] = (s->width - 1) << SRC_LR_EDGE_DET_RT_SHIFT;
+    s->regs[R_SRC_TB_EDGE_DET] = (s->height - 1) << SRC_TB_EDGE_DET_BOT_SHIFT;
+    s->regs[R_MODE_DETECT_STATUS] = MODE_DETECT_HSYNC_RDY |
+        MODE_DETECT_VSYNC_RDY | MODE_DETECT_V_STABLE | MODE_DETECT_H_STABLE |
+        deposit32(0, MODE_DETECT_V_LINES_SHIFT, 12, s->height) |
+        extract32(s->width, 0, 12);
+    s->regs[R_SYNC_STATUS] = 0;
+    s->regs[R_H_TOTAL_PIXELS] = s->width;
+
+    s->regs[R_INTERRUPT_STATUS] |= INTERRUPT_MODE_DETECT;
+    trace_aspeed_video_mode_detect(s->width, s->height);
+}
+
+static void aspeed_video_enc_setup(AspeedVideoState *s, uint32_t width,
+                                   uint32_t height, bool yuv420)
+{
+    uint32_t ctrl = s->regs[R_COMP_CTRL];
+    unsigned lum = extract32(ctrl, COMP_CTRL_DCT_LUM_SHIFT, 4);
+    unsigned chr = extract32(ctrl, COMP_CTRL_DCT_CHR_SHIFT, 4);
+    uint32_t mode = yuv420 << 16 | lum << 8 | chr;
+    unsigned mcu = yuv420 ? 16 : 8;
+    size_t nblocks;
+
+    if (s->enc_valid && s->enc_width == width && s->enc_height == height &&
+        s->enc_mode == mode) {
+        return;
+    }
+
+    /* Quality levels 0 to 11 of the driver, mapped to 20 to 97 */
+    jpeg_quant_init(s->qtable[0], s->qscale[0], jpeg_luma_quant,
+                    20 + MIN(lum, 11) * 7);
+    jpeg_quant_init(s->qtable[1], s->qscale[1], jpeg_chroma_quant,
+                    20 + MIN(chr, 11) * 7);
+
+    nblocks = DIV_ROUND_UP(width, mcu) * DIV_ROUND_UP(height, mcu) *
+              (yuv420 ? 6 : 3);
+    s->prev = g_realloc(s->prev, (size_t)width * height * 4);
+    s->coefs = g_renew(int16_t, s->coefs, nblocks * 64);
+    s->enc_width = width;
+    s->enc_height = height;
+    s->enc_mode = mode;
+    s->enc_valid = false;
+}
+
+/*
+ * Copy the pixels of a block of the source to the previous frame and
+ * return true if they differ from it.
+ */
+static bool aspeed_video_block_changed(AspeedVideoState *s, uint32_t x0,
+                                       uint32_t y0, unsigned size)
+{
+    size_t len = MIN(size, s->enc_width - x0) * 4;
+    unsigned rows = MIN(size, s->enc_height - y0);
+    bool changed = !s->enc_valid;
+    unsigned y;
+
+    for (y = y0; y < y0 + rows; y++) {
+        const uint8_t *src = s->fb + ((size_t)y * s->width + x0) * 4;
+        uint8_t *dst = s->prev + ((size_t)y * s->enc_width + x0) * 4;
+
+        if (changed || memcmp(src, dst, len)) {
+            memcpy(dst, src, len);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+/*
+ * Convert a block of the previous frame to level shifted YCbCr, the
+ * edges being replicated past the end of the frame.
+ */
+static void aspeed_video_load_block(AspeedVideoState *s, uint32_t x0,
+                                    uint32_t y0, unsigned size,
+                                    float *y, float *cb, float *cr)
+{
+    unsigned i, j;
+
+    for (j = 0; j < size; j++) {
+        uint32_t py = MIN(y0 + j, s->enc_height - 1);
+        const uint8_t *row = s->prev + (size_t)py * s->enc_width * 4;
+
+        for (i = 0; i < size; i++) {
+            const uint8_t *p = row + MIN(x0 + i, s->enc_width - 1) * 4;
+            float b = p[0], g = p[1], r = p[2];
+
+            y[j * size + i] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+            cb[j * size + i] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+            cr[j * size + i] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+        }
+    }
+}
+
+static void aspeed_video_transform(AspeedVideoState *s, uint32_t x0,
+                                   uint32_t y0, bool yuv420, int16_t *coefs)
+{
+    float y[256], cb[256], cr[256];
+    float cb2[64], cr2[64];
+    int i, j;
+
+    if (!yuv420) {
+        aspeed_video_load_block(s, x0, y0, 8, y, cb, cr);
+        jpeg_fdct_quant(y, 8, s->qscale[0], coefs);
+        jpeg_fdct_quant(cb, 8, s->qscale[1], coefs + 64);
+        jpeg_fdct_quant(cr, 8, s->qscale[1], coefs + 128);
+        return;
+    }
+
+    aspeed_video_load_block(s, x0, y0, 16, y, cb, cr);
+    for (j = 0; j < 8; j++) {
+        for (i = 0; i < 8; i++) {
+            int k = j * 32 + i * 2;
+
+            cb2[j * 8 + i] = (cb[k] + cb[k + 1] + cb[k + 16] + cb[k + 17]) *
+                             0.25f;
+            cr2[j * 8 + i] = (cr[k] + cr[k + 1] + cr[k + 16] + cr[k + 17]) *
+                             0.25f;
+        }
+    }
+    jpeg_fdct_quant(y, 16, s->qscale[0], coefs);
+    jpeg_fdct_quant(y + 8, 16, s->qscale[0], coefs + 64);
+    jpeg_fdct_quant(y + 128, 16, s->qscale[0], coefs + 128);
+    jpeg_fdct_quant(y + 136, 16, s->qscale[0], coefs + 192);
+    jpeg_fdct_quant(cb2, 8, s->qscale[1], coefs + 256);
+    jpeg_fdct_quant(cr2, 8, s->qscale[1], coefs + 320);
+}
+
+static void aspeed_video_encode(AspeedVideoState *s, uint32_t width,
+                                uint32_t height, bool yuv420,
+                                uint32_t *changed, uint32_t *total)
+{
+    unsigned mcu = yuv420 ? 16 : 8;
+    unsigned per_mcu = yuv420 ? 6 : 3;
+    uint32_t mcus_x = DIV_ROUND_UP(width, mcu);
+    uint32_t mcus_y = DIV_ROUND_UP(height, mcu);
+    int last_dc[3] = { 0 };
+    JpegBits b = { 0 };
+    uint32_t mx, my;
+    unsigned i;
+
+    aspeed_video_enc_setup(s, width, height, yuv420);
+
+    *changed = 0;
+    *total = mcus_x * mcus_y;
+    for (my = 0; my < mcus_y; my++) {
+        for (mx = 0; mx < mcus_x; mx++) {
+            int16_t *coefs = s->coefs + (my * mcus_x + mx) * per_mcu * 64;
+
+            if (aspeed_video_block_changed(s, mx * mcu, my * mcu, mcu)) {
+                aspeed_video_transform(s, mx * mcu, my * mcu, yuv420, coefs);
+                (*changed)++;
+            }
+        }
+    }
+
+    if (s->enc_valid && !*changed) {
+        return;
+    }
+    s->enc_valid = true;
+
+    /* Headers take a little more than 600 bytes */
+    s->jpeg_size = MAX(s->jpeg_size, 1024 + per_mcu * JPEG_BLOCK_MAX);
+    s->jpeg = g_realloc(s->jpeg, s->jpeg_size);
+    b.p = jpeg_put_headers(s->jpeg, s->qtable, width, height, yuv420);
+
+    for (i = 0; i < *total; i++) {
+        const int16_t *coefs = s->coefs + i * per_mcu * 64;
+        size_t len = b.p - s->jpeg;
+        unsigned k;
+
+        if (s->jpeg_size - len < per_mcu * JPEG_BLOCK_MAX + 2) {
+            s->jpeg_size *= 2;
+            s->jpeg = g_realloc(s->jpeg, s->jpeg_size);
+            b.p = s->jpeg + len;
+        }
+
+        for (k = 0; k < per_mcu - 2; k++) {
+            jpeg_put_block(&b, coefs + k * 64, &last_dc[0],
+                           &jpeg_huff[JPEG_DC_LUMA], &jpeg_huff[JPEG_AC_LUMA]);
+        }
+        jpeg_put_block(&b, coefs + k * 64, &last_dc[1],
+                       &jpeg_huff[JPEG_DC_CHROMA], &jpeg_huff[JPEG_AC_CHROMA]);
+        jpeg_put_block(&b, coefs + (k + 1) * 64, &last_dc[2],
+                       &jpeg_huff[JPEG_DC_CHROMA], &jpeg_huff[JPEG_AC_CHROMA]);
+    }
+
+    /* Pad the last byte with ones and end the image */
+    if (b.n) {
+        jpeg_put_bits(&b, 0x7f, 8 - b.n);
+    }
+    *b.p++ = 0xff;
+    *b.p++ = 0xd9;
+    s->jpeg_len = b.p - s->jpeg;
+}
+
+static void aspeed_video_compress(AspeedVideoState *s)
+{
+    AspeedVideoClass *avc = ASPEED_VIDEO_GET_CLASS(s);
+    uint32_t seq = s->regs[R_SEQ_CTRL];
+    uint32_t width = extract32(s->regs[R_COMP_WINDOW], 16, 16);
+    uint32_t height = extract32(s->regs[R_COMP_WINDOW], 0, 16);
+    uint32_t addr = s->regs[R_COMP_ADDR] & avc->dram_mask;
+    uint32_t changed, total;
+    int64_t start, ns;
+
+    s->regs[avc->comp_size_reg >> 2] = 0;
+
+    if (!s->fb) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: no video signal\n", __func__);
+        return;
+    }
+    if (!(seq & avc->jpeg_mode)) {
+        qemu_log_mask(LOG_UNIMP, "%s: Aspeed format not implemented, "
+                      "compressing to JPEG\n", __func__);
+    }
+
+    width = MIN(width, s->width);
+    height = MIN(height, s->height);
+    if (!width || !height) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: empty compression window\n",
+                      __func__);
+        return;
+    }
+
+    start = get_clock();
+    aspeed_video_encode(s, width, height, seq & SEQ_CTRL_YUV420,
+                        &changed, &total);
+    ns = get_clock() - start;
+
+    if (address_space_write(&s->dram_as, addr, MEMTXATTRS_UNSPECIFIED,
+                            s->jpeg, s->jpeg_len) != MEMTX_OK) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: failed to write frame at 0x%"
+                      PRIx32 "\n", __func__, addr);
+        return;
+    }
+
+    s->regs[avc->comp_size_reg >> 2] = s->jpeg_len;
+    s->stats.frames++;
+    s->stats.bytes += s->jpeg_len;
+    s->stats.blocks += total;
+    s->stats.changed_blocks += changed;
+    s->stats.encode_ns += ns;
+    trace_aspeed_video_frame(width, height, s->jpeg_len, changed, total, ns);
+}
+
+static void aspeed_video_bh(void *opaque)
+{
+    AspeedVideoState *s = ASPEED_VIDEO(opaque);
+    uint32_t pending = s->pending;
+
+    if (!pending) {
+        return;
+    }
+    s->pending = 0;
+
+    if (pending & SEQ_CTRL_TRIG_COMP) {
+        aspeed_video_compress(s);
+        s->regs[R_INTERRUPT_STATUS] |= INTERRUPT_COMP_READY |
+            INTERRUPT_COMP_COMPLETE;
+    }
+    if (pending & SEQ_CTRL_TRIG_CAPTURE) {
+        s->regs[R_INTERRUPT_STATUS] |= INTERRUPT_CAPTURE_COMPLETE;
+    }
+    s->regs[R_INTERRUPT_STATUS] |= INTERRUPT_FRAME_COMPLETE;
+    s->regs[R_SEQ_CTRL] &= ~SEQ_CTRL_BUSY;
+    aspeed_video_update_irq(s);
+}
+
+static uint64_t aspeed_video_read(void *opaque, hwaddr addr, unsigned int size)
+{
+    AspeedVideoState *s = ASPEED_VIDEO(opaque);
+    uint64_t val;
+
+    if (addr >= sizeof(s->regs)) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Out-of-bounds read at offset 0x%" HWADDR_PRIx "\n",
+                      __func__, addr);
+        return 0;
+    }
+
+    val = s->regs[addr >> 2];
+    trace_aspeed_video_read(addr, val);
+
+    return val;
+}
+
+static void aspeed_video_write(void *opaque, hwaddr addr, uint64_t data,
+                               unsigned int size)
+{
+    AspeedVideoState *s = ASPEED_VIDEO(opaque);
+    AspeedVideoClass *avc = ASPEED_VIDEO_GET_CLASS(s);
+    uint32_t old, rising;
+
+    if (addr >= sizeof(s->regs)) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Out-of-bounds write at offset 0x%" HWADDR_PRIx "\n",
+                      __func__, addr);
+        return;
+    }
+
+    trace_aspeed_video_write(addr, data);
+
+    if (addr == avc->comp_size_reg) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: write to read-only register 0x%"
+                      HWADDR_PRIx "\n", __func__, addr);
+        return;
+    }
+
+    addr >>= 2;
+
+    if (addr == R_PROTECTION_KEY) {
+        s->regs[addr] = data == PROTECTION_KEY_UNLOCK;
+        return;
+    }
+    if (!s->regs[R_PROTECTION_KEY]) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: engine is locked\n", __func__);
+        return;
+    }
+
+    switch (addr) {
+    case R_SEQ_CTRL:
+        old = s->regs[addr];
+        data = (data & ~SEQ_CTRL_BUSY) | (old & SEQ_CTRL_BUSY);
+        rising = data & ~old;
+
+        if (data & SEQ_CTRL_FORCE_IDLE) {
+            s->pending = 0;
+            qemu_bh_cancel(s->bh);
+            data &= ~SEQ_CTRL_BUSY;
+            rising &= ~(SEQ_CTRL_TRIG_CAPTURE | SEQ_CTRL_TRIG_COMP);
+        }
+        s->regs[addr] = data;
+
+        if (rising & SEQ_CTRL_TRIG_MODE_DET) {
+            aspeed_video_mode_detect(s);
+        }
+        rising &= SEQ_CTRL_TRIG_CAPTURE | SEQ_CTRL_TRIG_COMP;
+        if (rising) {
+            s->pending |= rising;
+            s->regs[addr] |= SEQ_CTRL_BUSY;
+            qemu_bh_schedule(s->bh);
+        }
+        break;
+    case R_INTERRUPT_STATUS:
+        s->regs[addr] &= ~data;
+        break;
+    case R_SRC_LR_EDGE_DET:
+    case R_SRC_TB_EDGE_DET:
+    case R_MODE_DETECT_STATUS:
+    case R_SYNC_STATUS:
+    case R_H_TOTAL_PIXELS:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: write to read-only register 0x%"
+                      HWADDR_PRIx "\n", __func__, addr << 2);
+        return;
+    default:
+        s->regs[addr] = data;
+        break;
+    }
+
+    aspeed_video_update_irq(s);
+}
+
+static const MemoryRegionOps aspeed_video_ops = {
+    .read = aspeed_video_read,
+    .write = aspeed_video_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+static void aspeed_video_reset(DeviceState *dev)
+{
+    AspeedVideoState *s = ASPEED_VIDEO(dev);
+
+    qemu_bh_cancel(s->bh);
+    memset(s->regs, 0, sizeof(s->regs));
+    s->pending = 0;
+    s->enc_valid = false;
+    aspeed_video_update_irq(s);
+}
+
+static void aspeed_video_realize(DeviceState *dev, Error **errp)
+{
+    AspeedVideoState *s = ASPEED_VIDEO(dev);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
+    g_autoptr(GError) gerr = NULL;
+
+    if (!s->dram_mr) {
+        error_setg(errp, TYPE_ASPEED_VIDEO ": 'dram' link not set");
+        return;
+    }
+
+    if (s->source) {
+        if (!s->width || s->width > ASPEED_VIDEO_MAX_WIDTH ||
+            !s->height || s->height > ASPEED_VIDEO_MAX_HEIGHT) {
+            error_setg(errp, TYPE_ASPEED_VIDEO ": invalid source size %ux%u",
+                       s->width, s->height);
+            return;
+        }
+
+        /*
+         * The mapping is never written, so it keeps following the file
+         * as another process updates it.
+         */
+        s->mapped = g_mapped_file_new(s->source, false, &gerr);
+        if (!s->mapped) {
+            error_setg(errp, TYPE_ASPEED_VIDEO ": failed to map '%s': %s",
+                       s->source, gerr->message);
+            return;
+        }
+        if (g_mapped_file_get_length(s->mapped) <
+            (size_t)s->width * s->height * 4) {
+            error_setg(errp, TYPE_ASPEED_VIDEO ": '%s' is smaller than "
+                       "%ux%u XRGB8888", s->source, s->width, s->height);
+            g_clear_pointer(&s->mapped, g_mapped_file_unref);
+            return;
+        }
+        s->fb = (const uint8_t *)g_mapped_file_get_contents(s->mapped);
+    }
+
+    sysbus_init_irq(sbd, &s->irq);
+
+    memory_region_init_io(&s->iomem, OBJECT(s), &aspeed_video_ops, s,
+                          TYPE_ASPEED_VIDEO, 0x1000);
+    sysbus_init_mmio(sbd, &s->iomem);
+
+    address_space_init(&s->dram_as, s->dram_mr, "dram");
+
+    s->bh = qemu_bh_new_guarded(aspeed_video_bh, s,
+                                &dev->mem_reentrancy_guard);
+}
+
+static void aspeed_video_unrealize(DeviceState *dev)
+{
+    AspeedVideoState *s = ASPEED_VIDEO(dev);
+
+    qemu_bh_delete(s->bh);
+    address_space_destroy(&s->dram_as);
+    g_clear_pointer(&s->mapped, g_mapped_file_unref);
+    s->fb = NULL;
+    g_clear_pointer(&s->prev, g_free);
+    g_clear_pointer(&s->coefs, g_free);
+    g_clear_pointer(&s->jpeg, g_free);
+}
+
+static void aspeed_video_init(Object *obj)
+{
+    AspeedVideoState *s = ASPEED_VIDEO(obj);
+
+    object_property_add_uint64_ptr(obj, "frames", &s->stats.frames,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "compressed-bytes", &s->stats.bytes,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "blocks", &s->stats.blocks,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "changed-blocks",
+                                   &s->stats.changed_blocks,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "encode-ns", &s->stats.encode_ns,
+                                   OBJ_PROP_FLAG_READ);
+}
+
+static int aspeed_video_post_load(void *opaque, int version_id)
+{
+    AspeedVideoState *s = ASPEED_VIDEO(opaque);
+
+    s->enc_valid = false;
+    if (s->pending) {
+        qemu_bh_schedule(s->bh);
+    }
+    return 0;
+}
+
+static const Property aspeed_video_properties[] = {
+    DEFINE_PROP_LINK("dram", AspeedVideoState, dram_mr,
+                     TYPE_MEMORY_REGION, MemoryRegion *),
+    DEFINE_PROP_STRING("source", AspeedVideoState, source),
+    DEFINE_PROP_UINT32("source-width", AspeedVideoState, width, 0),
+    DEFINE_PROP_UINT32("source-height", AspeedVideoState, height, 0),
+};
+
+static const VMStateDescription vmstate_aspeed_video = {
+    .name = TYPE_ASPEED_VIDEO,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = aspeed_video_post_load,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, AspeedVideoState, ASPEED_VIDEO_NR_REGS),
+        VMSTATE_UINT32(pending, AspeedVideoState),
+        VMSTATE_END_OF_LIST(),
+    }
+};
+
+static void aspeed_video_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = aspeed_video_realize;
+    dc->unrealize = aspeed_video_unrealize;
+    device_class_set_legacy_reset(dc, aspeed_video_reset);
+    device_class_set_props(dc, aspeed_video_properties);
+    dc->vmsd = &vmstate_aspeed_video;
+
+    jpeg_tables_init();
+}
+
+static const TypeInfo aspeed_video_info = {
+    .name = TYPE_ASPEED_VIDEO,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(AspeedVideoState),
+    .instance_init = aspeed_video_init,
+    .class_init = aspeed_video_class_init,
+    .class_size = sizeof(AspeedVideoClass),
+    .abstract = true,
+};
+
+static void aspeed_ast2400_video_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    AspeedVideoClass *avc = ASPEED_VIDEO_CLASS(klass);
+
+    dc->desc = "AST2400 Video Engine";
+
+    avc->dram_mask = 0x1FFFFFFF;
+    avc->jpeg_mode = BIT(8);
+    avc->comp_size_reg = 0x078;
+}
+
+static const TypeInfo aspeed_ast2400_video_info = {
+    .name = TYPE_ASPEED_AST2400_VIDEO,
+    .parent = TYPE_ASPEED_VIDEO,
+    .class_init = aspeed_ast2400_video_class_init,
+};
+
+static void aspeed_ast2500_video_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    AspeedVideoClass *avc = ASPEED_VIDEO_CLASS(klass);
+
+    dc->desc = "AST2500 Video Engine";
+
+    avc->dram_mask = 0x3FFFFFFF;
+    avc->jpeg_mode = BIT(13);
+    avc->comp_size_reg = 0x078;
+}
+
+static const TypeInfo aspeed_ast2500_video_info = {
+    .name = TYPE_ASPEED_AST2500_VIDEO,
+    .parent = TYPE_ASPEED_VIDEO,
+    .class_init = aspeed_ast2500_video_class_init,
+};
+
+static void aspeed_ast2600_video_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    AspeedVideoClass *avc = ASPEED_VIDEO_CLASS(klass);
+
+    dc->desc = "AST2600 Video Engine";
+
+    avc->dram_mask = 0x7FFFFFFF;
+    avc->jpeg_mode = BIT(13);
+    avc->comp_size_reg = 0x084;
+}
+
+static const TypeInfo aspeed_ast2600_video_info = {
+    .name = TYPE_ASPEED_AST2600_VIDEO,
+    .parent = TYPE_ASPEED_VIDEO,
+    .class_init = aspeed_ast2600_video_class_init,
+};
+
+static void aspeed_video_register_types(void)
+{
+    type_register_static(&aspeed_video_info);
+    type_register_static(&aspeed_ast2400_video_info);
+    type_register_static(&aspeed_ast2500_video_info);
+    type_register_static(&aspeed_ast2600_video_info);
+}
+
+type_init(aspeed_video_register_types);
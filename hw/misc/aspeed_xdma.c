@@ -9,9 +9,12 @@
 #include "qemu/osdep.h"
 #include "qemu/log.h"
 #include "qemu/error-report.h"
+#include "qemu/timer.h"
 #include "hw/irq.h"
 #include "hw/misc/aspeed_xdma.h"
+#include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
+#include "system/hostmem.h"
 #include "qapi/error.h"
 
 #include "trace.h"
@@ -45,6 +48,29 @@
 
 #define XDMA_MEM_SIZE              0x1000
 
+/* Commands are 4 little endian double words */
+#define XDMA_CMD_SIZE              32
+
+#define XDMA_CMD_AST2500_PITCH_BMC_SHIFT  51
+#define XDMA_CMD_AST2500_PITCH_HOST_SHIFT 35
+#define XDMA_CMD_AST2500_PITCH_LEN        12
+#define XDMA_CMD_AST2500_PITCH_UPSTREAM   BIT_ULL(31)
+#define XDMA_CMD_AST2500_PITCH_ADDR       0x3FFFFFF0
+#define XDMA_CMD_AST2500_CMD_LINE_NO_SHIFT   16
+#define XDMA_CMD_AST2500_CMD_LINE_NO_LEN     12
+#define XDMA_CMD_AST2500_CMD_LINE_SIZE_SHIFT 4
+#define XDMA_CMD_AST2500_CMD_LINE_SIZE_LEN   11
+
+#define XDMA_CMD_AST2600_PITCH_BMC_SHIFT  48
+#define XDMA_CMD_AST2600_PITCH_HOST_SHIFT 32
+#define XDMA_CMD_AST2600_PITCH_LEN        15
+#define XDMA_CMD_AST2600_PITCH_ADDR       0x7FFFFFFF
+#define XDMA_CMD_AST2600_CMD_64_EN        BIT_ULL(40)
+#define XDMA_CMD_AST2600_CMD_UPSTREAM     BIT_ULL(32)
+#define XDMA_CMD_AST2600_CMD_LINE_NO_SHIFT   16
+#define XDMA_CMD_AST2600_CMD_LINE_NO_LEN     12
+#define XDMA_CMD_AST2600_CMD_LINE_SIZE_LEN   15
+
 #define TO_REG(addr) ((addr) / sizeof(uint32_t))
 
 static uint64_t aspeed_xdma_read(void *opaque, hwaddr addr, unsigned int size)
@@ -59,6 +85,159 @@ static uint64_t aspeed_xdma_read(void *opaque, hwaddr addr, unsigned int size)
     return (uint64_t)val;
 }
 
+static void aspeed_2500_xdma_decode(const uint64_t *raw, AspeedXDMACmd *cmd)
+{
+    cmd->host_addr = raw[0];
+    cmd->bmc_addr = raw[1] & XDMA_CMD_AST2500_PITCH_ADDR;
+    cmd->host_pitch = extract64(raw[1], XDMA_CMD_AST2500_PITCH_HOST_SHIFT,
+                                XDMA_CMD_AST2500_PITCH_LEN) << 3;
+    cmd->bmc_pitch = extract64(raw[1], XDMA_CMD_AST2500_PITCH_BMC_SHIFT,
+                               XDMA_CMD_AST2500_PITCH_LEN) << 3;
+    cmd->upstream = raw[1] & XDMA_CMD_AST2500_PITCH_UPSTREAM;
+    cmd->line_no = extract64(raw[2], XDMA_CMD_AST2500_CMD_LINE_NO_SHIFT,
+                             XDMA_CMD_AST2500_CMD_LINE_NO_LEN);
+    cmd->line_size = extract64(raw[2], XDMA_CMD_AST2500_CMD_LINE_SIZE_SHIFT,
+                               XDMA_CMD_AST2500_CMD_LINE_SIZE_LEN) << 4;
+}
+
+static void aspeed_2600_xdma_decode(const uint64_t *raw, AspeedXDMACmd *cmd)
+{
+    cmd->host_addr = raw[2] & XDMA_CMD_AST2600_CMD_64_EN ? raw[0] :
+                     (uint32_t)raw[0];
+    cmd->bmc_addr = raw[1] & XDMA_CMD_AST2600_PITCH_ADDR;
+    cmd->host_pitch = extract64(raw[1], XDMA_CMD_AST2600_PITCH_HOST_SHIFT,
+                                XDMA_CMD_AST2600_PITCH_LEN);
+    cmd->bmc_pitch = extract64(raw[1], XDMA_CMD_AST2600_PITCH_BMC_SHIFT,
+                               XDMA_CMD_AST2600_PITCH_LEN);
+    cmd->upstream = raw[2] & XDMA_CMD_AST2600_CMD_UPSTREAM;
+    cmd->line_no = extract64(raw[2], XDMA_CMD_AST2600_CMD_LINE_NO_SHIFT,
+                             XDMA_CMD_AST2600_CMD_LINE_NO_LEN);
+    cmd->line_size = extract64(raw[2], 0, XDMA_CMD_AST2600_CMD_LINE_SIZE_LEN);
+}
+
+/*
+ * Copy the lines of one command between BMC DRAM and the host memory
+ * backend. The host side is accessed in place and the BMC side goes
+ * through the address space, so each line is copied once. Lines which
+ * are contiguous on both sides are copied at once.
+ */
+static void aspeed_xdma_transfer(AspeedXDMAState *xdma,
+                                 const AspeedXDMACmd *cmd)
+{
+    AspeedXDMAClass *axc = ASPEED_XDMA_GET_CLASS(xdma);
+    uint32_t lines = MAX(cmd->line_no, 1);
+    uint64_t len = cmd->line_size;
+    uint64_t total = lines * len;
+    int64_t start, ns;
+    uint32_t i;
+
+    if (!xdma->host_ptr) {
+        return;
+    }
+
+    if (lines > 1 && cmd->host_pitch == len && cmd->bmc_pitch == len) {
+        len = total;
+        lines = 1;
+    }
+
+    start = get_clock();
+    for (i = 0; i < lines; i++) {
+        uint64_t host = cmd->host_addr + (uint64_t)i * cmd->host_pitch;
+        hwaddr bmc = (cmd->bmc_addr + (hwaddr)i * cmd->bmc_pitch) &
+                     axc->dram_mask;
+        uint64_t off = host - xdma->host_base;
+        MemTxResult res;
+
+        if (host < xdma->host_base || off > xdma->host_size ||
+            len > xdma->host_size - off) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: host address 0x%" PRIx64 " out of range\n",
+                          __func__, host);
+            return;
+        }
+
+        if (cmd->upstream) {
+            res = address_space_read(&xdma->dram_as, bmc,
+                                     MEMTXATTRS_UNSPECIFIED,
+                                     xdma->host_ptr + off, len);
+        } else {
+            res = address_space_write(&xdma->dram_as, bmc,
+                                      MEMTXATTRS_UNSPECIFIED,
+                                      xdma->host_ptr + off, len);
+        }
+        if (res != MEMTX_OK) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: BMC address 0x%" HWADDR_PRIx " not accessible\n",
+                          __func__, bmc);
+            return;
+        }
+    }
+    ns = get_clock() - start;
+
+    xdma->stats.transfers++;
+    if (cmd->upstream) {
+        xdma->stats.upstream_bytes += total;
+    } else {
+        xdma->stats.downstream_bytes += total;
+    }
+    xdma->stats.transfer_ns += ns;
+    xdma->stats.max_transfer_ns = MAX(xdma->stats.max_transfer_ns, ns);
+    trace_aspeed_xdma_transfer(cmd->upstream, cmd->host_addr, cmd->bmc_addr,
+                               total, ns);
+}
+
+/*
+ * Run all the commands between the read and the write pointers and
+ * raise a single completion interrupt for the batch.
+ */
+static void aspeed_xdma_run(AspeedXDMAState *xdma)
+{
+    AspeedXDMAClass *axc = ASPEED_XDMA_GET_CLASS(xdma);
+    uint32_t *rdp = &xdma->regs[TO_REG(axc->cmdq_rdp)];
+    uint32_t wrp = xdma->regs[TO_REG(axc->cmdq_wrp)];
+    uint32_t endp = xdma->regs[TO_REG(axc->cmdq_endp)];
+    hwaddr base = xdma->regs[TO_REG(axc->cmdq_addr)] & axc->dram_mask;
+    uint32_t step = XDMA_CMD_SIZE / axc->cmdq_unit;
+    uint32_t status = 0;
+    uint32_t n;
+
+    for (n = 0; *rdp != wrp; n++) {
+        uint64_t raw[XDMA_CMD_SIZE / sizeof(uint64_t)];
+        AspeedXDMACmd cmd;
+        int i;
+
+        if (n > XDMA_BMC_CMDQ_W_MASK / step ||
+            address_space_read(&xdma->dram_as,
+                               base + (hwaddr)*rdp * axc->cmdq_unit,
+                               MEMTXATTRS_UNSPECIFIED, raw,
+                               sizeof(raw)) != MEMTX_OK) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: invalid command queue\n",
+                          __func__);
+            *rdp = wrp;
+            break;
+        }
+        for (i = 0; i < ARRAY_SIZE(raw); i++) {
+            raw[i] = le64_to_cpu(raw[i]);
+        }
+
+        axc->decode(raw, &cmd);
+        aspeed_xdma_transfer(xdma, &cmd);
+        status |= cmd.upstream ? axc->intr_us_comp : axc->intr_ds_comp;
+
+        *rdp = (*rdp + step) & XDMA_BMC_CMDQ_W_MASK;
+        if (endp && *rdp >= endp) {
+            *rdp = 0;
+        }
+    }
+
+    if (status) {
+        xdma->regs[TO_REG(axc->intr_status)] |= status;
+        if (xdma->regs[TO_REG(axc->intr_ctrl)] & status) {
+            qemu_irq_raise(xdma->irq);
+        }
+    }
+}
+
 static void aspeed_xdma_write(void *opaque, hwaddr addr, uint64_t val,
                               unsigned int size)
 {
@@ -74,26 +253,16 @@ static void aspeed_xdma_write(void *opaque, hwaddr addr, uint64_t val,
     if (addr == axc->cmdq_endp) {
         xdma->regs[TO_REG(addr)] = val32 & XDMA_BMC_CMDQ_W_MASK;
     } else if (addr == axc->cmdq_wrp) {
-        idx = TO_REG(addr);
-        xdma->regs[idx] = val32 & XDMA_BMC_CMDQ_W_MASK;
-        xdma->regs[TO_REG(axc->cmdq_rdp)] = xdma->regs[idx];
+        xdma->regs[TO_REG(addr)] = val32 & XDMA_BMC_CMDQ_W_MASK;
 
         trace_aspeed_xdma_write(addr, val);
 
-        if (xdma->bmc_cmdq_readp_set) {
-            xdma->bmc_cmdq_readp_set = 0;
-        } else {
-            xdma->regs[TO_REG(axc->intr_status)] |= axc->intr_complete;
-
-            if (xdma->regs[TO_REG(axc->intr_ctrl)] & axc->intr_complete) {
-                qemu_irq_raise(xdma->irq);
-            }
-        }
+        aspeed_xdma_run(xdma);
     } else if (addr == axc->cmdq_rdp) {
         trace_aspeed_xdma_write(addr, val);
 
         if (val32 == XDMA_BMC_CMDQ_RDP_MAGIC) {
-            xdma->bmc_cmdq_readp_set = 1;
+            xdma->regs[TO_REG(addr)] = 0;
         }
     } else if (addr == axc->intr_ctrl) {
         xdma->regs[TO_REG(addr)] = val32 & axc->intr_ctrl_mask;
@@ -122,6 +291,27 @@ static void aspeed_xdma_realize(DeviceState *dev, Error **errp)
 {
     SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
     AspeedXDMAState *xdma = ASPEED_XDMA(dev);
+    MemoryRegion *mr;
+
+    if (!xdma->dram_mr) {
+        error_setg(errp, TYPE_ASPEED_XDMA ": 'dram' link not set");
+        return;
+    }
+
+    if (xdma->host_memdev) {
+        if (host_memory_backend_is_mapped(xdma->host_memdev)) {
+            error_setg(errp, "can't use already busy memdev: %s",
+                       object_get_canonical_path_component(
+                           OBJECT(xdma->host_memdev)));
+            return;
+        }
+        mr = host_memory_backend_get_memory(xdma->host_memdev);
+        host_memory_backend_set_mapped(xdma->host_memdev, true);
+        xdma->host_ptr = memory_region_get_ram_ptr(mr);
+        xdma->host_size = memory_region_size(mr);
+    }
+
+    address_space_init(&xdma->dram_as, xdma->dram_mr, "dram");
 
     sysbus_init_irq(sbd, &xdma->irq);
     memory_region_init_io(&xdma->iomem, OBJECT(xdma), &aspeed_xdma_ops, xdma,
@@ -129,12 +319,41 @@ static void aspeed_xdma_realize(DeviceState *dev, Error **errp)
     sysbus_init_mmio(sbd, &xdma->iomem);
 }
 
+static void aspeed_xdma_unrealize(DeviceState *dev)
+{
+    AspeedXDMAState *xdma = ASPEED_XDMA(dev);
+
+    if (xdma->host_memdev) {
+        host_memory_backend_set_mapped(xdma->host_memdev, false);
+    }
+    address_space_destroy(&xdma->dram_as);
+}
+
+static void aspeed_xdma_init(Object *obj)
+{
+    AspeedXDMAState *xdma = ASPEED_XDMA(obj);
+
+    object_property_add_uint64_ptr(obj, "transfers", &xdma->stats.transfers,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "upstream-bytes",
+                                   &xdma->stats.upstream_bytes,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "downstream-bytes",
+                                   &xdma->stats.downstream_bytes,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "transfer-ns",
+                                   &xdma->stats.transfer_ns,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "max-transfer-ns",
+                                   &xdma->stats.max_transfer_ns,
+                                   OBJ_PROP_FLAG_READ);
+}
+
 static void aspeed_xdma_reset(DeviceState *dev)
 {
     AspeedXDMAState *xdma = ASPEED_XDMA(dev);
     AspeedXDMAClass *axc = ASPEED_XDMA_GET_CLASS(xdma);
 
-    xdma->bmc_cmdq_readp_set = 0;
     memset(xdma->regs, 0, ASPEED_XDMA_REG_SIZE);
     xdma->regs[TO_REG(axc->intr_status)] = XDMA_IRQ_ENG_STAT_RESET;
 
@@ -150,6 +369,14 @@ static const VMStateDescription aspeed_xdma_vmstate = {
     },
 };
 
+static const Property aspeed_xdma_properties[] = {
+    DEFINE_PROP_LINK("dram", AspeedXDMAState, dram_mr,
+                     TYPE_MEMORY_REGION, MemoryRegion *),
+    DEFINE_PROP_LINK("host-memdev", AspeedXDMAState, host_memdev,
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_UINT64("host-base", AspeedXDMAState, host_base, 0),
+};
+
 static void aspeed_2600_xdma_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -157,6 +384,9 @@ static void aspeed_2600_xdma_class_init(ObjectClass *klass, void *data)
 
     dc->desc = "ASPEED 2600 XDMA Controller";
 
+    axc->dram_mask = 0x7FFFFFFF;
+    axc->cmdq_addr = XDMA_AST2600_BMC_CMDQ_ADDR;
+    axc->cmdq_unit = 16;
     axc->cmdq_endp = XDMA_AST2600_BMC_CMDQ_ENDP;
     axc->cmdq_wrp = XDMA_AST2600_BMC_CMDQ_WRP;
     axc->cmdq_rdp = XDMA_AST2600_BMC_CMDQ_RDP;
@@ -165,6 +395,9 @@ static void aspeed_2600_xdma_class_init(ObjectClass *klass, void *data)
     axc->intr_status = XDMA_AST2600_IRQ_STATUS;
     axc->intr_complete = XDMA_AST2600_IRQ_STATUS_US_COMP |
         XDMA_AST2600_IRQ_STATUS_DS_COMP;
+    axc->intr_us_comp = XDMA_AST2600_IRQ_STATUS_US_COMP;
+    axc->intr_ds_comp = XDMA_AST2600_IRQ_STATUS_DS_COMP;
+    axc->decode = aspeed_2600_xdma_decode;
 }
 
 static const TypeInfo aspeed_2600_xdma_info = {
@@ -180,6 +413,9 @@ static void aspeed_2500_xdma_class_init(ObjectClass *klass, void *data)
 
     dc->desc = "ASPEED 2500 XDMA Controller";
 
+    axc->dram_mask = 0x3FFFFFFF;
+    axc->cmdq_addr = XDMA_BMC_CMDQ_ADDR;
+    axc->cmdq_unit = 8;
     axc->cmdq_endp = XDMA_BMC_CMDQ_ENDP;
     axc->cmdq_wrp = XDMA_BMC_CMDQ_WRP;
     axc->cmdq_rdp = XDMA_BMC_CMDQ_RDP;
@@ -187,6 +423,9 @@ static void aspeed_2500_xdma_class_init(ObjectClass *klass, void *data)
     axc->intr_ctrl_mask = XDMA_IRQ_ENG_CTRL_W_MASK;
     axc->intr_status = XDMA_IRQ_ENG_STAT;
     axc->intr_complete = XDMA_IRQ_ENG_STAT_US_COMP | XDMA_IRQ_ENG_STAT_DS_COMP;
+    axc->intr_us_comp = XDMA_IRQ_ENG_STAT_US_COMP;
+    axc->intr_ds_comp = XDMA_IRQ_ENG_STAT_DS_COMP;
+    axc->decode = aspeed_2500_xdma_decode;
 };
 
 static const TypeInfo aspeed_2500_xdma_info = {
@@ -202,6 +441,9 @@ static void aspeed_2400_xdma_class_init(ObjectClass *klass, void *data)
 
     dc->desc = "ASPEED 2400 XDMA Controller";
 
+    axc->dram_mask = 0x1FFFFFFF;
+    axc->cmdq_addr = XDMA_BMC_CMDQ_ADDR;
+    axc->cmdq_unit = 8;
     axc->cmdq_endp = XDMA_BMC_CMDQ_ENDP;
     axc->cmdq_wrp = XDMA_BMC_CMDQ_WRP;
     axc->cmdq_rdp = XDMA_BMC_CMDQ_RDP;
@@ -209,6 +451,9 @@ static void aspeed_2400_xdma_class_init(ObjectClass *klass, void *data)
     axc->intr_ctrl_mask = XDMA_IRQ_ENG_CTRL_W_MASK;
     axc->intr_status = XDMA_IRQ_ENG_STAT;
     axc->intr_complete = XDMA_IRQ_ENG_STAT_US_COMP | XDMA_IRQ_ENG_STAT_DS_COMP;
+    axc->intr_us_comp = XDMA_IRQ_ENG_STAT_US_COMP;
+    axc->intr_ds_comp = XDMA_IRQ_ENG_STAT_DS_COMP;
+    axc->decode = aspeed_2500_xdma_decode;
 };
 
 static const TypeInfo aspeed_2400_xdma_info = {
@@ -222,7 +467,9 @@ static void aspeed_xdma_class_init(ObjectClass *classp, void *data)
     DeviceClass *dc = DEVICE_CLASS(classp);
 
     dc->realize = aspeed_xdma_realize;
+    dc->unrealize = aspeed_xdma_unrealize;
     device_class_set_legacy_reset(dc, aspeed_xdma_reset);
+    device_class_set_props(dc, aspeed_xdma_properties);
     dc->vmsd = &aspeed_xdma_vmstate;
 }
 
@@ -230,6 +477,7 @@ static const TypeInfo aspeed_xdma_info = {
     .name          = TYPE_ASPEED_XDMA,
     .parent        = TYPE_SYS_BUS_DEVICE,
     .instance_size = sizeof(AspeedXDMAState),
+    .instance_init = aspeed_xdma_init,
     .class_init    = aspeed_xdma_class_init,
     .class_size    = sizeof(AspeedXDMAClass),
     .abstract      = true,
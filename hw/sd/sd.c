@@ -965,6 +965,7 @@ static const VMStateDescription sd_vmstate = {
     .name = "sd-card",
     .version_id = 2,
     .minimum_version_id = 2,
+    .independent = true,
     .pre_load = sd_vmstate_pre_load,
     .fields = (const VMStateField[]) {
         VMSTATE_UINT32(mode, SDState),
@@ -0,0 +1,1075 @@
+/*
+ * ASPEED USB Virtual Hub Controller
+ *
+ * The virtual hub is the device side of the BMC USB port : a hub whose
+ * downstream ports are gadgets run by the firmware, used for virtual
+ * media, keyboard and mouse, and USB networking. The upstream port is
+ * connected to a chardev on which a process plays the USB host, see
+ * include/hw/usb/aspeed_vhub.h for the protocol.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/log.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
+#include "hw/usb/aspeed_vhub.h"
+#include "migration/vmstate.h"
+#include "qapi/error.h"
+#include "trace.h"
+
+#define TO_REG(offset) ((offset) >> 2)
+
+#define VHUB_CTRL               0x00
+#define  VHUB_CTRL_FULL_SPEED_ONLY      BIT(1)
+#define  VHUB_CTRL_UPSTREAM_CONNECT     BIT(0)
+#define VHUB_CONF               0x04
+#define  VHUB_CONF_ADDR_MASK            0x7f
+#define VHUB_IER                0x08
+#define VHUB_ISR                0x0C
+#define  VHUB_IRQ_EP_POOL_ACK_STALL     BIT(16)
+#define  VHUB_IRQ_DEVICE1               BIT(9)
+#define  VHUB_IRQ_BUS_RESET             BIT(6)
+#define  VHUB_IRQ_HUB_EP1_IN_DATA_ACK   BIT(5)
+#define VHUB_EP_ACK_IER         0x10
+#define VHUB_EP_NACK_IER        0x14
+#define VHUB_EP_ACK_ISR         0x18
+#define VHUB_EP_NACK_ISR        0x1C
+#define VHUB_USBSTS             0x24
+#define  VHUB_USBSTS_HISPEED            BIT(27)
+#define VHUB_EP0_CTRL           0x30
+#define  VHUB_EP0_RX_LEN_MASK           (0x7f << 16)
+#define  VHUB_EP0_SET_RX_LEN(x)         ((x) << 16)
+#define  VHUB_EP0_TX_LEN(x)             (((x) >> 8) & 0x7f)
+#define  VHUB_EP0_RX_BUFF_RDY           BIT(2)
+#define  VHUB_EP0_TX_BUFF_RDY           BIT(1)
+#define  VHUB_EP0_CTRL_STALL            BIT(0)
+#define VHUB_EP0_DATA           0x34
+#define VHUB_EP1_CTRL           0x38
+#define  VHUB_EP1_CTRL_STALL            BIT(1)
+#define  VHUB_EP1_CTRL_ENABLE           BIT(0)
+#define VHUB_EP1_STS_CHG        0x3C
+#define VHUB_SETUP0             0x80    /* Hub, then one per device */
+
+/* EP0 events, in the hub ISR and in the device ISRs */
+#define VHUB_IRQ_EP0_IN_ACK_STALL       BIT(3)
+#define VHUB_IRQ_EP0_OUT_ACK_STALL      BIT(1)
+#define VHUB_IRQ_EP0_SETUP              BIT(0)
+
+/* Downstream devices */
+#define VHUB_DEV(i)             (0x100 + 0x10 * (i))
+#define VHUB_DEV_EN_CTRL        0x00
+#define  VHUB_DEV_EN_ADDR(x)            (((x) >> 8) & 0x7f)
+#define  VHUB_DEV_EN_IRQ(x)             (((x) >> 2) & 0x1f)
+#define  VHUB_DEV_EN_ENABLE_PORT        BIT(0)
+#define VHUB_DEV_ISR            0x04
+#define VHUB_DEV_EP0_CTRL       0x08
+#define VHUB_DEV_EP0_DATA       0x0C
+
+/* Generic endpoints */
+#define VHUB_EP(i)              (0x200 + 0x10 * (i))
+#define VHUB_EP_CONFIG          0x00
+#define  VHUB_EP_CFG_MAX_PKT(x)         (((x) >> 16) & 0x3ff)
+#define  VHUB_EP_CFG_STALL_CTRL         BIT(12)
+#define  VHUB_EP_CFG_EP_NUM(x)          (((x) >> 8) & 0xf)
+#define  VHUB_EP_CFG_DIR_OUT            BIT(6)
+#define  VHUB_EP_CFG_DEV(x)             (((x) >> 1) & 0x7)
+#define  VHUB_EP_CFG_ENABLED            BIT(0)
+#define VHUB_EP_DMA_CTLSTAT     0x04
+#define  VHUB_EP_DMA_PROC_TX_IDLE       (8 << 4)
+#define  VHUB_EP_DMA_CTRL_RESET         BIT(2)
+#define  VHUB_EP_DMA_DESC_MODE          BIT(0)
+#define VHUB_EP_DESC_BASE       0x08
+#define VHUB_EP_DESC_STATUS     0x0C
+#define  VHUB_EP_DMA_TX_SIZE_MASK       (0x7ff << 16)
+#define  VHUB_EP_DMA_TX_SIZE(x)         (((x) >> 16) & 0x7ff)
+#define  VHUB_EP_DMA_RPTR_MASK          (0xff << 8)
+#define  VHUB_EP_DMA_RPTR(x)            (((x) >> 8) & 0xff)
+#define  VHUB_EP_DMA_WPTR(x)            ((x) & 0xff)
+#define  VHUB_EP_DMA_SINGLE_KICK        BIT(0)
+
+/* Descriptors of the IN endpoints in descriptor mode */
+#define VHUB_DESC_SIZE          8
+#define VHUB_NUM_DESCS          256
+#define VHUB_DSC1_IN_INTERRUPT  BIT(31)
+#define VHUB_DSC1_IN_LEN(x)     ((x) & 0xfff)
+
+#define VHUB_EP0_MAX_PACKET     64
+
+static hwaddr aspeed_vhub_ep0_ctrl(int dev)
+{
+    return dev ? VHUB_DEV(dev - 1) + VHUB_DEV_EP0_CTRL : VHUB_EP0_CTRL;
+}
+
+static hwaddr aspeed_vhub_ep0_data(int dev)
+{
+    return dev ? VHUB_DEV(dev - 1) + VHUB_DEV_EP0_DATA : VHUB_EP0_DATA;
+}
+
+static uint32_t aspeed_vhub_isr(AspeedVHubState *s)
+{
+    AspeedVHubClass *avc = ASPEED_VHUB_GET_CLASS(s);
+    uint32_t isr = s->regs[TO_REG(VHUB_ISR)];
+    int i;
+
+    if (s->regs[TO_REG(VHUB_EP_ACK_ISR)] & s->regs[TO_REG(VHUB_EP_ACK_IER)]) {
+        isr |= VHUB_IRQ_EP_POOL_ACK_STALL;
+    }
+    for (i = 0; i < avc->num_ports; i++) {
+        uint32_t en = s->regs[TO_REG(VHUB_DEV(i) + VHUB_DEV_EN_CTRL)];
+
+        if (s->regs[TO_REG(VHUB_DEV(i) + VHUB_DEV_ISR)] & VHUB_DEV_EN_IRQ(en)) {
+            isr |= VHUB_IRQ_DEVICE1 << i;
+        }
+    }
+    return isr;
+}
+
+static void aspeed_vhub_update_irq(AspeedVHubState *s)
+{
+    qemu_set_irq(s->irq, !!(aspeed_vhub_isr(s) & s->regs[TO_REG(VHUB_IER)]));
+}
+
+static void aspeed_vhub_ep0_irq(AspeedVHubState *s, int dev, uint32_t bits)
+{
+    if (dev) {
+        s->regs[TO_REG(VHUB_DEV(dev - 1) + VHUB_DEV_ISR)] |= bits;
+    } else {
+        s->regs[TO_REG(VHUB_ISR)] |= bits;
+    }
+    aspeed_vhub_update_irq(s);
+}
+
+static void aspeed_vhub_ep_irq(AspeedVHubState *s, int i)
+{
+    s->regs[TO_REG(VHUB_EP_ACK_ISR)] |= BIT(i);
+    aspeed_vhub_update_irq(s);
+}
+
+/* Hub is 0, downstream devices 1 and up, -1 when nobody has the address */
+static int aspeed_vhub_find_dev(AspeedVHubState *s, uint8_t addr)
+{
+    AspeedVHubClass *avc = ASPEED_VHUB_GET_CLASS(s);
+    int i;
+
+    if ((s->regs[TO_REG(VHUB_CONF)] & VHUB_CONF_ADDR_MASK) == addr) {
+        return 0;
+    }
+    for (i = 0; i < avc->num_ports; i++) {
+        uint32_t en = s->regs[TO_REG(VHUB_DEV(i) + VHUB_DEV_EN_CTRL)];
+
+        if (en & VHUB_DEV_EN_ENABLE_PORT && VHUB_DEV_EN_ADDR(en) == addr) {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+static int aspeed_vhub_find_ep(AspeedVHubState *s, int dev, uint8_t ep,
+                               bool out)
+{
+    AspeedVHubClass *avc = ASPEED_VHUB_GET_CLASS(s);
+    int i;
+
+    for (i = 0; i < avc->num_eps; i++) {
+        uint32_t cfg = s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_CONFIG)];
+
+        if (cfg & VHUB_EP_CFG_ENABLED && VHUB_EP_CFG_DEV(cfg) == dev &&
+            VHUB_EP_CFG_EP_NUM(cfg) == ep &&
+            !!(cfg & VHUB_EP_CFG_DIR_OUT) == out) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static gboolean aspeed_vhub_flush(void *do_not_use, GIOCondition cond,
+                                  void *opaque)
+{
+    AspeedVHubState *s = opaque;
+    int ret;
+
+    s->tx_watch = 0;
+    if (!qemu_chr_fe_backend_connected(&s->chr)) {
+        g_byte_array_set_size(s->tx_buf, 0);
+    }
+
+    ret = qemu_chr_fe_write(&s->chr, s->tx_buf->data, s->tx_buf->len);
+    if (ret > 0) {
+        g_byte_array_remove_range(s->tx_buf, 0, ret);
+    }
+    if (s->tx_buf->len) {
+        s->tx_watch = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                            aspeed_vhub_flush, s);
+        if (!s->tx_watch) {
+            g_byte_array_set_size(s->tx_buf, 0);
+        }
+    }
+
+    /* Messages of the host were held while ours were queued */
+    if (!s->tx_buf->len && s->rx_blocked) {
+        s->rx_blocked = false;
+        qemu_chr_fe_accept_input(&s->chr);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * The chardev is written without blocking.  What it does not take now
+ * is queued, in order, and written from a watch once it can take more.
+ */
+static void aspeed_vhub_output(AspeedVHubState *s, const void *buf,
+                               uint32_t len)
+{
+    int ret = 0;
+
+    if (!s->tx_buf->len) {
+        ret = qemu_chr_fe_write(&s->chr, buf, len);
+        if (ret < 0) {
+            ret = 0;
+        }
+    }
+    if (ret < (int)len) {
+        g_byte_array_append(s->tx_buf, (const uint8_t *)buf + ret, len - ret);
+        if (!s->tx_watch) {
+            aspeed_vhub_flush(NULL, G_IO_OUT, s);
+        }
+    }
+}
+
+static void aspeed_vhub_send(AspeedVHubState *s, uint8_t type, uint8_t addr,
+                             uint8_t ep, uint32_t len)
+{
+    AspeedVHubMsg msg = {
+        .type = type,
+        .addr = addr,
+        .ep = ep,
+        .len = cpu_to_le32(len),
+    };
+
+    aspeed_vhub_output(s, &msg, sizeof(msg));
+}
+
+/*
+ * Guest buffers are handed to the chardev where they are, only what it
+ * does not take at once is copied.
+ */
+static void aspeed_vhub_send_dma(AspeedVHubState *s, uint32_t addr,
+                                 uint32_t len)
+{
+    AspeedVHubClass *avc = ASPEED_VHUB_GET_CLASS(s);
+    hwaddr offset = addr & avc->dram_mask;
+
+    while (len) {
+        static const uint8_t zero[64];
+        hwaddr plen = len;
+        void *p;
+
+        p = address_space_map(&s->dram_as, offset, &plen, false,
+                              MEMTXATTRS_UNSPECIFIED);
+        if (p) {
+            aspeed_vhub_output(s, p, plen);
+            address_space_unmap(&s->dram_as, p, plen, false, plen);
+        } else {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: invalid DMA address 0x%" HWADDR_PRIx "\n",
+                          __func__, offset);
+            /* Keep the stream in step with the announced length */
+            plen = MIN(len, sizeof(zero));
+            aspeed_vhub_output(s, zero, plen);
+        }
+        offset += plen;
+        len -= plen;
+    }
+}
+
+static void aspeed_vhub_dma_write(AspeedVHubState *s, uint32_t addr,
+                                  const uint8_t *buf, uint32_t len)
+{
+    AspeedVHubClass *avc = ASPEED_VHUB_GET_CLASS(s);
+
+    if (address_space_write(&s->dram_as, addr & avc->dram_mask,
+                            MEMTXATTRS_UNSPECIFIED, buf, len) != MEMTX_OK) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: invalid DMA address 0x%x\n",
+                      __func__, addr);
+    }
+}
+
+static void aspeed_vhub_stall(AspeedVHubState *s, AspeedVHubInReq *req,
+                              uint8_t ep)
+{
+    req->pending = false;
+    s->stats.stalls++;
+    trace_aspeed_vhub_stall(req->addr, ep);
+    aspeed_vhub_send(s, ASPEED_VHUB_MSG_STALL, req->addr, ep, 0);
+}
+
+static void aspeed_vhub_ep0_in(AspeedVHubState *s, int dev)
+{
+    AspeedVHubInReq *req = &s->ep0_in[dev];
+    uint32_t *ctrl = &s->regs[TO_REG(aspeed_vhub_ep0_ctrl(dev))];
+    uint32_t len;
+
+    if (!req->pending) {
+        return;
+    }
+    if (*ctrl & VHUB_EP0_CTRL_STALL) {
+        aspeed_vhub_stall(s, req, 0);
+        return;
+    }
+    if (!(*ctrl & VHUB_EP0_TX_BUFF_RDY)) {
+        return;
+    }
+
+    len = MIN(VHUB_EP0_TX_LEN(*ctrl), req->len);
+    req->pending = false;
+    aspeed_vhub_send(s, ASPEED_VHUB_MSG_DATA, req->addr, 0, len);
+    aspeed_vhub_send_dma(s, s->regs[TO_REG(aspeed_vhub_ep0_data(dev))], len);
+
+    *ctrl &= ~VHUB_EP0_TX_BUFF_RDY;
+    aspeed_vhub_ep0_irq(s, dev, VHUB_IRQ_EP0_IN_ACK_STALL);
+}
+
+/* Port status changes of the hub, one bit per port after the hub's */
+static void aspeed_vhub_ep1_in(AspeedVHubState *s)
+{
+    AspeedVHubInReq *req = &s->ep1_in;
+    uint32_t ctrl = s->regs[TO_REG(VHUB_EP1_CTRL)];
+    uint8_t bitmap = s->regs[TO_REG(VHUB_EP1_STS_CHG)];
+    uint32_t len = MIN(req->len, sizeof(bitmap));
+
+    if (!req->pending) {
+        return;
+    }
+    if (ctrl & VHUB_EP1_CTRL_STALL) {
+        aspeed_vhub_stall(s, req, 1);
+        return;
+    }
+    if (!(ctrl & VHUB_EP1_CTRL_ENABLE) || !s->ep1_ready) {
+        return;
+    }
+
+    req->pending = false;
+    s->ep1_ready = false;
+    aspeed_vhub_send(s, ASPEED_VHUB_MSG_DATA, req->addr, 1, len);
+    aspeed_vhub_output(s, &bitmap, len);
+
+    s->regs[TO_REG(VHUB_ISR)] |= VHUB_IRQ_HUB_EP1_IN_DATA_ACK;
+    aspeed_vhub_update_irq(s);
+}
+
+/*
+ * Answer an IN with all the packets ready on the endpoint, up to the
+ * length asked by the host and to the first short packet. In
+ * descriptor mode that can be many descriptors in one go.
+ */
+static void aspeed_vhub_epn_in(AspeedVHubState *s, int i)
+{
+    AspeedVHubClass *avc = ASPEED_VHUB_GET_CLASS(s);
+    AspeedVHubInReq *req = &s->ep_in[i];
+    uint32_t cfg = s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_CONFIG)];
+    uint32_t ctl = s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_DMA_CTLSTAT)];
+    uint32_t base = s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_DESC_BASE)];
+    uint32_t *stat = &s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_DESC_STATUS)];
+    uint32_t max_pkt = VHUB_EP_CFG_MAX_PKT(cfg) ?: 1024;
+    struct {
+        uint32_t addr;
+        uint32_t len;
+    } seg[VHUB_NUM_DESCS];
+    uint32_t total = 0, len, chunk;
+    int n = 0, j;
+    bool irq = false;
+
+    if (!req->pending) {
+        return;
+    }
+    if (cfg & VHUB_EP_CFG_STALL_CTRL) {
+        aspeed_vhub_stall(s, req, VHUB_EP_CFG_EP_NUM(cfg));
+        return;
+    }
+
+    if (ctl & VHUB_EP_DMA_DESC_MODE) {
+        uint32_t rptr = VHUB_EP_DMA_RPTR(*stat);
+        uint32_t wptr = VHUB_EP_DMA_WPTR(*stat);
+
+        while (rptr != wptr && total < req->len) {
+            uint32_t desc[2];
+
+            if (address_space_read(&s->dram_as,
+                                   (base & avc->dram_mask) +
+                                   rptr * VHUB_DESC_SIZE,
+                                   MEMTXATTRS_UNSPECIFIED, desc,
+                                   sizeof(desc)) != MEMTX_OK) {
+                qemu_log_mask(LOG_GUEST_ERROR,
+                              "%s: invalid descriptor address 0x%x\n",
+                              __func__, base);
+                break;
+            }
+            desc[0] = le32_to_cpu(desc[0]);
+            desc[1] = le32_to_cpu(desc[1]);
+
+            len = VHUB_DSC1_IN_LEN(desc[1]);
+            chunk = MIN(len - s->ep_pos[i], req->len - total);
+            seg[n].addr = desc[0] + s->ep_pos[i];
+            seg[n++].len = chunk;
+            total += chunk;
+
+            /* The host asked for less than the descriptor holds */
+            s->ep_pos[i] += chunk;
+            if (s->ep_pos[i] < len) {
+                break;
+            }
+            s->ep_pos[i] = 0;
+            irq |= desc[1] & VHUB_DSC1_IN_INTERRUPT;
+            rptr = (rptr + 1) % VHUB_NUM_DESCS;
+            if (len % max_pkt || !len) {
+                break;
+            }
+        }
+        if (!n) {
+            return;
+        }
+        *stat = (*stat & ~VHUB_EP_DMA_RPTR_MASK) | rptr << 8;
+    } else {
+        if (!(*stat & VHUB_EP_DMA_SINGLE_KICK)) {
+            return;
+        }
+        len = VHUB_EP_DMA_TX_SIZE(*stat);
+        chunk = MIN(len - s->ep_pos[i], req->len);
+        seg[n].addr = base + s->ep_pos[i];
+        seg[n++].len = chunk;
+        total = chunk;
+
+        s->ep_pos[i] += chunk;
+        if (s->ep_pos[i] >= len) {
+            s->ep_pos[i] = 0;
+            *stat &= ~VHUB_EP_DMA_SINGLE_KICK;
+            irq = true;
+        }
+    }
+
+    req->pending = false;
+    trace_aspeed_vhub_in(req->addr, VHUB_EP_CFG_EP_NUM(cfg), total, n);
+    aspeed_vhub_send(s, ASPEED_VHUB_MSG_DATA, req->addr,
+                     VHUB_EP_CFG_EP_NUM(cfg), total);
+    for (j = 0; j < n; j++) {
+        aspeed_vhub_send_dma(s, seg[j].addr, seg[j].len);
+    }
+
+    s->stats.in_transfers++;
+    s->stats.in_bytes += total;
+    s->stats.max_in_batch = MAX(s->stats.max_in_batch, n);
+
+    if (irq) {
+        aspeed_vhub_ep_irq(s, i);
+    }
+}
+
+static void aspeed_vhub_host_in(AspeedVHubState *s, int dev, uint8_t ep,
+                                uint32_t len)
+{
+    AspeedVHubInReq *req;
+    AspeedVHubInReq none;
+    int i = -1;
+
+    if (dev < 0) {
+        req = &none;
+    } else if (!ep) {
+        req = &s->ep0_in[dev];
+    } else if (!dev && ep == 1) {
+        req = &s->ep1_in;
+    } else {
+        i = aspeed_vhub_find_ep(s, dev, ep, false);
+        req = i < 0 ? &none : &s->ep_in[i];
+    }
+
+    req->pending = true;
+    req->addr = s->msg.addr;
+    req->len = len;
+
+    if (req == &none) {
+        aspeed_vhub_stall(s, req, ep);
+    } else if (!ep) {
+        aspeed_vhub_ep0_in(s, dev);
+    } else if (i < 0) {
+        aspeed_vhub_ep1_in(s);
+    } else {
+        aspeed_vhub_epn_in(s, i);
+    }
+}
+
+static void aspeed_vhub_setup(AspeedVHubState *s, int dev)
+{
+    hwaddr reg = VHUB_SETUP0 + 8 * dev;
+    uint32_t *ctrl = &s->regs[TO_REG(aspeed_vhub_ep0_ctrl(dev))];
+
+    s->regs[TO_REG(reg)] = ldl_le_p(s->setup);
+    s->regs[TO_REG(reg + 4)] = ldl_le_p(s->setup + 4);
+    trace_aspeed_vhub_setup(dev, s->regs[TO_REG(reg)],
+                            s->regs[TO_REG(reg + 4)]);
+
+    /* A SETUP ends the previous control transfer, stalled or not */
+    *ctrl &= ~(VHUB_EP0_CTRL_STALL | VHUB_EP0_TX_BUFF_RDY |
+               VHUB_EP0_RX_BUFF_RDY);
+    s->ep0_in[dev].pending = false;
+    s->ep0_out_pos[dev] = 0;
+    s->stats.setups++;
+
+    aspeed_vhub_ep0_irq(s, dev, VHUB_IRQ_EP0_SETUP);
+}
+
+static uint32_t aspeed_vhub_msg_payload(AspeedVHubState *s)
+{
+    return s->msg.type == ASPEED_VHUB_MSG_IN ? 0 : le32_to_cpu(s->msg.len);
+}
+
+/*
+ * Whether the endpoint of the current OUT has a buffer armed. A stalled
+ * endpoint drops the message, which is then answered with a STALL.
+ */
+static bool aspeed_vhub_out_armed(AspeedVHubState *s)
+{
+    int dev = s->msg_dev;
+    int i = s->msg_ep;
+    bool stall, armed;
+
+    if (i < 0) {
+        uint32_t ctrl = s->regs[TO_REG(aspeed_vhub_ep0_ctrl(dev))];
+
+        stall = ctrl & VHUB_EP0_CTRL_STALL;
+        armed = ctrl & VHUB_EP0_RX_BUFF_RDY;
+    } else {
+        uint32_t ctl = s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_DMA_CTLSTAT)];
+
+        stall = s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_CONFIG)] &
+            VHUB_EP_CFG_STALL_CTRL;
+        armed = s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_DESC_STATUS)] &
+            VHUB_EP_DMA_SINGLE_KICK && !(ctl & VHUB_EP_DMA_DESC_MODE);
+    }
+
+    if (stall) {
+        s->msg_dev = -1;
+        return false;
+    }
+    return armed;
+}
+
+/*
+ * Payload bytes the target of the current message can take now. OUT
+ * data is only read from the chardev once the firmware armed a buffer,
+ * and goes to guest memory straight from the chardev buffer.
+ */
+static uint32_t aspeed_vhub_msg_room(AspeedVHubState *s)
+{
+    uint32_t left = aspeed_vhub_msg_payload(s) - s->msg_pos;
+    int i = s->msg_ep;
+    uint32_t stat;
+
+    if (s->msg.type != ASPEED_VHUB_MSG_OUT || s->msg_dev < 0) {
+        return left;
+    }
+    if (!aspeed_vhub_out_armed(s)) {
+        return s->msg_dev < 0 ? left : 0;
+    }
+
+    if (i < 0) {
+        return MIN(left, VHUB_EP0_MAX_PACKET - s->ep0_out_pos[s->msg_dev]);
+    }
+    stat = s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_DESC_STATUS)];
+    return MIN(left, VHUB_EP_DMA_TX_SIZE(stat) - s->ep_pos[i]);
+}
+
+static void aspeed_vhub_ep0_out_done(AspeedVHubState *s, int dev)
+{
+    uint32_t *ctrl = &s->regs[TO_REG(aspeed_vhub_ep0_ctrl(dev))];
+
+    *ctrl = (*ctrl & ~(VHUB_EP0_RX_BUFF_RDY | VHUB_EP0_RX_LEN_MASK)) |
+        VHUB_EP0_SET_RX_LEN(s->ep0_out_pos[dev]);
+    s->ep0_out_pos[dev] = 0;
+    aspeed_vhub_ep0_irq(s, dev, VHUB_IRQ_EP0_OUT_ACK_STALL);
+}
+
+static void aspeed_vhub_epn_out_done(AspeedVHubState *s, int i)
+{
+    uint32_t *stat = &s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_DESC_STATUS)];
+
+    *stat = (*stat & ~(VHUB_EP_DMA_TX_SIZE_MASK | VHUB_EP_DMA_SINGLE_KICK)) |
+        s->ep_pos[i] << 16;
+    s->stats.out_transfers++;
+    s->stats.out_bytes += s->ep_pos[i];
+    s->ep_pos[i] = 0;
+    aspeed_vhub_ep_irq(s, i);
+}
+
+static void aspeed_vhub_msg_data(AspeedVHubState *s, const uint8_t *buf,
+                                 uint32_t len)
+{
+    int dev = s->msg_dev;
+    int i = s->msg_ep;
+    uint32_t addr;
+
+    if (s->msg.type == ASPEED_VHUB_MSG_SETUP && dev >= 0) {
+        memcpy(s->setup + s->msg_pos, buf, len);
+    } else if (s->msg.type == ASPEED_VHUB_MSG_OUT && dev >= 0 && i < 0) {
+        addr = s->regs[TO_REG(aspeed_vhub_ep0_data(dev))];
+        aspeed_vhub_dma_write(s, addr + s->ep0_out_pos[dev], buf, len);
+        s->ep0_out_pos[dev] += len;
+        if (s->ep0_out_pos[dev] == VHUB_EP0_MAX_PACKET) {
+            aspeed_vhub_ep0_out_done(s, dev);
+        }
+    } else if (s->msg.type == ASPEED_VHUB_MSG_OUT && dev >= 0) {
+        uint32_t stat = s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_DESC_STATUS)];
+
+        addr = s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_DESC_BASE)];
+        aspeed_vhub_dma_write(s, addr + s->ep_pos[i], buf, len);
+        s->ep_pos[i] += len;
+        if (s->ep_pos[i] == VHUB_EP_DMA_TX_SIZE(stat)) {
+            aspeed_vhub_epn_out_done(s, i);
+        }
+    }
+    s->msg_pos += len;
+}
+
+/*
+ * The last buffer of an OUT is completed when the payload ends short
+ * of filling it. A zero length OUT waits for a buffer like any other.
+ */
+static bool aspeed_vhub_out_done(AspeedVHubState *s)
+{
+    int dev = s->msg_dev;
+    int i = s->msg_ep;
+    uint32_t pos;
+
+    if (dev < 0) {
+        return true;
+    }
+    pos = i < 0 ? s->ep0_out_pos[dev] : s->ep_pos[i];
+    if (!pos && aspeed_vhub_msg_payload(s)) {
+        return true;
+    }
+    if (!aspeed_vhub_out_armed(s)) {
+        return s->msg_dev < 0;
+    }
+
+    if (i < 0) {
+        aspeed_vhub_ep0_out_done(s, dev);
+    } else {
+        aspeed_vhub_epn_out_done(s, i);
+    }
+    return true;
+}
+
+static void aspeed_vhub_msg_finish(AspeedVHubState *s)
+{
+    uint8_t type = s->msg.type;
+
+    if (s->msg_hdr < sizeof(s->msg) ||
+        s->msg_pos < aspeed_vhub_msg_payload(s)) {
+        return;
+    }
+
+    if (type == ASPEED_VHUB_MSG_SETUP || type == ASPEED_VHUB_MSG_OUT) {
+        if (type == ASPEED_VHUB_MSG_OUT && !aspeed_vhub_out_done(s)) {
+            return;
+        }
+        if (s->msg_dev < 0) {
+            s->stats.stalls++;
+            trace_aspeed_vhub_stall(s->msg.addr, s->msg.ep);
+            aspeed_vhub_send(s, ASPEED_VHUB_MSG_STALL, s->msg.addr,
+                             s->msg.ep, 0);
+        } else {
+            if (type == ASPEED_VHUB_MSG_SETUP) {
+                aspeed_vhub_setup(s, s->msg_dev);
+            } else {
+                trace_aspeed_vhub_out(s->msg.addr, s->msg.ep,
+                                      le32_to_cpu(s->msg.len));
+            }
+            aspeed_vhub_send(s, ASPEED_VHUB_MSG_ACK, s->msg.addr,
+                             s->msg.ep, 0);
+        }
+    }
+
+    s->msg_hdr = 0;
+    s->msg_pos = 0;
+}
+
+static void aspeed_vhub_drop_requests(AspeedVHubState *s)
+{
+    memset(s->ep0_in, 0, sizeof(s->ep0_in));
+    memset(s->ep0_out_pos, 0, sizeof(s->ep0_out_pos));
+    memset(&s->ep1_in, 0, sizeof(s->ep1_in));
+    memset(s->ep_in, 0, sizeof(s->ep_in));
+}
+
+static void aspeed_vhub_msg_start(AspeedVHubState *s)
+{
+    int dev = aspeed_vhub_find_dev(s, s->msg.addr);
+
+    s->msg_dev = dev;
+    s->msg_ep = -1;
+    s->msg_pos = 0;
+
+    switch (s->msg.type) {
+    case ASPEED_VHUB_MSG_RESET:
+        aspeed_vhub_drop_requests(s);
+        s->regs[TO_REG(VHUB_ISR)] |= VHUB_IRQ_BUS_RESET;
+        aspeed_vhub_update_irq(s);
+        break;
+    case ASPEED_VHUB_MSG_SETUP:
+        if (le32_to_cpu(s->msg.len) != sizeof(s->setup) || s->msg.ep) {
+            s->msg_dev = -1;
+        }
+        break;
+    case ASPEED_VHUB_MSG_OUT:
+        if (dev >= 0 && s->msg.ep) {
+            s->msg_ep = aspeed_vhub_find_ep(s, dev, s->msg.ep, true);
+            if (s->msg_ep < 0) {
+                s->msg_dev = -1;
+            }
+        }
+        break;
+    case ASPEED_VHUB_MSG_IN:
+        aspeed_vhub_host_in(s, dev, s->msg.ep, le32_to_cpu(s->msg.len));
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: unknown message type %d\n",
+                      __func__, s->msg.type);
+        s->msg_dev = -1;
+        break;
+    }
+}
+
+static int aspeed_vhub_can_receive(void *opaque)
+{
+    AspeedVHubState *s = opaque;
+    uint32_t room;
+
+    /* Answers are not queued up behind a host that does not read them */
+    if (s->tx_buf->len) {
+        s->rx_blocked = true;
+        return 0;
+    }
+
+    if (s->msg_hdr < sizeof(s->msg)) {
+        return sizeof(s->msg) - s->msg_hdr;
+    }
+
+    room = aspeed_vhub_msg_room(s);
+    s->rx_blocked = !room;
+    return room;
+}
+
+static void aspeed_vhub_receive(void *opaque, const uint8_t *buf, int size)
+{
+    AspeedVHubState *s = opaque;
+    uint32_t n;
+
+    while (size > 0) {
+        if (s->msg_hdr < sizeof(s->msg)) {
+            n = MIN(size, sizeof(s->msg) - s->msg_hdr);
+            memcpy((uint8_t *)&s->msg + s->msg_hdr, buf, n);
+            s->msg_hdr += n;
+            if (s->msg_hdr == sizeof(s->msg)) {
+                aspeed_vhub_msg_start(s);
+            }
+        } else {
+            n = MIN(size, aspeed_vhub_msg_room(s));
+            if (!n) {
+                break;
+            }
+            aspeed_vhub_msg_data(s, buf, n);
+        }
+        buf += n;
+        size -= n;
+        aspeed_vhub_msg_finish(s);
+    }
+}
+
+static void aspeed_vhub_event(void *opaque, QEMUChrEvent event)
+{
+    AspeedVHubState *s = opaque;
+
+    switch (event) {
+    case CHR_EVENT_OPENED:
+        s->msg_hdr = 0;
+        s->msg_pos = 0;
+        if (s->regs[TO_REG(VHUB_CTRL)] & VHUB_CTRL_UPSTREAM_CONNECT) {
+            aspeed_vhub_send(s, ASPEED_VHUB_MSG_CONNECT, 0, 0, 1);
+        }
+        break;
+
+    case CHR_EVENT_CLOSED:
+        s->msg_hdr = 0;
+        s->msg_pos = 0;
+        g_byte_array_set_size(s->tx_buf, 0);
+        aspeed_vhub_drop_requests(s);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Make progress on whatever the firmware just made possible */
+static void aspeed_vhub_kick(AspeedVHubState *s)
+{
+    AspeedVHubClass *avc = ASPEED_VHUB_GET_CLASS(s);
+    int i;
+
+    for (i = 0; i <= avc->num_ports; i++) {
+        aspeed_vhub_ep0_in(s, i);
+    }
+    aspeed_vhub_ep1_in(s);
+    for (i = 0; i < avc->num_eps; i++) {
+        aspeed_vhub_epn_in(s, i);
+    }
+    aspeed_vhub_msg_finish(s);
+    aspeed_vhub_update_irq(s);
+
+    if (s->rx_blocked && aspeed_vhub_msg_room(s)) {
+        s->rx_blocked = false;
+        qemu_chr_fe_accept_input(&s->chr);
+    }
+}
+
+static bool aspeed_vhub_is_ep_reg(AspeedVHubState *s, hwaddr addr,
+                                  hwaddr reg)
+{
+    AspeedVHubClass *avc = ASPEED_VHUB_GET_CLASS(s);
+
+    return addr >= VHUB_EP(0) && addr < VHUB_EP(avc->num_eps) &&
+        (addr & 0xf) == reg;
+}
+
+static uint64_t aspeed_vhub_read(void *opaque, hwaddr addr, unsigned int size)
+{
+    AspeedVHubState *s = ASPEED_VHUB(opaque);
+    uint32_t val;
+
+    switch (addr) {
+    case VHUB_ISR:
+        val = aspeed_vhub_isr(s);
+        break;
+    case VHUB_USBSTS:
+        val = s->regs[TO_REG(VHUB_CTRL)] & VHUB_CTRL_FULL_SPEED_ONLY ?
+            0 : VHUB_USBSTS_HISPEED;
+        break;
+    default:
+        val = s->regs[TO_REG(addr)];
+        /* The engines are idle between two tokens of the host */
+        if (aspeed_vhub_is_ep_reg(s, addr, VHUB_EP_DMA_CTLSTAT) &&
+            !(s->regs[TO_REG(addr - VHUB_EP_DMA_CTLSTAT + VHUB_EP_CONFIG)] &
+              VHUB_EP_CFG_DIR_OUT)) {
+            val |= VHUB_EP_DMA_PROC_TX_IDLE;
+        }
+        break;
+    }
+
+    trace_aspeed_vhub_read(addr, val);
+    return val;
+}
+
+static void aspeed_vhub_write(void *opaque, hwaddr addr, uint64_t data,
+                              unsigned int size)
+{
+    AspeedVHubState *s = ASPEED_VHUB(opaque);
+    AspeedVHubClass *avc = ASPEED_VHUB_GET_CLASS(s);
+    uint32_t old = s->regs[TO_REG(addr)];
+    int i;
+
+    trace_aspeed_vhub_write(addr, data);
+
+    switch (addr) {
+    case VHUB_CTRL:
+        s->regs[TO_REG(addr)] = data;
+        if ((old ^ data) & VHUB_CTRL_UPSTREAM_CONNECT) {
+            if (!(data & VHUB_CTRL_UPSTREAM_CONNECT)) {
+                aspeed_vhub_drop_requests(s);
+            }
+            aspeed_vhub_send(s, ASPEED_VHUB_MSG_CONNECT, 0, 0,
+                             !!(data & VHUB_CTRL_UPSTREAM_CONNECT));
+        }
+        break;
+    case VHUB_ISR:
+    case VHUB_EP_ACK_ISR:
+    case VHUB_EP_NACK_ISR:
+        s->regs[TO_REG(addr)] &= ~data;
+        break;
+    case VHUB_USBSTS:
+        break;
+    case VHUB_EP1_STS_CHG:
+        s->regs[TO_REG(addr)] = data;
+        s->ep1_ready = true;
+        break;
+    default:
+        if (addr >= VHUB_DEV(0) && addr < VHUB_DEV(avc->num_ports) &&
+            (addr & 0xf) == VHUB_DEV_ISR) {
+            s->regs[TO_REG(addr)] &= ~data;
+        } else if (aspeed_vhub_is_ep_reg(s, addr, VHUB_EP_DMA_CTLSTAT)) {
+            i = (addr - VHUB_EP(0)) / 0x10;
+            s->regs[TO_REG(addr)] = data & ~VHUB_EP_DMA_CTRL_RESET;
+            if (data & VHUB_EP_DMA_CTRL_RESET) {
+                s->regs[TO_REG(VHUB_EP(i) + VHUB_EP_DESC_STATUS)] = 0;
+                s->ep_pos[i] = 0;
+            }
+        } else if (aspeed_vhub_is_ep_reg(s, addr, VHUB_EP_DESC_STATUS) &&
+                   s->regs[TO_REG(addr - VHUB_EP_DESC_STATUS +
+                                  VHUB_EP_DMA_CTLSTAT)] &
+                   VHUB_EP_DMA_DESC_MODE) {
+            /* The read pointer belongs to the engine */
+            s->regs[TO_REG(addr)] = (old & VHUB_EP_DMA_RPTR_MASK) |
+                (data & ~VHUB_EP_DMA_RPTR_MASK);
+        } else {
+            s->regs[TO_REG(addr)] = data;
+        }
+        break;
+    }
+
+    aspeed_vhub_kick(s);
+}
+
+static const MemoryRegionOps aspeed_vhub_ops = {
+    .read = aspeed_vhub_read,
+    .write = aspeed_vhub_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void aspeed_vhub_realize(DeviceState *dev, Error **errp)
+{
+    SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
+    AspeedVHubState *s = ASPEED_VHUB(dev);
+
+    if (!s->dram_mr) {
+        error_setg(errp, TYPE_ASPEED_VHUB ": 'dram' link not set");
+        return;
+    }
+
+    address_space_init(&s->dram_as, s->dram_mr, "dram");
+
+    sysbus_init_irq(sbd, &s->irq);
+    memory_region_init_io(&s->iomem, OBJECT(s), &aspeed_vhub_ops, s,
+                          TYPE_ASPEED_VHUB, ASPEED_VHUB_REG_SIZE);
+    sysbus_init_mmio(sbd, &s->iomem);
+
+    s->tx_buf = g_byte_array_new();
+    qemu_chr_fe_set_handlers(&s->chr, aspeed_vhub_can_receive,
+                             aspeed_vhub_receive, aspeed_vhub_event,
+                             NULL, s, NULL, true);
+}
+
+static void aspeed_vhub_unrealize(DeviceState *dev)
+{
+    AspeedVHubState *s = ASPEED_VHUB(dev);
+
+    qemu_chr_fe_deinit(&s->chr, false);
+    if (s->tx_watch) {
+        g_source_remove(s->tx_watch);
+    }
+    g_byte_array_unref(s->tx_buf);
+    address_space_destroy(&s->dram_as);
+}
+
+static void aspeed_vhub_init(Object *obj)
+{
+    AspeedVHubState *s = ASPEED_VHUB(obj);
+
+    object_property_add_uint64_ptr(obj, "setups", &s->stats.setups,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "stalls", &s->stats.stalls,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "in-transfers",
+                                   &s->stats.in_transfers,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "in-bytes", &s->stats.in_bytes,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "out-transfers",
+                                   &s->stats.out_transfers,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "out-bytes", &s->stats.out_bytes,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "max-in-batch",
+                                   &s->stats.max_in_batch,
+                                   OBJ_PROP_FLAG_READ);
+}
+
+static void aspeed_vhub_reset(DeviceState *dev)
+{
+    AspeedVHubState *s = ASPEED_VHUB(dev);
+
+    memset(s->regs, 0, sizeof(s->regs));
+    memset(s->ep_pos, 0, sizeof(s->ep_pos));
+    aspeed_vhub_drop_requests(s);
+    s->ep1_ready = false;
+
+    qemu_irq_lower(s->irq);
+}
+
+/* Tokens of the host in flight are not migrated, the host retries them */
+static const VMStateDescription aspeed_vhub_vmstate = {
+    .name = TYPE_ASPEED_VHUB,
+    .version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, AspeedVHubState, ASPEED_VHUB_NUM_REGS),
+        VMSTATE_UINT32_ARRAY(ep_pos, AspeedVHubState, ASPEED_VHUB_MAX_EPS),
+        VMSTATE_BOOL(ep1_ready, AspeedVHubState),
+        VMSTATE_END_OF_LIST(),
+    },
+};
+
+static const Property aspeed_vhub_properties[] = {
+    DEFINE_PROP_LINK("dram", AspeedVHubState, dram_mr,
+                     TYPE_MEMORY_REGION, MemoryRegion *),
+    DEFINE_PROP_CHR("chardev", AspeedVHubState, chr),
+};
+
+static void aspeed_vhub_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = aspeed_vhub_realize;
+    dc->unrealize = aspeed_vhub_unrealize;
+    device_class_set_legacy_reset(dc, aspeed_vhub_reset);
+    dc->vmsd = &aspeed_vhub_vmstate;
+    device_class_set_props(dc, aspeed_vhub_properties);
+}
+
+static const TypeInfo aspeed_vhub_info = {
+    .name = TYPE_ASPEED_VHUB,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(AspeedVHubState),
+    .instance_init = aspeed_vhub_init,
+    .class_size = sizeof(AspeedVHubClass),
+    .class_init = aspeed_vhub_class_init,
+    .abstract = true,
+};
+
+static void aspeed_2600_vhub_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    AspeedVHubClass *avc = ASPEED_VHUB_CLASS(klass);
+
+    dc->desc = "ASPEED 2600 USB Virtual Hub Controller";
+
+    avc->dram_mask = 0x7FFFFFFF;
+    avc->num_ports = 7;
+    avc->num_eps = 21;
+}
+
+static const TypeInfo aspeed_2600_vhub_info = {
+    .name = TYPE_ASPEED_2600_VHUB,
+    .parent = TYPE_ASPEED_VHUB,
+    .class_init = aspeed_2600_vhub_class_init,
+};
+
+static void aspeed_vhub_register_types(void)
+{
+    type_register_static(&aspeed_vhub_info);
+    type_register_static(&aspeed_2600_vhub_info);
+}
+
+type_init(aspeed_vhub_register_types);
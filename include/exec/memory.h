@@ -26,6 +26,7 @@
 #include "qemu/int128.h"
 #include "qemu/range.h"
 #include "qemu/notify.h"
+#include "qemu/stats64.h"
 #include "qom/object.h"
 #include "qemu/rcu.h"
 
@@ -73,7 +74,10 @@ static inline void fuzz_dma_read_cb(size_t addr,
 /* Dirty tracking enabled because dirty limit */
 #define GLOBAL_DIRTY_LIMIT      (1U << 2)
 
-#define GLOBAL_DIRTY_MASK  (0x7)
+/* Dirty tracking enabled because an in-memory checkpoint is held */
+#define GLOBAL_DIRTY_CHECKPOINT (1U << 3)
+
+#define GLOBAL_DIRTY_MASK  (0xf)
 
 extern unsigned int global_dirty_tracking;
 
@@ -1086,6 +1090,15 @@ typedef struct AddressSpaceMapClient {
 
 #define DEFAULT_MAX_BOUNCE_BUFFER_SIZE (4096)
 
+/* address_space_map() statistics, shown by "info mtree" */
+typedef struct AddressSpaceMapStats {
+    Stat64 bounce_maps;     /* bounce buffers handed out */
+    Stat64 bounce_bytes;    /* bytes covered by them */
+    Stat64 bounce_short;    /* maps shortened by max_bounce_buffer_size */
+    Stat64 bounce_failed;   /* maps refused, the limit being reached */
+    Stat64 bounce_peak;     /* highest bounce_buffer_size seen */
+} AddressSpaceMapStats;
+
 /**
  * struct AddressSpace: describes a mapping of addresses to #MemoryRegion objects
  */
@@ -1118,6 +1131,7 @@ struct AddressSpace {
     /* List of callbacks to invoke when buffers free up */
     QemuMutex map_client_list_lock;
     QLIST_HEAD(, AddressSpaceMapClient) map_client_list;
+    AddressSpaceMapStats map_stats;
 };
 
 typedef struct AddressSpaceDispatch AddressSpaceDispatch;
@@ -154,6 +154,36 @@ static inline void qemu_ram_block_writeback(RAMBlock *block)
 #define DIRTY_CLIENTS_ALL     ((1 << DIRTY_MEMORY_NUM) - 1)
 #define DIRTY_CLIENTS_NOCODE  (DIRTY_CLIENTS_ALL & ~(1 << DIRTY_MEMORY_CODE))
 
+/*
+ * TCG dirty ring: log of the pages dirtied for migration, so that the
+ * bitmap sync does not have to walk the whole bitmap.  Disabled when
+ * tcg_dirty_ring_size is 0.
+ */
+typedef struct TCGDirtyRing TCGDirtyRing;
+typedef void (*TCGDirtyRingFn)(RAMBlock *rb, ram_addr_t offset, void *opaque);
+
+extern uint32_t tcg_dirty_ring_size;
+
+void tcg_dirty_ring_init(uint32_t size);
+void tcg_dirty_ring_push(ram_addr_t start, ram_addr_t length);
+void tcg_dirty_ring_set_overflow(void);
+void tcg_dirty_ring_alloc(CPUState *cpu);
+void tcg_dirty_ring_free(CPUState *cpu);
+
+/**
+ * tcg_dirty_ring_reap: collect the pages logged since the last sync
+ * @fn: called for each logged page that was still dirty, while clearing
+ *      the run of logged pages it belongs to in the global
+ *      DIRTY_MEMORY_MIGRATION bitmap
+ * @opaque: passed to @fn
+ *
+ * Must be called with the RCU read lock held.  Returns false if the rings
+ * are not in use or lost track of some pages; the caller must then call
+ * tcg_dirty_ring_rearm() and walk the bitmap instead.
+ */
+bool tcg_dirty_ring_reap(TCGDirtyRingFn fn, void *opaque);
+void tcg_dirty_ring_rearm(void);
+
 static inline bool cpu_physical_memory_get_dirty(ram_addr_t start,
                                                  ram_addr_t length,
                                                  unsigned client)
@@ -286,6 +316,10 @@ static inline void cpu_physical_memory_set_dirty_flag(ram_addr_t addr,
     blocks = qatomic_rcu_read(&ram_list.dirty_memory[client]);
 
     set_bit_atomic(offset, blocks->blocks[idx]);
+
+    if (unlikely(tcg_dirty_ring_size) && client == DIRTY_MEMORY_MIGRATION) {
+        tcg_dirty_ring_push(addr, TARGET_PAGE_SIZE);
+    }
 }
 
 static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
@@ -335,6 +369,11 @@ static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
         }
     }
 
+    if (unlikely(tcg_dirty_ring_size) &&
+        (mask & (1 << DIRTY_MEMORY_MIGRATION))) {
+        tcg_dirty_ring_push(start, length);
+    }
+
     xen_hvm_modified_memory(start, length);
 }
 
@@ -373,6 +412,11 @@ uint64_t cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
         offset = BIT_WORD((start >> TARGET_PAGE_BITS) %
                           DIRTY_MEMORY_BLOCK_SIZE);
 
+        /* Bits are merged straight into the bitmap, bypassing the ring */
+        if (unlikely(tcg_dirty_ring_size) && global_dirty_tracking) {
+            tcg_dirty_ring_set_overflow();
+        }
+
         WITH_RCU_READ_LOCK_GUARD() {
             for (i = 0; i < DIRTY_MEMORY_NUM; i++) {
                 blocks[i] =
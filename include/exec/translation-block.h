@@ -143,6 +143,17 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+    /*
+     * Execution profile, only maintained with -accel tcg,profile-tb=on.
+     * exec_count is incremented by the generated code of the TB itself
+     * each time it is entered, whether from the main loop or a chained
+     * jump; exit_count each time execution returns from this TB to the
+     * main loop instead of continuing in a chained TB.  Neither is
+     * updated atomically: concurrent vCPUs may lose increments.
+     */
+    uint64_t exec_count;
+    uint64_t exit_count;
 };
 
 /* The alignment given to TranslationBlock during allocation. */
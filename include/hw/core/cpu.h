@@ -264,19 +264,34 @@ struct CPUTLBEntryFull {
     } extra;
 };
 
+/*
+ * Number of distinct large page regions tracked per MMU mode.
+ * Once all slots are in use, a new large page is merged into the
+ * region that needs to grow the least to cover it.
+ */
+#define CPU_TLB_LARGE_PAGE_RANGES 4
+
+/*
+ * A naturally aligned region covering one or more large pages.
+ * An address @x lies within the region if (x & mask) == addr.
+ */
+typedef struct CPUTLBLargePage {
+    vaddr addr;
+    vaddr mask;
+} CPUTLBLargePage;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
  */
 typedef struct CPUTLBDesc {
     /*
-     * Describe a region covering all of the large pages allocated
-     * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
+     * Describe the regions covering all of the large pages allocated
+     * into the tlb.  When any page within one of these regions is
+     * flushed, we must flush every entry within that region.
      */
-    vaddr large_page_addr;
-    vaddr large_page_mask;
+    CPUTLBLargePage large_page[CPU_TLB_LARGE_PAGE_RANGES];
+    unsigned int n_large_pages;
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
@@ -310,6 +325,10 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /* Single page or range flushes, per mmu_idx. */
+    size_t page_flush_count;
+    /* Flushes widened to a whole large page region, per mmu_idx. */
+    size_t large_page_flush_count;
 } CPUTLBCommon;
 
 /*
@@ -448,6 +467,8 @@ struct qemu_work_item;
  *    ring is enabled.
  * @kvm_fetch_index: Keeps the index that we last fetched from the per-vCPU
  *    dirty ring structure.
+ * @tcg_dirty_ring: Pages this vCPU dirtied for migration, when the TCG
+ *    dirty ring is enabled.
  *
  * @neg_align: The CPUState is the common part of a concrete ArchCPU
  * which is allocated when an individual CPU instance is created. As
@@ -534,6 +555,9 @@ struct CPUState {
     uint32_t kvm_fetch_index;
     uint64_t dirty_pages;
     int kvm_vcpu_stats_fd;
+
+    /* Only used in TCG */
+    struct TCGDirtyRing *tcg_dirty_ring;
     bool vcpu_dirty;
 
     /* Use by accel-block: CPU is executing an ioctl() */
@@ -31,6 +31,9 @@ OBJECT_DECLARE_SIMPLE_TYPE(AspeedAPB2OPBState, ASPEED_APB2OPB)
 
 #define ASPEED_FSI_NUM 2
 
+/* Writes to consecutive addresses posted in one OPB transfer */
+#define ASPEED_APB2OPB_MAX_POSTED 64
+
 typedef struct AspeedAPB2OPBState {
     SysBusDevice parent_obj;
 
@@ -41,6 +44,28 @@ typedef struct AspeedAPB2OPBState {
 
     OPBus opb[ASPEED_FSI_NUM];
     FSIMasterState fsi[ASPEED_FSI_NUM];
+
+    /*
+     * Transfer latched by the trigger, run now or, with async, from a BH
+     * for a read and from post_timer for writes, which are posted
+     */
+    bool async;
+    QEMUBH *bh;
+    QEMUTimer *post_timer;
+    int pending_opb;
+    uint32_t pending_addr;
+    uint32_t pending_data[ASPEED_APB2OPB_MAX_POSTED];
+    unsigned int pending_count;
+    uint32_t pending_size;
+    bool pending_write;
+
+    uint64_t transfers;
+    uint64_t words;
 } AspeedAPB2OPBState;
 
+MemTxResult aspeed_apb2opb_transfer(AspeedAPB2OPBState *s, int opb,
+                                    uint32_t addr, uint32_t *data,
+                                    unsigned int count, unsigned int size,
+                                    bool is_write);
+
 #endif /* FSI_ASPEED_APB2OPB_H */
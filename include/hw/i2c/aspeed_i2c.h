@@ -259,6 +259,13 @@ struct AspeedI2CBus {
     uint32_t regs[ASPEED_I2C_NEW_NUM_REG];
     uint8_t pool[ASPEED_I2C_BUS_POOL_SIZE];
     uint64_t dma_dram_offset;
+
+    /* Command held while a target stretches the clock */
+    QEMUBH *stretch_bh;
+    bool stretched;
+    bool stretch_repeated;
+    uint8_t stretch_byte;
+    uint32_t stretch_pos;
 };
 
 struct AspeedI2CState {
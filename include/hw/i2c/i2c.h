@@ -92,6 +92,10 @@ struct I2CBus {
 
     /* Set from slave currently mastering the bus. */
     QEMUBH *bh;
+
+    /* Set by a master that can be held by its target, see i2c_stretch() */
+    QEMUBH *stretch_bh;
+    bool stretched;
 };
 
 I2CBus *i2c_init_bus(DeviceState *parent, const char *name);
@@ -151,6 +155,40 @@ void i2c_bus_release(I2CBus *bus);
 int i2c_send(I2CBus *bus, uint8_t data);
 int i2c_send_async(I2CBus *bus, uint8_t data);
 uint8_t i2c_recv(I2CBus *bus);
+
+/**
+ * i2c_bus_set_stretch_bh: let targets stretch the clock of a master.
+ *
+ * @bus: #I2CBus mastered by the caller
+ * @bh: BH resuming the held bus operation
+ *
+ * A master calling this checks i2c_stretched() after each START, send
+ * and receive.  When it is set, the master holds the operation and
+ * runs it again from @bh, which is scheduled once the target is done.
+ * The result of the held call is to be ignored.
+ */
+void i2c_bus_set_stretch_bh(I2CBus *bus, QEMUBH *bh);
+
+/**
+ * i2c_stretch: hold the master of a bus from a target.
+ *
+ * @bus: #I2CBus of the target
+ *
+ * Called by a target from its event, send or recv handler when it can
+ * not answer yet.  The master calls the handler again, with the same
+ * operation, after the target called i2c_stretch_release().
+ *
+ * Returns: false if the master can not be held
+ */
+bool i2c_stretch(I2CBus *bus);
+
+/**
+ * i2c_stretch_release: let a held master run the operation again.
+ *
+ * @bus: #I2CBus of the target
+ */
+void i2c_stretch_release(I2CBus *bus);
+bool i2c_stretched(I2CBus *bus);
 bool i2c_scan_bus(I2CBus *bus, uint8_t address, bool broadcast,
                   I2CNodeList *current_devs);
 
@@ -21,6 +21,7 @@
 #ifndef HW_ARM_GIC_COMMON_H
 #define HW_ARM_GIC_COMMON_H
 
+#include "qemu/bitmap.h"
 #include "hw/sysbus.h"
 #include "qom/object.h"
 
@@ -85,6 +86,13 @@ struct GICState {
     uint32_t cpu_ctlr[GIC_NCPU_VCPU];
 
     gic_irq_state irq_state[GIC_MAXIRQ];
+    /* Superset of the interrupts which are pending, or whose input is
+     * asserted, on any CPU. A bit is set whenever the pending or level
+     * state of the interrupt is set and is only cleared lazily when the
+     * best pending interrupt is searched for, so that search need not
+     * look at every interrupt. Not migrated; refilled on load.
+     */
+    DECLARE_BITMAP(irq_maybe_pending, GIC_MAXIRQ);
     uint8_t irq_target[GIC_MAXIRQ];
     uint8_t priority1[GIC_INTERNAL][GIC_NCPU];
     uint8_t priority2[GIC_MAXIRQ - GIC_INTERNAL];
@@ -11,6 +11,7 @@
 #define HW_ARM_ARMV7M_NVIC_H
 
 #include "target/arm/cpu-qom.h"
+#include "qemu/bitmap.h"
 #include "hw/sysbus.h"
 #include "hw/timer/armv7m_systick.h"
 #include "qom/object.h"
@@ -76,6 +77,17 @@ struct NVICState {
     int exception_prio; /* group prio of the highest prio active exception */
     int vectpending_prio; /* group prio of the exception in vectpending */
 
+    /* Bitmaps indexed by exception number, tracking which external
+     * interrupts are pending, active, and "live" (active, or both
+     * pending and enabled). These are also cached state derived from
+     * vectors[]; the bits for internal exceptions are always clear.
+     * They let the state recomputation look only at the handful of
+     * interrupts which can affect it rather than all num_irq vectors.
+     */
+    DECLARE_BITMAP(irq_pending, NVIC_MAX_VECTORS);
+    DECLARE_BITMAP(irq_active, NVIC_MAX_VECTORS);
+    DECLARE_BITMAP(irq_live, NVIC_MAX_VECTORS);
+
     MemoryRegion sysregmem;
 
     uint32_t num_irq;
@@ -41,6 +41,7 @@ enum ipmi_op {
     IPMI_SEND_NMI
 };
 
+#define IPMI_CC_NODE_BUSY                                0xc0
 #define IPMI_CC_INVALID_CMD                              0xc1
 #define IPMI_CC_COMMAND_INVALID_FOR_LUN                  0xc2
 #define IPMI_CC_TIMEOUT                                  0xc3
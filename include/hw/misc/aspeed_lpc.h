@@ -11,6 +11,9 @@
 #define ASPEED_LPC_H
 
 #include "hw/sysbus.h"
+#include "hw/ipmi/ipmi.h"
+#include "chardev/char-fe.h"
+#include "qemu/queue.h"
 
 #define TYPE_ASPEED_LPC "aspeed.lpc"
 #define ASPEED_LPC(obj) OBJECT_CHECK(AspeedLPCState, (obj), TYPE_ASPEED_LPC)
@@ -27,7 +30,78 @@ enum aspeed_lpc_subdevice {
 
 #define ASPEED_LPC_NR_SUBDEVS   5
 
-typedef struct AspeedLPCState {
+#define ASPEED_LPC_NR_KCS       4
+#define ASPEED_BT_FIFO_SIZE     256
+
+#define ASPEED_IPMI_HOST_QUEUE_LEN  64
+#define ASPEED_IPMI_HOST_LAT_BUCKETS 24
+
+typedef struct AspeedLPCState AspeedLPCState;
+
+typedef struct AspeedIPMIHostReq {
+    int64_t start;
+    int64_t sent;
+    uint8_t msg_id;
+    uint32_t len;
+    uint8_t data[MAX_IPMI_MSG_SIZE];
+    QSIMPLEQ_ENTRY(AspeedIPMIHostReq) next;
+} AspeedIPMIHostReq;
+
+/*
+ * Latency is measured from the arrival of a request on the chardev to
+ * the departure of its response.  Bucket n of the histogram counts the
+ * responses which took [2^n, 2^(n+1)) microseconds, the first bucket
+ * also counts those below a microsecond and the last one everything
+ * above.
+ */
+typedef struct AspeedIPMIHostStats {
+    uint64_t requests;
+    uint64_t responses;
+    uint64_t errors;
+    uint64_t busy;
+    uint64_t latency_ns;
+    uint64_t max_latency_ns;
+    uint64_t histogram[ASPEED_IPMI_HOST_LAT_BUCKETS];
+} AspeedIPMIHostStats;
+
+/*
+ * Host side of a KCS or BT channel, driven by a chardev which speaks
+ * the ipmi-bmc-extern protocol with the roles reversed: requests come
+ * in from the host stand-in and responses go back to it.  Requests
+ * are queued as they arrive so that the stand-in does not have to wait
+ * for a response before sending the next one.
+ */
+typedef struct AspeedIPMIHost {
+    AspeedLPCState *lpc;
+    const char *name;
+    int kcs;                    /* channel index, -1 for the iBT */
+
+    CharBackend chr;
+    QEMUTimer *timer;
+
+    uint8_t inbuf[MAX_IPMI_MSG_SIZE + 2];
+    uint32_t inpos;
+    bool in_escape;
+    bool in_too_many;
+
+    QSIMPLEQ_HEAD(, AspeedIPMIHostReq) queue;
+    uint32_t queue_len;
+    AspeedIPMIHostReq *inflight[256];
+    uint32_t n_inflight;
+
+    /* KCS transfer of the request in flight */
+    AspeedIPMIHostReq *cur;
+    uint32_t phase;
+    uint32_t pos;
+    uint8_t rsp[MAX_IPMI_MSG_SIZE];
+    uint32_t rsp_len;
+
+    bool atn;
+
+    AspeedIPMIHostStats stats;
+} AspeedIPMIHost;
+
+struct AspeedLPCState {
     /* <private> */
     SysBusDevice parent;
 
@@ -40,6 +114,15 @@ typedef struct AspeedLPCState {
 
     uint32_t regs[ASPEED_LPC_NR_REGS];
     uint32_t hicr7;
-} AspeedLPCState;
+
+    /* iBT FIFOs, host to BMC and BMC to host */
+    uint8_t bt_h2b[ASPEED_BT_FIFO_SIZE];
+    uint8_t bt_b2h[ASPEED_BT_FIFO_SIZE];
+    uint32_t bt_h2b_rd;
+    uint32_t bt_b2h_wr;
+
+    AspeedIPMIHost kcs_host[ASPEED_LPC_NR_KCS];
+    AspeedIPMIHost bt_host;
+};
 
 #endif /* ASPEED_LPC_H */
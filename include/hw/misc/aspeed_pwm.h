@@ -0,0 +1,79 @@
+/*
+ * ASPEED PWM and Fan Tach Controller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ASPEED_PWM_H
+#define ASPEED_PWM_H
+
+#include "hw/sysbus.h"
+#include "qom/object.h"
+
+#define TYPE_ASPEED_PWM "aspeed.pwm-tach"
+OBJECT_DECLARE_SIMPLE_TYPE(AspeedPWMState, ASPEED_PWM)
+
+#define ASPEED_PWM_NR_CHANNELS  16
+#define ASPEED_PWM_NR_REGS      (0x100 >> 2)
+#define ASPEED_PWM_MAX_ZONES    16
+
+/*
+ * The fans and the thermal zones they cool, simulated on a virtual
+ * clock timer. Each parameter and state is an array with one entry per
+ * fan or zone, so that a step of the whole plant is a handful of loops
+ * over floats the compiler vectorizes, whatever the number of fans.
+ */
+typedef struct AspeedPWMPlant {
+    unsigned int nr_fans;
+    unsigned int nr_zones;
+    float ambient;
+
+    /* Fans, fan n is measured by tach channel n */
+    unsigned int pwm[ASPEED_PWM_NR_CHANNELS];
+    float max_rpm[ASPEED_PWM_NR_CHANNELS];
+    float tau[ASPEED_PWM_NR_CHANNELS];
+    float duty[ASPEED_PWM_NR_CHANNELS];
+    float rpm[ASPEED_PWM_NR_CHANNELS];
+    float speed[ASPEED_PWM_NR_CHANNELS];
+    unsigned int pulses[ASPEED_PWM_NR_CHANNELS];
+
+    /*
+     * Zones, heated by a power and cooled by still air and the fans.
+     * The cooling of each fan at full speed is indexed by fan first so
+     * that summing the fans runs across the zones.
+     */
+    float capacitance[ASPEED_PWM_MAX_ZONES];
+    float conductance[ASPEED_PWM_MAX_ZONES];
+    float cooling[ASPEED_PWM_NR_CHANNELS][ASPEED_PWM_MAX_ZONES];
+    float temp[ASPEED_PWM_MAX_ZONES];
+
+    /* Temperature sensor model fed by each zone */
+    char *sensor_path[ASPEED_PWM_MAX_ZONES];
+    char *sensor_prop[ASPEED_PWM_MAX_ZONES];
+    Object *sensor[ASPEED_PWM_MAX_ZONES];
+} AspeedPWMPlant;
+
+struct AspeedPWMState {
+    SysBusDevice parent;
+
+    MemoryRegion iomem;
+    qemu_irq irq;
+    QEMUTimer *timer;
+
+    uint32_t regs[ASPEED_PWM_NR_REGS];
+
+    char *plant_file;
+    uint32_t period_ms;
+    uint32_t clk_freq;
+    AspeedPWMPlant plant;
+
+    /* Plant outputs and load, also the migrated state of the plant */
+    uint32_t rpm[ASPEED_PWM_NR_CHANNELS];
+    int32_t temp_mc[ASPEED_PWM_MAX_ZONES];
+    uint32_t power[ASPEED_PWM_MAX_ZONES];
+
+    uint64_t steps;
+    uint64_t step_ns;
+};
+
+#endif /* ASPEED_PWM_H */
@@ -0,0 +1,78 @@
+/*
+ * ASPEED Video Engine
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ASPEED_VIDEO_H
+#define ASPEED_VIDEO_H
+
+#include "hw/sysbus.h"
+#include "qom/object.h"
+
+#define TYPE_ASPEED_VIDEO "aspeed.video"
+#define TYPE_ASPEED_AST2400_VIDEO TYPE_ASPEED_VIDEO "-ast2400"
+#define TYPE_ASPEED_AST2500_VIDEO TYPE_ASPEED_VIDEO "-ast2500"
+#define TYPE_ASPEED_AST2600_VIDEO TYPE_ASPEED_VIDEO "-ast2600"
+
+OBJECT_DECLARE_TYPE(AspeedVideoState, AspeedVideoClass, ASPEED_VIDEO)
+
+#define ASPEED_VIDEO_NR_REGS (0x400 >> 2)
+
+typedef struct AspeedVideoStats {
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t blocks;
+    uint64_t changed_blocks;
+    uint64_t encode_ns;
+} AspeedVideoStats;
+
+struct AspeedVideoState {
+    SysBusDevice parent;
+
+    MemoryRegion iomem;
+    qemu_irq irq;
+    QEMUBH *bh;
+
+    uint32_t regs[ASPEED_VIDEO_NR_REGS];
+    uint32_t pending;
+
+    MemoryRegion *dram_mr;
+    AddressSpace dram_as;
+
+    /* Host side frame source, XRGB8888 */
+    char *source;
+    uint32_t width;
+    uint32_t height;
+    GMappedFile *mapped;
+    const uint8_t *fb;
+
+    /*
+     * Encoder state. The pixels and quantized coefficients of the last
+     * frame are kept so that only the blocks which changed since then
+     * go through the DCT again.
+     */
+    bool enc_valid;
+    uint32_t enc_width;
+    uint32_t enc_height;
+    uint32_t enc_mode;
+    uint8_t qtable[2][64];
+    float qscale[2][64];
+    uint8_t *prev;
+    int16_t *coefs;
+    uint8_t *jpeg;
+    size_t jpeg_len;
+    size_t jpeg_size;
+
+    AspeedVideoStats stats;
+};
+
+struct AspeedVideoClass {
+    SysBusDeviceClass parent_class;
+
+    uint32_t dram_mask;
+    uint32_t jpeg_mode;
+    uint32_t comp_size_reg;
+};
+
+#endif /* ASPEED_VIDEO_H */
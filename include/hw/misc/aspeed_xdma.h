@@ -21,19 +21,51 @@ OBJECT_DECLARE_TYPE(AspeedXDMAState, AspeedXDMAClass, ASPEED_XDMA)
 #define ASPEED_XDMA_NUM_REGS (ASPEED_XDMA_REG_SIZE / sizeof(uint32_t))
 #define ASPEED_XDMA_REG_SIZE 0x7C
 
+/* One command of the queue, decoded */
+typedef struct AspeedXDMACmd {
+    uint64_t host_addr;
+    uint32_t bmc_addr;
+    uint32_t host_pitch;
+    uint32_t bmc_pitch;
+    uint32_t line_size;
+    uint32_t line_no;
+    bool upstream;
+} AspeedXDMACmd;
+
+typedef struct AspeedXDMAStats {
+    uint64_t transfers;
+    uint64_t upstream_bytes;
+    uint64_t downstream_bytes;
+    uint64_t transfer_ns;
+    uint64_t max_transfer_ns;
+} AspeedXDMAStats;
+
 struct AspeedXDMAState {
     SysBusDevice parent;
 
     MemoryRegion iomem;
     qemu_irq irq;
 
-    char bmc_cmdq_readp_set;
     uint32_t regs[ASPEED_XDMA_NUM_REGS];
+
+    MemoryRegion *dram_mr;
+    AddressSpace dram_as;
+
+    /* Host memory seen through PCIe, at host_base in host address space */
+    HostMemoryBackend *host_memdev;
+    uint64_t host_base;
+    uint8_t *host_ptr;
+    uint64_t host_size;
+
+    AspeedXDMAStats stats;
 };
 
 struct AspeedXDMAClass {
     SysBusDeviceClass parent_class;
 
+    uint32_t dram_mask;
+    uint8_t cmdq_addr;
+    uint8_t cmdq_unit;
     uint8_t cmdq_endp;
     uint8_t cmdq_wrp;
     uint8_t cmdq_rdp;
@@ -41,6 +73,10 @@ struct AspeedXDMAClass {
     uint32_t intr_ctrl_mask;
     uint8_t intr_status;
     uint32_t intr_complete;
+    uint32_t intr_us_comp;
+    uint32_t intr_ds_comp;
+
+    void (*decode)(const uint64_t *raw, AspeedXDMACmd *cmd);
 };
 
 #endif /* ASPEED_XDMA_H */
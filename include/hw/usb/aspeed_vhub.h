@@ -0,0 +1,116 @@
+/*
+ * ASPEED USB Virtual Hub Controller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ASPEED_VHUB_H
+#define ASPEED_VHUB_H
+
+#include "hw/sysbus.h"
+#include "chardev/char-fe.h"
+#include "qom/object.h"
+
+#define TYPE_ASPEED_VHUB "aspeed.vhub"
+#define TYPE_ASPEED_2600_VHUB TYPE_ASPEED_VHUB "-ast2600"
+OBJECT_DECLARE_TYPE(AspeedVHubState, AspeedVHubClass, ASPEED_VHUB)
+
+#define ASPEED_VHUB_REG_SIZE    0x400
+#define ASPEED_VHUB_NUM_REGS    (ASPEED_VHUB_REG_SIZE / sizeof(uint32_t))
+#define ASPEED_VHUB_MAX_PORTS   7
+#define ASPEED_VHUB_MAX_EPS     21
+
+/*
+ * The upstream port is driven by a process playing the USB host,
+ * connected to a chardev.  Messages are this header, integers little
+ * endian, followed by len bytes of payload for SETUP, OUT and DATA.
+ *
+ * The host sends SETUP, OUT and IN to a device address and endpoint
+ * number.  SETUP and OUT are answered with ACK once the firmware took
+ * the data, IN with DATA holding at most len bytes.  An IN collects
+ * all the packets the endpoint has ready, up to a short packet, which
+ * is where bulk transfers get their throughput.  Any of them can be
+ * answered with STALL.  CONNECT reports the pull-up of the hub, len
+ * being 1 or 0, and RESET is a bus reset from the host.
+ */
+typedef struct QEMU_PACKED AspeedVHubMsg {
+    uint8_t type;
+    uint8_t addr;
+    uint8_t ep;
+    uint8_t reserved;
+    uint32_t len;
+} AspeedVHubMsg;
+
+enum {
+    ASPEED_VHUB_MSG_RESET = 1,
+    ASPEED_VHUB_MSG_SETUP,
+    ASPEED_VHUB_MSG_OUT,
+    ASPEED_VHUB_MSG_IN,
+    ASPEED_VHUB_MSG_DATA,
+    ASPEED_VHUB_MSG_ACK,
+    ASPEED_VHUB_MSG_STALL,
+    ASPEED_VHUB_MSG_CONNECT,
+};
+
+/* An IN token waiting for the firmware to provide data */
+typedef struct AspeedVHubInReq {
+    bool pending;
+    uint8_t addr;
+    uint32_t len;
+} AspeedVHubInReq;
+
+typedef struct AspeedVHubStats {
+    uint64_t setups;
+    uint64_t stalls;
+    uint64_t in_transfers;
+    uint64_t in_bytes;
+    uint64_t out_transfers;
+    uint64_t out_bytes;
+    uint64_t max_in_batch;
+} AspeedVHubStats;
+
+struct AspeedVHubState {
+    SysBusDevice parent;
+
+    MemoryRegion iomem;
+    qemu_irq irq;
+
+    uint32_t regs[ASPEED_VHUB_NUM_REGS];
+
+    MemoryRegion *dram_mr;
+    AddressSpace dram_as;
+
+    CharBackend chr;
+    GByteArray *tx_buf;
+    guint tx_watch;
+
+    /* Message from the host being received */
+    AspeedVHubMsg msg;
+    uint32_t msg_hdr;
+    uint32_t msg_pos;
+    int msg_dev;
+    int msg_ep;
+    uint8_t setup[8];
+    bool rx_blocked;
+
+    /* Index 0 is the hub, then the downstream devices */
+    AspeedVHubInReq ep0_in[ASPEED_VHUB_MAX_PORTS + 1];
+    uint32_t ep0_out_pos[ASPEED_VHUB_MAX_PORTS + 1];
+    AspeedVHubInReq ep1_in;
+    bool ep1_ready;
+
+    AspeedVHubInReq ep_in[ASPEED_VHUB_MAX_EPS];
+    uint32_t ep_pos[ASPEED_VHUB_MAX_EPS];
+
+    AspeedVHubStats stats;
+};
+
+struct AspeedVHubClass {
+    SysBusDeviceClass parent_class;
+
+    uint32_t dram_mask;
+    int num_ports;
+    int num_eps;
+};
+
+#endif /* ASPEED_VHUB_H */
@@ -198,6 +198,14 @@ struct VMStateDescription {
      * a QEMU_VM_SECTION_START section.
      */
     bool early_setup;
+    /*
+     * The callbacks of this VMSD and of its subsections only touch the
+     * device itself, and can run on a worker thread without the BQL while
+     * other devices are being saved or loaded.  With the
+     * x-parallel-device-state capability such sections are saved and
+     * loaded by a pool of threads.
+     */
+    bool independent;
     int version_id;
     int minimum_version_id;
     MigrationPriority priority;
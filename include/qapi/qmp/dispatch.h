@@ -15,6 +15,7 @@
 #define QAPI_QMP_DISPATCH_H
 
 #include "monitor/monitor.h"
+#include "qapi/qapi-builtin-types.h"
 #include "qemu/queue.h"
 
 typedef void (QmpCommandFunc)(QDict *, QObject **, Error **);
@@ -57,6 +58,8 @@ bool qmp_has_success_response(const QmpCommand *cmd);
 QDict *qmp_error_response(Error *err);
 QDict *coroutine_mixed_fn qmp_dispatch(const QmpCommandList *cmds, QObject *request,
                                        bool allow_oob, Monitor *cur_mon);
+anyList *qmp_dispatch_batch(const QmpCommandList *cmds, anyList *requests,
+                            bool stop_on_error, Monitor *cur_mon);
 bool qmp_is_oob(const QDict *dict);
 
 typedef void (*qmp_cmd_callback_fn)(const QmpCommand *cmd, void *opaque);
@@ -31,5 +31,7 @@ void json_writer_int64(JSONWriter *, const char *name, int64_t val);
 void json_writer_uint64(JSONWriter *, const char *name, uint64_t val);
 void json_writer_double(JSONWriter *, const char *name, double val);
 void json_writer_str(JSONWriter *, const char *name, const char *str);
+/* Append @json, a complete value produced by another JSONWriter */
+void json_writer_raw(JSONWriter *, const char *name, const char *json);
 
 #endif
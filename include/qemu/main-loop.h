@@ -91,6 +91,18 @@ int qemu_init_main_loop(Error **errp);
  */
 void main_loop_wait(int nonblocking);
 
+/**
+ * main_loop_set_timer_slack: Batch the main loop wakeups for timers.
+ *
+ * @slack_ns: granularity of the wakeups, 0 to wake up at each deadline
+ *
+ * When waiting for a timer, main_loop_wait then sleeps until the next
+ * multiple of @slack_ns of the host clock following the deadline, and
+ * runs in one go all the timers which expired in between.  Timers fire
+ * up to @slack_ns late, in exchange for fewer wakeups of the host.
+ */
+void main_loop_set_timer_slack(int64_t slack_ns);
+
 /**
  * qemu_get_aio_context: Return the main loop's AioContext
  */
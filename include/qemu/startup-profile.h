@@ -0,0 +1,69 @@
+/*
+ * Startup profiler
+ *
+ * Records how long the phases of machine construction and the
+ * instance_init, realize and reset handlers of each device take, and
+ * dumps the result once the machine is ready.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_STARTUP_PROFILE_H
+#define QEMU_STARTUP_PROFILE_H
+
+#include "qemu/timer.h"
+
+typedef enum StartupProfileFormat {
+    STARTUP_PROFILE_CHROME,     /* Chrome trace-event JSON */
+    STARTUP_PROFILE_SUMMARY,    /* text table sorted by self time */
+} StartupProfileFormat;
+
+extern bool startup_profile_enabled;
+
+/**
+ * startup_profile_enable:
+ * @path: output file, or NULL to print a summary to stderr
+ * @format: output format
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Start recording.  Returns false if @format needs a file and @path
+ * is NULL.
+ */
+bool startup_profile_enable(const char *path, StartupProfileFormat format,
+                            Error **errp);
+
+/**
+ * startup_profile_add:
+ * @cat: category, e.g. "phase" or "realize"
+ * @name: event name
+ * @start: get_clock() value when the event started
+ * @end: get_clock() value when the event ended
+ *
+ * Record one event.  @cat and @name are not copied and must stay valid
+ * until startup_profile_finish(); type names and string literals are fine.
+ */
+void startup_profile_add(const char *cat, const char *name,
+                         int64_t start, int64_t end);
+
+/**
+ * startup_profile_finish:
+ *
+ * Write the recorded events out and stop recording.  Does nothing if
+ * the profiler is not enabled.
+ */
+void startup_profile_finish(void);
+
+static inline int64_t startup_profile_start(void)
+{
+    return unlikely(startup_profile_enabled) ? get_clock() : 0;
+}
+
+static inline void startup_profile_end(const char *cat, const char *name,
+                                       int64_t start)
+{
+    if (unlikely(startup_profile_enabled)) {
+        startup_profile_add(cat, name, start, get_clock());
+    }
+}
+
+#endif /* QEMU_STARTUP_PROFILE_H */
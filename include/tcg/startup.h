@@ -25,16 +25,33 @@
 #ifndef TCG_STARTUP_H
 #define TCG_STARTUP_H
 
+/*
+ * How the JIT buffer is backed by host huge pages.
+ * TCG_HUGEPAGES_ADVISE only hints the kernel, as regions are separated
+ * by guard pages; TCG_HUGEPAGES_THP aligns regions to the huge page
+ * size and omits the guard pages so that transparent huge pages can
+ * back each region completely; TCG_HUGEPAGES_EXPLICIT maps the buffer
+ * from the hugetlb pool, falling back to TCG_HUGEPAGES_THP.
+ */
+typedef enum TCGHugepages {
+    TCG_HUGEPAGES_ADVISE,
+    TCG_HUGEPAGES_THP,
+    TCG_HUGEPAGES_EXPLICIT,
+} TCGHugepages;
+
 /**
  * tcg_init: Initialize the TCG runtime
  * @tb_size: translation buffer size
  * @splitwx: use separate rw and rx mappings
+ * @hugepages: huge page backing of the translation buffer
+ * @numa: place each region on the host node of the thread using it
  * @max_cpus: number of vcpus in system mode
  *
  * Allocate and initialize TCG resources, especially the JIT buffer.
  * In user-only mode, @max_cpus is unused.
  */
-void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus);
+void tcg_init(size_t tb_size, int splitwx, TCGHugepages hugepages,
+              bool numa, unsigned max_cpus);
 
 /**
  * tcg_register_thread: Register this thread with the TCG runtime
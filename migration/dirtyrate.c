@@ -30,6 +30,7 @@
 #include "exec/memory.h"
 #include "qemu/xxhash.h"
 #include "migration.h"
+#include "savevm.h"
 
 /*
  * total_dirty_pages is procted by BQL and is used
@@ -728,6 +729,16 @@ static void calculate_dirtyrate(struct DirtyRateConfig config)
     trace_dirtyrate_calculate(DirtyStat.dirty_rate);
 }
 
+/* Whether a dirty-bitmap measurement is starting or running */
+bool dirtyrate_bitmap_in_use(void)
+{
+    int state = qatomic_read(&CalculatingState);
+
+    return dirtyrate_mode == DIRTY_RATE_MEASURE_MODE_DIRTY_BITMAP &&
+           (state == DIRTY_RATE_STATUS_UNSTARTED ||
+            state == DIRTY_RATE_STATUS_MEASURING);
+}
+
 void *get_dirtyrate_thread(void *arg)
 {
     struct DirtyRateConfig config = *(struct DirtyRateConfig *)arg;
@@ -819,6 +830,17 @@ void qmp_calc_dirty_rate(int64_t calc_time,
          return;
     }
 
+    /*
+     * dirty bitmap mode resets the migration dirty bitmap, in which an
+     * in-memory checkpoint records the pages to copy back on restore.
+     */
+    if (mode == DIRTY_RATE_MEASURE_MODE_DIRTY_BITMAP &&
+        memory_checkpoint_held()) {
+        error_setg(errp, "mode %s is not available while an in-memory "
+                   "checkpoint is held.", DirtyRateMeasureMode_str(mode));
+        return;
+    }
+
     /*
      * Init calculation state as unstarted.
      */
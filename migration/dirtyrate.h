@@ -84,4 +84,5 @@ struct DirtyRateStat {
 };
 
 void *get_dirtyrate_thread(void *arg);
+bool dirtyrate_bitmap_in_use(void);
 #endif
@@ -1293,6 +1293,11 @@ static void fill_source_migration_info(MigrationInfo *info)
         populate_time_info(info, s);
         populate_ram_info(info, s);
         migration_populate_vfio_info(info);
+        if (s->device_times) {
+            info->has_x_device_times = true;
+            info->x_device_times = QAPI_CLONE(MigrationDeviceTimeList,
+                                              s->device_times);
+        }
         break;
     case MIGRATION_STATUS_FAILED:
         info->has_status = true;
@@ -1337,6 +1342,11 @@ static void fill_destination_migration_info(MigrationInfo *info)
     case MIGRATION_STATUS_COMPLETED:
         info->has_status = true;
         fill_destination_postcopy_migration_info(info);
+        if (mis->device_times) {
+            info->has_x_device_times = true;
+            info->x_device_times = QAPI_CLONE(MigrationDeviceTimeList,
+                                              mis->device_times);
+        }
         break;
     default:
         return;
@@ -1682,6 +1692,8 @@ int migrate_init(MigrationState *s, Error **errp)
     error_free(s->error);
     s->error = NULL;
     s->vmdesc = NULL;
+    qapi_free_MigrationDeviceTimeList(s->device_times);
+    s->device_times = NULL;
 
     migrate_set_state(&s->state, MIGRATION_STATUS_NONE, MIGRATION_STATUS_SETUP);
 
@@ -242,6 +242,9 @@ struct MigrationIncomingState {
      */
     unsigned int switchover_ack_pending_num;
 
+    /* Time spent loading each non-iterable device, for query-migrate */
+    MigrationDeviceTimeList *device_times;
+
     /* Do exit on incoming migration failure */
     bool exit_on_error;
 };
@@ -461,6 +464,9 @@ struct MigrationState {
     /* QEMU_VM_VMDESCRIPTION content filled for all non-iterable devices. */
     JSONWriter *vmdesc;
 
+    /* Time spent saving each non-iterable device, for query-migrate */
+    MigrationDeviceTimeList *device_times;
+
     /*
      * Indicates whether an ACK from the destination that it's OK to do
      * switchover has been received.
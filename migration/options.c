@@ -196,6 +196,11 @@ const Property migration_properties[] = {
                         MIGRATION_CAPABILITY_SWITCHOVER_ACK),
     DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
     DEFINE_PROP_MIG_CAP("mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram-mmap",
+                        MIGRATION_CAPABILITY_X_MAPPED_RAM_MMAP),
+    DEFINE_PROP_MIG_CAP("x-ram-dedup", MIGRATION_CAPABILITY_X_RAM_DEDUP),
+    DEFINE_PROP_MIG_CAP("x-parallel-device-state",
+                        MIGRATION_CAPABILITY_X_PARALLEL_DEVICE_STATE),
 };
 const size_t migration_properties_count = ARRAY_SIZE(migration_properties);
 
@@ -248,6 +253,13 @@ bool migrate_mapped_ram(void)
     return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
 }
 
+bool migrate_mapped_ram_mmap(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_X_MAPPED_RAM_MMAP];
+}
+
 bool migrate_ignore_shared(void)
 {
     MigrationState *s = migrate_get_current();
@@ -269,6 +281,13 @@ bool migrate_multifd(void)
     return s->capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+bool migrate_parallel_device_state(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_X_PARALLEL_DEVICE_STATE];
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s = migrate_get_current();
@@ -297,6 +316,13 @@ bool migrate_postcopy_ram(void)
     return s->capabilities[MIGRATION_CAPABILITY_POSTCOPY_RAM];
 }
 
+bool migrate_ram_dedup(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_X_RAM_DEDUP];
+}
+
 bool migrate_rdma_pin_all(void)
 {
     MigrationState *s = migrate_get_current();
@@ -599,6 +625,30 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_X_MAPPED_RAM_MMAP]) {
+#ifdef _WIN32
+        error_setg(errp, "x-mapped-ram-mmap is not supported on this host");
+        return false;
+#endif
+        if (!new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+            error_setg(errp, "Capability 'x-mapped-ram-mmap' requires "
+                       "capability 'mapped-ram'");
+            return false;
+        }
+    }
+
+    if (new_caps[MIGRATION_CAPABILITY_X_RAM_DEDUP]) {
+        if (new_caps[MIGRATION_CAPABILITY_MAPPED_RAM] ||
+            new_caps[MIGRATION_CAPABILITY_MULTIFD] ||
+            new_caps[MIGRATION_CAPABILITY_POSTCOPY_RAM] ||
+            new_caps[MIGRATION_CAPABILITY_XBZRLE] ||
+            new_caps[MIGRATION_CAPABILITY_X_COLO]) {
+            error_setg(errp, "Capability 'x-ram-dedup' is incompatible with "
+                       "mapped-ram, multifd, postcopy-ram, xbzrle and x-colo");
+            return false;
+        }
+    }
+
     return true;
 }
 
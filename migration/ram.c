@@ -30,8 +30,10 @@
 #include "qemu/cutils.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
+#include "qemu/bswap.h"
 #include "qemu/madvise.h"
 #include "qemu/main-loop.h"
+#include "qemu/xxhash.h"
 #include "xbzrle.h"
 #include "ram.h"
 #include "migration.h"
@@ -39,6 +41,7 @@
 #include "migration/register.h"
 #include "migration/misc.h"
 #include "qemu-file.h"
+#include "io/channel-file.h"
 #include "postcopy-ram.h"
 #include "page_cache.h"
 #include "qemu/error-report.h"
@@ -393,6 +396,17 @@ struct RAMState {
      * RAM migration.
      */
     unsigned int postcopy_bmap_sync_requested;
+
+    /*
+     * Page content hash -> host address of the first page sent with that
+     * content.  Only used with x-ram-dedup while saving a snapshot, when
+     * the guest is stopped and sent pages cannot change under us.  It
+     * lives as long as the stream: references never point into another
+     * snapshot, which loadvm cannot read and which may be deleted.
+     */
+    GHashTable *dedup_pages;
+    /* Number of pages sent as RAM_SAVE_FLAG_DEDUP */
+    uint64_t dedup_sent;
 };
 typedef struct RAMState RAMState;
 
@@ -901,6 +915,40 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+static void ram_sync_dirty_ring_page(RAMBlock *rb, ram_addr_t offset,
+                                     void *opaque)
+{
+    RAMState *rs = opaque;
+
+    if (migrate_ram_is_ignored(rb) || !rb->bmap) {
+        return;
+    }
+    if (!test_and_set_bit(offset >> TARGET_PAGE_BITS, rb->bmap)) {
+        rs->migration_dirty_pages++;
+        rs->num_dirty_pages_period++;
+    }
+}
+
+/*
+ * With TCG and -accel tcg,dirty-ring-size, only visit the pages logged
+ * since the last sync.  Falls back to walking the dirty bitmap of every
+ * RAMBlock when the rings are not in use or overflowed.
+ */
+static void ram_sync_dirty(RAMState *rs)
+{
+    RAMBlock *block;
+
+    if (tcg_dirty_ring_reap(ram_sync_dirty_ring_page, rs)) {
+        trace_migration_bitmap_sync_ring(rs->num_dirty_pages_period);
+        return;
+    }
+
+    tcg_dirty_ring_rearm();
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ramblock_sync_dirty_bitmap(rs, block);
+    }
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -1022,7 +1070,6 @@ static void migration_trigger_throttle(RAMState *rs)
 
 static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 {
-    RAMBlock *block;
     int64_t end_time;
 
     stat64_add(&mig_stats.dirty_sync_count, 1);
@@ -1036,9 +1083,7 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 
     WITH_QEMU_LOCK_GUARD(&rs->bitmap_mutex) {
         WITH_RCU_READ_LOCK_GUARD() {
-            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-                ramblock_sync_dirty_bitmap(rs, block);
-            }
+            ram_sync_dirty(rs);
             stat64_set(&mig_stats.dirty_bytes_last_sync, ram_bytes_remaining());
         }
     }
@@ -1957,6 +2002,86 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
     return 0;
 }
 
+/**
+ * ram_page_hash: hash the contents of a target page
+ *
+ * This is the XXH64 main loop over the whole page, which is always a
+ * multiple of 32 bytes.  Collisions are resolved by the caller.
+ *
+ * @p: host address of the page
+ */
+static uint64_t ram_page_hash(const uint8_t *p)
+{
+    uint64_t v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+    uint64_t v2 = XXH_PRIME64_2;
+    uint64_t v3 = 0;
+    uint64_t v4 = -XXH_PRIME64_1;
+    size_t i;
+
+    for (i = 0; i < TARGET_PAGE_SIZE; i += 32) {
+        v1 = XXH64_round(v1, ldq_le_p(p + i));
+        v2 = XXH64_round(v2, ldq_le_p(p + i + 8));
+        v3 = XXH64_round(v3, ldq_le_p(p + i + 16));
+        v4 = XXH64_round(v4, ldq_le_p(p + i + 24));
+    }
+
+    return XXH64_avalanche(XXH64_mergerounds(v1, v2, v3, v4) +
+                           TARGET_PAGE_SIZE);
+}
+
+/**
+ * save_dedup_page: send a page as a reference to an identical page
+ *
+ * If a page with the same contents was already sent in this stream,
+ * send its location instead of the data.  Otherwise remember this page,
+ * which the caller is about to send in full.
+ *
+ * Returns the number of pages written (0 or 1).
+ *
+ * @rs: current RAM state
+ * @pss: current PSS channel
+ * @offset: offset inside the block for the page
+ */
+static int save_dedup_page(RAMState *rs, PageSearchStatus *pss,
+                           ram_addr_t offset)
+{
+    uint8_t *p = pss->block->host + offset;
+    QEMUFile *file = pss->pss_channel;
+    gpointer key = GSIZE_TO_POINTER(ram_page_hash(p));
+    uint8_t *src = g_hash_table_lookup(rs->dedup_pages, key);
+    RAMBlock *src_block;
+    ram_addr_t src_offset;
+    size_t len;
+
+    if (!src) {
+        g_hash_table_insert(rs->dedup_pages, key, p);
+        return 0;
+    }
+
+    /* A collision keeps the first page; the new one is sent in full */
+    if (memcmp(src, p, TARGET_PAGE_SIZE)) {
+        return 0;
+    }
+
+    src_block = qemu_ram_block_from_host(src, false, &src_offset);
+    if (!src_block) {
+        return 0;
+    }
+
+    trace_ram_save_dedup_page(pss->block->idstr, offset,
+                              src_block->idstr, src_offset);
+
+    len = save_page_header(pss, file, pss->block,
+                           offset | RAM_SAVE_FLAG_DEDUP);
+    len += 1 + strlen(src_block->idstr) + 8;
+    qemu_put_counted_string(file, src_block->idstr);
+    qemu_put_be64(file, src_offset);
+    ram_transferred_add(len);
+    rs->dedup_sent++;
+
+    return 1;
+}
+
 /**
  * ram_save_target_page_legacy: save one target page
  *
@@ -1978,6 +2103,10 @@ static int ram_save_target_page_legacy(RAMState *rs, PageSearchStatus *pss)
         return 1;
     }
 
+    if (rs->dedup_pages && save_dedup_page(rs, pss, offset)) {
+        return 1;
+    }
+
     return ram_save_page(rs, pss);
 }
 
@@ -2298,6 +2427,11 @@ static void xbzrle_load_cleanup(void)
 static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
+        if ((*rsp)->dedup_pages) {
+            trace_ram_save_dedup_cleanup(g_hash_table_size((*rsp)->dedup_pages),
+                                         (*rsp)->dedup_sent);
+            g_hash_table_destroy((*rsp)->dedup_pages);
+        }
         migration_page_queue_free(*rsp);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
@@ -2985,6 +3119,14 @@ static int ram_save_setup(QEMUFile *f, void *opaque, Error **errp)
     }
     (*rsp)->pss[RAM_CHANNEL_PRECOPY].pss_channel = f;
 
+    /*
+     * Deduplication relies on pages not changing once they have been
+     * sent, so it is only done for snapshots of a stopped guest.
+     */
+    if (migrate_ram_dedup() && runstate_check(RUN_STATE_SAVE_VM)) {
+        (*rsp)->dedup_pages = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+
     /*
      * ??? Mirrors the previous value of qemu_host_page_size,
      * but is this really what was intended for the migration?
@@ -3434,6 +3576,43 @@ static inline void *host_from_ram_block_offset(RAMBlock *block,
     return block->host + offset;
 }
 
+/**
+ * load_dedup: load a page sent as a copy of an earlier page
+ *
+ * Returns 0 for success or -1 for an invalid reference.
+ *
+ * @f: QEMUFile where to read the data from
+ * @host: host address of the page to fill
+ */
+static int load_dedup(QEMUFile *f, void *host)
+{
+    RAMBlock *src_block;
+    ram_addr_t src_offset;
+    void *src;
+    char id[256];
+
+    qemu_get_counted_string(f, id);
+    src_offset = qemu_get_be64(f);
+
+    src_block = qemu_ram_block_by_name(id);
+    if (!src_block || migrate_ram_is_ignored(src_block)) {
+        error_report("Duplicate page refers to unknown block %s", id);
+        return -1;
+    }
+
+    src = host_from_ram_block_offset(src_block, src_offset);
+    if (!src || src_offset & ~TARGET_PAGE_MASK) {
+        error_report("Duplicate page refers to illegal offset "
+                     RAM_ADDR_FMT " in %s", src_offset, id);
+        return -1;
+    }
+
+    if (src != host) {
+        memcpy(host, src, TARGET_PAGE_SIZE);
+    }
+    return 0;
+}
+
 static void *host_page_from_ram_block_offset(RAMBlock *block,
                                              ram_addr_t offset)
 {
@@ -3950,9 +4129,127 @@ err:
     return false;
 }
 
+#ifndef _WIN32
+/*
+ * Zero [start, end) of a RAMBlock mapped from the migration file.  The
+ * file may still hold an older copy of these pages: a page that was
+ * sent and then became zero only has its bit cleared in the bitmap.
+ * Ranges that are holes in the file already read as zero.
+ */
+static bool mapped_ram_zero_range(RAMBlock *block, int fd, ram_addr_t start,
+                                  ram_addr_t end, Error **errp)
+{
+    size_t pagesize = qemu_real_host_page_size();
+    ram_addr_t map_start = ROUND_UP(start, pagesize);
+    ram_addr_t map_end = ROUND_DOWN(end, pagesize);
+    off_t data = lseek(fd, block->pages_offset + start, SEEK_DATA);
+
+    if ((data < 0 && errno == ENXIO) ||
+        (data >= 0 && data >= block->pages_offset + end)) {
+        return true;
+    }
+
+    if (map_start >= map_end) {
+        memset(block->host + start, 0, end - start);
+        return true;
+    }
+
+    if (mmap(block->host + map_start, map_end - map_start,
+             PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+             -1, 0) == MAP_FAILED) {
+        error_setg_errno(errp, errno, "failed to zero pages of ramblock %s",
+                         block->idstr);
+        return false;
+    }
+    memset(block->host + start, 0, map_start - start);
+    memset(block->host + map_end, 0, end - map_end);
+    trace_mapped_ram_zero_range(block->idstr, start, end - start);
+    return true;
+}
+#endif
+
+/*
+ * With x-mapped-ram-mmap, map the pages region of the migration file
+ * privately over the RAMBlock instead of reading it.  Pages whose bit
+ * is clear in the bitmap are zero, whatever the file holds at their
+ * offset, and are replaced with zeroes after mapping.  Discarding RAM
+ * must be disabled: on a private file mapping MADV_DONTNEED would bring
+ * back the file contents instead of zeroes.
+ *
+ * Returns true if the block is mapped, false if it must be read.
+ */
+static bool mapped_ram_map_ramblock(QEMUFile *f, RAMBlock *block,
+                                    ram_addr_t length, long num_pages,
+                                    unsigned long *bitmap, Error **errp)
+{
+#ifndef _WIN32
+    static bool discard_disabled;
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+    size_t pagesize = qemu_real_host_page_size();
+    unsigned long set_bit_idx, clear_bit_idx;
+    void *host;
+
+    if (!object_dynamic_cast(OBJECT(ioc), TYPE_QIO_CHANNEL_FILE)) {
+        warn_report_once("x-mapped-ram-mmap: migration channel is not a "
+                         "file, reading RAM instead");
+        return false;
+    }
+
+    if (block->fd >= 0 || qemu_ram_is_shared(block) ||
+        qemu_ram_pagesize(block) != pagesize ||
+        length != block->used_length ||
+        !QEMU_IS_ALIGNED(block->pages_offset, pagesize)) {
+        warn_report("x-mapped-ram-mmap: cannot map RAM block %s, "
+                    "reading it instead", block->idstr);
+        return false;
+    }
+
+    if (!discard_disabled) {
+        if (ram_block_discard_disable(true)) {
+            warn_report_once("x-mapped-ram-mmap: RAM discard is in use, "
+                             "reading RAM instead");
+            return false;
+        }
+        discard_disabled = true;
+    }
+
+    host = mmap(block->host, length, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_FIXED, QIO_CHANNEL_FILE(ioc)->fd,
+                block->pages_offset);
+    if (host == MAP_FAILED) {
+        error_setg_errno(errp, errno, "failed to map ramblock %s from the "
+                         "migration file", block->idstr);
+        return false;
+    }
+
+    for (clear_bit_idx = find_first_zero_bit(bitmap, num_pages);
+         clear_bit_idx < num_pages;
+         clear_bit_idx = find_next_zero_bit(bitmap, num_pages,
+                                            set_bit_idx + 1)) {
+        set_bit_idx = find_next_bit(bitmap, num_pages, clear_bit_idx + 1);
+        if (!mapped_ram_zero_range(block, QIO_CHANNEL_FILE(ioc)->fd,
+                                   clear_bit_idx * TARGET_PAGE_SIZE,
+                                   set_bit_idx * TARGET_PAGE_SIZE, errp)) {
+            return false;
+        }
+    }
+
+    /* The new mapping does not inherit the advice given to the old one */
+    if (!machine_dump_guest_core(current_machine)) {
+        qemu_madvise(block->host, length, QEMU_MADV_DONTDUMP);
+    }
+    trace_mapped_ram_map_ramblock(block->idstr, block->pages_offset, length);
+    return true;
+#else
+    /* it should have been rejected when setting the capability */
+    g_assert_not_reached();
+#endif
+}
+
 static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
                                       ram_addr_t length, Error **errp)
 {
+    ERRP_GUARD();
     g_autofree unsigned long *bitmap = NULL;
     MappedRamHeader header;
     size_t bitmap_size;
@@ -3987,10 +4284,21 @@ static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
         return;
     }
 
+    if (migrate_mapped_ram_mmap()) {
+        if (mapped_ram_map_ramblock(f, block, length, num_pages, bitmap,
+                                    errp)) {
+            goto skip;
+        }
+        if (*errp) {
+            return;
+        }
+    }
+
     if (!read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
         return;
     }
 
+skip:
     /* Skip pages array */
     qemu_set_offset(f, block->pages_offset + length, SEEK_SET);
 
@@ -4111,7 +4419,7 @@ static int ram_load_precopy(QEMUFile *f)
     if (migrate_mapped_ram()) {
         invalid_flags |= (RAM_SAVE_FLAG_HOOK | RAM_SAVE_FLAG_MULTIFD_FLUSH |
                           RAM_SAVE_FLAG_PAGE | RAM_SAVE_FLAG_XBZRLE |
-                          RAM_SAVE_FLAG_ZERO);
+                          RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_DEDUP);
     }
 
     while (!ret && !(flags & RAM_SAVE_FLAG_EOS)) {
@@ -4148,7 +4456,7 @@ static int ram_load_precopy(QEMUFile *f)
         }
 
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
-                     RAM_SAVE_FLAG_XBZRLE)) {
+                     RAM_SAVE_FLAG_XBZRLE | RAM_SAVE_FLAG_DEDUP)) {
             RAMBlock *block = ram_block_from_stream(mis, f, flags,
                                                     RAM_CHANNEL_PRECOPY);
 
@@ -4225,6 +4533,14 @@ static int ram_load_precopy(QEMUFile *f)
                 break;
             }
             break;
+        case RAM_SAVE_FLAG_DEDUP:
+            if (load_dedup(f, host) < 0) {
+                error_report("Failed to load duplicate page at "
+                             RAM_ADDR_FMT, addr);
+                ret = -EINVAL;
+                break;
+            }
+            break;
         case RAM_SAVE_FLAG_MULTIFD_FLUSH:
             multifd_recv_sync_main();
             break;
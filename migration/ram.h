@@ -39,7 +39,10 @@
  * it to only search for the zero value.  And to avoid confusion with
  * RAM_SAVE_FLAG_COMPRESS_PAGE just rename it.
  *
- * RAM_SAVE_FLAG_FULL (0x01) was obsoleted in 2009.
+ * RAM_SAVE_FLAG_FULL (0x01) was obsoleted in 2009.  The bit is reused
+ * by RAM_SAVE_FLAG_DEDUP, which is only sent with the x-ram-dedup
+ * capability: the page is a copy of a page sent earlier in the stream,
+ * identified by its block name and offset.
  *
  * RAM_SAVE_FLAG_COMPRESS_PAGE (0x100) was removed in QEMU 9.1.
  *
@@ -52,6 +55,7 @@
  * multiple of PAGE_SIZE.  Here it means QEMU supports migration with any
  * architecture that has PAGE_SIZE>=1K (0x400).
  */
+#define RAM_SAVE_FLAG_DEDUP                   0x001
 #define RAM_SAVE_FLAG_ZERO                    0x002
 #define RAM_SAVE_FLAG_MEM_SIZE                0x004
 #define RAM_SAVE_FLAG_PAGE                    0x008
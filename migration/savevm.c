@@ -36,10 +36,12 @@
 #include "migration/misc.h"
 #include "migration/register.h"
 #include "migration/global_state.h"
+#include "migration/blocker.h"
 #include "migration/channel-block.h"
 #include "ram.h"
 #include "qemu-file.h"
 #include "savevm.h"
+#include "dirtyrate.h"
 #include "postcopy-ram.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-migration.h"
@@ -55,6 +57,7 @@
 #include "qemu/main-loop.h"
 #include "block/snapshot.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "io/channel-buffer.h"
 #include "io/channel-file.h"
 #include "system/replay.h"
@@ -68,6 +71,7 @@
 #include "yank_functions.h"
 #include "system/qtest.h"
 #include "options.h"
+#include "state-workers.h"
 
 const unsigned int postcopy_ram_discard_version;
 
@@ -94,6 +98,8 @@ enum qemu_vm_cmd {
 };
 
 #define MAX_VM_CMD_PACKAGED_SIZE UINT32_MAX
+/* Largest QEMU_VM_SECTION_FULL_SIZED section, buffered whole on both sides */
+#define MAX_VM_SIZED_SECTION_SIZE (64 * MiB)
 static struct mig_cmd_args {
     ssize_t     len; /* -1 = variable */
     const char *name;
@@ -968,6 +974,7 @@ static void save_section_header(QEMUFile *f, SaveStateEntry *se,
     qemu_put_be32(f, se->section_id);
 
     if (section_type == QEMU_VM_SECTION_FULL ||
+        section_type == QEMU_VM_SECTION_FULL_SIZED ||
         section_type == QEMU_VM_SECTION_START) {
         /* ID string */
         size_t len = strlen(se->idstr);
@@ -1030,6 +1037,158 @@ static int vmstate_save(QEMUFile *f, SaveStateEntry *se, JSONWriter *vmdesc,
     }
     return 0;
 }
+
+/*
+ * An independent device section saved by a worker thread into its own
+ * buffer, which the migration thread copies to the stream once it
+ * reaches the section.
+ */
+typedef struct SaveStateJob {
+    StateWork work;
+    SaveStateEntry *se;
+    QIOChannelBuffer *bioc;
+    JSONWriter *vmdesc;
+    Error *err;
+    int64_t time;
+} SaveStateJob;
+
+static bool vmstate_is_independent(SaveStateEntry *se)
+{
+    return se->vmsd && se->vmsd->independent && !se->vmsd->early_setup;
+}
+
+static void device_time_append(MigrationDeviceTimeList **list,
+                               SaveStateEntry *se, int64_t time,
+                               bool parallel)
+{
+    MigrationDeviceTime *dt = g_new0(MigrationDeviceTime, 1);
+
+    dt->idstr = g_strdup(se->idstr);
+    dt->instance_id = se->instance_id;
+    dt->time = time;
+    dt->parallel = parallel;
+
+    while (*list) {
+        list = &(*list)->next;
+    }
+    QAPI_LIST_APPEND(list, dt);
+}
+
+static int vmstate_save_job(StateWork *work)
+{
+    SaveStateJob *job = container_of(work, SaveStateJob, work);
+    SaveStateEntry *se = job->se;
+    int64_t start = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    QEMUFile *f;
+    int ret, close_ret;
+
+    job->bioc = qio_channel_buffer_new(4096);
+    qio_channel_set_name(QIO_CHANNEL(job->bioc), "migration-state-buffer");
+    f = qemu_file_new_output(QIO_CHANNEL(job->bioc));
+
+    if (job->vmdesc) {
+        json_writer_start_object(job->vmdesc, NULL);
+        json_writer_str(job->vmdesc, "name", se->idstr);
+        json_writer_int64(job->vmdesc, "instance_id", se->instance_id);
+    }
+
+    trace_vmstate_save(se->idstr, se->vmsd->name);
+    ret = vmstate_save_state_with_err(f, se->vmsd, se->opaque, job->vmdesc,
+                                      &job->err);
+    if (job->vmdesc && !ret) {
+        json_writer_end_object(job->vmdesc);
+    }
+
+    close_ret = qemu_fclose(f);
+    if (!ret && close_ret) {
+        error_setg_errno(&job->err, -close_ret,
+                         "Failed to buffer state of '%s'", se->idstr);
+        ret = close_ret;
+    }
+
+    job->time = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start;
+    return ret;
+}
+
+static int vmstate_save_job_finish(QEMUFile *f, SaveStateJob *job,
+                                   JSONWriter *vmdesc, Error **errp)
+{
+    SaveStateEntry *se = job->se;
+    int ret;
+
+    ret = state_work_wait(&job->work);
+    if (ret) {
+        if (job->err) {
+            error_propagate(errp, job->err);
+            job->err = NULL;
+        } else {
+            error_setg(errp, "Failed to save state of '%s'", se->idstr);
+        }
+        return ret;
+    }
+    if (job->bioc->usage > MAX_VM_SIZED_SECTION_SIZE) {
+        error_setg(errp, "State of '%s' is too large: %zu bytes",
+                   se->idstr, job->bioc->usage);
+        return -EFBIG;
+    }
+
+    trace_savevm_section_start(se->idstr, se->section_id);
+    save_section_header(f, se, QEMU_VM_SECTION_FULL_SIZED);
+    qemu_put_be32(f, job->bioc->usage);
+    qemu_put_buffer(f, job->bioc->data, job->bioc->usage);
+    trace_savevm_section_end(se->idstr, se->section_id, 0);
+    save_section_footer(f, se);
+    if (vmdesc) {
+        json_writer_raw(vmdesc, NULL, json_writer_get(job->vmdesc));
+    }
+    return 0;
+}
+
+static void save_state_job_free(SaveStateJob *job)
+{
+    if (job->bioc) {
+        object_unref(OBJECT(job->bioc));
+    }
+    json_writer_free(job->vmdesc);
+    error_free(job->err);
+    g_free(job);
+}
+
+/* Start saving the independent sections on worker threads */
+static StateWorkers *save_state_jobs_start(GQueue *jobs, JSONWriter *vmdesc)
+{
+    StateWorkers *workers = NULL;
+    SaveStateEntry *se;
+    SaveStateJob *job;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        if (!vmstate_is_independent(se) ||
+            !vmstate_section_needed(se->vmsd, se->opaque)) {
+            continue;
+        }
+        if (!workers) {
+            workers = state_workers_new();
+        }
+
+        job = g_new0(SaveStateJob, 1);
+        job->se = se;
+        job->vmdesc = vmdesc ? json_writer_new(false) : NULL;
+        g_queue_push_tail(jobs, job);
+        state_workers_submit(workers, &job->work, vmstate_save_job);
+    }
+
+    return workers;
+}
+
+static void save_state_jobs_cancel(GQueue *jobs)
+{
+    SaveStateJob *job;
+
+    while ((job = g_queue_pop_head(jobs))) {
+        state_work_wait(&job->work);
+        save_state_job_free(job);
+    }
+}
 /**
  * qemu_savevm_command_send: Send a 'QEMU_VM_COMMAND' type element with the
  *                           command and associated data.
@@ -1518,33 +1677,59 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                                     bool inactivate_disks)
 {
     MigrationState *ms = migrate_get_current();
-    int64_t start_ts_each, end_ts_each;
+    int64_t start_ts_each, end_ts_each, time_each;
     JSONWriter *vmdesc = ms->vmdesc;
+    MigrationDeviceTimeList *device_times = NULL;
+    StateWorkers *workers = NULL;
+    GQueue jobs = G_QUEUE_INIT;
+    SaveStateJob *job;
     int vmdesc_len;
     SaveStateEntry *se;
     Error *local_err = NULL;
+    bool parallel;
     int ret;
 
+    if (migrate_parallel_device_state()) {
+        workers = save_state_jobs_start(&jobs, vmdesc);
+    }
+
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
         if (se->vmsd && se->vmsd->early_setup) {
             /* Already saved during qemu_savevm_state_setup(). */
             continue;
         }
 
-        start_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
-
-        ret = vmstate_save(f, se, vmdesc, &local_err);
+        job = g_queue_peek_head(&jobs);
+        parallel = job && job->se == se;
+        if (parallel) {
+            g_queue_pop_head(&jobs);
+            ret = vmstate_save_job_finish(f, job, vmdesc, &local_err);
+            time_each = job->time;
+            save_state_job_free(job);
+        } else {
+            start_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+            ret = vmstate_save(f, se, vmdesc, &local_err);
+            end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+            time_each = end_ts_each - start_ts_each;
+        }
         if (ret) {
             migrate_set_error(ms, local_err);
             error_report_err(local_err);
             qemu_file_set_error(f, ret);
+            save_state_jobs_cancel(&jobs);
+            state_workers_free(workers);
+            qapi_free_MigrationDeviceTimeList(device_times);
             return ret;
         }
 
-        end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
-        trace_vmstate_downtime_save("non-iterable", se->idstr, se->instance_id,
-                                    end_ts_each - start_ts_each);
+        trace_vmstate_downtime_save(parallel ? "parallel" : "non-iterable",
+                                    se->idstr, se->instance_id, time_each);
+        device_time_append(&device_times, se, time_each, parallel);
     }
+    state_workers_free(workers);
+
+    qapi_free_MigrationDeviceTimeList(ms->device_times);
+    ms->device_times = device_times;
 
     if (inactivate_disks) {
         /*
@@ -1744,16 +1929,14 @@ void qemu_savevm_live_state(QEMUFile *f)
     qemu_put_byte(f, QEMU_VM_EOF);
 }
 
-int qemu_save_device_state(QEMUFile *f)
+/*
+ * Write the full sections of every non-RAM handler, terminated by
+ * QEMU_VM_EOF; this is what qemu_load_device_state() reads back.
+ */
+static int qemu_save_device_sections(QEMUFile *f, Error **errp)
 {
-    MigrationState *ms = migrate_get_current();
-    Error *local_err = NULL;
     SaveStateEntry *se;
 
-    if (!migration_in_colo_state()) {
-        qemu_put_be32(f, QEMU_VM_FILE_MAGIC);
-        qemu_put_be32(f, QEMU_VM_FILE_VERSION);
-    }
     cpu_synchronize_all_states();
 
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
@@ -1762,10 +1945,8 @@ int qemu_save_device_state(QEMUFile *f)
         if (se->is_ram) {
             continue;
         }
-        ret = vmstate_save(f, se, NULL, &local_err);
+        ret = vmstate_save(f, se, NULL, errp);
         if (ret) {
-            migrate_set_error(ms, local_err);
-            error_report_err(local_err);
             return ret;
         }
     }
@@ -1775,6 +1956,25 @@ int qemu_save_device_state(QEMUFile *f)
     return qemu_file_get_error(f);
 }
 
+int qemu_save_device_state(QEMUFile *f)
+{
+    MigrationState *ms = migrate_get_current();
+    Error *local_err = NULL;
+    int ret;
+
+    if (!migration_in_colo_state()) {
+        qemu_put_be32(f, QEMU_VM_FILE_MAGIC);
+        qemu_put_be32(f, QEMU_VM_FILE_VERSION);
+    }
+
+    ret = qemu_save_device_sections(f, &local_err);
+    if (local_err) {
+        migrate_set_error(ms, local_err);
+        error_report_err(local_err);
+    }
+    return ret;
+}
+
 static SaveStateEntry *find_se(const char *idstr, uint32_t instance_id)
 {
     SaveStateEntry *se;
@@ -2556,8 +2756,140 @@ static bool check_section_footer(QEMUFile *f, SaveStateEntry *se)
     return true;
 }
 
+/*
+ * A QEMU_VM_SECTION_FULL_SIZED section read into its own buffer.  The
+ * sections of independent devices are loaded by worker threads; the
+ * jobs are waited for before anything else in the stream is loaded.
+ */
+typedef struct LoadStateJob {
+    StateWork work;
+    SaveStateEntry *se;
+    int version_id;
+    QIOChannelBuffer *bioc;
+    int64_t time;
+} LoadStateJob;
+
+typedef struct LoadStateJobs {
+    StateWorkers *workers;
+    GQueue queue;
+} LoadStateJobs;
+
+static int vmstate_load_job(StateWork *work)
+{
+    LoadStateJob *job = container_of(work, LoadStateJob, work);
+    SaveStateEntry *se = job->se;
+    int64_t start = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    QEMUFile *f = qemu_file_new_input(QIO_CHANNEL(job->bioc));
+    int ret;
+
+    trace_vmstate_load(se->idstr, se->vmsd->name);
+    ret = vmstate_load_state(f, se->vmsd, se->opaque, job->version_id);
+    qemu_fclose(f);
+
+    job->time = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start;
+    return ret;
+}
+
+static void load_state_job_free(LoadStateJob *job)
+{
+    object_unref(OBJECT(job->bioc));
+    g_free(job);
+}
+
+static int load_state_job_done(LoadStateJob *job, int ret, bool parallel)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    SaveStateEntry *se = job->se;
+
+    if (ret < 0) {
+        error_report("error while loading state for instance 0x%"PRIx32" of"
+                     " device '%s'", se->instance_id, se->idstr);
+    } else {
+        trace_vmstate_downtime_load(parallel ? "parallel" : "non-iterable",
+                                    se->idstr, se->instance_id, job->time);
+        device_time_append(&mis->device_times, se, job->time, parallel);
+    }
+    load_state_job_free(job);
+    return ret;
+}
+
+/* Wait for the sections being loaded by worker threads */
+static int load_state_jobs_wait(LoadStateJobs *jobs)
+{
+    LoadStateJob *job;
+    int ret = 0, job_ret;
+
+    while ((job = g_queue_pop_head(&jobs->queue))) {
+        job_ret = load_state_job_done(job, state_work_wait(&job->work), true);
+        if (!ret) {
+            ret = job_ret;
+        }
+    }
+    return ret;
+}
+
+static int qemu_loadvm_section_sized(QEMUFile *f, SaveStateEntry *se,
+                                     LoadStateJobs *jobs)
+{
+    LoadStateJob *job;
+    uint32_t len;
+    int ret;
+
+    if (!se->vmsd) {
+        error_report("Sized section for '%s', which has no VMSD", se->idstr);
+        return -EINVAL;
+    }
+
+    len = qemu_get_be32(f);
+    ret = qemu_file_get_error(f);
+    if (ret) {
+        error_report("Failed to read section length of '%s': %d",
+                     se->idstr, ret);
+        return ret;
+    }
+    if (len > MAX_VM_SIZED_SECTION_SIZE) {
+        error_report("Section of '%s' is too large: %" PRIu32 " bytes",
+                     se->idstr, len);
+        return -EINVAL;
+    }
+
+    job = g_new0(LoadStateJob, 1);
+    job->se = se;
+    job->version_id = se->load_version_id;
+    job->bioc = qio_channel_buffer_new(len);
+    qio_channel_set_name(QIO_CHANNEL(job->bioc), "migration-state-buffer");
+    if (qemu_get_buffer(f, job->bioc->data, len) != len) {
+        error_report("Failed to read section of '%s'", se->idstr);
+        load_state_job_free(job);
+        ret = qemu_file_get_error(f);
+        return ret ? ret : -EIO;
+    }
+    job->bioc->usage = len;
+
+    if (!check_section_footer(f, se)) {
+        load_state_job_free(job);
+        return -EINVAL;
+    }
+
+    if (migrate_parallel_device_state() && se->vmsd->independent) {
+        if (!jobs->workers) {
+            jobs->workers = state_workers_new();
+        }
+        g_queue_push_tail(&jobs->queue, job);
+        state_workers_submit(jobs->workers, &job->work, vmstate_load_job);
+        return 0;
+    }
+
+    ret = load_state_jobs_wait(jobs);
+    if (ret < 0) {
+        load_state_job_free(job);
+        return ret;
+    }
+    return load_state_job_done(job, vmstate_load_job(&job->work), false);
+}
+
 static int
-qemu_loadvm_section_start_full(QEMUFile *f, uint8_t type)
+qemu_loadvm_section_start_full(QEMUFile *f, uint8_t type, LoadStateJobs *jobs)
 {
     bool trace_downtime = (type == QEMU_VM_SECTION_FULL);
     uint32_t instance_id, version_id, section_id;
@@ -2610,6 +2942,10 @@ qemu_loadvm_section_start_full(QEMUFile *f, uint8_t type)
         return -EINVAL;
     }
 
+    if (type == QEMU_VM_SECTION_FULL_SIZED) {
+        return qemu_loadvm_section_sized(f, se, jobs);
+    }
+
     if (trace_downtime) {
         start_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     }
@@ -2625,6 +2961,8 @@ qemu_loadvm_section_start_full(QEMUFile *f, uint8_t type)
         end_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
         trace_vmstate_downtime_load("non-iterable", se->idstr,
                                     se->instance_id, end_ts - start_ts);
+        device_time_append(&migration_incoming_get_current()->device_times,
+                           se, end_ts - start_ts, false);
     }
 
     if (!check_section_footer(f, se)) {
@@ -2852,8 +3190,9 @@ static bool postcopy_pause_incoming(MigrationIncomingState *mis)
 
 int qemu_loadvm_state_main(QEMUFile *f, MigrationIncomingState *mis)
 {
+    LoadStateJobs jobs = { .queue = G_QUEUE_INIT };
     uint8_t section_type;
-    int ret = 0;
+    int ret = 0, jobs_ret;
 
 retry:
     while (true) {
@@ -2864,11 +3203,20 @@ retry:
             break;
         }
 
+        /* Devices loaded in parallel must be done before anything else */
+        if (section_type != QEMU_VM_SECTION_FULL_SIZED) {
+            ret = load_state_jobs_wait(&jobs);
+            if (ret < 0) {
+                goto out;
+            }
+        }
+
         trace_qemu_loadvm_state_section(section_type);
         switch (section_type) {
         case QEMU_VM_SECTION_START:
         case QEMU_VM_SECTION_FULL:
-            ret = qemu_loadvm_section_start_full(f, section_type);
+        case QEMU_VM_SECTION_FULL_SIZED:
+            ret = qemu_loadvm_section_start_full(f, section_type, &jobs);
             if (ret < 0) {
                 goto out;
             }
@@ -2898,6 +3246,13 @@ retry:
     }
 
 out:
+    jobs_ret = load_state_jobs_wait(&jobs);
+    if (ret >= 0 && jobs_ret < 0) {
+        ret = jobs_ret;
+    }
+    state_workers_free(jobs.workers);
+    jobs.workers = NULL;
+
     if (ret < 0) {
         qemu_file_set_error(f, ret);
 
@@ -2952,6 +3307,9 @@ int qemu_loadvm_state(QEMUFile *f)
 
     cpu_synchronize_all_pre_loadvm();
 
+    qapi_free_MigrationDeviceTimeList(mis->device_times);
+    mis->device_times = NULL;
+
     ret = qemu_loadvm_state_main(f, mis);
     qemu_event_set(&mis->main_thread_load_event);
 
@@ -3014,6 +3372,9 @@ int qemu_load_device_state(QEMUFile *f)
     MigrationIncomingState *mis = migration_incoming_get_current();
     int ret;
 
+    qapi_free_MigrationDeviceTimeList(mis->device_times);
+    mis->device_times = NULL;
+
     /* Load QEMU_VM_SECTION_FULL section */
     ret = qemu_loadvm_state_main(f, mis);
     if (ret < 0) {
@@ -3322,6 +3683,336 @@ void load_snapshot_resume(RunState state)
     }
 }
 
+/*
+ * In-memory checkpoint
+ *
+ * A copy of every migratable RAM block and of the device state is kept
+ * in host memory so that the machine can be reset to it repeatedly.
+ * While a checkpoint is held, global dirty logging stays enabled and
+ * the migration dirty bitmap records the guest pages written since the
+ * checkpoint (or since the last restore), so a restore only copies those
+ * pages back.  Migration is blocked for the lifetime of the checkpoint
+ * because it would consume the same dirty bitmap.  Block device contents
+ * are not part of the checkpoint.
+ */
+typedef struct MemCheckpointBlock {
+    RAMBlock *rb;
+    char idstr[256];
+    ram_addr_t length;
+    uint8_t *data;
+} MemCheckpointBlock;
+
+typedef struct MemCheckpoint {
+    MemCheckpointBlock *blocks;
+    unsigned int nr_blocks;
+    uint8_t *device_state;
+    size_t device_state_size;
+    Error *blocker;
+} MemCheckpoint;
+
+static MemCheckpoint *mem_checkpoint;
+
+bool memory_checkpoint_held(void)
+{
+    return mem_checkpoint != NULL;
+}
+
+static void mem_checkpoint_free(MemCheckpoint *c)
+{
+    unsigned int i;
+
+    for (i = 0; i < c->nr_blocks; i++) {
+        qemu_vfree(c->blocks[i].data);
+    }
+    g_free(c->blocks);
+    g_free(c->device_state);
+    g_free(c);
+}
+
+static void mem_checkpoint_release(void)
+{
+    if (!mem_checkpoint) {
+        return;
+    }
+    migrate_del_blocker(&mem_checkpoint->blocker);
+    memory_global_dirty_log_stop(GLOBAL_DIRTY_CHECKPOINT);
+    mem_checkpoint_free(mem_checkpoint);
+    mem_checkpoint = NULL;
+}
+
+/* Drop the pending dirty bits of @rb, returning them as a snapshot */
+static DirtyBitmapSnapshot *mem_checkpoint_take_dirty(RAMBlock *rb)
+{
+    return memory_region_snapshot_and_clear_dirty(rb->mr, 0, rb->used_length,
+                                                  DIRTY_MEMORY_MIGRATION);
+}
+
+static bool mem_checkpoint_save_ram(MemCheckpoint *c, Error **errp)
+{
+    RAMBlock *rb;
+    unsigned int i = 0;
+
+    RCU_READ_LOCK_GUARD();
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
+        c->nr_blocks++;
+    }
+    c->blocks = g_new0(MemCheckpointBlock, c->nr_blocks);
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
+        MemCheckpointBlock *b = &c->blocks[i++];
+
+        b->rb = rb;
+        pstrcpy(b->idstr, sizeof(b->idstr), rb->idstr);
+        b->length = rb->used_length;
+        b->data = qemu_try_memalign(qemu_real_host_page_size(), b->length);
+        if (!b->data) {
+            error_setg(errp, "Could not allocate %" PRIu64 " bytes to "
+                       "checkpoint RAM block '%s'", (uint64_t)b->length,
+                       rb->idstr);
+            return false;
+        }
+
+        g_free(mem_checkpoint_take_dirty(rb));
+        memcpy(b->data, rb->host, b->length);
+    }
+    return true;
+}
+
+static bool mem_checkpoint_save_devices(MemCheckpoint *c, Error **errp)
+{
+    QIOChannelBuffer *bioc = qio_channel_buffer_new(4096);
+    QEMUFile *f = qemu_file_new_output(QIO_CHANNEL(bioc));
+    Error *local_err = NULL;
+    int ret;
+
+    ret = qemu_save_device_sections(f, &local_err);
+    if (!ret) {
+        ret = qemu_fflush(f);
+    }
+    if (local_err) {
+        error_propagate(errp, local_err);
+    } else if (ret) {
+        error_setg_errno(errp, -ret, "Could not save device state");
+    } else {
+        c->device_state = g_memdup2(bioc->data, bioc->usage);
+        c->device_state_size = bioc->usage;
+    }
+
+    qemu_fclose(f);
+    object_unref(OBJECT(bioc));
+    return ret == 0;
+}
+
+/*
+ * Check that the RAM layout still matches the checkpoint, i.e. that no
+ * block was added, removed or resized since it was captured.
+ */
+static bool mem_checkpoint_check_ram(MemCheckpoint *c, Error **errp)
+{
+    RAMBlock *rb;
+    unsigned int i = 0;
+
+    RCU_READ_LOCK_GUARD();
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
+        MemCheckpointBlock *b = &c->blocks[i];
+
+        if (i == c->nr_blocks || b->rb != rb || strcmp(b->idstr, rb->idstr) ||
+            b->length != rb->used_length) {
+            error_setg(errp, "RAM layout changed since the checkpoint was "
+                       "taken (block '%s')", rb->idstr);
+            return false;
+        }
+        i++;
+    }
+    if (i != c->nr_blocks) {
+        error_setg(errp, "RAM block '%s' was removed since the checkpoint "
+                   "was taken", c->blocks[i].idstr);
+        return false;
+    }
+    return true;
+}
+
+static uint64_t mem_checkpoint_restore_ram(MemCheckpoint *c)
+{
+    size_t page_size = qemu_target_page_size();
+    uint64_t restored = 0;
+    unsigned int i;
+
+    RCU_READ_LOCK_GUARD();
+
+    for (i = 0; i < c->nr_blocks; i++) {
+        MemCheckpointBlock *b = &c->blocks[i];
+        g_autofree DirtyBitmapSnapshot *snap = mem_checkpoint_take_dirty(b->rb);
+        ram_addr_t offset = 0;
+
+        /* Copy back runs of consecutive dirty pages */
+        while (offset < b->length) {
+            ram_addr_t start;
+
+            if (!memory_region_snapshot_get_dirty(b->rb->mr, snap, offset,
+                                                  page_size)) {
+                offset += page_size;
+                continue;
+            }
+            start = offset;
+            do {
+                offset += page_size;
+            } while (offset < b->length &&
+                     memory_region_snapshot_get_dirty(b->rb->mr, snap, offset,
+                                                      page_size));
+
+            memcpy(b->rb->host + start, b->data + start, offset - start);
+            restored += (offset - start) / page_size;
+        }
+    }
+    return restored;
+}
+
+static int mem_checkpoint_restore_devices(MemCheckpoint *c)
+{
+    QIOChannelBuffer *bioc = qio_channel_buffer_new(c->device_state_size);
+    QEMUFile *f;
+    int ret;
+
+    memcpy(bioc->data, c->device_state, c->device_state_size);
+    bioc->usage = c->device_state_size;
+
+    f = qemu_file_new_input(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+
+    ret = qemu_load_device_state(f);
+    qemu_fclose(f);
+    return ret;
+}
+
+void qmp_x_memory_checkpoint_save(Error **errp)
+{
+    RunState saved_state = runstate_get();
+    MemCheckpoint *c;
+    bool ok = false;
+
+    GLOBAL_STATE_CODE();
+
+    if (qemu_savevm_state_blocked(errp)) {
+        return;
+    }
+    /* Both would consume the dirty bitmap the checkpoint relies on */
+    if (migration_is_running()) {
+        error_setg(errp, "Cannot take a checkpoint while a migration is "
+                   "running");
+        return;
+    }
+    if (dirtyrate_bitmap_in_use()) {
+        error_setg(errp, "Cannot take a checkpoint while the dirty rate is "
+                   "being measured in dirty-bitmap mode");
+        return;
+    }
+    if (!replay_can_snapshot()) {
+        error_setg(errp, "Record/replay does not allow making a checkpoint "
+                   "right now. Try once more later.");
+        return;
+    }
+
+    /* A new checkpoint replaces the old one */
+    mem_checkpoint_release();
+
+    c = g_new0(MemCheckpoint, 1);
+    error_setg(&c->blocker, "Migration is disabled while an in-memory "
+               "checkpoint is held");
+    if (migrate_add_blocker(&c->blocker, errp) < 0) {
+        mem_checkpoint_free(c);
+        return;
+    }
+    if (!memory_global_dirty_log_start(GLOBAL_DIRTY_CHECKPOINT, errp)) {
+        migrate_del_blocker(&c->blocker);
+        mem_checkpoint_free(c);
+        return;
+    }
+    mem_checkpoint = c;
+
+    global_state_store();
+    vm_stop(RUN_STATE_SAVE_VM);
+    bdrv_drain_all_begin();
+
+    if (mem_checkpoint_save_ram(c, errp) &&
+        mem_checkpoint_save_devices(c, errp)) {
+        trace_memory_checkpoint_save(c->nr_blocks, c->device_state_size);
+        ok = true;
+    }
+
+    bdrv_drain_all_end();
+    if (!ok) {
+        mem_checkpoint_release();
+    }
+    vm_resume(saved_state);
+}
+
+MemoryCheckpointRestoreInfo *qmp_x_memory_checkpoint_restore(Error **errp)
+{
+    MemCheckpoint *c = mem_checkpoint;
+    RunState saved_state = runstate_get();
+    MemoryCheckpointRestoreInfo *info;
+    int64_t start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    uint64_t total = 0;
+    unsigned int i;
+    int ret;
+
+    GLOBAL_STATE_CODE();
+
+    if (!c) {
+        error_setg(errp, "No in-memory checkpoint has been taken");
+        return NULL;
+    }
+    if (!mem_checkpoint_check_ram(c, errp)) {
+        return NULL;
+    }
+
+    vm_stop(RUN_STATE_RESTORE_VM);
+    replay_flush_events();
+    bdrv_drain_all_begin();
+
+    /*
+     * Reset first, as for load_snapshot(): whatever the reset handlers
+     * write to guest RAM (ROM blobs, ...) is dirty and copied back below.
+     */
+    qemu_system_reset(SHUTDOWN_CAUSE_SNAPSHOT_LOAD);
+
+    info = g_new0(MemoryCheckpointRestoreInfo, 1);
+    info->restored_pages = mem_checkpoint_restore_ram(c);
+    for (i = 0; i < c->nr_blocks; i++) {
+        total += c->blocks[i].length / qemu_target_page_size();
+    }
+    info->total_pages = total;
+
+    ret = mem_checkpoint_restore_devices(c);
+
+    bdrv_drain_all_end();
+
+    if (ret < 0) {
+        error_setg(errp, "Error %d while loading checkpoint device state",
+                   ret);
+        qapi_free_MemoryCheckpointRestoreInfo(info);
+        return NULL;
+    }
+
+    trace_memory_checkpoint_restore(info->restored_pages, info->total_pages,
+                                    qemu_clock_get_ns(QEMU_CLOCK_REALTIME) -
+                                    start_ns);
+    load_snapshot_resume(saved_state);
+    return info;
+}
+
+void qmp_x_memory_checkpoint_drop(Error **errp)
+{
+    if (!mem_checkpoint) {
+        error_setg(errp, "No in-memory checkpoint has been taken");
+        return;
+    }
+    mem_checkpoint_release();
+}
+
 bool delete_snapshot(const char *name, bool has_devices,
                      strList *devices, Error **errp)
 {
@@ -27,6 +27,12 @@
 #define QEMU_VM_VMDESCRIPTION        0x06
 #define QEMU_VM_CONFIGURATION        0x07
 #define QEMU_VM_COMMAND              0x08
+/*
+ * Like QEMU_VM_SECTION_FULL, but the section data is preceded by its
+ * be32 length so that it can be loaded from a separate buffer.  Only
+ * sent with the x-parallel-device-state capability.
+ */
+#define QEMU_VM_SECTION_FULL_SIZED   0x09
 #define QEMU_VM_SECTION_FOOTER       0x7e
 
 bool qemu_savevm_state_blocked(Error **errp);
@@ -66,6 +72,7 @@ int qemu_loadvm_state(QEMUFile *f);
 void qemu_loadvm_state_cleanup(void);
 int qemu_loadvm_state_main(QEMUFile *f, MigrationIncomingState *mis);
 int qemu_load_device_state(QEMUFile *f);
+bool memory_checkpoint_held(void);
 int qemu_loadvm_approve_switchover(void);
 int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         bool in_postcopy, bool inactivate_disks);
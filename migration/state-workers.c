@@ -0,0 +1,122 @@
+/*
+ * Worker threads for saving and loading device state
+ *
+ * Device sections whose VMSD is marked independent are saved to and
+ * loaded from memory buffers on these threads, while the migration
+ * thread keeps the order of sections in the stream.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/lockable.h"
+#include "qemu/rcu.h"
+#include "state-workers.h"
+#include "threadinfo.h"
+#include "trace.h"
+
+#define STATE_WORKERS_MAX 8
+
+struct StateWorkers {
+    QemuMutex lock;
+    QemuCond cond;
+    QSIMPLEQ_HEAD(, StateWork) queue;
+    bool quit;
+    unsigned n_threads;
+    QemuThread threads[STATE_WORKERS_MAX];
+};
+
+static void *state_worker_thread(void *opaque)
+{
+    StateWorkers *workers = opaque;
+    MigrationThread *thread;
+    StateWork *work;
+
+    rcu_register_thread();
+    thread = migration_threads_add("state-worker", qemu_get_thread_id());
+
+    for (;;) {
+        WITH_QEMU_LOCK_GUARD(&workers->lock) {
+            while (QSIMPLEQ_EMPTY(&workers->queue) && !workers->quit) {
+                qemu_cond_wait(&workers->cond, &workers->lock);
+            }
+            work = QSIMPLEQ_FIRST(&workers->queue);
+            if (work) {
+                QSIMPLEQ_REMOVE_HEAD(&workers->queue, next);
+            }
+        }
+        if (!work) {
+            break;
+        }
+
+        work->ret = work->func(work);
+        qemu_event_set(&work->done);
+    }
+
+    migration_threads_remove(thread);
+    rcu_unregister_thread();
+    return NULL;
+}
+
+StateWorkers *state_workers_new(void)
+{
+    StateWorkers *workers = g_new0(StateWorkers, 1);
+    unsigned i;
+
+    qemu_mutex_init(&workers->lock);
+    qemu_cond_init(&workers->cond);
+    QSIMPLEQ_INIT(&workers->queue);
+    workers->n_threads = MIN(MAX(g_get_num_processors(), 1),
+                             STATE_WORKERS_MAX);
+
+    for (i = 0; i < workers->n_threads; i++) {
+        qemu_thread_create(&workers->threads[i], "mig/state",
+                           state_worker_thread, workers,
+                           QEMU_THREAD_JOINABLE);
+    }
+    trace_state_workers_new(workers->n_threads);
+
+    return workers;
+}
+
+void state_workers_submit(StateWorkers *workers, StateWork *work,
+                          StateWorkFunc *func)
+{
+    work->func = func;
+    work->ret = 0;
+    qemu_event_init(&work->done, false);
+
+    WITH_QEMU_LOCK_GUARD(&workers->lock) {
+        QSIMPLEQ_INSERT_TAIL(&workers->queue, work, next);
+        qemu_cond_signal(&workers->cond);
+    }
+}
+
+int state_work_wait(StateWork *work)
+{
+    qemu_event_wait(&work->done);
+    qemu_event_destroy(&work->done);
+    return work->ret;
+}
+
+void state_workers_free(StateWorkers *workers)
+{
+    unsigned i;
+
+    if (!workers) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&workers->lock) {
+        workers->quit = true;
+        qemu_cond_broadcast(&workers->cond);
+    }
+    for (i = 0; i < workers->n_threads; i++) {
+        qemu_thread_join(&workers->threads[i]);
+    }
+
+    qemu_cond_destroy(&workers->cond);
+    qemu_mutex_destroy(&workers->lock);
+    g_free(workers);
+}
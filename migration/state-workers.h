@@ -0,0 +1,59 @@
+/*
+ * Worker threads for saving and loading device state
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_STATE_WORKERS_H
+#define QEMU_MIGRATION_STATE_WORKERS_H
+
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+
+typedef struct StateWorkers StateWorkers;
+typedef struct StateWork StateWork;
+
+typedef int StateWorkFunc(StateWork *work);
+
+/*
+ * One unit of work.  Callers usually embed it in a larger structure
+ * and get back to it with container_of() from @func.
+ */
+struct StateWork {
+    StateWorkFunc *func;
+    int ret;
+    QemuEvent done;
+    QSIMPLEQ_ENTRY(StateWork) next;
+};
+
+/**
+ * state_workers_new: start a pool of worker threads
+ *
+ * The number of threads depends on the number of host CPUs.
+ */
+StateWorkers *state_workers_new(void);
+
+/**
+ * state_workers_submit: queue @work for a worker thread
+ *
+ * @work must stay valid until state_work_wait() has returned for it.
+ */
+void state_workers_submit(StateWorkers *workers, StateWork *work,
+                          StateWorkFunc *func);
+
+/**
+ * state_work_wait: wait for @work to complete
+ *
+ * Returns the value returned by its function.
+ */
+int state_work_wait(StateWork *work);
+
+/**
+ * state_workers_free: stop the worker threads
+ *
+ * Work that is still queued is run before the threads exit.
+ */
+void state_workers_free(StateWorkers *workers);
+
+#endif
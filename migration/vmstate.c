@@ -18,7 +18,9 @@
 #include "qapi/qmp/json-writer.h"
 #include "qemu-file.h"
 #include "qemu/bitops.h"
+#include "qemu/bswap.h"
 #include "qemu/error-report.h"
+#include "qemu/lockable.h"
 #include "trace.h"
 
 static int vmstate_subsection_save(QEMUFile *f, const VMStateDescription *vmsd,
@@ -131,10 +133,226 @@ static void vmstate_handle_alloc(void *ptr, const VMStateField *field,
     }
 }
 
+/*
+ * Compiled save/load plans
+ *
+ * Most fields of a VMStateDescription are plain scalars or byte buffers
+ * living directly in the device struct.  Walking them one by one through
+ * the generic interpreter costs an indirect call and a QEMUFile access
+ * per element.  The first time a description is used, work out which
+ * fields can be moved as raw bytes and group consecutive ones into runs,
+ * so that each run is transferred with a single qemu_put_buffer() or
+ * qemu_get_buffer().  The stream contents are identical to what the
+ * interpreter produces.
+ */
+typedef enum {
+    VMSTATE_PLAN_NONE,          /* go through the interpreter */
+    VMSTATE_PLAN_BYTES,         /* copied as is */
+    VMSTATE_PLAN_ZERO,          /* unused: zeroes on save, skipped on load */
+    VMSTATE_PLAN_BOOL,
+    VMSTATE_PLAN_BE16,
+    VMSTATE_PLAN_BE32,
+    VMSTATE_PLAN_BE64,
+} VMStatePlanKind;
+
+typedef struct VMStatePlanOp {
+    uint8_t kind;
+    uint32_t n_elems;
+    uint32_t elem_len;
+    /* Only set on the first field of a run */
+    uint32_t run_fields;
+    size_t run_len;
+} VMStatePlanOp;
+
+typedef struct VMStatePlan {
+    /* Used to detect a description reallocated at the same address */
+    const VMStateField *fields;
+    const char *name;
+    VMStatePlanOp ops[];
+} VMStatePlan;
+
+/* Runs up to this size are staged on the stack */
+#define VMSTATE_PLAN_STACK_BUF 1024
+
+static QemuMutex vmstate_plan_lock;
+static GHashTable *vmstate_plans;
+
+static void __attribute__((__constructor__)) vmstate_plan_init(void)
+{
+    qemu_mutex_init(&vmstate_plan_lock);
+    vmstate_plans = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+}
+
+static VMStatePlanKind vmstate_plan_kind(const VMStateField *field)
+{
+    const VMStateInfo *info = field->info;
+
+    if (field->field_exists ||
+        field->flags & ~(VMS_SINGLE | VMS_ARRAY | VMS_BUFFER)) {
+        return VMSTATE_PLAN_NONE;
+    }
+
+    if (info == &vmstate_info_buffer) {
+        return VMSTATE_PLAN_BYTES;
+    } else if (info == &vmstate_info_unused_buffer) {
+        return VMSTATE_PLAN_ZERO;
+    } else if (info == &vmstate_info_bool && field->size == sizeof(bool)) {
+        return VMSTATE_PLAN_BOOL;
+    } else if ((info == &vmstate_info_uint8 || info == &vmstate_info_int8) &&
+               field->size == 1) {
+        return VMSTATE_PLAN_BYTES;
+    } else if ((info == &vmstate_info_uint16 ||
+                info == &vmstate_info_int16) && field->size == 2) {
+        return VMSTATE_PLAN_BE16;
+    } else if ((info == &vmstate_info_uint32 ||
+                info == &vmstate_info_int32) && field->size == 4) {
+        return VMSTATE_PLAN_BE32;
+    } else if ((info == &vmstate_info_uint64 ||
+                info == &vmstate_info_int64) && field->size == 8) {
+        return VMSTATE_PLAN_BE64;
+    }
+
+    return VMSTATE_PLAN_NONE;
+}
+
+static VMStatePlan *vmstate_plan_compile(const VMStateDescription *vmsd)
+{
+    const VMStateField *field;
+    VMStatePlanOp *run = NULL;
+    VMStatePlan *plan;
+    int n = 0, i, run_version = 0;
+
+    for (field = vmsd->fields; field->name; field++) {
+        n++;
+    }
+
+    plan = g_malloc0(sizeof(*plan) + (n + 1) * sizeof(plan->ops[0]));
+    plan->fields = vmsd->fields;
+    plan->name = vmsd->name;
+
+    for (i = 0; i < n; i++) {
+        VMStatePlanOp *op = &plan->ops[i];
+        size_t len;
+
+        field = &vmsd->fields[i];
+        op->kind = vmstate_plan_kind(field);
+        if (op->kind == VMSTATE_PLAN_NONE) {
+            run = NULL;
+            continue;
+        }
+
+        op->n_elems = field->flags & VMS_ARRAY ? field->num : 1;
+        op->elem_len = field->size;
+        len = (size_t)op->n_elems * op->elem_len;
+
+        /*
+         * A run shares one version_id, so that a single check decides
+         * whether all of its fields exist in the stream.
+         */
+        if (!run || run_version != field->version_id) {
+            run = op;
+            run_version = field->version_id;
+        }
+        run->run_fields++;
+        run->run_len += len;
+    }
+
+    trace_vmstate_plan_compile(vmsd->name, n);
+    return plan;
+}
+
+static const VMStatePlanOp *vmstate_plan_get(const VMStateDescription *vmsd)
+{
+    VMStatePlan *plan;
+
+    QEMU_LOCK_GUARD(&vmstate_plan_lock);
+    plan = g_hash_table_lookup(vmstate_plans, vmsd);
+    if (!plan || plan->fields != vmsd->fields || plan->name != vmsd->name) {
+        /*
+         * A stale entry can only belong to a description that has been
+         * freed, so nobody can still be walking its plan.
+         */
+        plan = vmstate_plan_compile(vmsd);
+        g_hash_table_insert(vmstate_plans, (gpointer)vmsd, plan);
+    }
+    return plan->ops;
+}
+
+static int vmstate_load_run(QEMUFile *f, const VMStateDescription *vmsd,
+                            const VMStatePlanOp *plan, int first,
+                            void *opaque)
+{
+    const VMStatePlanOp *run = &plan[first];
+    uint8_t stack_buf[VMSTATE_PLAN_STACK_BUF];
+    g_autofree uint8_t *heap_buf = NULL;
+    uint8_t *buf = stack_buf;
+    int i, ret;
+    uint32_t j;
+
+    if (run->run_fields == 1 && run->kind == VMSTATE_PLAN_BYTES) {
+        /* Big buffers are read in place */
+        buf = opaque + vmsd->fields[first].offset;
+    } else if (run->run_len > sizeof(stack_buf)) {
+        buf = heap_buf = g_malloc(run->run_len);
+    }
+
+    qemu_get_buffer(f, buf, run->run_len);
+    ret = qemu_file_get_error(f);
+    if (ret < 0) {
+        error_report("Failed to load %s:%s", vmsd->name,
+                     vmsd->fields[first].name);
+        trace_vmstate_load_field_error(vmsd->fields[first].name, ret);
+        return ret;
+    }
+
+    for (i = first; i < first + run->run_fields; i++) {
+        const VMStateField *field = &vmsd->fields[i];
+        const VMStatePlanOp *op = &plan[i];
+        void *elem = opaque + field->offset;
+
+        trace_vmstate_load_state_field(vmsd->name, field->name, true);
+        switch (op->kind) {
+        case VMSTATE_PLAN_BYTES:
+            if (buf != elem) {
+                memcpy(elem, buf, op->n_elems * op->elem_len);
+            }
+            break;
+        case VMSTATE_PLAN_ZERO:
+            break;
+        case VMSTATE_PLAN_BOOL:
+            for (j = 0; j < op->n_elems; j++) {
+                ((bool *)elem)[j] = buf[j];
+            }
+            break;
+        case VMSTATE_PLAN_BE16:
+            for (j = 0; j < op->n_elems; j++) {
+                ((uint16_t *)elem)[j] = lduw_be_p(buf + j * 2);
+            }
+            break;
+        case VMSTATE_PLAN_BE32:
+            for (j = 0; j < op->n_elems; j++) {
+                ((uint32_t *)elem)[j] = ldl_be_p(buf + j * 4);
+            }
+            break;
+        case VMSTATE_PLAN_BE64:
+            for (j = 0; j < op->n_elems; j++) {
+                ((uint64_t *)elem)[j] = ldq_be_p(buf + j * 8);
+            }
+            break;
+        default:
+            g_assert_not_reached();
+        }
+        buf += op->n_elems * op->elem_len;
+    }
+
+    return 0;
+}
+
 int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
                        void *opaque, int version_id)
 {
     const VMStateField *field = vmsd->fields;
+    const VMStatePlanOp *plan = vmstate_plan_get(vmsd);
     int ret = 0;
 
     trace_vmstate_load_state(vmsd->name, version_id);
@@ -159,7 +377,21 @@ int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
         }
     }
     while (field->name) {
-        bool exists = vmstate_field_exists(vmsd, field, opaque, version_id);
+        const VMStatePlanOp *op = &plan[field - vmsd->fields];
+        bool exists;
+
+        if (op->run_fields && field->version_id <= version_id) {
+            ret = vmstate_load_run(f, vmsd, plan, field - vmsd->fields,
+                                   opaque);
+            if (ret < 0) {
+                qemu_file_set_error(f, ret);
+                return ret;
+            }
+            field += op->run_fields;
+            continue;
+        }
+
+        exists = vmstate_field_exists(vmsd, field, opaque, version_id);
         trace_vmstate_load_state_field(vmsd->name, field->name, exists);
         if (exists) {
             void *first_elem = opaque + field->offset;
@@ -372,6 +604,74 @@ static void vmsd_desc_field_end(const VMStateDescription *vmsd,
     json_writer_end_object(vmdesc);
 }
 
+static void vmstate_save_run(QEMUFile *f, const VMStateDescription *vmsd,
+                             const VMStatePlanOp *plan, int first,
+                             void *opaque, JSONWriter *vmdesc)
+{
+    const VMStatePlanOp *run = &plan[first];
+    uint8_t stack_buf[VMSTATE_PLAN_STACK_BUF];
+    g_autofree uint8_t *heap_buf = NULL;
+    uint8_t *buf = stack_buf, *p;
+    int i;
+    uint32_t j;
+
+    if (run->run_fields == 1 && run->kind == VMSTATE_PLAN_BYTES) {
+        /* Big buffers are written in place */
+        buf = opaque + vmsd->fields[first].offset;
+    } else if (run->run_len > sizeof(stack_buf)) {
+        buf = heap_buf = g_malloc(run->run_len);
+    }
+
+    p = buf;
+    for (i = first; i < first + run->run_fields; i++) {
+        const VMStateField *field = &vmsd->fields[i];
+        const VMStatePlanOp *op = &plan[i];
+        void *elem = opaque + field->offset;
+
+        trace_vmstate_save_state_loop(vmsd->name, field->name, op->n_elems);
+        switch (op->kind) {
+        case VMSTATE_PLAN_BYTES:
+            if (p != elem) {
+                memcpy(p, elem, op->n_elems * op->elem_len);
+            }
+            break;
+        case VMSTATE_PLAN_ZERO:
+            memset(p, 0, op->n_elems * op->elem_len);
+            break;
+        case VMSTATE_PLAN_BOOL:
+            for (j = 0; j < op->n_elems; j++) {
+                p[j] = ((bool *)elem)[j];
+            }
+            break;
+        case VMSTATE_PLAN_BE16:
+            for (j = 0; j < op->n_elems; j++) {
+                stw_be_p(p + j * 2, ((uint16_t *)elem)[j]);
+            }
+            break;
+        case VMSTATE_PLAN_BE32:
+            for (j = 0; j < op->n_elems; j++) {
+                stl_be_p(p + j * 4, ((uint32_t *)elem)[j]);
+            }
+            break;
+        case VMSTATE_PLAN_BE64:
+            for (j = 0; j < op->n_elems; j++) {
+                stq_be_p(p + j * 8, ((uint64_t *)elem)[j]);
+            }
+            break;
+        default:
+            g_assert_not_reached();
+        }
+        p += op->n_elems * op->elem_len;
+
+        /* Same description as the interpreter gives for a compressed array */
+        if (op->n_elems) {
+            vmsd_desc_field_start(vmsd, vmdesc, field, 0, op->n_elems);
+            vmsd_desc_field_end(vmsd, vmdesc, field, op->elem_len);
+        }
+    }
+
+    qemu_put_buffer(f, buf, run->run_len);
+}
 
 bool vmstate_section_needed(const VMStateDescription *vmsd, void *opaque)
 {
@@ -400,6 +700,7 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
 {
     int ret = 0;
     const VMStateField *field = vmsd->fields;
+    const VMStatePlanOp *plan = vmstate_plan_get(vmsd);
 
     trace_vmstate_save_state_top(vmsd->name);
 
@@ -419,6 +720,15 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
     }
 
     while (field->name) {
+        const VMStatePlanOp *op = &plan[field - vmsd->fields];
+
+        if (op->run_fields && field->version_id <= version_id) {
+            vmstate_save_run(f, vmsd, plan, field - vmsd->fields, opaque,
+                             vmdesc);
+            field += op->run_fields;
+            continue;
+        }
+
         if (vmstate_field_exists(vmsd, field, opaque, version_id)) {
             void *first_elem = opaque + field->offset;
             int i, n_elems = vmstate_n_elems(opaque, field);
@@ -133,6 +133,19 @@ CommandInfoList *qmp_query_commands(Error **errp)
     return list;
 }
 
+anyList *qmp_batch(anyList *commands, bool has_stop_on_error,
+                   bool stop_on_error, Error **errp)
+{
+    Monitor *cur_mon = monitor_cur();
+    MonitorQMP *mon;
+
+    assert(monitor_is_qmp(cur_mon));
+    mon = container_of(cur_mon, MonitorQMP, common);
+
+    return qmp_dispatch_batch(mon->commands, commands, stop_on_error,
+                              cur_mon);
+}
+
 static void *split_off_generic_list(void *list,
                                     bool (*splitp)(void *elt),
                                     void **part)
@@ -195,6 +195,12 @@ QDict *coroutine_mixed_fn qmp_dispatch(const QmpCommandList *cmds, QObject *requ
     if (!qmp_command_available(cmd, &err)) {
         goto out;
     }
+    if ((cmd->options & QCO_COROUTINE) && !qemu_in_coroutine()) {
+        /* Only commands of a batch get here, see qmp_dispatch_batch() */
+        error_setg(&err, "The command %s cannot be run in a batch",
+                   command);
+        goto out;
+    }
 
     if (!qdict_haskey(dict, "arguments")) {
         args = qdict_new();
@@ -242,7 +248,8 @@ QDict *coroutine_mixed_fn qmp_dispatch(const QmpCommandList *cmds, QObject *requ
         * Case 2: we are outside coroutine context, but command has
         * QCO_COROUTINE.  Can't actually happen, because we get here
         * outside coroutine context only when executing a command
-        * out of band, and OOB commands never have QCO_COROUTINE.
+        * out of band, and OOB commands never have QCO_COROUTINE, or
+        * in a batch, which rejects them above.
         */
         assert(!oob && qemu_in_coroutine() && !(cmd->options & QCO_COROUTINE));
 
@@ -294,3 +301,40 @@ out:
 
     return rsp;
 }
+
+/*
+ * Dispatch each of @requests in turn and return the list of their
+ * responses.  Called from the handler of a command that is not
+ * QCO_COROUTINE, so the whole list runs in one go, without releasing
+ * the BQL in between.  Commands that need coroutine context fail.
+ * With @stop_on_error, the requests after the first failing one are
+ * not dispatched and get no response.
+ */
+anyList *qmp_dispatch_batch(const QmpCommandList *cmds, anyList *requests,
+                            bool stop_on_error, Monitor *cur_mon)
+{
+    anyList *rsps = NULL;
+    anyList **tail = &rsps;
+    QDict *rsp;
+    bool failed;
+
+    assert(!qemu_in_coroutine());
+    assert(monitor_cur() == cur_mon);
+
+    monitor_set_cur(qemu_coroutine_self(), NULL);
+    for (; requests; requests = requests->next) {
+        rsp = qmp_dispatch(cmds, requests->value, false, cur_mon);
+        if (!rsp) {
+            /* QCO_NO_SUCCESS_RESP, keep one response per request */
+            rsp = qdict_new();
+        }
+        failed = qdict_haskey(rsp, "error");
+        QAPI_LIST_APPEND(tail, QOBJECT(rsp));
+        if (failed && stop_on_error) {
+            break;
+        }
+    }
+    monitor_set_cur(qemu_coroutine_self(), cur_mon);
+
+    return rsps;
+}
@@ -186,11 +186,16 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
+    "                code-hugepages=advise|thp|explicit (huge page backing of the TCG code buffer)\n"
+    "                code-numa=on|off (NUMA-local TCG code buffer regions)\n"
+    "                profile-tb=on|off (count executions of each TCG translation block)\n"
     "                tb-size=n (TCG translation block cache size)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
+    "                dirty-ring-size=n (TCG per-vCPU log of pages dirtied for migration, in pages, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
-    "                thread=single|multi (enable multi-threaded TCG)\n"
+    "                thread=single|multi|dense (enable multi-threaded TCG, or pack vCPUs on one thread)\n"
+    "                timer-slack=n (TCG main loop timer granularity in microseconds)\n"
     "                device=path (KVM device path, default /dev/kvm)\n", QEMU_ARCH_ALL)
 SRST
 ``-accel name[,prop=value[,...]]``
@@ -230,6 +235,33 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``code-hugepages=advise|thp|explicit``
+        Controls how the TCG translation block cache is backed by host
+        huge pages. With ``advise`` (the default), huge pages are only
+        requested from the kernel, and the guard pages between the
+        per-thread regions of the cache prevent most of them from being
+        used. ``thp`` aligns every region to the host huge page size and
+        drops the guard pages, so that transparent huge pages can back the
+        whole cache. ``explicit`` allocates the cache from the hugetlbfs
+        pool and falls back to ``thp`` if no huge pages are available; it
+        cannot be combined with ``split-wx=on``. Huge page backing reduces
+        host iTLB misses when running translated code.
+
+    ``code-numa=on|off``
+        Places each region of the TCG translation block cache on the host
+        NUMA node of the vCPU thread that generates code into it, and
+        releases the pages of the cache on every flush so they are
+        allocated again close to their next user. This avoids cross-node
+        instruction fetches on multi-socket hosts. The default is off.
+
+    ``profile-tb=on|off``
+        Makes every TCG translation block count how often it is executed
+        and how often it returns to the main loop rather than jumping
+        directly to the next block. The hottest blocks can then be listed
+        with the ``x-query-jit-hot`` QMP command or ``info jit-hot``. This
+        adds a memory increment to the start of every block, so it is off
+        by default.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -238,6 +270,22 @@ SRST
         incompatible TCG features have been enabled (e.g.
         icount/replay).
 
+        ``thread=dense`` runs all vCPUs on a single thread like
+        ``thread=single``, for hosts running many small guests at once.
+        vCPUs that are halted are skipped rather than entered, and the
+        time slices are only enforced while at least two vCPUs are
+        runnable; they start short and grow as long as no vCPU is woken
+        up or goes idle.  It also sets a default ``timer-slack`` of 1000.
+        It cannot be combined with icount.
+
+    ``timer-slack=n``
+        Rounds the deadlines the main loop sleeps until up to a multiple
+        of n microseconds of the host clock, so that the timers of a guest
+        and of the other guests on the host fire together rather than
+        waking each QEMU up separately.  Guest timers are delayed by up to
+        n microseconds.  The default is 0, no rounding, except with
+        ``thread=dense``.
+
     ``dirty-ring-size=n``
         When the KVM accelerator is used, it controls the size of the per-vCPU
         dirty page ring buffer (number of entries for each vCPU). It should
@@ -248,6 +296,14 @@ SRST
         is disabled (dirty-ring-size=0).  When enabled, KVM will instead
         record dirty pages in a bitmap.
 
+        With TCG, it sets the number of entries of the per-vCPU rings in
+        which the pages dirtied by the guest and by device emulation are
+        logged during migration.  Each bitmap sync then only visits the
+        logged pages instead of the whole dirty bitmap, which helps guests
+        with a lot of RAM and a small working set.  When a ring fills up
+        between two syncs, the next sync walks the bitmap as usual.  It
+        must be a power of two.
+
     ``eager-split-size=n``
         KVM implements dirty page logging at the PAGE_SIZE granularity and
         enabling dirty-logging on a huge-page requires breaking it into
@@ -5215,6 +5271,27 @@ SRST
     Enable synchronization profiling.
 ERST
 
+DEF("profile-startup", HAS_ARG, QEMU_OPTION_profile_startup,
+    "-profile-startup [[file=]path][,format=chrome|summary]\n"
+    "                record the time spent building the machine\n"
+    "                format=chrome writes a Chrome trace-event JSON file\n"
+    "                format=summary writes a table sorted by self time\n"
+    "                (default: chrome with a file, summary on stderr without)\n",
+    QEMU_ARCH_ALL)
+SRST
+``-profile-startup [[file=]path][,format=chrome|summary]``
+    Record the wall time spent in each phase of machine construction
+    and in the ``instance_init``, ``realize`` and reset handlers of every
+    device, and write it out once the machine has been created, before
+    the guest starts running.
+
+    ``format=chrome`` writes the events in the Chrome trace-event JSON
+    format, which can be loaded in ``chrome://tracing`` or Perfetto.
+    ``format=summary`` prints one line per category and name, sorted by
+    the time spent in the handler itself, excluding nested handlers.
+    Without ``file``, the summary is printed on stderr.
+ERST
+
 #if defined(CONFIG_TCG) && defined(CONFIG_LINUX)
 DEF("perfmap", 0, QEMU_OPTION_perfmap,
     "-perfmap        generate a /tmp/perf-${pid}.map file for perf\n",
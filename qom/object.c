@@ -17,6 +17,7 @@
 #include "qom/object_interfaces.h"
 #include "qemu/cutils.h"
 #include "qemu/memalign.h"
+#include "qemu/startup-profile.h"
 #include "qapi/visitor.h"
 #include "qapi/string-input-visitor.h"
 #include "qapi/string-output-visitor.h"
@@ -425,7 +426,10 @@ static void object_init_with_type(Object *obj, TypeImpl *ti)
     }
 
     if (ti->instance_init) {
+        int64_t start = startup_profile_start();
+
         ti->instance_init(obj);
+        startup_profile_end("init", ti->name, start);
     }
 }
 
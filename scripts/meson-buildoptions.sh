@@ -29,6 +29,7 @@ meson_options_help() {
   printf "%s\n" '  --enable-cfi-debug       Verbose errors in case of CFI violation'
   printf "%s\n" '  --enable-debug-graph-lock'
   printf "%s\n" '                           graph lock debugging support'
+  printf "%s\n" '  --enable-debug-memory    memory API debugging support'
   printf "%s\n" '  --enable-debug-mutex     mutex debugging support'
   printf "%s\n" '  --enable-debug-remap     syscall buffer debugging support'
   printf "%s\n" '  --enable-debug-stack-usage'
@@ -299,6 +300,8 @@ _meson_option_parse() {
     --disable-debug-info) printf "%s" -Ddebug=false ;;
     --enable-debug-graph-lock) printf "%s" -Ddebug_graph_lock=true ;;
     --disable-debug-graph-lock) printf "%s" -Ddebug_graph_lock=false ;;
+    --enable-debug-memory) printf "%s" -Ddebug_memory=true ;;
+    --disable-debug-memory) printf "%s" -Ddebug_memory=false ;;
     --enable-debug-mutex) printf "%s" -Ddebug_mutex=true ;;
     --disable-debug-mutex) printf "%s" -Ddebug_mutex=false ;;
     --enable-debug-remap) printf "%s" -Ddebug_remap=true ;;
@@ -61,6 +61,22 @@ struct AddrRange {
     Int128 size;
 };
 
+/*
+ * Subregions that were added, removed, moved, resized or toggled within
+ * a single container are tracked here rather than through
+ * memory_region_update_pending.  The commit then only renders again the
+ * window of each FlatView covered by @range, instead of regenerating
+ * every FlatView from scratch.
+ */
+static struct {
+    MemoryRegion *container;
+    AddrRange range;            /* in @container's address space */
+    bool full;                  /* changes that need a full rebuild */
+} memory_region_update_window;
+
+static uint64_t flatview_updates_incremental;
+static uint64_t flatview_updates_full;
+
 static AddrRange addrrange_make(Int128 start, Int128 size)
 {
     return (AddrRange) { start, size };
@@ -749,10 +765,22 @@ static MemoryRegion *memory_region_get_flatview_root(MemoryRegion *mr)
     return NULL;
 }
 
+static void flatview_init_dispatch(FlatView *view)
+{
+    int i;
+
+    view->dispatch = address_space_dispatch_new(view);
+    for (i = 0; i < view->nr; i++) {
+        MemoryRegionSection mrs =
+            section_from_flat_range(&view->ranges[i], view);
+        flatview_add_to_dispatch(view, &mrs);
+    }
+    address_space_dispatch_compact(view->dispatch);
+}
+
 /* Render a memory topology into a list of disjoint absolute ranges. */
 static FlatView *generate_memory_topology(MemoryRegion *mr)
 {
-    int i;
     FlatView *view;
 
     view = flatview_new(mr);
@@ -763,19 +791,202 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
                              false, false, false);
     }
     flatview_simplify(view);
+    flatview_init_dispatch(view);
+    g_hash_table_replace(flat_views, mr, view);
 
-    view->dispatch = address_space_dispatch_new(view);
-    for (i = 0; i < view->nr; i++) {
-        MemoryRegionSection mrs =
-            section_from_flat_range(&view->ranges[i], view);
-        flatview_add_to_dispatch(view, &mrs);
+    return view;
+}
+
+/*
+ * Build a FlatView that is equal to @old_view outside @window, and
+ * rendered again from the memory tree inside it.
+ */
+static FlatView *flatview_update_window(FlatView *old_view, AddrRange window)
+{
+    FlatView *view = flatview_new(old_view->root);
+    Int128 window_end = addrrange_end(window);
+    FlatRange *fr;
+
+    /* Keep what lies outside the window, cutting ranges at its edges */
+    FOR_EACH_FLAT_RANGE(fr, old_view) {
+        Int128 end = addrrange_end(fr->addr);
+        FlatRange tmp;
+
+        if (int128_lt(fr->addr.start, window.start)) {
+            tmp = *fr;
+            tmp.addr.size = int128_min(fr->addr.size,
+                                       int128_sub(window.start,
+                                                  fr->addr.start));
+            flatview_insert(view, view->nr, &tmp);
+        }
+        if (int128_gt(end, window_end)) {
+            Int128 start = int128_max(fr->addr.start, window_end);
+
+            tmp = *fr;
+            tmp.offset_in_region +=
+                int128_get64(int128_sub(start, fr->addr.start));
+            tmp.addr = addrrange_make(start, int128_sub(end, start));
+            flatview_insert(view, view->nr, &tmp);
+        }
     }
-    address_space_dispatch_compact(view->dispatch);
-    g_hash_table_replace(flat_views, mr, view);
+
+    /* The window is now a gap that the root renders into */
+    render_memory_region(view, view->root, int128_zero(), window,
+                         false, false, false);
+    flatview_simplify(view);
+    flatview_init_dispatch(view);
 
     return view;
 }
 
+/*
+ * Whether @view has a range that can not be merged back together once
+ * cut at an edge of @window.  A full rendering would keep it whole.
+ */
+static bool flatview_window_cuts_unmergeable(FlatView *view,
+                                             AddrRange window)
+{
+    Int128 window_end = addrrange_end(window);
+    FlatRange *fr;
+
+    FOR_EACH_FLAT_RANGE(fr, view) {
+        if (!fr->unmergeable) {
+            continue;
+        }
+        if ((addrrange_contains(fr->addr, window.start) &&
+             int128_gt(window.start, fr->addr.start)) ||
+            (addrrange_contains(fr->addr, window_end) &&
+             int128_gt(window_end, fr->addr.start))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef CONFIG_DEBUG_MEMORY
+/*
+ * Check an incrementally updated FlatView against a full rendering of
+ * its root, so that tests catch any difference.
+ */
+static void flatview_check_window(FlatView *view)
+{
+    FlatView *full = flatview_new(view->root);
+    int i;
+
+    render_memory_region(full, view->root, int128_zero(),
+                         addrrange_make(int128_zero(), int128_2_64()),
+                         false, false, false);
+    flatview_simplify(full);
+
+    g_assert_cmpuint(view->nr, ==, full->nr);
+    for (i = 0; i < view->nr; i++) {
+        g_assert(flatrange_equal(&view->ranges[i], &full->ranges[i]));
+    }
+
+    flatview_unref(full);
+}
+#endif
+
+/*
+ * If @mr is @root or lies below it, return true and set @base to the
+ * address of @mr's origin in a FlatView rendered from @root.
+ */
+static bool memory_region_base_in_root(MemoryRegion *root, MemoryRegion *mr,
+                                       Int128 *base)
+{
+    *base = int128_zero();
+    for (; mr; mr = mr->container) {
+        int128_addto(base, int128_make64(mr->addr));
+        if (mr == root) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Update the FlatViews affected by memory_region_update_window in place
+ * of flatviews_reset().  Returns false, without changing anything, if
+ * the change may be visible anywhere else than below its container,
+ * i.e. through an alias, or if it changes the root of a FlatView.
+ */
+static bool flatviews_update_window(void)
+{
+    MemoryRegion *container = memory_region_update_window.container;
+    AddrRange *window = &memory_region_update_window.range;
+    GHashTableIter iter;
+    MemoryRegion *root, *mr;
+    FlatView *view;
+    AddressSpace *as;
+    Int128 base;
+
+    if (memory_region_update_window.full || !flat_views) {
+        return false;
+    }
+
+    for (mr = container; mr; mr = mr->container) {
+        if (mr->mapped_via_alias) {
+            return false;
+        }
+    }
+
+    QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
+        root = memory_region_get_flatview_root(as->root);
+        view = address_space_to_flatview(as);
+        if (!view || view->root != root ||
+            g_hash_table_lookup(flat_views, root) != view) {
+            return false;
+        }
+    }
+
+    g_hash_table_iter_init(&iter, flat_views);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&root,
+                                  (gpointer *)&view)) {
+        if (!root) {
+            continue;
+        }
+        if (memory_region_base_in_root(root, container, &base) &&
+            flatview_window_cuts_unmergeable(view,
+                                             addrrange_shift(*window, base))) {
+            return false;
+        }
+        for (mr = root; mr->alias; mr = mr->alias) {
+            /* nothing */
+        }
+        if (mr != root && memory_region_base_in_root(mr, container, &base)) {
+            return false;
+        }
+        /* A root that is, or lies below, one of the changed subregions */
+        for (; mr->container; mr = mr->container) {
+            if (mr->container == container) {
+                AddrRange range = addrrange_make(int128_make64(mr->addr),
+                                                 mr->size);
+
+                if (!int128_nz(mr->size) ||
+                    addrrange_intersects(range, *window)) {
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+
+    g_hash_table_iter_init(&iter, flat_views);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&root,
+                                  (gpointer *)&view)) {
+        if (!root || !memory_region_base_in_root(root, container, &base)) {
+            continue;
+        }
+        view = flatview_update_window(view, addrrange_shift(*window, base));
+#ifdef CONFIG_DEBUG_MEMORY
+        flatview_check_window(view);
+#endif
+        g_hash_table_iter_replace(&iter, view);
+    }
+
+    return true;
+}
+
 static void address_space_add_del_ioeventfds(AddressSpace *as,
                                              MemoryRegionIoeventfd *fds_new,
                                              unsigned fds_new_nb,
@@ -1155,8 +1366,15 @@ void memory_region_transaction_commit(void)
 
     --memory_region_transaction_depth;
     if (!memory_region_transaction_depth) {
-        if (memory_region_update_pending) {
-            flatviews_reset();
+        if (memory_region_update_pending ||
+            memory_region_update_window.container ||
+            memory_region_update_window.full) {
+            if (!memory_region_update_pending && flatviews_update_window()) {
+                flatview_updates_incremental++;
+            } else {
+                flatviews_reset();
+                flatview_updates_full++;
+            }
 
             MEMORY_LISTENER_CALL_GLOBAL(begin, Forward);
 
@@ -1165,6 +1383,8 @@ void memory_region_transaction_commit(void)
                 address_space_update_ioeventfds(as);
             }
             memory_region_update_pending = false;
+            memset(&memory_region_update_window, 0,
+                   sizeof(memory_region_update_window));
             ioeventfd_update_pending = false;
             MEMORY_LISTENER_CALL_GLOBAL(commit, Forward);
         } else if (ioeventfd_update_pending) {
@@ -2637,6 +2857,36 @@ void memory_region_del_eventfd(MemoryRegion *mr,
     memory_region_transaction_commit();
 }
 
+/*
+ * Note a change in how @subregion covers its container, over the range
+ * it currently spans.
+ */
+static void memory_region_update_subregion(MemoryRegion *subregion)
+{
+    MemoryRegion *container = subregion->container;
+    AddrRange range = addrrange_make(int128_make64(subregion->addr),
+                                     subregion->size);
+    AddrRange *window = &memory_region_update_window.range;
+    Int128 start, end;
+
+    if (!container || subregion->mapped_via_alias ||
+        (memory_region_update_window.container &&
+         memory_region_update_window.container != container)) {
+        memory_region_update_window.full = true;
+        return;
+    }
+
+    if (!memory_region_update_window.container) {
+        memory_region_update_window.container = container;
+        *window = range;
+        return;
+    }
+
+    start = int128_min(window->start, range.start);
+    end = int128_max(addrrange_end(*window), addrrange_end(range));
+    *window = addrrange_make(start, int128_sub(end, start));
+}
+
 static void memory_region_update_container_subregions(MemoryRegion *subregion)
 {
     MemoryRegion *mr = subregion->container;
@@ -2653,7 +2903,9 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_subregion(subregion);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2696,6 +2948,9 @@ void memory_region_del_subregion(MemoryRegion *mr,
 
     memory_region_transaction_begin();
     assert(subregion->container == mr);
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_subregion(subregion);
+    }
     subregion->container = NULL;
     for (alias = subregion->alias; alias; alias = alias->alias) {
         alias->mapped_via_alias--;
@@ -2703,7 +2958,6 @@ void memory_region_del_subregion(MemoryRegion *mr,
     }
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
     memory_region_unref(subregion);
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
     memory_region_transaction_commit();
 }
 
@@ -2714,7 +2968,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     }
     memory_region_transaction_begin();
     mr->enabled = enabled;
-    memory_region_update_pending = true;
+    memory_region_update_subregion(mr);
     memory_region_transaction_commit();
 }
 
@@ -2729,8 +2983,9 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
         return;
     }
     memory_region_transaction_begin();
+    memory_region_update_subregion(mr);
     mr->size = s;
-    memory_region_update_pending = true;
+    memory_region_update_subregion(mr);
     memory_region_transaction_commit();
 }
 
@@ -2766,7 +3021,9 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
 
     memory_region_transaction_begin();
     mr->alias_offset = offset;
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update_subregion(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -3233,6 +3490,7 @@ void address_space_init(AddressSpace *as, MemoryRegion *root, const char *name)
     QTAILQ_INSERT_TAIL(&address_spaces, as, address_spaces_link);
     as->max_bounce_buffer_size = DEFAULT_MAX_BOUNCE_BUFFER_SIZE;
     as->bounce_buffer_size = 0;
+    memset(&as->map_stats, 0, sizeof(as->map_stats));
     qemu_mutex_init(&as->map_client_list_lock);
     QLIST_INIT(&as->map_client_list);
     as->name = g_strdup(name ? name : "anonymous");
@@ -3571,6 +3829,9 @@ static void mtree_info_flatview(bool dispatch_tree, bool owner)
         fvi.ac = ac;
     }
 
+    qemu_printf("FlatView updates: %" PRIu64 " incremental, %" PRIu64
+                " full\n", flatview_updates_incremental, flatview_updates_full);
+
     /* Gather all FVs in one table */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         view = address_space_get_flatview(as);
@@ -3610,8 +3871,20 @@ static gint address_space_compare_name(gconstpointer a, gconstpointer b)
 static void mtree_print_as_name(gpointer data, gpointer user_data)
 {
     AddressSpace *as = data;
+    AddressSpaceMapStats *stats = &as->map_stats;
 
     qemu_printf("address-space: %s\n", as->name);
+    if (stat64_get(&stats->bounce_maps) || stat64_get(&stats->bounce_failed)) {
+        qemu_printf("  dma-map: %" PRIu64 " bounced (%" PRIu64 " bytes,"
+                    " peak %" PRIu64 "/%zu), %" PRIu64 " shortened,"
+                    " %" PRIu64 " refused\n",
+                    stat64_get(&stats->bounce_maps),
+                    stat64_get(&stats->bounce_bytes),
+                    stat64_get(&stats->bounce_peak),
+                    as->max_bounce_buffer_size,
+                    stat64_get(&stats->bounce_short),
+                    stat64_get(&stats->bounce_failed));
+    }
 }
 
 static void mtree_print_as(gpointer key, gpointer value, gpointer user_data)
@@ -919,6 +919,272 @@ bool cpu_physical_memory_test_and_clear_dirty(ram_addr_t start,
     return dirty;
 }
 
+/*
+ * TCG dirty ring
+ *
+ * With TCG, the first write to a clean page goes through notdirty_write(),
+ * and every other writer (DMA, device models, ...) marks pages dirty through
+ * cpu_physical_memory_set_dirty_range().  When "-accel tcg,dirty-ring-size=N"
+ * is given, these paths also log the pages they dirty for migration into
+ * a ring: one per vCPU, filled without locking by the vCPU thread, plus
+ * a shared one for all other threads.  The migration bitmap sync can then
+ * visit only the logged pages instead of walking the whole global bitmap.
+ *
+ * A ring that fills up, or a dirty bitmap merged wholesale from a log
+ * (cpu_physical_memory_set_dirty_lebitmap()), sets an overflow flag; the
+ * next sync then falls back to the bitmap walk and rearms the rings.  The
+ * global bitmap stays authoritative throughout: pages are always set there
+ * before being logged, so a page logged late is simply found by the next
+ * sync.
+ */
+struct TCGDirtyRing {
+    uint32_t head;      /* written by the producer */
+    uint32_t tail;      /* written by the consumer */
+    ram_addr_t pages[];
+};
+
+uint32_t tcg_dirty_ring_size;
+
+static bool tcg_dirty_ring_overflowed = true;
+static TCGDirtyRing *tcg_dirty_ring_shared;
+static QemuSpin tcg_dirty_ring_shared_lock;
+/* Protects the per-vCPU rings against being freed while reaped */
+static QemuMutex tcg_dirty_ring_lock;
+
+static TCGDirtyRing *tcg_dirty_ring_new(void)
+{
+    return g_malloc0(sizeof(TCGDirtyRing) +
+                     tcg_dirty_ring_size * sizeof(ram_addr_t));
+}
+
+void tcg_dirty_ring_init(uint32_t size)
+{
+    assert(is_power_of_2(size));
+    tcg_dirty_ring_size = size;
+    tcg_dirty_ring_shared = tcg_dirty_ring_new();
+    qemu_spin_init(&tcg_dirty_ring_shared_lock);
+    qemu_mutex_init(&tcg_dirty_ring_lock);
+}
+
+static void tcg_dirty_ring_fill(TCGDirtyRing *ring, ram_addr_t start,
+                                ram_addr_t length)
+{
+    uint32_t head = ring->head;
+    uint32_t tail = qatomic_load_acquire(&ring->tail);
+    ram_addr_t addr = start & TARGET_PAGE_MASK;
+    ram_addr_t end = start + length;
+
+    for (; addr < end; addr += TARGET_PAGE_SIZE) {
+        if (head - tail == tcg_dirty_ring_size) {
+            qatomic_set(&tcg_dirty_ring_overflowed, true);
+            break;
+        }
+        ring->pages[head & (tcg_dirty_ring_size - 1)] = addr;
+        head++;
+    }
+    qatomic_store_release(&ring->head, head);
+}
+
+void tcg_dirty_ring_push(ram_addr_t start, ram_addr_t length)
+{
+    CPUState *cpu = current_cpu;
+
+    /* Nobody is going to look at the rings until they are rearmed */
+    if (qatomic_read(&tcg_dirty_ring_overflowed)) {
+        return;
+    }
+
+    if (cpu && cpu->tcg_dirty_ring) {
+        tcg_dirty_ring_fill(cpu->tcg_dirty_ring, start, length);
+    } else {
+        qemu_spin_lock(&tcg_dirty_ring_shared_lock);
+        tcg_dirty_ring_fill(tcg_dirty_ring_shared, start, length);
+        qemu_spin_unlock(&tcg_dirty_ring_shared_lock);
+    }
+}
+
+void tcg_dirty_ring_set_overflow(void)
+{
+    qatomic_set(&tcg_dirty_ring_overflowed, true);
+}
+
+void tcg_dirty_ring_alloc(CPUState *cpu)
+{
+    if (!tcg_dirty_ring_size) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&tcg_dirty_ring_lock);
+    qatomic_store_release(&cpu->tcg_dirty_ring, tcg_dirty_ring_new());
+}
+
+void tcg_dirty_ring_free(CPUState *cpu)
+{
+    if (!tcg_dirty_ring_size) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&tcg_dirty_ring_lock);
+    g_free(cpu->tcg_dirty_ring);
+    cpu->tcg_dirty_ring = NULL;
+}
+
+static RAMBlock *tcg_dirty_ring_find_block(ram_addr_t addr)
+{
+    RAMBlock *block = qatomic_rcu_read(&ram_list.mru_block);
+
+    if (block && addr - block->offset < block->used_length) {
+        return block;
+    }
+    /* The block may have been unplugged or shrunk since */
+    RAMBLOCK_FOREACH(block) {
+        if (addr - block->offset < block->used_length) {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+/* Move the pages logged in @ring to @pages, or drop them if NULL */
+static void tcg_dirty_ring_drain(TCGDirtyRing *ring, GArray *pages)
+{
+    uint32_t head = qatomic_load_acquire(&ring->head);
+    uint32_t tail = ring->tail;
+
+    for (; pages && tail != head; tail++) {
+        g_array_append_val(pages,
+                           ring->pages[tail & (tcg_dirty_ring_size - 1)]);
+    }
+    qatomic_store_release(&ring->tail, head);
+}
+
+static void tcg_dirty_ring_drain_all(GArray *pages)
+{
+    CPUState *cpu;
+
+    RCU_READ_LOCK_GUARD();
+    QEMU_LOCK_GUARD(&tcg_dirty_ring_lock);
+    CPU_FOREACH(cpu) {
+        TCGDirtyRing *ring = qatomic_load_acquire(&cpu->tcg_dirty_ring);
+
+        if (ring) {
+            tcg_dirty_ring_drain(ring, pages);
+        }
+    }
+    /* Producers serialize on the lock, the consumer does not need it */
+    tcg_dirty_ring_drain(tcg_dirty_ring_shared, pages);
+}
+
+static gint tcg_dirty_ring_cmp(gconstpointer a, gconstpointer b)
+{
+    ram_addr_t x = *(const ram_addr_t *)a, y = *(const ram_addr_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Clear the pages [start, start + length) of @rb in the global bitmap,
+ * calling @fn for each one that was dirty.  The TLBs of all vCPUs and
+ * the dirty log of the memory region are reset once for the whole run.
+ */
+static void tcg_dirty_ring_clear_run(RAMBlock *rb, ram_addr_t start,
+                                     ram_addr_t length, TCGDirtyRingFn fn,
+                                     void *opaque)
+{
+    DirtyMemoryBlocks *blocks =
+        qatomic_rcu_read(&ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION]);
+    ram_addr_t addr;
+    bool dirty = false;
+
+    for (addr = start; addr < start + length; addr += TARGET_PAGE_SIZE) {
+        unsigned long page = addr >> TARGET_PAGE_BITS;
+
+        if (bitmap_test_and_clear_atomic(
+                blocks->blocks[page / DIRTY_MEMORY_BLOCK_SIZE],
+                page % DIRTY_MEMORY_BLOCK_SIZE, 1)) {
+            fn(rb, addr - rb->offset, opaque);
+            dirty = true;
+        }
+    }
+
+    memory_region_clear_dirty_bitmap(rb->mr, start - rb->offset, length);
+    if (dirty) {
+        cpu_physical_memory_dirty_bits_cleared(start, length);
+    }
+}
+
+/*
+ * The pages logged by all rings, sorted, are cleared by runs of
+ * contiguous pages of a RAMBlock, so that a busy guest does not pay
+ * for a TLB flush of every vCPU per page.
+ */
+static void tcg_dirty_ring_clear(GArray *pages, TCGDirtyRingFn fn,
+                                 void *opaque)
+{
+    ram_addr_t *addrs = (ram_addr_t *)pages->data;
+    RAMBlock *rb = NULL;
+    ram_addr_t start = 0, end = 0;
+    guint i;
+
+    RCU_READ_LOCK_GUARD();
+    g_array_sort(pages, tcg_dirty_ring_cmp);
+    for (i = 0; i < pages->len; i++) {
+        ram_addr_t addr = addrs[i];
+
+        if (addr < end) {
+            continue;   /* logged more than once */
+        }
+        if (rb && addr == end && addr - rb->offset < rb->used_length) {
+            end += TARGET_PAGE_SIZE;
+            continue;
+        }
+        if (rb) {
+            tcg_dirty_ring_clear_run(rb, start, end - start, fn, opaque);
+        }
+        rb = tcg_dirty_ring_find_block(addr);
+        start = addr;
+        end = addr + TARGET_PAGE_SIZE;
+    }
+    if (rb) {
+        tcg_dirty_ring_clear_run(rb, start, end - start, fn, opaque);
+    }
+}
+
+bool tcg_dirty_ring_reap(TCGDirtyRingFn fn, void *opaque)
+{
+    GArray *pages;
+
+    if (!tcg_dirty_ring_size || qatomic_read(&tcg_dirty_ring_overflowed)) {
+        return false;
+    }
+
+    pages = g_array_sized_new(false, false, sizeof(ram_addr_t), 1024);
+    tcg_dirty_ring_drain_all(pages);
+    tcg_dirty_ring_clear(pages, fn, opaque);
+    g_array_free(pages, true);
+
+    /*
+     * Pages logged while draining are still set in the bitmap; if one of
+     * the rings overflowed meanwhile, only the bitmap walk can find them.
+     */
+    return !qatomic_read(&tcg_dirty_ring_overflowed);
+}
+
+void tcg_dirty_ring_rearm(void)
+{
+    if (!tcg_dirty_ring_size) {
+        return;
+    }
+
+    /*
+     * Called right before walking the bitmap: anything logged from now on
+     * is either found by that walk or left for the next reap.
+     */
+    qatomic_set(&tcg_dirty_ring_overflowed, false);
+    smp_mb();
+    tcg_dirty_ring_drain_all(NULL);
+}
+
 DirtyBitmapSnapshot *cpu_physical_memory_snapshot_and_clear_dirty
     (MemoryRegion *mr, hwaddr offset, hwaddr length, unsigned client)
 {
@@ -3249,6 +3515,7 @@ void *address_space_map(AddressSpace *as,
 
     if (!memory_access_is_direct(mr, is_write)) {
         size_t used = qatomic_read(&as->bounce_buffer_size);
+        hwaddr wanted = l;
         for (;;) {
             hwaddr alloc = MIN(as->max_bounce_buffer_size - used, l);
             size_t new_size = used + alloc;
@@ -3256,16 +3523,25 @@ void *address_space_map(AddressSpace *as,
                 qatomic_cmpxchg(&as->bounce_buffer_size, used, new_size);
             if (actual == used) {
                 l = alloc;
+                stat64_max(&as->map_stats.bounce_peak, new_size);
                 break;
             }
             used = actual;
         }
 
         if (l == 0) {
+            stat64_add(&as->map_stats.bounce_failed, 1);
             *plen = 0;
             return NULL;
         }
 
+        stat64_add(&as->map_stats.bounce_maps, 1);
+        stat64_add(&as->map_stats.bounce_bytes, l);
+        if (l < wanted) {
+            stat64_add(&as->map_stats.bounce_short, 1);
+        }
+        trace_address_space_map_bounce(as, addr, l, wanted);
+
         BounceBuffer *bounce = g_malloc0(l + sizeof(BounceBuffer));
         bounce->magic = BOUNCE_BUFFER_MAGIC;
         memory_region_ref(mr);
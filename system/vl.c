@@ -134,6 +134,7 @@
 #include "system/iothread.h"
 #include "qemu/guest-random.h"
 #include "qemu/keyval.h"
+#include "qemu/startup-profile.h"
 
 #define MAX_VIRTIO_CONSOLES 1
 
@@ -481,6 +482,22 @@ static QemuOptsList qemu_fw_cfg_opts = {
     },
 };
 
+static QemuOptsList qemu_profile_startup_opts = {
+    .name = "profile-startup",
+    .implied_opt_name = "file",
+    .head = QTAILQ_HEAD_INITIALIZER(qemu_profile_startup_opts.head),
+    .desc = {
+        {
+            .name = "file",
+            .type = QEMU_OPT_STRING,
+        },{
+            .name = "format",
+            .type = QEMU_OPT_STRING,
+        },
+        { /* end of list */ }
+    },
+};
+
 static QemuOptsList qemu_action_opts = {
     .name = "action",
     .merge_lists = true,
@@ -807,6 +824,26 @@ static void configure_msg(QemuOpts *opts)
     error_with_guestname = qemu_opt_get_bool(opts, "guest-name", false);
 }
 
+static void configure_startup_profile(QemuOpts *opts)
+{
+    const char *file = qemu_opt_get(opts, "file");
+    const char *format = qemu_opt_get(opts, "format");
+    StartupProfileFormat fmt;
+
+    if (!format) {
+        fmt = file ? STARTUP_PROFILE_CHROME : STARTUP_PROFILE_SUMMARY;
+    } else if (!strcmp(format, "chrome")) {
+        fmt = STARTUP_PROFILE_CHROME;
+    } else if (!strcmp(format, "summary")) {
+        fmt = STARTUP_PROFILE_SUMMARY;
+    } else {
+        error_report("-profile-startup: unknown format '%s'", format);
+        exit(1);
+    }
+
+    startup_profile_enable(file, fmt, &error_fatal);
+}
+
 
 /***********************************************************/
 /* USB devices */
@@ -2730,16 +2767,27 @@ static bool qemu_machine_creation_done(Error **errp)
 
 void qmp_x_exit_preconfig(Error **errp)
 {
+    int64_t start;
+
     if (phase_check(PHASE_MACHINE_INITIALIZED)) {
         error_setg(errp, "The command is permitted only before machine initialization");
         return;
     }
 
+    start = startup_profile_start();
     qemu_init_board();
+    startup_profile_end("phase", "init-board", start);
+
+    start = startup_profile_start();
     qemu_create_cli_devices();
+    startup_profile_end("phase", "cli-devices", start);
+
+    start = startup_profile_start();
     if (!qemu_machine_creation_done(errp)) {
         return;
     }
+    startup_profile_end("phase", "machine-done", start);
+    startup_profile_finish();
 
     if (loadvm) {
         RunState state = autostart ? RUN_STATE_RUNNING : runstate_get();
@@ -2775,6 +2823,7 @@ void qemu_init(int argc, char **argv)
     MachineClass *machine_class;
     bool userconfig = true;
     FILE *vmstate_dump_file = NULL;
+    int64_t start, subsystems_start, subsystems_end;
 
     qemu_add_opts(&qemu_drive_opts);
     qemu_add_drive_opts(&qemu_legacy_drive_opts);
@@ -2807,6 +2856,7 @@ void qemu_init(int argc, char **argv)
     qemu_add_opts(&qemu_semihosting_config_opts);
     qemu_add_opts(&qemu_fw_cfg_opts);
     qemu_add_opts(&qemu_action_opts);
+    qemu_add_opts(&qemu_profile_startup_opts);
     qemu_add_run_with_opts();
     module_call_init(MODULE_INIT_OPTS);
 
@@ -2817,7 +2867,9 @@ void qemu_init(int argc, char **argv)
 
     qemu_init_arch_modules();
 
+    subsystems_start = get_clock();
     qemu_init_subsystems();
+    subsystems_end = get_clock();
 
     /* first pass of option parsing */
     optind = 1;
@@ -3604,6 +3656,21 @@ void qemu_init(int argc, char **argv)
             case QEMU_OPTION_enable_sync_profile:
                 qsp_enable();
                 break;
+            case QEMU_OPTION_profile_startup:
+                if (startup_profile_enabled) {
+                    error_report("only one '-profile-startup' "
+                                 "option may be given");
+                    exit(1);
+                }
+                olist = qemu_find_opts("profile-startup");
+                opts = qemu_opts_parse_noisily(olist, optarg, true);
+                if (!opts) {
+                    exit(1);
+                }
+                configure_startup_profile(opts);
+                startup_profile_add("phase", "init-subsystems",
+                                    subsystems_start, subsystems_end);
+                break;
             case QEMU_OPTION_nouserconfig:
                 /* Nothing to be parsed here. Especially, do not error out below. */
                 break;
@@ -3689,7 +3756,9 @@ void qemu_init(int argc, char **argv)
     /* Transfer QemuOpts options into machine options */
     parse_memory_options();
 
+    start = startup_profile_start();
     qemu_create_machine(machine_opts_dict);
+    startup_profile_end("phase", "create-machine", start);
 
     suspend_mux_open();
 
@@ -3698,8 +3767,10 @@ void qemu_init(int argc, char **argv)
     qemu_create_default_devices();
     qemu_create_early_backends();
 
+    start = startup_profile_start();
     qemu_apply_legacy_machine_options(machine_opts_dict);
     qemu_apply_machine_options(machine_opts_dict);
+    startup_profile_end("phase", "machine-options", start);
     qobject_unref(machine_opts_dict);
     phase_advance(PHASE_MACHINE_CREATED);
 
@@ -3707,7 +3778,9 @@ void qemu_init(int argc, char **argv)
      * Note: uses machine properties such as kernel-irqchip, must run
      * after qemu_apply_machine_options.
      */
+    start = startup_profile_start();
     configure_accelerators(argv[0]);
+    startup_profile_end("phase", "accelerators", start);
     phase_advance(PHASE_ACCEL_CREATED);
 
     /*
@@ -3737,7 +3810,9 @@ void qemu_init(int argc, char **argv)
      * check against compatibilities on the backend memories (e.g. postcopy
      * over memory-backend-file objects).
      */
+    start = startup_profile_start();
     qemu_create_late_backends();
+    startup_profile_end("phase", "late-backends", start);
     phase_advance(PHASE_LATE_BACKENDS_CREATED);
 
     /*
@@ -29,12 +29,16 @@
 #include "qemu/memalign.h"
 #include "qemu/cacheinfo.h"
 #include "qemu/qtree.h"
+#include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "tcg/tcg.h"
 #include "exec/translation-block.h"
 #include "tcg-internal.h"
 #include "host/cpuinfo.h"
 
+#ifdef CONFIG_NUMA
+#include <numaif.h>
+#endif
 
 /*
  * Local source-level compatibility with Unix.
@@ -68,6 +72,8 @@ struct tcg_region_state {
     size_t size; /* size of one region */
     size_t stride; /* .size + guard size */
     size_t total_size; /* size of entire buffer, >= n * stride */
+    TCGHugepages hugepages;
+    bool numa; /* bind each region to the node of the thread using it */
 
     /* fields protected by the lock */
     size_t current; /* current region index */
@@ -357,6 +363,34 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
     s->code_gen_highwater = end - TCG_HIGHWATER;
 }
 
+/*
+ * Migrate the pages of @s's current region to the host NUMA node of the
+ * calling thread, and allocate any pages not yet touched there as well.
+ * Must be called from the thread that owns @s.
+ */
+static void tcg_region_bind_local(TCGContext *s)
+{
+#ifdef CONFIG_NUMA
+    const size_t page_size = qemu_real_host_page_size();
+    uintptr_t start, end;
+
+    if (!region.numa) {
+        return;
+    }
+
+    start = QEMU_ALIGN_DOWN((uintptr_t)s->code_gen_buffer, page_size);
+    end = QEMU_ALIGN_UP((uintptr_t)s->code_gen_buffer +
+                        s->code_gen_buffer_size, page_size);
+
+    /* MPOL_PREFERRED with an empty node mask means "local allocation". */
+    if (mbind((void *)start, end - start, MPOL_PREFERRED, NULL, 0,
+              MPOL_MF_MOVE)) {
+        /* Placement is an optimization only; carry on regardless. */
+        region.numa = false;
+    }
+#endif
+}
+
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
     if (region.current == region.n) {
@@ -383,6 +417,10 @@ bool tcg_region_alloc(TCGContext *s)
         region.agg_size_full += size_full - TCG_HIGHWATER;
     }
     qemu_mutex_unlock(&region.lock);
+
+    if (!err) {
+        tcg_region_bind_local(s);
+    }
     return err;
 }
 
@@ -401,6 +439,8 @@ void tcg_region_initial_alloc(TCGContext *s)
     qemu_mutex_lock(&region.lock);
     tcg_region_initial_alloc__locked(s);
     qemu_mutex_unlock(&region.lock);
+
+    tcg_region_bind_local(s);
 }
 
 /* Call from a safe-work context */
@@ -420,6 +460,19 @@ void tcg_region_reset_all(void)
     qemu_mutex_unlock(&region.lock);
 
     tcg_region_tree_reset_all();
+
+    /*
+     * With NUMA placement, the regions are about to be handed out to
+     * different threads than before.  Everything after the first region,
+     * which also holds the prologue, is dead code now: drop the backing
+     * pages so that they are faulted in again on the node of the thread
+     * which next writes them.  This does not work for the shared memfd
+     * mapping of split-wx, whose pages would stay in the page cache.
+     */
+    if (region.numa && !tcg_splitwx_diff && region.n > 1) {
+        qemu_madvise(region.start_aligned + region.stride,
+                     region.total_size - region.stride, QEMU_MADV_DONTNEED);
+    }
 }
 
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
@@ -568,6 +621,39 @@ static int alloc_code_gen_buffer_anon(size_t size, int prot,
     return prot;
 }
 
+/*
+ * Like alloc_code_gen_buffer_anon, but align the buffer to @align so
+ * that regions which are multiples of @align can use huge pages.
+ */
+static int alloc_code_gen_buffer_anon_aligned(size_t size, size_t align,
+                                              int prot, int flags,
+                                              Error **errp)
+{
+    void *buf, *start;
+    size_t head, tail;
+
+    buf = mmap(NULL, size + align, prot, flags, -1, 0);
+    if (buf == MAP_FAILED) {
+        error_setg_errno(errp, errno,
+                         "allocate %zu bytes for jit buffer", size);
+        return -1;
+    }
+
+    start = QEMU_ALIGN_PTR_UP(buf, align);
+    head = start - buf;
+    tail = align - head;
+    if (head) {
+        munmap(buf, head);
+    }
+    if (tail) {
+        munmap(start + size, tail);
+    }
+
+    region.start_aligned = start;
+    region.total_size = size;
+    return prot;
+}
+
 #ifndef CONFIG_TCG_INTERPRETER
 #ifdef CONFIG_POSIX
 #include "qemu/memfd.h"
@@ -687,6 +773,15 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
     ERRP_GUARD();
     int prot, flags;
 
+    if (splitwx && region.hugepages == TCG_HUGEPAGES_EXPLICIT) {
+        if (splitwx > 0) {
+            error_setg(errp, "jit split-wx not supported with "
+                       "explicit huge pages");
+            return -1;
+        }
+        splitwx = 0;
+    }
+
     if (splitwx) {
         prot = alloc_code_gen_buffer_splitwx(size, errp);
         if (prot >= 0) {
@@ -717,6 +812,22 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
     }
 #endif
 
+#ifdef MAP_HUGETLB
+    if (region.hugepages == TCG_HUGEPAGES_EXPLICIT) {
+        if (alloc_code_gen_buffer_anon(size, prot, flags | MAP_HUGETLB,
+                                       NULL) >= 0) {
+            return prot;
+        }
+        warn_report("jit buffer: no explicit huge pages available, "
+                    "using transparent huge pages");
+        region.hugepages = TCG_HUGEPAGES_THP;
+    }
+#endif
+    if (region.hugepages != TCG_HUGEPAGES_ADVISE) {
+        return alloc_code_gen_buffer_anon_aligned(size, QEMU_VMALLOC_ALIGN,
+                                                  prot, flags, errp);
+    }
+
     return alloc_code_gen_buffer_anon(size, prot, flags, errp);
 }
 #endif /* USE_STATIC_CODE_GEN_BUFFER, WIN32, POSIX */
@@ -749,10 +860,11 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
  * in practice. Multi-threaded guests share most if not all of their translated
  * code, which makes parallel code generation less appealing than in system-mode
  */
-void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
+void tcg_region_init(size_t tb_size, int splitwx, TCGHugepages hugepages,
+                     bool numa, unsigned max_cpus)
 {
     const size_t page_size = qemu_real_host_page_size();
-    size_t region_size;
+    size_t region_size, region_align, guard_size;
     int have_prot, need_prot;
 
     /* Size the buffer.  */
@@ -772,6 +884,26 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
         tb_size = MAX_CODE_GEN_BUFFER_SIZE;
     }
 
+    region.n = tcg_n_regions(tb_size, max_cpus);
+    region.numa = numa;
+
+    /*
+     * Huge page backing requires each region to span at least one
+     * huge page, so that regions can be aligned to huge page size.
+     */
+    region.hugepages = hugepages;
+    region_align = page_size;
+    if (hugepages != TCG_HUGEPAGES_ADVISE) {
+        if (tb_size / region.n >= QEMU_VMALLOC_ALIGN) {
+            region_align = QEMU_VMALLOC_ALIGN;
+            tb_size = QEMU_ALIGN_DOWN(tb_size, region_align);
+        } else {
+            warn_report("jit buffer: regions too small for huge pages, "
+                        "increase tb-size");
+            region.hugepages = TCG_HUGEPAGES_ADVISE;
+        }
+    }
+
     have_prot = alloc_code_gen_buffer(tb_size, splitwx, &error_fatal);
     assert(have_prot >= 0);
 
@@ -783,21 +915,24 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
     }
 
     /*
-     * Make region_size a multiple of page_size, using aligned as the start.
+     * Make region_size a multiple of region_align, using aligned as the start.
      * As a result of this we might end up with a few extra pages at the end of
      * the buffer; we will assign those to the last region.
      */
-    region.n = tcg_n_regions(tb_size, max_cpus);
     region_size = tb_size / region.n;
-    region_size = QEMU_ALIGN_DOWN(region_size, page_size);
+    region_size = QEMU_ALIGN_DOWN(region_size, region_align);
 
     /* A region must have at least 2 pages; one code, one guard */
     g_assert(region_size >= 2 * page_size);
     region.stride = region_size;
 
-    /* Reserve space for guard pages. */
-    region.size = region_size - page_size;
-    region.total_size -= page_size;
+    /*
+     * Reserve space for guard pages.  These would split the huge page
+     * mapping at the end of every region, so omit them in that case.
+     */
+    guard_size = region.hugepages == TCG_HUGEPAGES_ADVISE ? page_size : 0;
+    region.size = region_size - guard_size;
+    region.total_size -= guard_size;
 
     /*
      * The first region will be smaller than the others, via the prologue,
@@ -844,9 +979,9 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
                                  "mprotect of jit buffer");
             }
         }
-        if (have_prot != 0) {
+        if (have_prot != 0 && guard_size) {
             /* Guard pages are nice for bug detection but are not essential. */
-            (void)qemu_mprotect_none(end, page_size);
+            (void)qemu_mprotect_none(end, guard_size);
         }
     }
 
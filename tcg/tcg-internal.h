@@ -26,6 +26,7 @@
 #define TCG_INTERNAL_H
 
 #include "tcg/helper-info.h"
+#include "tcg/startup.h"
 
 #define TCG_HIGHWATER 1024
 
@@ -34,7 +35,8 @@ extern TCGContext **tcg_ctxs;
 extern unsigned int tcg_cur_ctxs;
 extern unsigned int tcg_max_ctxs;
 
-void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus);
+void tcg_region_init(size_t tb_size, int splitwx, TCGHugepages hugepages,
+                     bool numa, unsigned max_cpus);
 bool tcg_region_alloc(TCGContext *s);
 void tcg_region_initial_alloc(TCGContext *s);
 void tcg_region_prologue_set(TCGContext *s);
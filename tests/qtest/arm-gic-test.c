@@ -0,0 +1,153 @@
+/*
+ * QTest testcase for the selection of the best pending IRQ of the GIC
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+
+/* The GICv1 of the Cortex-A9 MPCore of vexpress-a9, without security */
+#define PERIPHBASE              0x1e000000
+#define GICC_BASE               (PERIPHBASE + 0x100)
+#define GICD_BASE               (PERIPHBASE + 0x1000)
+#define NUM_IRQ                 96
+
+#define GICC_CTLR               0x000
+#define GICC_PMR                0x004
+#define GICC_IAR                0x00c
+#define GICC_EOIR               0x010
+
+#define GICD_CTLR               0x000
+#define GICD_ISENABLER(n)       (0x100 + (n) / 32 * 4)
+#define GICD_ICENABLER(n)       (0x180 + (n) / 32 * 4)
+#define GICD_ISPENDR(n)         (0x200 + (n) / 32 * 4)
+#define GICD_ICPENDR(n)         (0x280 + (n) / 32 * 4)
+#define GICD_IPRIORITYR(n)      (0x400 + (n))
+
+#define SPURIOUS                1023
+
+static void gic_set(QTestState *s, uint32_t reg, int irq)
+{
+    qtest_writel(s, GICD_BASE + reg, BIT(irq % 32));
+}
+
+static QTestState *gic_init(void)
+{
+    QTestState *s = qtest_init("-machine vexpress-a9");
+    int irq;
+
+    qtest_writel(s, GICD_BASE + GICD_CTLR, 1);
+    qtest_writel(s, GICC_BASE + GICC_CTLR, 1);
+    qtest_writel(s, GICC_BASE + GICC_PMR, 0xff);
+    for (irq = 32; irq < NUM_IRQ; irq++) {
+        gic_set(s, GICD_ISENABLER(irq), irq);
+        qtest_writeb(s, GICD_BASE + GICD_IPRIORITYR(irq), 0xa0);
+    }
+    return s;
+}
+
+static uint32_t gic_ack(QTestState *s)
+{
+    uint32_t irq = qtest_readl(s, GICC_BASE + GICC_IAR) & 0x3ff;
+
+    if (irq != SPURIOUS) {
+        qtest_writel(s, GICC_BASE + GICC_EOIR, irq);
+    }
+    return irq;
+}
+
+/* Lowest priority value first, then lowest IRQ number */
+static void test_best_irq_order(void)
+{
+    static const struct {
+        int irq;
+        uint8_t prio;
+    } pending[] = {
+        { 90, 0x80 }, { 41, 0x80 }, { 60, 0x40 }, { 50, 0x40 }, { 33, 0xc0 },
+    };
+    static const int order[] = { 50, 60, 41, 90, 33 };
+    QTestState *s = gic_init();
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(pending); i++) {
+        qtest_writeb(s, GICD_BASE + GICD_IPRIORITYR(pending[i].irq),
+                     pending[i].prio);
+        gic_set(s, GICD_ISPENDR(pending[i].irq), pending[i].irq);
+    }
+    for (i = 0; i < ARRAY_SIZE(order); i++) {
+        g_assert_cmpuint(gic_ack(s), ==, order[i]);
+    }
+    g_assert_cmpuint(gic_ack(s), ==, SPURIOUS);
+
+    qtest_quit(s);
+}
+
+/* IRQs which are disabled or no longer pending are not selected */
+static void test_best_irq_filtered(void)
+{
+    QTestState *s = gic_init();
+
+    qtest_writeb(s, GICD_BASE + GICD_IPRIORITYR(40), 0x20);
+    qtest_writeb(s, GICD_BASE + GICD_IPRIORITYR(70), 0x40);
+    gic_set(s, GICD_ISPENDR(40), 40);
+    gic_set(s, GICD_ISPENDR(70), 70);
+    gic_set(s, GICD_ISPENDR(80), 80);
+
+    /* Disabled while pending, then enabled again */
+    gic_set(s, GICD_ICENABLER(40), 40);
+    g_assert_cmpuint(gic_ack(s), ==, 70);
+    gic_set(s, GICD_ISENABLER(40), 40);
+
+    /* Cleared before being acknowledged */
+    gic_set(s, GICD_ICPENDR(80), 80);
+    g_assert_cmpuint(gic_ack(s), ==, 40);
+    g_assert_cmpuint(gic_ack(s), ==, SPURIOUS);
+
+    /* Pending again once it was dropped from the candidates */
+    gic_set(s, GICD_ISPENDR(80), 80);
+    g_assert_cmpuint(gic_ack(s), ==, 80);
+    g_assert_cmpuint(gic_ack(s), ==, SPURIOUS);
+
+    qtest_quit(s);
+}
+
+/*
+ * An IRQ storm: a handful of SPIs pending at once, over and over. Each
+ * acknowledge and EOI updates the GIC, which looks for the best IRQ.
+ */
+static void test_perf_storm(void)
+{
+    static const int storm[] = { 35, 47, 63, 64, 95 };
+    QTestState *s = gic_init();
+    double duration;
+    int i, n;
+
+    g_test_timer_start();
+    for (n = 0; n < 10000; n++) {
+        for (i = 0; i < ARRAY_SIZE(storm); i++) {
+            gic_set(s, GICD_ISPENDR(storm[i]), storm[i]);
+        }
+        for (i = 0; i < ARRAY_SIZE(storm); i++) {
+            g_assert_cmpuint(gic_ack(s), ==, storm[i]);
+        }
+    }
+    duration = g_test_timer_elapsed();
+    g_test_message("%d IRQs in %f s, %f us per IRQ", n * i, duration,
+                   duration * 1e6 / (n * i));
+
+    qtest_quit(s);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/arm/gic/best-irq/order", test_best_irq_order);
+    qtest_add_func("/arm/gic/best-irq/filtered", test_best_irq_filtered);
+    if (g_test_perf()) {
+        qtest_add_func("/arm/gic/perf/storm", test_perf_storm);
+    }
+
+    return g_test_run();
+}
@@ -14,6 +14,7 @@
 #include <glib/gstdio.h>
 
 #include "qemu/module.h"
+#include "qapi/qmp/qdict.h"
 #include "libqtest-single.h"
 
 /* Registers from ast2600 specifications */
@@ -24,6 +25,7 @@
 #define ASPEED_FSI_OPB1_RW_DIRECTION 0x2c
 #define ASPEED_FSI_OPB0_XFER_SIZE    0x18
 #define ASPEED_FSI_OPB1_XFER_SIZE    0x30
+#define ASPEED_FSI_OPB0_WRITE_DATA   0x20
 #define ASPEED_FSI_OPB0_BUS_ADDR     0x1c
 #define ASPEED_FSI_OPB1_BUS_ADDR     0x34
 #define ASPEED_FSI_INTRRUPT_CLEAR    0x40
@@ -39,6 +41,12 @@
 #define AST2600_OPB_FSI0_BASE_ADDR 0x1e79b000
 #define AST2600_OPB_FSI1_BASE_ADDR 0x1e79b100
 
+/* CFAM scratchpad register, through the OPB2FSI window */
+#define FSI_CFAM_SCRATCHPAD        0xa0000c00
+/* Nothing on the OPB there */
+#define FSI_OPB_UNMAPPED           0x10000000
+#define FSI_OPB_STATUS_ERR_ACK     0x4
+
 static uint32_t aspeed_fsi_base_addr;
 
 static uint32_t aspeed_fsi_readl(QTestState *s, uint32_t reg)
@@ -175,6 +183,214 @@ static void test_fsi1_getcfam_addr0(const void *data)
     g_assert_cmphex(curval, ==, 0x152d02c0);
 }
 
+static void test_fsi0_opb_write(QTestState *s, uint32_t addr, uint32_t val)
+{
+    aspeed_fsi_writel(s, ASPEED_FSI_OPB0_RW_DIRECTION, 0x0);
+    aspeed_fsi_writel(s, ASPEED_FSI_OPB0_XFER_SIZE, 0x3);
+    aspeed_fsi_writel(s, ASPEED_FSI_OPB0_BUS_ADDR, addr);
+    aspeed_fsi_writel(s, ASPEED_FSI_OPB0_WRITE_DATA, val);
+    aspeed_fsi_writel(s, ASPEED_FSI_INTRRUPT_CLEAR, 0x1);
+    aspeed_fsi_writel(s, ASPEED_FSI_ENGINER_TRIGGER, 0x1);
+}
+
+static uint32_t test_fsi0_opb_read(QTestState *s, uint32_t addr)
+{
+    aspeed_fsi_writel(s, ASPEED_FSI_OPB0_RW_DIRECTION, 0x1);
+    aspeed_fsi_writel(s, ASPEED_FSI_OPB0_XFER_SIZE, 0x3);
+    aspeed_fsi_writel(s, ASPEED_FSI_OPB0_BUS_ADDR, addr);
+    aspeed_fsi_writel(s, ASPEED_FSI_INTRRUPT_CLEAR, 0x1);
+    aspeed_fsi_writel(s, ASPEED_FSI_ENGINER_TRIGGER, 0x1);
+
+    g_assert_cmphex(aspeed_fsi_readl(s, ASPEED_FSI_INTRRUPT_STATUS), ==,
+                    0x10000);
+    return aspeed_fsi_readl(s, ASPEED_FSI_OPB0_READ_DATA);
+}
+
+static void test_fsi0_scratchpad(const void *data)
+{
+    QTestState *s = (QTestState *)data;
+    uint32_t curval;
+
+    test_fsi_setup(s, AST2600_OPB_FSI0_BASE_ADDR);
+
+    test_fsi0_opb_write(s, FSI_CFAM_SCRATCHPAD, 0xcafe1234);
+    curval = aspeed_fsi_readl(s, ASPEED_FSI_INTRRUPT_STATUS);
+    g_assert_cmphex(curval, ==, 0x10000);
+
+    /* Status is cleared before the next transfer */
+    aspeed_fsi_writel(s, ASPEED_FSI_INTRRUPT_CLEAR, 0x1);
+    curval = aspeed_fsi_readl(s, ASPEED_FSI_INTRRUPT_STATUS);
+    g_assert_cmphex(curval, ==, 0x0);
+
+    curval = test_fsi0_opb_read(s, FSI_CFAM_SCRATCHPAD);
+    g_assert_cmphex(curval, ==, 0xcafe1234);
+}
+
+static void test_fsi0_async_completion(void)
+{
+    QTestState *s;
+    uint32_t curval;
+
+    s = qtest_init("-machine ast2600-evb "
+                   "-global aspeed.apb2opb.async-completion=on");
+
+    test_fsi_setup(s, AST2600_OPB_FSI0_BASE_ADDR);
+
+    /* Back to back transfers, the status read waits for the last one */
+    test_fsi0_opb_write(s, FSI_CFAM_SCRATCHPAD, 0x5a5a0001);
+    curval = test_fsi0_opb_read(s, FSI_CFAM_SCRATCHPAD);
+    g_assert_cmphex(curval, ==, 0x5a5a0001);
+
+    /* Left to the main loop */
+    test_fsi0_opb_write(s, FSI_CFAM_SCRATCHPAD, 0x5a5a0002);
+    qtest_clock_step(s, 1);
+    g_assert_cmphex(aspeed_fsi_readl(s, ASPEED_FSI_INTRRUPT_STATUS), ==,
+                    0x10000);
+    curval = test_fsi0_opb_read(s, FSI_CFAM_SCRATCHPAD);
+    g_assert_cmphex(curval, ==, 0x5a5a0002);
+
+    qtest_quit(s);
+}
+
+static uint64_t test_fsi0_stat(QTestState *s, const char *name)
+{
+    QDict *rsp;
+    uint64_t val;
+
+    rsp = qtest_qmp(s, "{ 'execute': 'qom-get', 'arguments': "
+                    "{ 'path': '/machine/soc/fsi[0]', 'property': %s } }",
+                    name);
+    g_assert(qdict_haskey(rsp, "return"));
+    val = qdict_get_int(rsp, "return");
+    qobject_unref(rsp);
+    return val;
+}
+
+/* Writes to consecutive registers go out as one block transfer */
+static void test_fsi0_posted_writes(void)
+{
+    QTestState *s;
+    uint64_t transfers, words;
+    uint32_t i;
+
+    s = qtest_init("-machine ast2600-evb "
+                   "-global aspeed.apb2opb.async-completion=on");
+
+    test_fsi_setup(s, AST2600_OPB_FSI0_BASE_ADDR);
+
+    /* Flushed by the read which follows them */
+    transfers = test_fsi0_stat(s, "transfers");
+    words = test_fsi0_stat(s, "words");
+    for (i = 0; i < 4; i++) {
+        test_fsi0_opb_write(s, FSI_CFAM_SCRATCHPAD + i * 4, 0x11110000 + i);
+        g_assert_cmphex(aspeed_fsi_readl(s, ASPEED_FSI_INTRRUPT_STATUS), ==,
+                        0x10000);
+    }
+    g_assert_cmpuint(test_fsi0_stat(s, "transfers"), ==, transfers);
+
+    g_assert_cmphex(test_fsi0_opb_read(s, FSI_CFAM_SCRATCHPAD), ==,
+                    0x11110000);
+    g_assert_cmpuint(test_fsi0_stat(s, "transfers"), ==, transfers + 2);
+    g_assert_cmpuint(test_fsi0_stat(s, "words"), ==, words + 5);
+    for (i = 1; i < 4; i++) {
+        g_assert_cmphex(test_fsi0_opb_read(s, FSI_CFAM_SCRATCHPAD + i * 4),
+                        ==, 0x11110000 + i);
+    }
+
+    /* Flushed by the timer, a gap in the addresses starts a new batch */
+    transfers = test_fsi0_stat(s, "transfers");
+    words = test_fsi0_stat(s, "words");
+    test_fsi0_opb_write(s, FSI_CFAM_SCRATCHPAD, 0x22220000);
+    test_fsi0_opb_write(s, FSI_CFAM_SCRATCHPAD + 4, 0x22220001);
+    test_fsi0_opb_write(s, FSI_CFAM_SCRATCHPAD + 12, 0x22220003);
+    qtest_clock_step(s, 1000);
+    g_assert_cmpuint(test_fsi0_stat(s, "transfers"), ==, transfers + 2);
+    g_assert_cmpuint(test_fsi0_stat(s, "words"), ==, words + 3);
+
+    g_assert_cmphex(test_fsi0_opb_read(s, FSI_CFAM_SCRATCHPAD), ==,
+                    0x22220000);
+    g_assert_cmphex(test_fsi0_opb_read(s, FSI_CFAM_SCRATCHPAD + 4), ==,
+                    0x22220001);
+    g_assert_cmphex(test_fsi0_opb_read(s, FSI_CFAM_SCRATCHPAD + 8), ==,
+                    0x11110002);
+    g_assert_cmphex(test_fsi0_opb_read(s, FSI_CFAM_SCRATCHPAD + 12), ==,
+                    0x22220003);
+
+    qtest_quit(s);
+}
+
+/* A posted write that fails is reported by the next status read, once */
+static void test_fsi0_posted_write_error(void)
+{
+    QTestState *s;
+
+    s = qtest_init("-machine ast2600-evb "
+                   "-global aspeed.apb2opb.async-completion=on");
+
+    test_fsi_setup(s, AST2600_OPB_FSI0_BASE_ADDR);
+
+    /* Acknowledged by the trigger, before it is run */
+    test_fsi0_opb_write(s, FSI_OPB_UNMAPPED, 0xdeadbeef);
+    g_assert_cmphex(aspeed_fsi_readl(s, ASPEED_FSI_INTRRUPT_STATUS), ==,
+                    0x10000);
+    g_assert_cmphex(aspeed_fsi_readl(s, ASPEED_FSI_OPB0_BUS_STATUS) &
+                    FSI_OPB_STATUS_ERR_ACK, ==, 0);
+
+    qtest_clock_step(s, 1000);
+    g_assert_cmphex(aspeed_fsi_readl(s, ASPEED_FSI_OPB0_BUS_STATUS) &
+                    FSI_OPB_STATUS_ERR_ACK, ==, FSI_OPB_STATUS_ERR_ACK);
+    g_assert_cmphex(aspeed_fsi_readl(s, ASPEED_FSI_OPB0_BUS_STATUS) &
+                    FSI_OPB_STATUS_ERR_ACK, ==, 0);
+
+    /* Also when flushed by the next transfer */
+    test_fsi0_opb_write(s, FSI_OPB_UNMAPPED, 0xdeadbeef);
+    test_fsi0_opb_write(s, FSI_CFAM_SCRATCHPAD, 0x33330000);
+    g_assert_cmphex(aspeed_fsi_readl(s, ASPEED_FSI_OPB0_BUS_STATUS) &
+                    FSI_OPB_STATUS_ERR_ACK, ==, FSI_OPB_STATUS_ERR_ACK);
+    g_assert_cmphex(test_fsi0_opb_read(s, FSI_CFAM_SCRATCHPAD), ==,
+                    0x33330000);
+    g_assert_cmphex(aspeed_fsi_readl(s, ASPEED_FSI_OPB0_BUS_STATUS) &
+                    FSI_OPB_STATUS_ERR_ACK, ==, 0);
+
+    qtest_quit(s);
+}
+
+#define FSI_PERF_WORDS 20000
+
+static void test_fsi_perf(const char *args)
+{
+    QTestState *s;
+    double duration;
+    uint32_t i;
+
+    s = qtest_init(args);
+    test_fsi_setup(s, AST2600_OPB_FSI0_BASE_ADDR);
+
+    g_test_timer_start();
+    for (i = 0; i < FSI_PERF_WORDS; i++) {
+        test_fsi0_opb_write(s, FSI_CFAM_SCRATCHPAD, i);
+        g_assert_cmphex(test_fsi0_opb_read(s, FSI_CFAM_SCRATCHPAD), ==, i);
+    }
+    duration = g_test_timer_elapsed();
+
+    g_test_message("%u scratchpad write/read pairs in %f s, "
+                   "%f transfers/s", FSI_PERF_WORDS, duration,
+                   2 * FSI_PERF_WORDS / duration);
+
+    qtest_quit(s);
+}
+
+static void test_fsi_perf_sync(void)
+{
+    test_fsi_perf("-machine ast2600-evb");
+}
+
+static void test_fsi_perf_async(void)
+{
+    test_fsi_perf("-machine ast2600-evb "
+                  "-global aspeed.apb2opb.async-completion=on");
+}
+
 int main(int argc, char **argv)
 {
     int ret = -1;
@@ -198,6 +414,21 @@ int main(int argc, char **argv)
     qtest_add_data_func("/aspeed-fsi-test/test_fsi1_getcfam_addr0", s,
                         test_fsi1_getcfam_addr0);
 
+    /* OPB transfers through the CFAM */
+    qtest_add_data_func("/aspeed-fsi-test/test_fsi0_scratchpad", s,
+                        test_fsi0_scratchpad);
+    qtest_add_func("/aspeed-fsi-test/test_fsi0_async_completion",
+                   test_fsi0_async_completion);
+    qtest_add_func("/aspeed-fsi-test/test_fsi0_posted_writes",
+                   test_fsi0_posted_writes);
+    qtest_add_func("/aspeed-fsi-test/test_fsi0_posted_write_error",
+                   test_fsi0_posted_write_error);
+
+    if (g_test_perf()) {
+        qtest_add_func("/aspeed-fsi-test/perf/sync", test_fsi_perf_sync);
+        qtest_add_func("/aspeed-fsi-test/perf/async", test_fsi_perf_async);
+    }
+
     ret = g_test_run();
     qtest_quit(s);
 
@@ -0,0 +1,274 @@
+/*
+ * QTest testcase for the host side of the ASPEED KCS channels
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+
+#include "qemu/bitops.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+#include "libqtest.h"
+
+#define AST2600_LPC_BASE        0x1E789000
+
+#define HICR0                   0x00
+#define  HICR0_LPC3E            BIT(7)
+#define HICR4                   0x10
+#define  HICR4_KCSENBL          BIT(2)
+#define IDR3                    0x2C
+#define ODR3                    0x38
+#define STR3                    0x44
+#define  STR_OBF                BIT(0)
+#define  STR_IBF                BIT(1)
+#define  STR_CMD_DATA           BIT(3)
+#define  STR_STATE_MASK         (0x3 << 6)
+#define  STR_STATE_IDLE         (0x0 << 6)
+#define  STR_STATE_READ         (0x1 << 6)
+#define  STR_STATE_WRITE        (0x2 << 6)
+
+#define KCS_CMD_WRITE_START     0x61
+#define KCS_CMD_WRITE_END       0x62
+#define KCS_CMD_READ_BYTE       0x68
+
+#define VM_MSG_CHAR             0xA0
+#define VM_CMD_CHAR             0xA1
+#define VM_ESCAPE_CHAR          0xAA
+
+static int emu_lfd;
+static int emu_fd;
+static int emu_port;
+
+static uint8_t lpc_readb(QTestState *s, uint32_t reg)
+{
+    return qtest_readb(s, AST2600_LPC_BASE + reg);
+}
+
+static void lpc_writeb(QTestState *s, uint32_t reg, uint8_t val)
+{
+    qtest_writeb(s, AST2600_LPC_BASE + reg, val);
+}
+
+static void kcs_set_state(QTestState *s, uint8_t state)
+{
+    lpc_writeb(s, STR3, (lpc_readb(s, STR3) & ~STR_STATE_MASK) | state);
+}
+
+static uint8_t kcs_wait_ibf(QTestState *s)
+{
+    uint8_t str;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        str = lpc_readb(s, STR3);
+        if (str & STR_IBF) {
+            return str;
+        }
+        g_usleep(1000);
+    }
+    g_assert_not_reached();
+}
+
+/* Play the BMC firmware for one request and answer it */
+static void kcs_serve(QTestState *s, const uint8_t *rsp, int rsp_len,
+                      uint8_t *req, int *req_len)
+{
+    bool end = false;
+    uint8_t str;
+    int i;
+
+    *req_len = 0;
+    for (;;) {
+        str = kcs_wait_ibf(s);
+        if (str & STR_CMD_DATA) {
+            kcs_set_state(s, STR_STATE_WRITE);
+            lpc_writeb(s, ODR3, 0);
+            switch (lpc_readb(s, IDR3)) {
+            case KCS_CMD_WRITE_START:
+                *req_len = 0;
+                break;
+            case KCS_CMD_WRITE_END:
+                end = true;
+                break;
+            default:
+                g_assert_not_reached();
+            }
+        } else if (end) {
+            kcs_set_state(s, STR_STATE_READ);
+            req[(*req_len)++] = lpc_readb(s, IDR3);
+            break;
+        } else {
+            kcs_set_state(s, STR_STATE_WRITE);
+            lpc_writeb(s, ODR3, 0);
+            req[(*req_len)++] = lpc_readb(s, IDR3);
+        }
+    }
+
+    lpc_writeb(s, ODR3, rsp[0]);
+    for (i = 1; i <= rsp_len; i++) {
+        kcs_wait_ibf(s);
+        if (i == rsp_len) {
+            kcs_set_state(s, STR_STATE_IDLE);
+        }
+        g_assert_cmphex(lpc_readb(s, IDR3), ==, KCS_CMD_READ_BYTE);
+        lpc_writeb(s, ODR3, i == rsp_len ? 0 : rsp[i]);
+    }
+}
+
+static void emu_send(uint8_t msg_id, const uint8_t *msg, int len)
+{
+    uint8_t buf[64];
+    uint8_t csum = msg_id;
+    int i, n = 0;
+
+    buf[n++] = msg_id;
+    for (i = 0; i < len; i++) {
+        buf[n++] = msg[i];
+        csum += msg[i];
+    }
+    buf[n++] = -csum;
+    buf[n++] = VM_MSG_CHAR;
+
+    g_assert(write(emu_fd, buf, n) == n);
+}
+
+/* Read one message, skipping commands, and check its checksum */
+static int emu_recv(uint8_t *msg)
+{
+    bool escape = false;
+    uint8_t csum = 0;
+    uint8_t ch;
+    int i, n = 0;
+
+    for (;;) {
+        g_assert(read(emu_fd, &ch, 1) == 1);
+        if (ch == VM_MSG_CHAR) {
+            break;
+        } else if (ch == VM_CMD_CHAR) {
+            n = 0;
+        } else if (ch == VM_ESCAPE_CHAR) {
+            escape = true;
+        } else {
+            msg[n++] = escape ? ch & ~0x10 : ch;
+            escape = false;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        csum += msg[i];
+    }
+    g_assert_cmphex(csum, ==, 0);
+    return n - 1;
+}
+
+static uint64_t kcs_stat(QTestState *s, const char *name)
+{
+    QDict *response;
+    uint64_t ret;
+
+    response = qtest_qmp(s, "{ 'execute': 'qom-get', 'arguments': "
+                         "{ 'path': '/machine/soc/lpc', 'property': %s } }",
+                         name);
+    g_assert(qdict_haskey(response, "return"));
+    ret = qdict_get_int(response, "return");
+    qobject_unref(response);
+    return ret;
+}
+
+static void test_pipeline(const void *data)
+{
+    static const uint8_t get_dev_id[] = { 0x06 << 2, 0x01 };
+    static const uint8_t get_sel_info[] = { 0x0a << 2, 0x40 };
+    static const uint8_t dev_id_rsp[] = { 0x07 << 2, 0x01, 0x00, 0x20, 0xa1 };
+    static const uint8_t sel_info_rsp[] = { 0x0b << 2, 0x40, 0x00, 0x51 };
+    uint8_t req[16], msg[64];
+    QDict *response;
+    QList *histogram;
+    QTestState *s;
+    int len;
+
+    s = qtest_initf("-machine ast2600-evb "
+                    "-chardev socket,id=kcs,host=127.0.0.1,port=%d,"
+                    "reconnect-ms=10000 "
+                    "-global aspeed.lpc.kcs3-chardev=kcs", emu_port);
+    emu_fd = accept(emu_lfd, NULL, 0);
+    g_assert(emu_fd >= 0);
+
+    /* Both requests are sent before the BMC is even listening */
+    emu_send(0x10, get_dev_id, sizeof(get_dev_id));
+    emu_send(0x11, get_sel_info, sizeof(get_sel_info));
+
+    lpc_writeb(s, HICR0, HICR0_LPC3E);
+    lpc_writeb(s, HICR4, HICR4_KCSENBL);
+
+    kcs_serve(s, dev_id_rsp, sizeof(dev_id_rsp), req, &len);
+    g_assert_cmpint(len, ==, sizeof(get_dev_id));
+    g_assert(!memcmp(req, get_dev_id, len));
+    g_assert_cmpint(emu_recv(msg), ==, 1 + sizeof(dev_id_rsp));
+    g_assert_cmphex(msg[0], ==, 0x10);
+    g_assert(!memcmp(msg + 1, dev_id_rsp, sizeof(dev_id_rsp)));
+
+    /* The second one went in as soon as the first was done */
+    kcs_serve(s, sel_info_rsp, sizeof(sel_info_rsp), req, &len);
+    g_assert_cmpint(len, ==, sizeof(get_sel_info));
+    g_assert(!memcmp(req, get_sel_info, len));
+    g_assert_cmpint(emu_recv(msg), ==, 1 + sizeof(sel_info_rsp));
+    g_assert_cmphex(msg[0], ==, 0x11);
+    g_assert(!memcmp(msg + 1, sel_info_rsp, sizeof(sel_info_rsp)));
+
+    g_assert_cmpuint(kcs_stat(s, "kcs3-requests"), ==, 2);
+    g_assert_cmpuint(kcs_stat(s, "kcs3-responses"), ==, 2);
+    g_assert_cmpuint(kcs_stat(s, "kcs3-errors"), ==, 0);
+
+    response = qtest_qmp(s, "{ 'execute': 'qom-get', 'arguments': "
+                         "{ 'path': '/machine/soc/lpc', "
+                         "'property': 'kcs3-latency-histogram' } }");
+    histogram = qdict_get_qlist(response, "return");
+    g_assert_cmpuint(qlist_size(histogram), ==, 24);
+    qobject_unref(response);
+
+    close(emu_fd);
+    qtest_quit(s);
+}
+
+/*
+ * Create a local TCP socket with any port, then save off the port we got.
+ */
+static void open_socket(void)
+{
+    struct sockaddr_in myaddr = {};
+    socklen_t addrlen;
+
+    myaddr.sin_family = AF_INET;
+    myaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    myaddr.sin_port = 0;
+    emu_lfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    g_assert(emu_lfd != -1);
+    g_assert(bind(emu_lfd, (struct sockaddr *) &myaddr,
+                  sizeof(myaddr)) != -1);
+    addrlen = sizeof(myaddr);
+    g_assert(getsockname(emu_lfd, (struct sockaddr *) &myaddr,
+                         &addrlen) != -1);
+    emu_port = ntohs(myaddr.sin_port);
+    g_assert(listen(emu_lfd, 1) != -1);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    open_socket();
+
+    qtest_add_data_func("/ast2600/kcs/pipeline", NULL, test_pipeline);
+    ret = g_test_run();
+
+    close(emu_lfd);
+    return ret;
+}
@@ -0,0 +1,301 @@
+/*
+ * QTest testcase for the ASPEED PWM and Fan Tach Controller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include <glib/gstdio.h>
+
+#include "qemu/bitops.h"
+#include "qapi/qmp/qdict.h"
+#include "libqtest.h"
+
+#define AST2600_PWM_BASE        0x1E610000
+
+#define PWM_CTRL(ch)            ((ch) * 0x10 + 0x00)
+#define  PWM_CTRL_CLK_ENABLE            BIT(16)
+#define  PWM_CTRL_PIN_ENABLE            BIT(12)
+#define PWM_DUTY_CYCLE(ch)      ((ch) * 0x10 + 0x04)
+#define  PWM_DUTY_CYCLE_PERIOD(x)       ((x) << 24)
+#define  PWM_DUTY_CYCLE_FALLING(x)      ((x) << 8)
+#define TACH_CTRL(ch)           ((ch) * 0x10 + 0x08)
+#define  TACH_CTRL_IER                  BIT(31)
+#define  TACH_CTRL_ENABLE               BIT(28)
+#define  TACH_CTRL_CLK_DIV_T(x)         ((x) << 20)
+#define TACH_STS(ch)            ((ch) * 0x10 + 0x0C)
+#define  TACH_STS_ISR                   BIT(31)
+#define  TACH_STS_FULL_MEASUREMENT      BIT(20)
+#define  TACH_STS_VALUE(x)              ((x) & 0xfffff)
+
+/* HCLK, divided by 4^5 and 2 pulses per revolution, as Linux does */
+#define TACH_RPM(x)             (200000000ULL * 60 / ((x) * 1024 * 2))
+
+#define SEC                     (1000 * 1000 * 1000LL)
+
+static void pwm_writel(QTestState *s, uint32_t reg, uint32_t val)
+{
+    qtest_writel(s, AST2600_PWM_BASE + reg, val);
+}
+
+static uint32_t pwm_readl(QTestState *s, uint32_t reg)
+{
+    return qtest_readl(s, AST2600_PWM_BASE + reg);
+}
+
+static int64_t qom_get_int(QTestState *s, const char *path, const char *name)
+{
+    QDict *response;
+    int64_t ret;
+
+    response = qtest_qmp(s, "{ 'execute': 'qom-get', 'arguments': "
+                         "{ 'path': %s, 'property': %s } }", path, name);
+    g_assert(qdict_haskey(response, "return"));
+    ret = qdict_get_int(response, "return");
+    qobject_unref(response);
+    return ret;
+}
+
+/* Drive a channel with a duty cycle of @falling / 256 */
+static void pwm_set_duty(QTestState *s, int ch, uint32_t falling)
+{
+    pwm_writel(s, PWM_DUTY_CYCLE(ch),
+               PWM_DUTY_CYCLE_PERIOD(0xff) | PWM_DUTY_CYCLE_FALLING(falling));
+    pwm_writel(s, PWM_CTRL(ch), PWM_CTRL_CLK_ENABLE | PWM_CTRL_PIN_ENABLE);
+}
+
+static char *plant_file(unsigned int fans, unsigned int zones,
+                        const char *sensor)
+{
+    g_autoptr(GString) str = g_string_new("[plant]\nambient=25\n");
+    g_autoptr(GError) err = NULL;
+    char *path;
+    unsigned int i, z;
+    int fd;
+
+    for (i = 0; i < fans; i++) {
+        g_string_append_printf(str, "[fan %u]\npwm=%u\nmax-rpm=12000\n"
+                               "time-constant=1\n", i, i);
+    }
+    for (z = 0; z < zones; z++) {
+        g_string_append_printf(str, "[zone %u]\npower=100\ncapacitance=100\n"
+                               "conductance=1\ncooling=", z);
+        for (i = 0; i < fans; i++) {
+            g_string_append_printf(str, "%s%d", i ? ";" : "",
+                                   i % zones == z ? 10 : 1);
+        }
+        g_string_append(str, "\n");
+        if (sensor && !z) {
+            g_string_append_printf(str, "sensor=%s\n", sensor);
+        }
+    }
+
+    fd = g_file_open_tmp("aspeed-pwm-plant.XXXXXX", &path, &err);
+    g_assert_no_error(err);
+    close(fd);
+    g_file_set_contents(path, str->str, str->len, &err);
+    g_assert_no_error(err);
+    return path;
+}
+
+static void test_tach(void)
+{
+    QTestState *s = qtest_init("-machine ast2600-evb");
+    uint32_t sts;
+    int64_t rpm;
+
+    pwm_set_duty(s, 0, 128);
+    pwm_writel(s, TACH_CTRL(0), TACH_CTRL_ENABLE | TACH_CTRL_CLK_DIV_T(5));
+
+    /* Ten time constants of the default fans */
+    qtest_clock_step(s, 10 * SEC);
+
+    rpm = qom_get_int(s, "/machine/soc/pwm", "rpm[0]");
+    g_assert_cmpint(rpm, >=, 4990);
+    g_assert_cmpint(rpm, <=, 5000);
+
+    sts = pwm_readl(s, TACH_STS(0));
+    g_assert(sts & TACH_STS_FULL_MEASUREMENT);
+    g_assert_cmpint(TACH_RPM(TACH_STS_VALUE(sts)), >=, rpm - 10);
+    g_assert_cmpint(TACH_RPM(TACH_STS_VALUE(sts)), <=, rpm + 10);
+
+    /* A stopped fan cannot be measured */
+    pwm_writel(s, PWM_CTRL(0), PWM_CTRL_PIN_ENABLE);
+    qtest_clock_step(s, 30 * SEC);
+    sts = pwm_readl(s, TACH_STS(0));
+    g_assert_false(sts & TACH_STS_FULL_MEASUREMENT);
+
+    /* The threshold catches it */
+    pwm_writel(s, TACH_CTRL(0), TACH_CTRL_IER | TACH_CTRL_ENABLE |
+               TACH_CTRL_CLK_DIV_T(5) | 0x1000);
+    qtest_clock_step(s, SEC);
+    g_assert(pwm_readl(s, TACH_STS(0)) & TACH_STS_ISR);
+    pwm_writel(s, TACH_STS(0), TACH_STS_ISR);
+    g_assert_false(pwm_readl(s, TACH_STS(0)) & TACH_STS_ISR);
+
+    qtest_quit(s);
+}
+
+static void test_plant(void)
+{
+    g_autofree char *path = plant_file(2, 1, "/machine/peripheral/zone0");
+    QTestState *s;
+    int64_t temp, zone;
+
+    s = qtest_initf("-machine ast2600-evb "
+                    "-global aspeed.pwm-tach.plant=%s "
+                    "-device tmp105,bus=aspeed.i2c.bus.3,address=0x4d,"
+                    "id=zone0", path);
+
+    /* Fans full speed, 25 + 100 / (1 + 10 + 10) */
+    qtest_clock_step(s, 60 * SEC);
+    temp = qom_get_int(s, "/machine/peripheral/zone0", "temperature");
+    g_assert_cmpint(temp, >=, 29600);
+    g_assert_cmpint(temp, <=, 29900);
+    /* The TMP105 truncates to 1/256 of a degree */
+    zone = qom_get_int(s, "/machine/soc/pwm", "temperature[0]");
+    g_assert_cmpint(zone - temp, >=, 0);
+    g_assert_cmpint(zone - temp, <=, 8);
+
+    /* Half speed */
+    pwm_set_duty(s, 0, 128);
+    pwm_set_duty(s, 1, 128);
+    qtest_clock_step(s, 120 * SEC);
+    temp = qom_get_int(s, "/machine/peripheral/zone0", "temperature");
+    g_assert_cmpint(temp, >=, 33900);
+    g_assert_cmpint(temp, <=, 34200);
+
+    /* A load step, 25 + 200 / (1 + 5 + 5) */
+    qtest_qmp_assert_success(s, "{ 'execute': 'qom-set', 'arguments': "
+                             "{ 'path': '/machine/soc/pwm', "
+                             "'property': 'power[0]', 'value': 200 } }");
+    qtest_clock_step(s, 120 * SEC);
+    temp = qom_get_int(s, "/machine/peripheral/zone0", "temperature");
+    g_assert_cmpint(temp, >=, 43000);
+    g_assert_cmpint(temp, <=, 43300);
+
+    qtest_quit(s);
+    g_unlink(path);
+}
+
+/* The example of hw/misc/aspeed_pwm.c, comments included */
+static const char example_plant[] =
+    "[plant]\n"
+    "# Ambient temperature in C\n"
+    "ambient=25\n"
+    "\n"
+    "[fan 0]\n"
+    "# PWM channel driving the fan\n"
+    "pwm=0\n"
+    "max-rpm=12000\n"
+    "# Time constant in s\n"
+    "time-constant=1.5\n"
+    "# Tach pulses per revolution\n"
+    "pulses=2\n"
+    "\n"
+    "[zone 0]\n"
+    "# Heating power in W, heat capacity in J/K\n"
+    "power=150\n"
+    "capacitance=600\n"
+    "# Cooling by still air, in W/K\n"
+    "conductance=1.5\n"
+    "# Cooling of each fan at full speed from fan 0, in W/K\n"
+    "cooling=4\n"
+    "sensor=/machine/peripheral/cpu-temp\n"
+    "sensor-property=temperature\n";
+
+static void test_example_plant(void)
+{
+    g_autoptr(GError) err = NULL;
+    g_autofree char *path = NULL;
+    QTestState *s;
+    int64_t temp;
+    int fd;
+
+    fd = g_file_open_tmp("aspeed-pwm-plant.XXXXXX", &path, &err);
+    g_assert_no_error(err);
+    close(fd);
+    g_file_set_contents(path, example_plant, -1, &err);
+    g_assert_no_error(err);
+
+    s = qtest_initf("-machine ast2600-evb "
+                    "-global aspeed.pwm-tach.plant=%s "
+                    "-device tmp105,bus=aspeed.i2c.bus.3,address=0x4d,"
+                    "id=cpu-temp", path);
+
+    pwm_set_duty(s, 0, 0xff);
+    qtest_clock_step(s, 60 * SEC);
+    g_assert_cmpint(qom_get_int(s, "/machine/soc/pwm", "rpm[0]"), >=, 11900);
+
+    /* Warming up from ambient, towards 25 + 150 / (1.5 + 4) */
+    temp = qom_get_int(s, "/machine/peripheral/cpu-temp", "temperature");
+    g_assert_cmpint(temp, >, 25000);
+    g_assert_cmpint(temp, <, 52300);
+
+    qtest_quit(s);
+    g_unlink(path);
+}
+
+/*
+ * A fan control loop at the scale of a large system: 16 fans, 16 zones,
+ * the plant stepped every millisecond and the duty cycles set from the
+ * tach readings every second of guest time.
+ */
+static void test_perf_closed_loop(void)
+{
+    g_autofree char *path = plant_file(16, 16, NULL);
+    int64_t steps, step_ns;
+    double duration;
+    QTestState *s;
+    int t, ch;
+
+    s = qtest_initf("-machine ast2600-evb "
+                    "-global aspeed.pwm-tach.plant=%s "
+                    "-global aspeed.pwm-tach.plant-period-ms=1", path);
+
+    for (ch = 0; ch < 16; ch++) {
+        pwm_set_duty(s, ch, 0x80);
+        pwm_writel(s, TACH_CTRL(ch), TACH_CTRL_ENABLE |
+                   TACH_CTRL_CLK_DIV_T(5));
+    }
+
+    g_test_timer_start();
+    for (t = 0; t < 600; t++) {
+        for (ch = 0; ch < 16; ch++) {
+            uint32_t sts = pwm_readl(s, TACH_STS(ch));
+            uint32_t rpm = 0;
+
+            if (sts & TACH_STS_FULL_MEASUREMENT) {
+                rpm = TACH_RPM(TACH_STS_VALUE(sts));
+            }
+            /* Hold every fan around 6000 RPM */
+            pwm_set_duty(s, ch, rpm < 6000 ? 0xc0 : 0x40);
+        }
+        qtest_clock_step(s, SEC);
+    }
+    duration = g_test_timer_elapsed();
+
+    steps = qom_get_int(s, "/machine/soc/pwm", "plant-steps");
+    step_ns = qom_get_int(s, "/machine/soc/pwm", "plant-step-ns");
+    g_test_message("600 s of guest time in %f s, %" PRId64 " plant steps, "
+                   "%f ns per step", duration, steps,
+                   (double)step_ns / steps);
+
+    qtest_quit(s);
+    g_unlink(path);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/ast2600/pwm/tach", test_tach);
+    qtest_add_func("/ast2600/pwm/plant", test_plant);
+    qtest_add_func("/ast2600/pwm/example-plant", test_example_plant);
+    if (g_test_perf()) {
+        qtest_add_func("/ast2600/pwm/perf/closed-loop",
+                       test_perf_closed_loop);
+    }
+
+    return g_test_run();
+}
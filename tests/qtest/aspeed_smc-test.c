@@ -25,6 +25,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/bswap.h"
+#include "qemu/units.h"
 #include "libqtest-single.h"
 #include "qemu/bitops.h"
 #include "aspeed-smc-utils.h"
@@ -204,6 +205,68 @@ static void test_ast1030_evb(AspeedSMCTestData *data)
                         data, aspeed_smc_test_write_page_qpi);
 }
 
+/* Segment registers of the AST2600 SPI1 controller, with two CS */
+#define AST2600_SPI1_BASE       0x1E630000
+#define R_SEG_ADDR(cs)          (0x30 + (cs) * 4)
+
+/* Segment register value for [start, start + size) of the flash window */
+static uint32_t ast2600_segment(uint32_t start, uint32_t size)
+{
+    return ((start + size - 1) & 0x0ff00000) | (start >> 16);
+}
+
+static uint64_t flatview_updates_incremental(QTestState *s)
+{
+    g_autofree char *mtree = qtest_hmp(s, "info mtree -f");
+    uint64_t incremental;
+    char *p;
+
+    p = strstr(mtree, "FlatView updates: ");
+    g_assert(p);
+    g_assert(sscanf(p, "FlatView updates: %" SCNu64, &incremental) == 1);
+    return incremental;
+}
+
+/*
+ * Overlapping segments of the flash window, moved, resized and disabled.
+ * Each change only renders the window of the FlatViews it touches, and
+ * with --enable-debug-memory QEMU checks the result against a full
+ * rendering.
+ */
+static void test_ast2600_segments(void)
+{
+    static const struct {
+        int cs;
+        uint32_t start;
+        uint32_t size;
+    } updates[] = {
+        { 0, 0, 32 * MiB },
+        { 1, 16 * MiB, 32 * MiB },      /* over the end of CS0 */
+        { 1, 0, 16 * MiB },             /* inside CS0 */
+        { 0, 0, 8 * MiB },              /* now inside CS1 */
+        { 1, 0, 0 },                    /* disabled */
+        { 1, 64 * MiB, 64 * MiB },
+        { 0, 0, 128 * MiB },            /* over all of CS1 */
+        { 1, 96 * MiB, 32 * MiB },
+    };
+    QTestState *s = qtest_init("-machine ast2600-evb");
+    uint64_t incremental = flatview_updates_incremental(s);
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(updates); i++) {
+        uint32_t v = updates[i].size ?
+            ast2600_segment(updates[i].start, updates[i].size) : 0;
+
+        qtest_writel(s, AST2600_SPI1_BASE + R_SEG_ADDR(updates[i].cs), v);
+        g_assert_cmphex(qtest_readl(s, AST2600_SPI1_BASE +
+                                    R_SEG_ADDR(updates[i].cs)), ==, v);
+        g_assert_cmpuint(flatview_updates_incremental(s), ==,
+                         incremental + i + 1);
+    }
+
+    qtest_quit(s);
+}
+
 int main(int argc, char **argv)
 {
     AspeedSMCTestData palmetto_data;
@@ -218,6 +281,7 @@ int main(int argc, char **argv)
     test_ast2500_evb(&ast2500_evb_data);
     test_ast2600_evb(&ast2600_evb_data);
     test_ast1030_evb(&ast1030_evb_data);
+    qtest_add_func("/ast2600/smc/segments", test_ast2600_segments);
     ret = g_test_run();
 
     qtest_quit(palmetto_data.s);
@@ -0,0 +1,332 @@
+/*
+ * QTest testcase for the upstream port of the ASPEED USB virtual hub
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+
+#include "qemu/bitops.h"
+#include "qemu/bswap.h"
+#include "qapi/qmp/qdict.h"
+#include "libqtest.h"
+
+#define AST2600_VHUB_BASE       0x1E6A0000
+#define AST2600_DRAM_BASE       0x80000000
+
+#define VHUB_CTRL               0x00
+#define  VHUB_CTRL_UPSTREAM_CONNECT     BIT(0)
+#define VHUB_CONF               0x04
+#define VHUB_EP_ACK_ISR         0x18
+#define VHUB_SETUP(dev)         (0x80 + 8 * (dev))
+#define VHUB_DEV(i)             (0x100 + 0x10 * (i))
+#define VHUB_DEV_EN_CTRL        0x00
+#define  VHUB_DEV_EN_ADDR(x)            ((x) << 8)
+#define  VHUB_DEV_EN_IRQ_ALL            (0x1f << 2)
+#define  VHUB_DEV_EN_ENABLE_PORT        BIT(0)
+#define VHUB_DEV_ISR            0x04
+#define  VHUB_DEV_IRQ_EP0_SETUP         BIT(0)
+#define VHUB_EP(i)              (0x200 + 0x10 * (i))
+#define VHUB_EP_CONFIG          0x00
+#define  VHUB_EP_CFG_MAX_PKT(x)         ((x) << 16)
+#define  VHUB_EP_CFG_EP_NUM(x)          ((x) << 8)
+#define  VHUB_EP_CFG_DIR_OUT            BIT(6)
+#define  VHUB_EP_CFG_DEV(x)             ((x) << 1)
+#define  VHUB_EP_CFG_ENABLED            BIT(0)
+#define VHUB_EP_DMA_CTLSTAT     0x04
+#define  VHUB_EP_DMA_DESC_MODE          BIT(0)
+#define VHUB_EP_DESC_BASE       0x08
+#define VHUB_EP_DESC_STATUS     0x0C
+#define  VHUB_EP_DMA_TX_SIZE(x)         ((x) << 16)
+#define  VHUB_EP_DMA_RPTR(x)            (((x) >> 8) & 0xff)
+#define  VHUB_EP_DMA_SINGLE_KICK        BIT(0)
+
+/* See include/hw/usb/aspeed_vhub.h */
+typedef struct QEMU_PACKED VHubMsg {
+    uint8_t type;
+    uint8_t addr;
+    uint8_t ep;
+    uint8_t reserved;
+    uint32_t len;
+} VHubMsg;
+
+#define MSG_SETUP               2
+#define MSG_OUT                 3
+#define MSG_IN                  4
+#define MSG_DATA                5
+#define MSG_ACK                 6
+#define MSG_STALL               7
+#define MSG_CONNECT             8
+
+#define HUB_ADDR                1
+#define DEV_ADDR                2
+
+#define DESC_RING               (AST2600_DRAM_BASE + 0x100000)
+#define IN_BUF                  (AST2600_DRAM_BASE + 0x101000)
+#define OUT_BUF                 (AST2600_DRAM_BASE + 0x102000)
+/* Past the 1 GiB of RAM, in the part of the DRAM window with nothing */
+#define EMPTY_BUF               (AST2600_DRAM_BASE + 0x40000000)
+
+static int host_lfd;
+static int host_fd;
+static int host_port;
+
+static uint32_t vhub_readl(QTestState *s, uint32_t reg)
+{
+    return qtest_readl(s, AST2600_VHUB_BASE + reg);
+}
+
+static void vhub_writel(QTestState *s, uint32_t reg, uint32_t val)
+{
+    qtest_writel(s, AST2600_VHUB_BASE + reg, val);
+}
+
+static void host_send(uint8_t type, uint8_t addr, uint8_t ep,
+                      const uint8_t *data, uint32_t len)
+{
+    VHubMsg msg = {
+        .type = type,
+        .addr = addr,
+        .ep = ep,
+        .len = cpu_to_le32(len),
+    };
+
+    g_assert(write(host_fd, &msg, sizeof(msg)) == sizeof(msg));
+    if (data) {
+        g_assert(write(host_fd, data, len) == len);
+    }
+}
+
+static void host_read(void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    ssize_t n;
+
+    while (len) {
+        n = read(host_fd, p, len);
+        g_assert(n > 0);
+        p += n;
+        len -= n;
+    }
+}
+
+/* Read one message, and its payload if it is DATA */
+static uint32_t host_recv(uint8_t type, uint8_t addr, uint8_t ep,
+                          uint8_t *data)
+{
+    VHubMsg msg;
+    uint32_t len;
+
+    host_read(&msg, sizeof(msg));
+    g_assert_cmpuint(msg.type, ==, type);
+    g_assert_cmpuint(msg.addr, ==, addr);
+    g_assert_cmpuint(msg.ep, ==, ep);
+    len = le32_to_cpu(msg.len);
+    if (type == MSG_DATA) {
+        host_read(data, len);
+    }
+    return len;
+}
+
+static uint64_t vhub_stat(QTestState *s, const char *name)
+{
+    QDict *response;
+    uint64_t ret;
+
+    response = qtest_qmp(s, "{ 'execute': 'qom-get', 'arguments': "
+                         "{ 'path': '/machine/soc/vhub', 'property': %s } }",
+                         name);
+    g_assert(qdict_haskey(response, "return"));
+    ret = qdict_get_int(response, "return");
+    qobject_unref(response);
+    return ret;
+}
+
+/* Start QEMU, connect the host, and let the firmware enable a device */
+static QTestState *vhub_start(void)
+{
+    QTestState *s;
+
+    s = qtest_initf("-machine ast2600-evb -m 1G "
+                    "-chardev socket,id=vhub,host=127.0.0.1,port=%d,"
+                    "reconnect-ms=10000 "
+                    "-global driver=aspeed.vhub-ast2600,property=chardev,"
+                    "value=vhub", host_port);
+    host_fd = accept(host_lfd, NULL, 0);
+    g_assert(host_fd >= 0);
+
+    /* The firmware connects the hub and enables its first device */
+    vhub_writel(s, VHUB_CTRL, VHUB_CTRL_UPSTREAM_CONNECT);
+    g_assert_cmpuint(host_recv(MSG_CONNECT, 0, 0, NULL), ==, 1);
+    vhub_writel(s, VHUB_CONF, HUB_ADDR);
+    vhub_writel(s, VHUB_DEV(0) + VHUB_DEV_EN_CTRL,
+                VHUB_DEV_EN_ADDR(DEV_ADDR) | VHUB_DEV_EN_IRQ_ALL |
+                VHUB_DEV_EN_ENABLE_PORT);
+    return s;
+}
+
+/* Bulk IN endpoint of the device, in descriptor mode */
+static void vhub_setup_in(QTestState *s)
+{
+    vhub_writel(s, VHUB_EP(0) + VHUB_EP_CONFIG,
+                VHUB_EP_CFG_MAX_PKT(512) | VHUB_EP_CFG_EP_NUM(1) |
+                VHUB_EP_CFG_DEV(1) | VHUB_EP_CFG_ENABLED);
+    vhub_writel(s, VHUB_EP(0) + VHUB_EP_DMA_CTLSTAT, VHUB_EP_DMA_DESC_MODE);
+    vhub_writel(s, VHUB_EP(0) + VHUB_EP_DESC_BASE, DESC_RING);
+}
+
+static void test_transfers(const void *data)
+{
+    static const uint8_t set_config[] = { 0x00, 0x09, 0x01, 0x00,
+                                          0x00, 0x00, 0x00, 0x00 };
+    static const uint32_t in_lens[] = { 512, 512, 100 };
+    uint8_t in_data[1124], out_data[100], buf[1124];
+    uint32_t off = 0, len;
+    QTestState *s;
+    int i;
+
+    for (i = 0; i < sizeof(in_data); i++) {
+        in_data[i] = i * 7;
+    }
+    for (i = 0; i < sizeof(out_data); i++) {
+        out_data[i] = ~i;
+    }
+
+    s = vhub_start();
+
+    /* A SETUP lands in the registers of the device */
+    host_send(MSG_SETUP, DEV_ADDR, 0, set_config,
+              sizeof(set_config));
+    host_recv(MSG_ACK, DEV_ADDR, 0, NULL);
+    g_assert_cmphex(vhub_readl(s, VHUB_SETUP(1)), ==, ldl_le_p(set_config));
+    g_assert_cmphex(vhub_readl(s, VHUB_SETUP(1) + 4), ==,
+                    ldl_le_p(set_config + 4));
+    g_assert(vhub_readl(s, VHUB_DEV(0) + VHUB_DEV_ISR) &
+             VHUB_DEV_IRQ_EP0_SETUP);
+
+    /* Bulk IN in descriptor mode, three packets up to a short one */
+    vhub_setup_in(s);
+    qtest_memwrite(s, IN_BUF, in_data, sizeof(in_data));
+    for (i = 0; i < ARRAY_SIZE(in_lens); i++) {
+        qtest_writel(s, DESC_RING + 8 * i, IN_BUF + off);
+        qtest_writel(s, DESC_RING + 8 * i + 4, in_lens[i] | BIT(31));
+        off += in_lens[i];
+    }
+    vhub_writel(s, VHUB_EP(0) + VHUB_EP_DESC_STATUS, ARRAY_SIZE(in_lens));
+
+    host_send(MSG_IN, DEV_ADDR, 1, NULL, 4096);
+    len = host_recv(MSG_DATA, DEV_ADDR, 1, buf);
+    g_assert_cmpuint(len, ==, sizeof(in_data));
+    g_assert(!memcmp(buf, in_data, len));
+    g_assert_cmpuint(VHUB_EP_DMA_RPTR(vhub_readl(s, VHUB_EP(0) +
+                                                 VHUB_EP_DESC_STATUS)),
+                     ==, ARRAY_SIZE(in_lens));
+    g_assert(vhub_readl(s, VHUB_EP_ACK_ISR) & BIT(0));
+
+    /* Single stage OUT, only taken once the firmware armed a buffer */
+    vhub_writel(s, VHUB_EP(1) + VHUB_EP_CONFIG,
+                VHUB_EP_CFG_MAX_PKT(512) | VHUB_EP_CFG_EP_NUM(2) |
+                VHUB_EP_CFG_DIR_OUT | VHUB_EP_CFG_DEV(1) |
+                VHUB_EP_CFG_ENABLED);
+    vhub_writel(s, VHUB_EP(1) + VHUB_EP_DESC_BASE, OUT_BUF);
+    host_send(MSG_OUT, DEV_ADDR, 2, out_data, sizeof(out_data));
+    vhub_writel(s, VHUB_EP(1) + VHUB_EP_DESC_STATUS,
+                VHUB_EP_DMA_TX_SIZE(512) | VHUB_EP_DMA_SINGLE_KICK);
+    host_recv(MSG_ACK, DEV_ADDR, 2, NULL);
+    g_assert_cmphex(vhub_readl(s, VHUB_EP(1) + VHUB_EP_DESC_STATUS), ==,
+                    VHUB_EP_DMA_TX_SIZE(sizeof(out_data)));
+    qtest_memread(s, OUT_BUF, buf, sizeof(out_data));
+    g_assert(!memcmp(buf, out_data, sizeof(out_data)));
+    g_assert(vhub_readl(s, VHUB_EP_ACK_ISR) & BIT(1));
+
+    /* Nobody has this address */
+    host_send(MSG_IN, 9, 1, NULL, 64);
+    host_recv(MSG_STALL, 9, 1, NULL);
+
+    g_assert_cmpuint(vhub_stat(s, "setups"), ==, 1);
+    g_assert_cmpuint(vhub_stat(s, "stalls"), ==, 1);
+    g_assert_cmpuint(vhub_stat(s, "in-transfers"), ==, 1);
+    g_assert_cmpuint(vhub_stat(s, "in-bytes"), ==, sizeof(in_data));
+    g_assert_cmpuint(vhub_stat(s, "out-transfers"), ==, 1);
+    g_assert_cmpuint(vhub_stat(s, "out-bytes"), ==, sizeof(out_data));
+    g_assert_cmpuint(vhub_stat(s, "max-in-batch"), ==, ARRAY_SIZE(in_lens));
+
+    close(host_fd);
+    qtest_quit(s);
+}
+
+/*
+ * RAM is mapped straight to the chardev.  A packet in the DRAM window
+ * past the end of RAM has an MMIO region behind it, so the address
+ * space of the hub hands out a bounce buffer, and counts it.
+ */
+static void test_bounce(const void *data)
+{
+    uint8_t buf[100], zero[100] = {};
+    g_autofree char *mtree = NULL;
+    QTestState *s;
+    char *p;
+
+    s = vhub_start();
+    vhub_setup_in(s);
+    qtest_writel(s, DESC_RING, EMPTY_BUF);
+    qtest_writel(s, DESC_RING + 4, sizeof(buf) | BIT(31));
+    vhub_writel(s, VHUB_EP(0) + VHUB_EP_DESC_STATUS, 1);
+
+    host_send(MSG_IN, DEV_ADDR, 1, NULL, 4096);
+    g_assert_cmpuint(host_recv(MSG_DATA, DEV_ADDR, 1, buf), ==, sizeof(buf));
+    g_assert(!memcmp(buf, zero, sizeof(buf)));
+
+    /* Only the hub maps memory, so its counters are the only ones shown */
+    mtree = qtest_hmp(s, "info mtree");
+    p = strstr(mtree, "  dma-map: ");
+    g_assert(p);
+    g_assert(g_str_has_prefix(p, "  dma-map: 1 bounced (100 bytes, "
+                              "peak 100/4096), 0 shortened, 0 refused\n"));
+    g_assert(!strstr(p + 1, "  dma-map: "));
+
+    close(host_fd);
+    qtest_quit(s);
+}
+
+/*
+ * Create a local TCP socket with any port, then save off the port we got.
+ */
+static void open_socket(void)
+{
+    struct sockaddr_in myaddr = {};
+    socklen_t addrlen;
+
+    myaddr.sin_family = AF_INET;
+    myaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    myaddr.sin_port = 0;
+    host_lfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    g_assert(host_lfd != -1);
+    g_assert(bind(host_lfd, (struct sockaddr *) &myaddr,
+                  sizeof(myaddr)) != -1);
+    addrlen = sizeof(myaddr);
+    g_assert(getsockname(host_lfd, (struct sockaddr *) &myaddr,
+                         &addrlen) != -1);
+    host_port = ntohs(myaddr.sin_port);
+    g_assert(listen(host_lfd, 1) != -1);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    open_socket();
+
+    qtest_add_data_func("/ast2600/vhub/transfers", NULL, test_transfers);
+    qtest_add_data_func("/ast2600/vhub/bounce", NULL, test_bounce);
+    ret = g_test_run();
+
+    close(host_lfd);
+    return ret;
+}
@@ -0,0 +1,168 @@
+/*
+ * QTest testcase for the ASPEED Video Engine
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qapi/qmp/qdict.h"
+#include "libqtest.h"
+
+#define AST2600_VIDEO_BASE      0x1E700000
+#define AST2600_DRAM_BASE       0x80000000
+
+#define VE_PROTECTION_KEY       0x000
+#define  VE_PROTECTION_KEY_UNLOCK 0x1a038aa8
+#define VE_SEQ_CTRL             0x004
+#define  VE_SEQ_CTRL_TRIG_MODE_DET BIT(0)
+#define  VE_SEQ_CTRL_TRIG_CAPTURE BIT(1)
+#define  VE_SEQ_CTRL_TRIG_COMP  BIT(4)
+#define  VE_SEQ_CTRL_YUV420     BIT(10)
+#define  VE_SEQ_CTRL_JPEG_MODE  BIT(13)
+#define  VE_SEQ_CTRL_CAP_BUSY   BIT(16)
+#define  VE_SEQ_CTRL_COMP_BUSY  BIT(18)
+#define VE_COMP_WINDOW          0x034
+#define VE_COMP_ADDR            0x054
+#define VE_COMP_CTRL            0x060
+#define VE_COMP_SIZE_READ_BACK  0x084
+#define VE_SRC_LR_EDGE_DET      0x090
+#define VE_SRC_TB_EDGE_DET      0x094
+#define VE_INTERRUPT_CTRL       0x304
+#define VE_INTERRUPT_STATUS     0x308
+#define  VE_INTERRUPT_COMP_COMPLETE BIT(3)
+#define  VE_INTERRUPT_MODE_DETECT BIT(4)
+
+#define WIDTH                   64
+#define HEIGHT                  48
+#define FRAME_ADDR              (AST2600_DRAM_BASE + 0x100000)
+
+static void video_writel(QTestState *s, uint32_t reg, uint32_t val)
+{
+    qtest_writel(s, AST2600_VIDEO_BASE + reg, val);
+}
+
+static uint32_t video_readl(QTestState *s, uint32_t reg)
+{
+    return qtest_readl(s, AST2600_VIDEO_BASE + reg);
+}
+
+static uint64_t video_stat(QTestState *s, const char *name)
+{
+    QDict *response;
+    uint64_t ret;
+
+    response = qtest_qmp(s, "{ 'execute': 'qom-get', 'arguments': "
+                         "{ 'path': '/machine/soc/video', 'property': %s } }",
+                         name);
+    g_assert(qdict_haskey(response, "return"));
+    ret = qdict_get_int(response, "return");
+    qobject_unref(response);
+    return ret;
+}
+
+static uint32_t video_capture(QTestState *s)
+{
+    uint32_t seq = VE_SEQ_CTRL_JPEG_MODE | VE_SEQ_CTRL_YUV420;
+    int i;
+
+    video_writel(s, VE_SEQ_CTRL, seq);
+    video_writel(s, VE_SEQ_CTRL, seq | VE_SEQ_CTRL_TRIG_CAPTURE |
+                 VE_SEQ_CTRL_TRIG_COMP);
+
+    /* The frame is compressed from a bottom half */
+    for (i = 0; i < 1000; i++) {
+        if (video_readl(s, VE_INTERRUPT_STATUS) & VE_INTERRUPT_COMP_COMPLETE) {
+            break;
+        }
+        g_usleep(1000);
+    }
+    g_assert_cmphex(video_readl(s, VE_INTERRUPT_STATUS) &
+                    VE_INTERRUPT_COMP_COMPLETE, ==, VE_INTERRUPT_COMP_COMPLETE);
+    g_assert_cmphex(video_readl(s, VE_SEQ_CTRL) &
+                    (VE_SEQ_CTRL_CAP_BUSY | VE_SEQ_CTRL_COMP_BUSY), ==, 0);
+    video_writel(s, VE_INTERRUPT_STATUS, VE_INTERRUPT_COMP_COMPLETE);
+
+    return video_readl(s, VE_COMP_SIZE_READ_BACK);
+}
+
+static void test_video(const void *data)
+{
+    const char *source = data;
+    g_autofree char *args = NULL;
+    QTestState *s;
+    uint32_t size;
+    uint8_t marker[2];
+
+    args = g_strdup_printf("-machine ast2600-evb "
+        "-global driver=aspeed.video-ast2600,property=source,value=%s "
+        "-global driver=aspeed.video-ast2600,property=source-width,value=%d "
+        "-global driver=aspeed.video-ast2600,property=source-height,value=%d",
+        source, WIDTH, HEIGHT);
+    s = qtest_init(args);
+
+    video_writel(s, VE_PROTECTION_KEY, VE_PROTECTION_KEY_UNLOCK);
+    video_writel(s, VE_INTERRUPT_CTRL, VE_INTERRUPT_COMP_COMPLETE |
+                 VE_INTERRUPT_MODE_DETECT);
+
+    /* Mode detection reports the size of the source */
+    video_writel(s, VE_SEQ_CTRL, VE_SEQ_CTRL_TRIG_MODE_DET);
+    g_assert_cmphex(video_readl(s, VE_INTERRUPT_STATUS) &
+                    VE_INTERRUPT_MODE_DETECT, ==, VE_INTERRUPT_MODE_DETECT);
+    g_assert_cmphex(video_readl(s, VE_SRC_LR_EDGE_DET), ==, (WIDTH - 1) << 16);
+    g_assert_cmphex(video_readl(s, VE_SRC_TB_EDGE_DET), ==, (HEIGHT - 1) << 16);
+    video_writel(s, VE_INTERRUPT_STATUS, VE_INTERRUPT_MODE_DETECT);
+
+    video_writel(s, VE_COMP_WINDOW, WIDTH << 16 | HEIGHT);
+    video_writel(s, VE_COMP_ADDR, FRAME_ADDR);
+    video_writel(s, VE_COMP_CTRL, 4 << 11 | 4 << 6);
+
+    /* A complete JPEG lands at the compression address */
+    size = video_capture(s);
+    g_assert_cmpuint(size, >, 600);
+    qtest_memread(s, FRAME_ADDR, marker, sizeof(marker));
+    g_assert_cmphex(marker[0], ==, 0xff);
+    g_assert_cmphex(marker[1], ==, 0xd8);
+    qtest_memread(s, FRAME_ADDR + size - 2, marker, sizeof(marker));
+    g_assert_cmphex(marker[0], ==, 0xff);
+    g_assert_cmphex(marker[1], ==, 0xd9);
+
+    /* 4:2:0 uses 16x16 blocks, which all changed in the first frame */
+    g_assert_cmpuint(video_stat(s, "frames"), ==, 1);
+    g_assert_cmpuint(video_stat(s, "blocks"), ==, 12);
+    g_assert_cmpuint(video_stat(s, "changed-blocks"), ==, 12);
+
+    /* The source did not change, so neither does the frame */
+    g_assert_cmpuint(video_capture(s), ==, size);
+    g_assert_cmpuint(video_stat(s, "frames"), ==, 2);
+    g_assert_cmpuint(video_stat(s, "blocks"), ==, 24);
+    g_assert_cmpuint(video_stat(s, "changed-blocks"), ==, 12);
+    g_assert_cmpuint(video_stat(s, "compressed-bytes"), ==, 2 * size);
+
+    qtest_quit(s);
+}
+
+int main(int argc, char **argv)
+{
+    g_autofree uint32_t *pixels = g_new(uint32_t, WIDTH * HEIGHT);
+    g_autofree char *source = NULL;
+    int fd, x, y, ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    fd = g_file_open_tmp("aspeed-video-XXXXXX", &source, NULL);
+    g_assert(fd >= 0);
+    for (y = 0; y < HEIGHT; y++) {
+        for (x = 0; x < WIDTH; x++) {
+            pixels[y * WIDTH + x] = (x * 4) << 16 | (y * 5) << 8 | (x ^ y);
+        }
+    }
+    g_assert(write(fd, pixels, WIDTH * HEIGHT * 4) == WIDTH * HEIGHT * 4);
+    close(fd);
+
+    qtest_add_data_func("/ast2600/video/compress", source, test_video);
+    ret = g_test_run();
+
+    unlink(source);
+    return ret;
+}
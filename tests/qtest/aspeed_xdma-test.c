@@ -0,0 +1,135 @@
+/*
+ * QTest testcase for the ASPEED XDMA Controller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qapi/qmp/qdict.h"
+#include "libqtest.h"
+
+#define AST2600_XDMA_BASE       0x1E6E7000
+#define AST2600_DRAM_BASE       0x80000000
+
+#define XDMA_BMC_CMDQ_ADDR      0x14
+#define XDMA_BMC_CMDQ_ENDP      0x18
+#define XDMA_BMC_CMDQ_WRP       0x1c
+#define XDMA_BMC_CMDQ_RDP       0x20
+#define  XDMA_BMC_CMDQ_RDP_MAGIC 0xEE882266
+#define XDMA_IRQ_CTRL           0x38
+#define XDMA_IRQ_STATUS         0x3c
+#define  XDMA_IRQ_US_COMP       BIT(16)
+#define  XDMA_IRQ_DS_COMP       BIT(17)
+
+#define XDMA_CMD_UPSTREAM       BIT_ULL(32)
+#define XDMA_CMD_IRQ_BMC        BIT_ULL(37)
+
+/* Pointers count 16 byte units, a command takes two */
+#define XDMA_CMD_UNITS          2
+#define XDMA_NUM_CMDS           8
+
+#define CMDQ_ADDR               (AST2600_DRAM_BASE + 0x100000)
+#define SRC_ADDR                (AST2600_DRAM_BASE + 0x200000)
+#define DST_ADDR                (AST2600_DRAM_BASE + 0x300000)
+#define HOST_ADDR               0x10000
+#define LEN                     0x1000
+
+static void xdma_writel(QTestState *s, uint32_t reg, uint32_t val)
+{
+    qtest_writel(s, AST2600_XDMA_BASE + reg, val);
+}
+
+static uint32_t xdma_readl(QTestState *s, uint32_t reg)
+{
+    return qtest_readl(s, AST2600_XDMA_BASE + reg);
+}
+
+static uint64_t xdma_stat(QTestState *s, const char *name)
+{
+    QDict *response;
+    uint64_t ret;
+
+    response = qtest_qmp(s, "{ 'execute': 'qom-get', 'arguments': "
+                         "{ 'path': '/machine/soc/xdma', 'property': %s } }",
+                         name);
+    g_assert(qdict_haskey(response, "return"));
+    ret = qdict_get_int(response, "return");
+    qobject_unref(response);
+    return ret;
+}
+
+static void xdma_put_cmd(QTestState *s, int idx, bool upstream,
+                         uint32_t bmc_addr)
+{
+    uint64_t base = CMDQ_ADDR + idx * 32;
+
+    qtest_writeq(s, base, HOST_ADDR);
+    qtest_writeq(s, base + 8, bmc_addr & 0x7FFFFFFF);
+    qtest_writeq(s, base + 16, XDMA_CMD_IRQ_BMC | 1 << 16 | LEN |
+                 (upstream ? XDMA_CMD_UPSTREAM : 0));
+    qtest_writeq(s, base + 24, 0);
+}
+
+static void test_round_trip(const void *data)
+{
+    g_autofree uint8_t *src = g_malloc(LEN);
+    g_autofree uint8_t *dst = g_malloc0(LEN);
+    QTestState *s;
+    int i;
+
+    s = qtest_init("-machine ast2600-evb "
+                   "-object memory-backend-ram,id=host,size=1M "
+                   "-global driver=aspeed.xdma-ast2600,property=host-memdev,"
+                   "value=host");
+
+    for (i = 0; i < LEN; i++) {
+        src[i] = i * 7;
+    }
+    qtest_memwrite(s, SRC_ADDR, src, LEN);
+    qtest_memwrite(s, DST_ADDR, dst, LEN);
+
+    xdma_writel(s, XDMA_BMC_CMDQ_ADDR, CMDQ_ADDR);
+    xdma_writel(s, XDMA_BMC_CMDQ_ENDP, XDMA_NUM_CMDS * XDMA_CMD_UNITS);
+    xdma_writel(s, XDMA_BMC_CMDQ_RDP, XDMA_BMC_CMDQ_RDP_MAGIC);
+    xdma_writel(s, XDMA_BMC_CMDQ_WRP, 0);
+    xdma_writel(s, XDMA_IRQ_CTRL, XDMA_IRQ_US_COMP | XDMA_IRQ_DS_COMP);
+    g_assert_cmphex(xdma_readl(s, XDMA_IRQ_STATUS) &
+                    (XDMA_IRQ_US_COMP | XDMA_IRQ_DS_COMP), ==, 0);
+
+    /* BMC to host then host back to BMC, in a single batch */
+    xdma_put_cmd(s, 0, true, SRC_ADDR);
+    xdma_put_cmd(s, 1, false, DST_ADDR);
+    xdma_writel(s, XDMA_BMC_CMDQ_WRP, 2 * XDMA_CMD_UNITS);
+
+    g_assert_cmphex(xdma_readl(s, XDMA_BMC_CMDQ_RDP), ==, 2 * XDMA_CMD_UNITS);
+    g_assert_cmphex(xdma_readl(s, XDMA_IRQ_STATUS) &
+                    (XDMA_IRQ_US_COMP | XDMA_IRQ_DS_COMP), ==,
+                    XDMA_IRQ_US_COMP | XDMA_IRQ_DS_COMP);
+    qtest_memread(s, DST_ADDR, dst, LEN);
+    g_assert(!memcmp(src, dst, LEN));
+
+    g_assert_cmpuint(xdma_stat(s, "transfers"), ==, 2);
+    g_assert_cmpuint(xdma_stat(s, "upstream-bytes"), ==, LEN);
+    g_assert_cmpuint(xdma_stat(s, "downstream-bytes"), ==, LEN);
+
+    /* The queue wraps at the end pointer */
+    for (i = 2; i < XDMA_NUM_CMDS; i++) {
+        xdma_put_cmd(s, i, true, SRC_ADDR);
+    }
+    xdma_put_cmd(s, 0, true, SRC_ADDR);
+    xdma_writel(s, XDMA_BMC_CMDQ_WRP, XDMA_CMD_UNITS);
+    g_assert_cmphex(xdma_readl(s, XDMA_BMC_CMDQ_RDP), ==, XDMA_CMD_UNITS);
+    g_assert_cmpuint(xdma_stat(s, "transfers"), ==, XDMA_NUM_CMDS + 1);
+
+    qtest_quit(s);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_data_func("/ast2600/xdma/round_trip", NULL, test_round_trip);
+
+    return g_test_run();
+}
@@ -0,0 +1,140 @@
+/*
+ * QTest testcase for the execution domains of the fby35 machine
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+
+#define BMC_CLUSTER     "/machine/bmc-cluster"
+#define BIC_CLUSTER     "/machine/bic-cluster"
+
+static int64_t cluster_id(QTestState *s, const char *path)
+{
+    QDict *rsp;
+    int64_t id;
+
+    rsp = qtest_qmp(s, "{ 'execute': 'qom-get', 'arguments': "
+                    "{ 'path': %s, 'property': 'cluster-id' } }", path);
+    id = qdict_get_int(rsp, "return");
+    qobject_unref(rsp);
+    return id;
+}
+
+/*
+ * Call @fn for each vCPU with the cluster it belongs to and its host
+ * thread, checking that the BMC has two vCPUs and the BIC one.
+ */
+static void foreach_vcpu(QTestState *s,
+                         void (*fn)(const char *cluster, int64_t tid,
+                                    void *opaque),
+                         void *opaque)
+{
+    QDict *rsp = qtest_qmp(s, "{ 'execute': 'query-cpus-fast' }");
+    QListEntry *e;
+    int bmc = 0, bic = 0;
+
+    QLIST_FOREACH_ENTRY(qdict_get_qlist(rsp, "return"), e) {
+        QDict *cpu = qobject_to(QDict, qlist_entry_obj(e));
+        const char *path = qdict_get_str(cpu, "qom-path");
+
+        if (g_str_has_prefix(path, BMC_CLUSTER "/")) {
+            fn(BMC_CLUSTER, qdict_get_int(cpu, "thread-id"), opaque);
+            bmc++;
+        } else {
+            g_assert(g_str_has_prefix(path, BIC_CLUSTER "/"));
+            fn(BIC_CLUSTER, qdict_get_int(cpu, "thread-id"), opaque);
+            bic++;
+        }
+    }
+    qobject_unref(rsp);
+
+    g_assert_cmpint(bmc, ==, 2);
+    g_assert_cmpint(bic, ==, 1);
+}
+
+static void check_nothing(const char *cluster, int64_t tid, void *opaque)
+{
+}
+
+/* Each SoC has its own cluster, holding its vCPUs */
+static void test_domains(void)
+{
+    QTestState *s = qtest_init("-machine fby35");
+
+    g_assert_cmpint(cluster_id(s, BMC_CLUSTER), ==, 0);
+    g_assert_cmpint(cluster_id(s, BIC_CLUSTER), ==, 1);
+    foreach_vcpu(s, check_nothing, NULL);
+
+    qtest_quit(s);
+}
+
+#ifdef CONFIG_LINUX
+typedef struct HostCpus {
+    int bmc[2];
+    int bic;
+} HostCpus;
+
+static void check_affinity(const char *cluster, int64_t tid, void *opaque)
+{
+    HostCpus *host = opaque;
+    cpu_set_t set;
+
+    g_assert(sched_getaffinity(tid, sizeof(set), &set) == 0);
+    if (!strcmp(cluster, BMC_CLUSTER)) {
+        g_assert(CPU_ISSET(host->bmc[0], &set));
+        g_assert(CPU_ISSET(host->bmc[1], &set));
+        g_assert_cmpint(CPU_COUNT(&set), ==,
+                        host->bmc[0] == host->bmc[1] ? 1 : 2);
+    } else {
+        g_assert(CPU_ISSET(host->bic, &set));
+        g_assert_cmpint(CPU_COUNT(&set), ==, 1);
+    }
+}
+
+/* The vCPU threads of each domain run on the host CPUs given for it */
+static void test_host_cpus(void)
+{
+    HostCpus host = { { -1, -1 }, -1 };
+    QTestState *s;
+    cpu_set_t set;
+    int i;
+
+    /* Only CPUs the test may run on, up to two of them */
+    g_assert(sched_getaffinity(0, sizeof(set), &set) == 0);
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (!CPU_ISSET(i, &set)) {
+            continue;
+        }
+        if (host.bmc[0] < 0) {
+            host.bmc[0] = host.bmc[1] = host.bic = i;
+        } else {
+            host.bmc[1] = host.bic = i;
+            break;
+        }
+    }
+    g_assert(host.bmc[0] >= 0);
+
+    /* A range and a doubled comma, as taskset(1) lists on the command line */
+    s = qtest_initf("-machine fby35,bmc-host-cpus=%d-%d,,%d,bic-host-cpus=%d",
+                    host.bmc[0], host.bmc[0], host.bmc[1], host.bic);
+    foreach_vcpu(s, check_affinity, &host);
+
+    qtest_quit(s);
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/fby35/domains", test_domains);
+#ifdef CONFIG_LINUX
+    qtest_add_func("/fby35/host-cpus", test_host_cpus);
+#endif
+
+    return g_test_run();
+}
@@ -0,0 +1,357 @@
+/*
+ * QTest testcase for the I2C bridge between two QEMU processes
+ *
+ * Two ast2600-evb instances share a memfd.  Each one has a bridge and a
+ * TMP105 on its bus 2, the bridge standing for the TMP105 of the other
+ * side, and the tests master the bus through the old register mode of
+ * the I2C controller.  Commands held by the bridge are polled for.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/memfd.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qdict.h"
+#include "hw/i2c/aspeed_i2c.h"
+#include "qtest_aspeed.h"
+
+#define LINK_SIZE       (64 * KiB)
+#define I2C_BUS         2
+
+/* Address of the TMP105 of each side, and of the bridge on the other */
+#define TMP105_ADDR(port)       (0x48 + (port))
+#define BRIDGE_ADDR(port)       TMP105_ADDR(!(port))
+
+#define TMP105_REG_T_LOW        2
+
+/* Long enough for the other process to run what it was sent */
+#define RETRIES                 5000
+
+#define I2C_DONE_MASK   (TX_ACK_MASK | TX_NAK_MASK | RX_DONE_MASK | \
+                         NORMAL_STOP_MASK | ABNORMAL_MASK | ARBIT_LOSS_MASK)
+
+typedef struct BridgeTest {
+    int fd;
+    QTestState *s[2];
+} BridgeTest;
+
+static uint32_t i2c_base(void)
+{
+    return ast2600_i2c_calc_bus_addr(I2C_BUS);
+}
+
+static void i2c_cmd_post(QTestState *s, uint32_t cmd)
+{
+    qtest_writel(s, i2c_base() + A_I2CD_INTR_STS, 0x7fff);
+    qtest_writel(s, i2c_base() + A_I2CD_CMD, cmd);
+}
+
+/* The status of a command, once the bridge no longer holds it */
+static uint32_t i2c_wait(QTestState *s)
+{
+    uint32_t sts;
+    int i;
+
+    for (i = 0; i < RETRIES; i++) {
+        sts = qtest_readl(s, i2c_base() + A_I2CD_INTR_STS);
+        if (sts & I2C_DONE_MASK) {
+            return sts;
+        }
+        g_usleep(1000);
+    }
+    g_assert_not_reached();
+}
+
+static uint32_t i2c_cmd(QTestState *s, uint32_t cmd)
+{
+    i2c_cmd_post(s, cmd);
+    return i2c_wait(s);
+}
+
+static void i2c_start_post(QTestState *s, uint8_t addr, bool recv)
+{
+    qtest_writel(s, i2c_base() + A_I2CD_BYTE_BUF, addr << 1 | recv);
+    i2c_cmd_post(s, A_I2CD_M_START_CMD);
+}
+
+/* Retried while the bridge masters the bus for the other side */
+static bool i2c_start(QTestState *s, uint8_t addr, bool recv)
+{
+    uint32_t sts;
+    int i;
+
+    for (i = 0; i < RETRIES; i++) {
+        i2c_start_post(s, addr, recv);
+        sts = i2c_wait(s);
+        if (!(sts & ARBIT_LOSS_MASK)) {
+            return sts & TX_ACK_MASK;
+        }
+        g_usleep(1000);
+    }
+    g_assert_not_reached();
+}
+
+static bool i2c_tx(QTestState *s, uint8_t data)
+{
+    qtest_writel(s, i2c_base() + A_I2CD_BYTE_BUF, data);
+    return i2c_cmd(s, A_I2CD_M_TX_CMD) & TX_ACK_MASK;
+}
+
+static uint8_t i2c_rx(QTestState *s, bool last)
+{
+    uint32_t cmd = A_I2CD_M_RX_CMD | (last ? M_S_RX_CMD_LAST_MASK : 0);
+
+    g_assert(i2c_cmd(s, cmd) & RX_DONE_MASK);
+    return qtest_readl(s, i2c_base() + A_I2CD_BYTE_BUF) >> 8;
+}
+
+static void i2c_stop(QTestState *s)
+{
+    g_assert(i2c_cmd(s, A_I2CD_M_STOP_CMD) & NORMAL_STOP_MASK);
+}
+
+/* Write a TMP105 limit, the address was acked */
+static void tmp105_write_limit(QTestState *s, uint16_t v)
+{
+    g_assert(i2c_tx(s, TMP105_REG_T_LOW));
+    g_assert(i2c_tx(s, v >> 8));
+    g_assert(i2c_tx(s, v & 0xff));
+    i2c_stop(s);
+}
+
+static void tmp105_write(QTestState *s, uint8_t addr, uint16_t v)
+{
+    g_assert(i2c_start(s, addr, false));
+    tmp105_write_limit(s, v);
+}
+
+/* Read a TMP105 limit, false when the START is NACKed */
+static bool tmp105_try_read(QTestState *s, uint8_t addr, uint16_t *v)
+{
+    if (!i2c_start(s, addr, false)) {
+        i2c_stop(s);
+        return false;
+    }
+    g_assert(i2c_tx(s, TMP105_REG_T_LOW));
+    g_assert(i2c_start(s, addr, true));
+    *v = i2c_rx(s, false) << 8;
+    *v |= i2c_rx(s, true);
+    i2c_stop(s);
+    return true;
+}
+
+static uint16_t tmp105_read(QTestState *s, uint8_t addr)
+{
+    uint16_t v;
+
+    g_assert(tmp105_try_read(s, addr, &v));
+    return v;
+}
+
+static uint64_t bridge_stat(QTestState *s, const char *name)
+{
+    QDict *rsp;
+    uint64_t v;
+
+    rsp = qtest_qmp(s, "{ 'execute': 'qom-get', 'arguments': "
+                    "{ 'path': '/machine/peripheral/bridge', "
+                    "'property': %s } }", name);
+    g_assert(qdict_haskey(rsp, "return"));
+    if (!strcmp(name, "connected")) {
+        v = qdict_get_bool(rsp, "return");
+    } else {
+        v = qdict_get_int(rsp, "return");
+    }
+    qobject_unref(rsp);
+    return v;
+}
+
+static void bridge_wait_connected(QTestState *s)
+{
+    int i;
+
+    for (i = 0; i < RETRIES && !bridge_stat(s, "connected"); i++) {
+        g_usleep(1000);
+    }
+    g_assert(bridge_stat(s, "connected"));
+}
+
+/* Each side, with or without its TMP105 */
+static QTestState *bridge_start(BridgeTest *t, int port, bool tmp105)
+{
+    g_autofree char *dev = NULL;
+    QTestState *s;
+
+    if (tmp105) {
+        dev = g_strdup_printf("-device tmp105,bus=aspeed.i2c.bus.%d,"
+                              "address=0x%x", I2C_BUS, TMP105_ADDR(port));
+    }
+    s = qtest_initf("-machine ast2600-evb "
+                    "-object memory-backend-file,id=link,size=%u,share=on,"
+                    "mem-path=/proc/self/fd/%d "
+                    "-device i2c-bridge,id=bridge,bus=aspeed.i2c.bus.%d,"
+                    "address=0x%x,memdev=link,port=%d %s",
+                    (unsigned)LINK_SIZE, t->fd, I2C_BUS, BRIDGE_ADDR(port),
+                    port, dev ? dev : "");
+
+    qtest_writel(s, i2c_base() + A_I2CC_FUN_CTRL, A_I2CD_MASTER_EN);
+    qtest_writel(s, i2c_base() + A_I2CD_INTR_CTRL, 0x7fff);
+    return s;
+}
+
+static void bridge_open(BridgeTest *t)
+{
+    /* Inherited by QEMU, which opens it again through /proc */
+    t->fd = qemu_memfd_create("i2c-bridge-test", LINK_SIZE, false, 0, 0,
+                              &error_abort);
+    g_assert(fcntl(t->fd, F_SETFD, 0) == 0);
+}
+
+static void bridge_init(BridgeTest *t)
+{
+    bridge_open(t);
+    t->s[0] = bridge_start(t, 0, true);
+    t->s[1] = bridge_start(t, 1, true);
+    bridge_wait_connected(t->s[0]);
+    bridge_wait_connected(t->s[1]);
+}
+
+static void bridge_cleanup(BridgeTest *t)
+{
+    qtest_quit(t->s[0]);
+    qtest_quit(t->s[1]);
+    close(t->fd);
+}
+
+/* Transfers are NACKed until the other side is up */
+static void test_handshake(void)
+{
+    BridgeTest t;
+    uint16_t v;
+
+    bridge_open(&t);
+    t.s[0] = bridge_start(&t, 0, true);
+    g_assert(!bridge_stat(t.s[0], "connected"));
+    g_assert(!i2c_start(t.s[0], BRIDGE_ADDR(0), false));
+    i2c_stop(t.s[0]);
+    g_assert(!tmp105_try_read(t.s[0], BRIDGE_ADDR(0), &v));
+    g_assert_cmpuint(bridge_stat(t.s[0], "nacks"), ==, 2);
+
+    t.s[1] = bridge_start(&t, 1, true);
+    bridge_wait_connected(t.s[0]);
+    bridge_wait_connected(t.s[1]);
+
+    /* A new instance of a side is a new handshake */
+    qtest_quit(t.s[1]);
+    t.s[1] = bridge_start(&t, 1, true);
+    bridge_wait_connected(t.s[0]);
+    bridge_wait_connected(t.s[1]);
+    g_assert_cmphex(tmp105_read(t.s[0], BRIDGE_ADDR(0)), ==, 0x4b00);
+
+    bridge_cleanup(&t);
+}
+
+/* The master is held until each operation has run on the other side */
+static void test_write_read(void)
+{
+    BridgeTest t;
+
+    bridge_init(&t);
+
+    tmp105_write(t.s[0], BRIDGE_ADDR(0), 0x1a00);
+    g_assert_cmphex(tmp105_read(t.s[1], TMP105_ADDR(1)), ==, 0x1a00);
+    g_assert_cmphex(tmp105_read(t.s[0], BRIDGE_ADDR(0)), ==, 0x1a00);
+
+    g_assert_cmpuint(bridge_stat(t.s[0], "transfers"), ==, 3);
+    g_assert_cmpuint(bridge_stat(t.s[0], "tx-bytes"), ==, 4);
+    g_assert_cmpuint(bridge_stat(t.s[0], "rx-bytes"), ==, 2);
+    g_assert_cmpuint(bridge_stat(t.s[0], "nacks"), ==, 0);
+    g_assert_cmpuint(bridge_stat(t.s[1], "remote-transfers"), ==, 3);
+    g_assert_cmpuint(bridge_stat(t.s[1], "remote-nacks"), ==, 0);
+
+    bridge_cleanup(&t);
+}
+
+/* A device missing on the other side NACKs its address */
+static void test_remote_nack(void)
+{
+    BridgeTest t;
+
+    bridge_open(&t);
+    t.s[0] = bridge_start(&t, 0, true);
+    t.s[1] = bridge_start(&t, 1, false);
+    bridge_wait_connected(t.s[0]);
+    bridge_wait_connected(t.s[1]);
+
+    g_assert(!i2c_start(t.s[0], BRIDGE_ADDR(0), false));
+    i2c_stop(t.s[0]);
+
+    g_assert_cmpuint(bridge_stat(t.s[0], "nacks"), ==, 1);
+    g_assert_cmpuint(bridge_stat(t.s[0], "timeouts"), ==, 0);
+    g_assert_cmpuint(bridge_stat(t.s[1], "remote-nacks"), ==, 1);
+
+    /* The STOP gave the bus of the other side back */
+    g_assert_cmphex(tmp105_read(t.s[1], BRIDGE_ADDR(1)), ==, 0x4b00);
+
+    bridge_cleanup(&t);
+}
+
+/*
+ * Both masters address each other at the same time.  Depending on how
+ * the two processes run, one of them finds its bus taken by the bridge
+ * or both hold their bus for the other one, in which case port 1 backs
+ * off.  Either way exactly one of them goes through.
+ */
+static void test_collision(void)
+{
+    BridgeTest t;
+    int i;
+
+    bridge_init(&t);
+
+    for (i = 0; i < 16; i++) {
+        uint16_t v = (0x10 + i) << 8;
+        uint32_t sts[2];
+        int winner;
+
+        i2c_start_post(t.s[0], BRIDGE_ADDR(0), false);
+        i2c_start_post(t.s[1], BRIDGE_ADDR(1), false);
+
+        /* Port 0 may be waiting for the bus of port 1 to be free */
+        sts[1] = i2c_wait(t.s[1]);
+        if (sts[1] & TX_NAK_MASK) {
+            i2c_stop(t.s[1]);
+        }
+        sts[0] = i2c_wait(t.s[0]);
+        if (sts[0] & TX_NAK_MASK) {
+            i2c_stop(t.s[0]);
+        }
+
+        g_assert(!(sts[0] & TX_ACK_MASK) != !(sts[1] & TX_ACK_MASK));
+        winner = sts[0] & TX_ACK_MASK ? 0 : 1;
+        tmp105_write_limit(t.s[winner], v);
+        g_assert_cmphex(tmp105_read(t.s[!winner], TMP105_ADDR(!winner)), ==,
+                        v);
+    }
+
+    bridge_cleanup(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (!qtest_has_device("i2c-bridge")) {
+        return g_test_run();
+    }
+
+    qtest_add_func("/i2c-bridge/handshake", test_handshake);
+    qtest_add_func("/i2c-bridge/write-read", test_write_read);
+    qtest_add_func("/i2c-bridge/remote-nack", test_remote_nack);
+    qtest_add_func("/i2c-bridge/collision", test_collision);
+
+    return g_test_run();
+}
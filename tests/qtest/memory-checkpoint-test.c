@@ -0,0 +1,107 @@
+/*
+ * QTest testcase for the in-memory checkpoint commands
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+
+/* Pages far enough apart to be different pages on every target */
+#define PAGE_A          0x100000
+#define PAGE_B          0x200000
+
+static QTestState *checkpoint_init(void)
+{
+    return qtest_init("-machine none -m 16M");
+}
+
+static uint64_t checkpoint_restore(QTestState *s)
+{
+    QDict *rsp, *ret;
+    uint64_t restored;
+
+    rsp = qtest_qmp(s, "{ 'execute': 'x-memory-checkpoint-restore' }");
+    ret = qdict_get_qdict(rsp, "return");
+    g_assert(ret);
+    restored = qdict_get_int(ret, "restored-pages");
+    g_assert_cmpuint(restored, <, qdict_get_int(ret, "total-pages"));
+    qobject_unref(rsp);
+    return restored;
+}
+
+/* Only the pages written since the checkpoint, or last restore, go back */
+static void test_save_restore(void)
+{
+    QTestState *s = checkpoint_init();
+
+    qtest_writeq(s, PAGE_A, 0x1111111111111111ULL);
+    qtest_writeq(s, PAGE_B, 0x2222222222222222ULL);
+    qtest_qmp_assert_success(s, "{ 'execute': 'x-memory-checkpoint-save' }");
+
+    qtest_writeq(s, PAGE_A, 0xaaaaaaaaaaaaaaaaULL);
+    qtest_writeq(s, PAGE_B + 8, 0xbbbbbbbbbbbbbbbbULL);
+    g_assert_cmpuint(checkpoint_restore(s), ==, 2);
+    g_assert_cmphex(qtest_readq(s, PAGE_A), ==, 0x1111111111111111ULL);
+    g_assert_cmphex(qtest_readq(s, PAGE_B), ==, 0x2222222222222222ULL);
+    g_assert_cmphex(qtest_readq(s, PAGE_B + 8), ==, 0);
+
+    /* Nothing written since the last restore */
+    g_assert_cmpuint(checkpoint_restore(s), ==, 0);
+
+    /* The checkpoint outlives a restore */
+    qtest_writeq(s, PAGE_B, 0xccccccccccccccccULL);
+    g_assert_cmpuint(checkpoint_restore(s), ==, 1);
+    g_assert_cmphex(qtest_readq(s, PAGE_B), ==, 0x2222222222222222ULL);
+
+    qtest_quit(s);
+}
+
+static void test_drop(void)
+{
+    QTestState *s = checkpoint_init();
+
+    qtest_qmp_assert_success(s, "{ 'execute': 'x-memory-checkpoint-save' }");
+    qtest_qmp_assert_success(s, "{ 'execute': 'x-memory-checkpoint-drop' }");
+    qobject_unref(qtest_qmp_assert_failure_ref(
+                      s, "{ 'execute': 'x-memory-checkpoint-restore' }"));
+
+    qtest_quit(s);
+}
+
+/* Nothing else may reset the dirty bitmap while a checkpoint is held */
+static void test_dirty_rate_blocked(void)
+{
+    QTestState *s = checkpoint_init();
+
+    qtest_qmp_assert_success(s, "{ 'execute': 'x-memory-checkpoint-save' }");
+    qobject_unref(qtest_qmp_assert_failure_ref(
+                      s, "{ 'execute': 'calc-dirty-rate', 'arguments': "
+                      "{ 'calc-time': 1, 'mode': 'dirty-bitmap' } }"));
+    qobject_unref(qtest_qmp_assert_failure_ref(
+                      s, "{ 'execute': 'migrate', 'arguments': "
+                      "{ 'uri': 'exec:cat > /dev/null' } }"));
+
+    /* Nor can a checkpoint be taken while it is measured */
+    qtest_qmp_assert_success(s, "{ 'execute': 'x-memory-checkpoint-drop' }");
+    qtest_qmp_assert_success(s, "{ 'execute': 'calc-dirty-rate', "
+                             "'arguments': { 'calc-time': 60, "
+                             "'mode': 'dirty-bitmap' } }");
+    qobject_unref(qtest_qmp_assert_failure_ref(
+                      s, "{ 'execute': 'x-memory-checkpoint-save' }"));
+
+    qtest_quit(s);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/memory-checkpoint/save-restore", test_save_restore);
+    qtest_add_func("/memory-checkpoint/drop", test_drop);
+    qtest_add_func("/memory-checkpoint/dirty-rate-blocked",
+                   test_dirty_rate_blocked);
+
+    return g_test_run();
+}
@@ -142,6 +142,79 @@ static void test_precopy_file_mapped_ram(void)
     test_file_common(&args, true);
 }
 
+#ifndef _WIN32
+static void *migrate_hook_start_mapped_ram_mmap(QTestState *from,
+                                                QTestState *to)
+{
+    migrate_hook_start_mapped_ram(from, to);
+    migrate_set_capability(to, "x-mapped-ram-mmap", true);
+
+    return NULL;
+}
+
+static void test_precopy_file_mapped_ram_mmap(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_hook_start_mapped_ram_mmap,
+    };
+
+    test_file_common(&args, true);
+}
+
+/* Beyond the pages the guest dirties, on every target */
+#define STALE_ADDR      (end_address + 1024 * 1024)
+#define STALE_SIZE      (64 * 1024)
+
+/*
+ * A page sent by the first pass and zero by the time the migration
+ * completes only has its bit cleared: its old contents stay in the
+ * file and must not come back when the file is mapped.
+ */
+static void test_precopy_file_mapped_ram_mmap_zeroed(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    g_autofree uint8_t *buf = g_malloc(STALE_SIZE);
+    MigrateStart args = {};
+    QTestState *from, *to;
+    int i;
+
+    if (migrate_start(&from, &to, "defer", &args)) {
+        return;
+    }
+
+    migrate_hook_start_mapped_ram_mmap(from, to);
+    migrate_set_capability(from, "pause-before-switchover", true);
+    qtest_memset(from, STALE_ADDR, 0x5a, STALE_SIZE);
+
+    migrate_ensure_non_converge(from);
+    wait_for_serial("src_serial");
+    migrate_qmp(from, to, uri, NULL, "{}");
+    wait_for_migration_pass(from, get_src());
+
+    migrate_ensure_converge(from);
+    wait_for_migration_status(from, "pre-switchover", NULL);
+    qtest_memset(from, STALE_ADDR, 0, STALE_SIZE);
+    migrate_continue(from, "pre-switchover");
+    wait_for_migration_complete(from);
+
+    migrate_incoming_qmp(to, uri, "{}");
+    wait_for_migration_complete(to);
+    wait_for_serial("dest_serial");
+
+    qtest_memread(to, STALE_ADDR, buf, STALE_SIZE);
+    for (i = 0; i < STALE_SIZE; i++) {
+        g_assert_cmphex(buf[i], ==, 0);
+    }
+
+    migrate_end(from, to, true);
+}
+#endif /* !_WIN32 */
+
 static void *migrate_hook_start_multifd_mapped_ram(QTestState *from,
                                                    QTestState *to)
 {
@@ -320,6 +393,12 @@ void migration_test_add_file(MigrationTestEnv *env)
                        test_precopy_file_mapped_ram);
     migration_test_add("/migration/precopy/file/mapped-ram/live",
                        test_precopy_file_mapped_ram_live);
+#ifndef _WIN32
+    migration_test_add("/migration/precopy/file/mapped-ram/mmap",
+                       test_precopy_file_mapped_ram_mmap);
+    migration_test_add("/migration/precopy/file/mapped-ram/mmap/zeroed",
+                       test_precopy_file_mapped_ram_mmap_zeroed);
+#endif
 
     migration_test_add("/migration/multifd/file/mapped-ram",
                        test_multifd_file_mapped_ram);
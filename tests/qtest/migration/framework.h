@@ -105,6 +105,8 @@ typedef struct {
     bool only_target;
     /* Use dirty ring if true; dirty logging otherwise */
     bool use_dirty_ring;
+    /* Run on TCG only, logging dirty pages in rings of this size */
+    uint32_t tcg_dirty_ring_size;
     const char *opts_source;
     const char *opts_target;
     /* suspend the src before migrating to dest. */
@@ -197,6 +199,10 @@ typedef struct {
     PostcopyRecoveryFailStage postcopy_recovery_fail_stage;
 } MigrateCommon;
 
+/* The range of guest memory the boot file keeps dirtying */
+extern unsigned start_address;
+extern unsigned end_address;
+
 void wait_for_serial(const char *side);
 void migrate_prepare_for_dirty_mem(QTestState *from);
 void migrate_wait_for_dirty_mem(QTestState *from, QTestState *to);
@@ -79,6 +79,43 @@ static void test_precopy_unix_suspend_notlive(void)
     test_precopy_common(&args);
 }
 
+/*
+ * TCG logs the pages the guest dirties in rings, and the bitmap sync
+ * only visits them.  The guest memory check at the end catches any
+ * page the rings missed.
+ */
+static void test_precopy_unix_tcg_dirty_ring(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .start = {
+            /* More than the pages the guest keeps dirtying */
+            .tcg_dirty_ring_size = 65536,
+        },
+        .listen_uri = uri,
+        .connect_uri = uri,
+        .live = true,
+    };
+
+    test_precopy_common(&args);
+}
+
+/* Rings too small for the guest: every sync walks the bitmap */
+static void test_precopy_unix_tcg_dirty_ring_overflow(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .start = {
+            .tcg_dirty_ring_size = 256,
+        },
+        .listen_uri = uri,
+        .connect_uri = uri,
+        .live = true,
+    };
+
+    test_precopy_common(&args);
+}
+
 static void test_precopy_unix_dirty_ring(void)
 {
     g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
@@ -134,6 +171,71 @@ static void test_precopy_tcp_switchover_ack(void)
     test_precopy_common(&args);
 }
 
+static void *migrate_hook_start_parallel_device_state(QTestState *from,
+                                                     QTestState *to)
+{
+    migrate_set_capability(from, "x-parallel-device-state", true);
+    migrate_set_capability(to, "x-parallel-device-state", true);
+
+    return NULL;
+}
+
+/*
+ * Both sides report the time spent on every device, and the SD card,
+ * which is independent, went through a worker.
+ */
+static void check_device_times(QTestState *who)
+{
+    QDict *rsp = migrate_query(who);
+    QList *times = qdict_get_qlist(rsp, "x-device-times");
+    const QListEntry *entry;
+    bool sd_card = false;
+
+    g_assert(times);
+    g_assert(!qlist_empty(times));
+    QLIST_FOREACH_ENTRY(times, entry) {
+        QDict *dev = qobject_to(QDict, qlist_entry_obj(entry));
+        const char *idstr = qdict_get_str(dev, "idstr");
+        bool parallel = qdict_get_bool(dev, "parallel");
+
+        g_assert_cmpint(qdict_get_int(dev, "time"), >=, 0);
+        if (g_str_has_suffix(idstr, "sd-card")) {
+            g_assert_true(parallel);
+            sd_card = true;
+        } else {
+            g_assert_false(parallel);
+        }
+    }
+    g_assert_true(sd_card);
+    qobject_unref(rsp);
+}
+
+static void migrate_hook_end_parallel_device_state(QTestState *from,
+                                                   QTestState *to,
+                                                   void *opaque)
+{
+    check_device_times(from);
+    check_device_times(to);
+}
+
+static void test_precopy_unix_parallel_device_state(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .start = {
+            /* An SD card, whose state is saved and loaded in parallel */
+            .opts_source = "-device sdhci-pci -device sd-card",
+            .opts_target = "-device sdhci-pci -device sd-card",
+        },
+        .listen_uri = uri,
+        .connect_uri = uri,
+        .start_hook = migrate_hook_start_parallel_device_state,
+        .end_hook = migrate_hook_end_parallel_device_state,
+    };
+
+    test_precopy_common(&args);
+}
+
 #ifndef _WIN32
 static void *migrate_hook_start_fd(QTestState *from,
                                    QTestState *to)
@@ -970,6 +1072,11 @@ void migration_test_add_precopy(MigrationTestEnv *env)
     migration_test_add("/migration/precopy/tcp/plain/switchover-ack",
                        test_precopy_tcp_switchover_ack);
 
+    if (qtest_has_device("sdhci-pci")) {
+        migration_test_add("/migration/precopy/unix/parallel-device-state",
+                           test_precopy_unix_parallel_device_state);
+    }
+
 #ifndef _WIN32
     migration_test_add("/migration/precopy/fd/tcp",
                        test_precopy_fd_socket);
@@ -999,6 +1106,12 @@ void migration_test_add_precopy(MigrationTestEnv *env)
                        test_multifd_tcp_no_zero_page);
     migration_test_add("/migration/multifd/tcp/plain/cancel",
                        test_multifd_tcp_cancel);
+    if (env->has_tcg) {
+        migration_test_add("/migration/tcg_dirty_ring",
+                           test_precopy_unix_tcg_dirty_ring);
+        migration_test_add("/migration/tcg_dirty_ring/overflow",
+                           test_precopy_unix_tcg_dirty_ring_overflow);
+    }
     if (g_str_equal(env->arch, "x86_64")
         && env->has_kvm && env->has_dirty_ring) {
 
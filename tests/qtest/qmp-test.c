@@ -337,6 +337,66 @@ static void test_qmp_missing_any_arg(void)
     qtest_quit(qts);
 }
 
+static void test_qmp_batch(void)
+{
+    QTestState *qts;
+    QDict *resp, *rsp;
+    QList *rsps;
+
+    qts = qtest_init(common_args);
+
+    resp = qtest_qmp(qts, "{ 'execute': 'batch', 'arguments': {"
+                     " 'commands': ["
+                     "  { 'execute': 'qom-set', 'arguments':"
+                     "    { 'path': '/machine', 'property': 'type',"
+                     "      'value': 'foo' } },"
+                     "  { 'execute': 'query-name', 'id': 'cookie#1' },"
+                     "  { 'execute': 'no-such-command', 'id': 2 },"
+                     "  42,"
+                     "  { 'execute': 'qom-list-types', 'arguments':"
+                     "    { 'implements': 'machine', 'abstract': true } } ]"
+                     " } }");
+    rsps = qdict_get_qlist(resp, "return");
+    g_assert(rsps);
+    g_assert_cmpint(qlist_size(rsps), ==, 5);
+
+    /* Each command gets the response it would have had on its own */
+    rsp = qobject_to(QDict, qlist_pop(rsps));
+    qmp_expect_error_and_unref(rsp, "GenericError");
+    rsp = qobject_to(QDict, qlist_pop(rsps));
+    g_assert(qdict_get_qdict(rsp, "return"));
+    g_assert_cmpstr(qdict_get_try_str(rsp, "id"), ==, "cookie#1");
+    qobject_unref(rsp);
+    rsp = qobject_to(QDict, qlist_pop(rsps));
+    g_assert_cmpint(qdict_get_int(rsp, "id"), ==, 2);
+    qmp_expect_error_and_unref(rsp, "CommandNotFound");
+    rsp = qobject_to(QDict, qlist_pop(rsps));
+    qmp_expect_error_and_unref(rsp, "GenericError");
+    rsp = qobject_to(QDict, qlist_pop(rsps));
+    g_assert(qdict_get_qlist(rsp, "return"));
+    qobject_unref(rsp);
+    qobject_unref(resp);
+
+    /* Nothing runs after the first failure */
+    resp = qtest_qmp(qts, "{ 'execute': 'batch', 'arguments': {"
+                     " 'stop-on-error': true, 'commands': ["
+                     "  { 'execute': 'query-name' },"
+                     "  { 'execute': 'query-name', 'arguments': { 'x': 1 } },"
+                     "  { 'execute': 'query-name' } ]"
+                     " } }");
+    rsps = qdict_get_qlist(resp, "return");
+    g_assert(rsps);
+    g_assert_cmpint(qlist_size(rsps), ==, 2);
+    qobject_unref(resp);
+
+    /* Malformed batches fail as a whole */
+    resp = qtest_qmp(qts, "{ 'execute': 'batch', 'arguments': {"
+                     " 'commands': { 'execute': 'query-name' } } }");
+    qmp_expect_error_and_unref(resp, "GenericError");
+
+    qtest_quit(qts);
+}
+
 int main(int argc, char *argv[])
 {
     g_test_init(&argc, &argv, NULL);
@@ -348,6 +408,7 @@ int main(int argc, char *argv[])
 #endif
     qtest_add_func("qmp/preconfig", test_qmp_preconfig);
     qtest_add_func("qmp/missing-any-arg", test_qmp_missing_any_arg);
+    qtest_add_func("qmp/batch", test_qmp_batch);
 
     return g_test_run();
 }
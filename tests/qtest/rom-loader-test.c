@@ -0,0 +1,91 @@
+/*
+ * QTest testcase for images loaded with rom_add_file()
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include <glib/gstdio.h>
+#include "libqtest.h"
+
+/* RAM of vexpress-a9 */
+#define LOAD_ADDR       0x60000000
+#define IMAGE_SIZE      (64 * 1024)
+
+static uint8_t pattern(unsigned int i, uint8_t seed)
+{
+    return (i * 7 + seed) & 0xff;
+}
+
+static void write_image(int fd, uint8_t seed)
+{
+    g_autofree uint8_t *buf = g_malloc(IMAGE_SIZE);
+    unsigned int i;
+
+    for (i = 0; i < IMAGE_SIZE; i++) {
+        buf[i] = pattern(i, seed);
+    }
+    g_assert_cmpint(pwrite(fd, buf, IMAGE_SIZE, 0), ==, IMAGE_SIZE);
+}
+
+static void check_image(QTestState *s, uint8_t seed)
+{
+    g_autofree uint8_t *buf = g_malloc(IMAGE_SIZE);
+    unsigned int i;
+
+    qtest_memread(s, LOAD_ADDR, buf, IMAGE_SIZE);
+    for (i = 0; i < IMAGE_SIZE; i++) {
+        g_assert_cmphex(buf[i], ==, pattern(i, seed));
+    }
+}
+
+/*
+ * The image is read from its file when the machine is reset.  Truncating
+ * the file afterwards must not crash QEMU: the ROM is left as the guest
+ * had it.
+ */
+static void test_rom_truncated(void)
+{
+    g_autoptr(GError) err = NULL;
+    g_autofree char *path = NULL;
+    g_autofree uint8_t *buf = g_malloc(IMAGE_SIZE);
+    unsigned int i;
+    QTestState *s;
+    int fd;
+
+    fd = g_file_open_tmp("rom-loader-test.XXXXXX", &path, &err);
+    g_assert_no_error(err);
+    write_image(fd, 1);
+
+    s = qtest_initf("-machine vexpress-a9 "
+                    "-device loader,file=%s,addr=0x%x,force-raw=on",
+                    path, LOAD_ADDR);
+    check_image(s, 1);
+
+    /* The guest overwrites the image, a reset restores it */
+    qtest_memset(s, LOAD_ADDR, 0x5a, IMAGE_SIZE);
+    qtest_system_reset(s);
+    check_image(s, 1);
+
+    /* Not once the file was truncated */
+    g_assert_cmpint(ftruncate(fd, 0), ==, 0);
+    qtest_memset(s, LOAD_ADDR, 0xa5, IMAGE_SIZE);
+    qtest_system_reset(s);
+    qtest_memread(s, LOAD_ADDR, buf, IMAGE_SIZE);
+    for (i = 0; i < IMAGE_SIZE; i++) {
+        g_assert_cmphex(buf[i], ==, 0xa5);
+    }
+
+    qtest_quit(s);
+    close(fd);
+    g_unlink(path);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/loader/rom/truncated", test_rom_truncated);
+
+    return g_test_run();
+}
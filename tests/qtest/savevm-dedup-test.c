@@ -0,0 +1,150 @@
+/*
+ * QTest testcase for internal snapshots saved with x-ram-dedup
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+
+/* Large enough chunks to hold whole pages on every target */
+#define CHUNK           (64 * KiB)
+
+#define DUP_BASE        0x100000
+#define DUP_SIZE        (4 * MiB)
+#define DUP_BYTE        0x5a
+#define UNIQUE_BASE     0x800000
+#define ZERO_BASE       0xc00000
+
+static void set_dedup(QTestState *s, bool on)
+{
+    qtest_qmp_assert_success(s, "{ 'execute': 'migrate-set-capabilities', "
+                             "'arguments': { 'capabilities': [ "
+                             "{ 'capability': 'x-ram-dedup', "
+                             "'state': %i } ] } }", on);
+}
+
+static void hmp_assert_silent(QTestState *s, const char *cmd)
+{
+    g_autofree char *out = qtest_hmp(s, "%s", cmd);
+
+    g_assert_cmpstr(out, ==, "");
+}
+
+static int64_t snapshot_vm_size(QTestState *s, const char *name)
+{
+    QDict *rsp = qtest_qmp(s, "{ 'execute': 'query-block' }");
+    QListEntry *e, *f;
+    int64_t size = -1;
+
+    QLIST_FOREACH_ENTRY(qdict_get_qlist(rsp, "return"), e) {
+        QDict *block = qobject_to(QDict, qlist_entry_obj(e));
+        QDict *image;
+
+        if (strcmp(qdict_get_str(block, "device"), "disk")) {
+            continue;
+        }
+        image = qdict_get_qdict(qdict_get_qdict(block, "inserted"), "image");
+        QLIST_FOREACH_ENTRY(qdict_get_qlist(image, "snapshots"), f) {
+            QDict *sn = qobject_to(QDict, qlist_entry_obj(f));
+
+            if (!strcmp(qdict_get_str(sn, "name"), name)) {
+                size = qdict_get_int(sn, "vm-state-size");
+            }
+        }
+    }
+    qobject_unref(rsp);
+
+    g_assert_cmpint(size, >, 0);
+    return size;
+}
+
+/* Every 32-bit word differs, so does every page */
+static void unique_fill(uint32_t *buf)
+{
+    int i;
+
+    for (i = 0; i < CHUNK / 4; i++) {
+        buf[i] = 0x10000 + i;
+    }
+}
+
+static void check_memory(QTestState *s)
+{
+    g_autofree uint8_t *expected = g_malloc(CHUNK);
+    g_autofree uint8_t *buf = g_malloc(CHUNK);
+    int i;
+
+    memset(expected, DUP_BYTE, CHUNK);
+    for (i = 0; i < DUP_SIZE; i += CHUNK) {
+        qtest_memread(s, DUP_BASE + i, buf, CHUNK);
+        g_assert(!memcmp(buf, expected, CHUNK));
+    }
+
+    unique_fill((uint32_t *)expected);
+    qtest_memread(s, UNIQUE_BASE, buf, CHUNK);
+    g_assert(!memcmp(buf, expected, CHUNK));
+
+    memset(expected, 0, CHUNK);
+    qtest_memread(s, ZERO_BASE, buf, CHUNK);
+    g_assert(!memcmp(buf, expected, CHUNK));
+}
+
+/*
+ * Identical pages are stored once, and a snapshot saved that way
+ * brings guest RAM back as it was.
+ */
+static void test_save_load(void)
+{
+    g_autofree uint32_t *unique = g_malloc(CHUNK);
+    g_autofree char *image = NULL;
+    QTestState *s;
+    int fd;
+
+    fd = g_file_open_tmp("savevm-dedup-test.XXXXXX", &image, NULL);
+    g_assert(fd >= 0);
+    close(fd);
+    g_assert(mkimg(image, "qcow2", 16));
+
+    s = qtest_initf("-machine none -m 16M "
+                    "-drive if=none,id=disk,format=qcow2,file=%s", image);
+
+    qtest_memset(s, DUP_BASE, DUP_BYTE, DUP_SIZE);
+    unique_fill(unique);
+    qtest_memwrite(s, UNIQUE_BASE, unique, CHUNK);
+
+    set_dedup(s, true);
+    hmp_assert_silent(s, "savevm dedup");
+    set_dedup(s, false);
+    hmp_assert_silent(s, "savevm full");
+    g_assert_cmpint(snapshot_vm_size(s, "dedup") * 4, <,
+                    snapshot_vm_size(s, "full"));
+
+    qtest_memset(s, DUP_BASE, ~DUP_BYTE, DUP_SIZE);
+    qtest_memset(s, UNIQUE_BASE, 0, CHUNK);
+    qtest_memset(s, ZERO_BASE, 0xff, CHUNK);
+
+    hmp_assert_silent(s, "loadvm dedup");
+    check_memory(s);
+
+    qtest_quit(s);
+    unlink(image);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (!have_qemu_img()) {
+        g_test_message("QTEST_QEMU_IMG not set or qemu-img missing; "
+                       "skipping savevm-dedup tests");
+        return g_test_run();
+    }
+
+    qtest_add_func("/savevm-dedup/save-load", test_save_load);
+
+    return g_test_run();
+}
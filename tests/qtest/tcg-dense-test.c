@@ -0,0 +1,233 @@
+/*
+ * QTest testcase for the dense TCG vCPU scheduling
+ *
+ * Any machine with two vCPUs started at once does, the AST2600 EVB is
+ * used as it has no firmware requirements.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/qmp/qdict.h"
+#include "libqtest.h"
+
+#define DRAM_BASE               0x80000000
+#define PROGRAM                 DRAM_BASE
+#define IDLE_PROGRAM            (DRAM_BASE + 0x100)
+#define COUNTER(cpu)            (DRAM_BASE + 0x1000 + (cpu) * 4)
+
+/* Increment the word at COUNTER(MPIDR.Aff0) forever */
+static const uint32_t busy_program[] = {
+    0xe3a01102, /* mov     r1, #0x80000000 */
+    0xe2811a01, /* add     r1, r1, #0x1000 */
+    0xee102fb0, /* mrc     p15, 0, r2, c0, c0, 5 */
+    0xe2022003, /* and     r2, r2, #3 */
+    0xe0811102, /* add     r1, r1, r2, lsl #2 */
+    0xe5910000, /* 1: ldr  r0, [r1] */
+    0xe2800001, /* add     r0, r0, #1 */
+    0xe5810000, /* str     r0, [r1] */
+    0xeafffffb, /* b       1b */
+};
+
+/* Nothing ever wakes the vCPU up */
+static const uint32_t idle_program[] = {
+    0xe320f003, /* 1: wfi */
+    0xeafffffd, /* b       1b */
+};
+
+static void load_program(QTestState *s, uint64_t addr,
+                         const uint32_t *insns, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        qtest_writel(s, addr + i * 4, insns[i]);
+    }
+}
+
+/*
+ * Start both vCPUs of the AST2600, @cpu1_busy telling whether the
+ * second one runs the counter or sleeps. The reset vectors are set by
+ * generic loaders and the programs loaded while the machine is stopped.
+ */
+static QTestState *start(const char *thread, bool cpu1_busy)
+{
+    QTestState *s;
+
+    s = qtest_initf("-S -accel tcg,thread=%s -machine ast2600-evb "
+                    "-device loader,addr=0x%x,cpu-num=0 "
+                    "-device loader,addr=0x%x,cpu-num=1",
+                    thread, PROGRAM, cpu1_busy ? PROGRAM : IDLE_PROGRAM);
+
+    load_program(s, PROGRAM, busy_program, ARRAY_SIZE(busy_program));
+    load_program(s, IDLE_PROGRAM, idle_program, ARRAY_SIZE(idle_program));
+    qtest_qmp_assert_success(s, "{ 'execute': 'cont' }");
+    return s;
+}
+
+/* The "slice kicks" count of the dense scheduling section of x-query-jit */
+static uint64_t dense_kicks(QTestState *s)
+{
+    QDict *response;
+    const char *p;
+    uint64_t ret;
+
+    response = qtest_qmp(s, "{ 'execute': 'x-query-jit' }");
+    g_assert(qdict_haskey(response, "return"));
+    p = strstr(qdict_get_str(response, "return"), "slice kicks");
+    g_assert(p);
+    ret = g_ascii_strtoull(p + strlen("slice kicks"), NULL, 10);
+    qobject_unref(response);
+    return ret;
+}
+
+/* Two busy vCPUs share the thread, each preempted at the end of a slice */
+static void test_dense_runs_all(void)
+{
+    QTestState *s = start("dense", true);
+    uint32_t c0, c1;
+    uint64_t kicks;
+
+    g_usleep(200 * 1000);
+    c0 = qtest_readl(s, COUNTER(0));
+    c1 = qtest_readl(s, COUNTER(1));
+    kicks = dense_kicks(s);
+    g_usleep(500 * 1000);
+    g_assert_cmpuint(qtest_readl(s, COUNTER(0)), >, c0);
+    g_assert_cmpuint(qtest_readl(s, COUNTER(1)), >, c1);
+    g_assert_cmpuint(dense_kicks(s), >, kicks);
+
+    qtest_quit(s);
+}
+
+/*
+ * With the other vCPU asleep, the busy one runs without being preempted:
+ * unlike thread=single, whose kick timer fires every 100ms whatever the
+ * state of the vCPUs, no slice ends.
+ */
+static void test_dense_skips_idle(void)
+{
+    QTestState *s = start("dense", false);
+    uint32_t c0;
+    uint64_t kicks;
+
+    g_usleep(200 * 1000);
+    c0 = qtest_readl(s, COUNTER(0));
+    kicks = dense_kicks(s);
+    g_usleep(500 * 1000);
+    g_assert_cmpuint(qtest_readl(s, COUNTER(0)), >, c0);
+    g_assert_cmpuint(dense_kicks(s), ==, kicks);
+    g_assert_cmpuint(qtest_readl(s, COUNTER(1)), ==, 0);
+
+    qtest_quit(s);
+}
+
+#ifdef __linux__
+/* Host CPU time of the whole QEMU process, in clock ticks */
+static uint64_t host_cpu_ticks(pid_t pid)
+{
+    g_autofree char *path = g_strdup_printf("/proc/%d/stat", pid);
+    g_autofree char *stat = NULL;
+    g_auto(GStrv) fields = NULL;
+    char *p;
+
+    g_assert(g_file_get_contents(path, &stat, NULL, NULL));
+    /* Skip the command name, it may contain spaces */
+    p = strrchr(stat, ')');
+    g_assert(p);
+    fields = g_strsplit(p + 2, " ", 0);
+    g_assert_cmpint(g_strv_length(fields), >, 12);
+    /* utime and stime, fields 14 and 15 of the whole line */
+    return g_ascii_strtoull(fields[11], NULL, 10) +
+           g_ascii_strtoull(fields[12], NULL, 10);
+}
+
+/* Context switches summed over all the threads of QEMU */
+static uint64_t host_ctxt_switches(pid_t pid)
+{
+    g_autofree char *dir = g_strdup_printf("/proc/%d/task", pid);
+    g_autoptr(GDir) tasks = g_dir_open(dir, 0, NULL);
+    const char *tid;
+    uint64_t total = 0;
+
+    g_assert(tasks);
+    while ((tid = g_dir_read_name(tasks))) {
+        g_autofree char *path = g_strdup_printf("%s/%s/status", dir, tid);
+        g_autofree char *status = NULL;
+        g_auto(GStrv) lines = NULL;
+        int i;
+
+        /* The thread may be gone already */
+        if (!g_file_get_contents(path, &status, NULL, NULL)) {
+            continue;
+        }
+        lines = g_strsplit(status, "\n", 0);
+        for (i = 0; lines[i]; i++) {
+            const char *val = strchr(lines[i], ':');
+
+            /* voluntary_ctxt_switches and nonvoluntary_ctxt_switches */
+            if (val &&
+                g_strstr_len(lines[i], val - lines[i], "ctxt_switches")) {
+                total += g_ascii_strtoull(val + 1, NULL, 10);
+            }
+        }
+    }
+    return total;
+}
+
+/*
+ * One vCPU spinning and the other one sleeping, as most of the small
+ * guests packed on a host are, with each threading mode: host CPU time
+ * and context switches of QEMU over a second of wall clock time.
+ */
+static void test_perf_density(void)
+{
+    static const char *const modes[] = { "multi", "single", "dense" };
+    long hz = sysconf(_SC_CLK_TCK);
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(modes); i++) {
+        QTestState *s = start(modes[i], false);
+        pid_t pid = qtest_pid(s);
+        uint64_t ticks, ctxt;
+        uint32_t count;
+        double duration;
+
+        g_usleep(200 * 1000);
+        ticks = host_cpu_ticks(pid);
+        ctxt = host_ctxt_switches(pid);
+        count = qtest_readl(s, COUNTER(0));
+
+        g_test_timer_start();
+        g_usleep(1000 * 1000);
+        duration = g_test_timer_elapsed();
+
+        ticks = host_cpu_ticks(pid) - ticks;
+        ctxt = host_ctxt_switches(pid) - ctxt;
+        count = qtest_readl(s, COUNTER(0)) - count;
+        g_test_message("thread=%s: %f host CPUs busy, %" PRIu64 " context "
+                       "switches, %f M guest iterations per CPU second",
+                       modes[i], (double)ticks / hz / duration, ctxt,
+                       ticks ? count / ((double)ticks / hz) / 1e6 : 0);
+
+        qtest_quit(s);
+    }
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (qtest_has_accel("tcg")) {
+        qtest_add_func("/tcg/dense/runs-all", test_dense_runs_all);
+        qtest_add_func("/tcg/dense/skips-idle", test_dense_skips_idle);
+#ifdef __linux__
+        if (g_test_perf()) {
+            qtest_add_func("/tcg/dense/perf/density", test_perf_density);
+        }
+#endif
+    }
+
+    return g_test_run();
+}
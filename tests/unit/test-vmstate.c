@@ -330,6 +330,82 @@ static void test_simple_array(void)
                          sizeof(wire_simple_arr)));
 }
 
+typedef struct TestMixed {
+    bool b_1;
+    uint8_t u8_arr[3];
+    int16_t i16_1;
+    uint32_t u32_arr[2];
+    uint64_t u64_1;
+    uint8_t buf[1500];
+} TestMixed;
+
+/*
+ * All the fields below are moved through the compiled plan as one run;
+ * the unused bytes in the middle and the buffer larger than the staging
+ * area on the stack must still come out exactly as the interpreter would
+ * write them.
+ */
+static const VMStateDescription vmstate_mixed = {
+    .name = "simple/mixed",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_BOOL(b_1, TestMixed),
+        VMSTATE_UINT8_ARRAY(u8_arr, TestMixed, 3),
+        VMSTATE_UNUSED(2),
+        VMSTATE_INT16(i16_1, TestMixed),
+        VMSTATE_UINT32_ARRAY(u32_arr, TestMixed, 2),
+        VMSTATE_UINT64(u64_1, TestMixed),
+        VMSTATE_BUFFER(buf, TestMixed),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void test_simple_mixed(void)
+{
+    TestMixed obj_mixed = {
+        .b_1 = true,
+        .u8_arr = { 0x01, 0x02, 0x03 },
+        .i16_1 = -2,
+        .u32_arr = { 0x11223344, 0x55667788 },
+        .u64_1 = 0x0102030405060708ULL,
+    };
+    uint8_t head[] = {
+        /* b_1 */     0x01,
+        /* u8_arr */  0x01, 0x02, 0x03,
+        /* unused */  0x00, 0x00,
+        /* i16_1 */   0xff, 0xfe,
+        /* u32_arr */ 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88,
+        /* u64_1 */   0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    };
+    size_t size = sizeof(head) + sizeof(obj_mixed.buf) + 1;
+    g_autofree uint8_t *wire = g_malloc(size);
+    TestMixed obj, obj_clone;
+    int i;
+
+    for (i = 0; i < sizeof(obj_mixed.buf); i++) {
+        obj_mixed.buf[i] = i;
+    }
+    memcpy(wire, head, sizeof(head));
+    memcpy(wire + sizeof(head), obj_mixed.buf, sizeof(obj_mixed.buf));
+    wire[size - 1] = QEMU_VM_EOF;
+
+    save_vmstate(&vmstate_mixed, &obj_mixed);
+    compare_vmstate(wire, size);
+
+    memset(&obj, 0, sizeof(obj));
+    SUCCESS(load_vmstate_one(&vmstate_mixed, &obj, 1, wire, size));
+    g_assert(obj.b_1);
+    g_assert_cmpint(obj.i16_1, ==, -2);
+    g_assert_cmpint(obj.u32_arr[1], ==, 0x55667788);
+    g_assert_cmpuint(obj.u64_1, ==, 0x0102030405060708ULL);
+    SUCCESS(memcmp(obj.u8_arr, obj_mixed.u8_arr, sizeof(obj.u8_arr)));
+    SUCCESS(memcmp(obj.buf, obj_mixed.buf, sizeof(obj.buf)));
+
+    /* A truncated stream must fail the whole run */
+    FAILURE(load_vmstate_one(&vmstate_mixed, &obj_clone, 1, wire, 10));
+}
+
 typedef struct TestStruct {
     uint32_t a, b, c, e;
     uint64_t d, f;
@@ -1492,6 +1568,7 @@ int main(int argc, char **argv)
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/vmstate/simple/primitive", test_simple_primitive);
     g_test_add_func("/vmstate/simple/array", test_simple_array);
+    g_test_add_func("/vmstate/simple/mixed", test_simple_mixed);
     g_test_add_func("/vmstate/versioned/load/v1", test_load_v1);
     g_test_add_func("/vmstate/versioned/load/v2", test_load_v2);
     g_test_add_func("/vmstate/field_exists/load/noskip", test_load_noskip);
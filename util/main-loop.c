@@ -544,6 +544,13 @@ static int os_host_main_loop_wait(int64_t timeout)
 }
 #endif
 
+static int64_t main_loop_timer_slack_ns;
+
+void main_loop_set_timer_slack(int64_t slack_ns)
+{
+    main_loop_timer_slack_ns = slack_ns;
+}
+
 static NotifierList main_loop_poll_notifiers =
     NOTIFIER_LIST_INITIALIZER(main_loop_poll_notifiers);
 
@@ -586,6 +593,14 @@ void main_loop_wait(int nonblocking)
                                       timerlistgroup_deadline_ns(
                                           &main_loop_tlg));
 
+    if (main_loop_timer_slack_ns && timeout_ns > 0) {
+        int64_t now = get_clock();
+
+        timeout_ns = QEMU_ALIGN_UP(now + timeout_ns,
+                                   main_loop_timer_slack_ns) -
+                     now;
+    }
+
     ret = os_host_main_loop_wait(timeout_ns);
     mlpoll.state = ret < 0 ? MAIN_LOOP_POLL_ERR : MAIN_LOOP_POLL_OK;
     notifier_list_notify(&main_loop_poll_notifiers, &mlpoll);
@@ -0,0 +1,240 @@
+/*
+ * Startup profiler
+ *
+ * Events are kept in a flat array as they complete.  Nesting (a SoC
+ * realize containing the realize of its children, for example) is only
+ * reconstructed when the profile is written out: the Chrome trace viewer
+ * does that on its own from the timestamps, and the summary computes the
+ * self time of each event by subtracting the time of its direct children.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qmp/json-writer.h"
+#include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/startup-profile.h"
+#include "qemu/thread.h"
+
+typedef struct StartupProfileEvent {
+    const char *cat;
+    const char *name;
+    int64_t start;
+    int64_t dur;
+    int64_t children;
+    int tid;
+} StartupProfileEvent;
+
+typedef struct StartupProfileEntry {
+    const char *cat;
+    const char *name;
+    int64_t total;
+    int64_t self;
+    unsigned count;
+} StartupProfileEntry;
+
+bool startup_profile_enabled;
+
+static QemuMutex startup_profile_lock;
+static GArray *startup_profile_events;
+static char *startup_profile_path;
+static StartupProfileFormat startup_profile_format;
+
+bool startup_profile_enable(const char *path, StartupProfileFormat format,
+                            Error **errp)
+{
+    if (!path && format != STARTUP_PROFILE_SUMMARY) {
+        error_setg(errp, "a file is required for the Chrome trace format");
+        return false;
+    }
+
+    qemu_mutex_init(&startup_profile_lock);
+    startup_profile_events = g_array_new(false, false,
+                                         sizeof(StartupProfileEvent));
+    startup_profile_path = g_strdup(path);
+    startup_profile_format = format;
+    startup_profile_enabled = true;
+    return true;
+}
+
+void startup_profile_add(const char *cat, const char *name,
+                         int64_t start, int64_t end)
+{
+    StartupProfileEvent ev = {
+        .cat = cat,
+        .name = name,
+        .start = start,
+        .dur = end - start,
+        .tid = qemu_get_thread_id(),
+    };
+
+    /* Started before the profiler was enabled */
+    if (!start) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&startup_profile_lock);
+    if (startup_profile_enabled) {
+        g_array_append_val(startup_profile_events, ev);
+    }
+}
+
+static gint startup_profile_event_cmp(gconstpointer a, gconstpointer b)
+{
+    const StartupProfileEvent *ea = a, *eb = b;
+
+    if (ea->tid != eb->tid) {
+        return ea->tid < eb->tid ? -1 : 1;
+    }
+    if (ea->start != eb->start) {
+        return ea->start < eb->start ? -1 : 1;
+    }
+    /* Parents first when they start on the same tick */
+    return ea->dur > eb->dur ? -1 : ea->dur < eb->dur;
+}
+
+static gint startup_profile_entry_cmp(gconstpointer a, gconstpointer b)
+{
+    const StartupProfileEntry *ea = *(StartupProfileEntry **)a;
+    const StartupProfileEntry *eb = *(StartupProfileEntry **)b;
+
+    return ea->self > eb->self ? -1 : ea->self < eb->self;
+}
+
+static void startup_profile_write_chrome(FILE *out)
+{
+    g_autoptr(JSONWriter) writer = json_writer_new(false);
+    int64_t epoch = INT64_MAX;
+    int pid = getpid();
+    guint i;
+
+    for (i = 0; i < startup_profile_events->len; i++) {
+        epoch = MIN(epoch, g_array_index(startup_profile_events,
+                                         StartupProfileEvent, i).start);
+    }
+
+    json_writer_start_object(writer, NULL);
+    json_writer_str(writer, "displayTimeUnit", "ms");
+    json_writer_start_array(writer, "traceEvents");
+    for (i = 0; i < startup_profile_events->len; i++) {
+        StartupProfileEvent *ev = &g_array_index(startup_profile_events,
+                                                 StartupProfileEvent, i);
+
+        json_writer_start_object(writer, NULL);
+        json_writer_str(writer, "name", ev->name);
+        json_writer_str(writer, "cat", ev->cat);
+        json_writer_str(writer, "ph", "X");
+        json_writer_double(writer, "ts", (ev->start - epoch) / 1000.0);
+        json_writer_double(writer, "dur", ev->dur / 1000.0);
+        json_writer_int64(writer, "pid", pid);
+        json_writer_int64(writer, "tid", ev->tid);
+        json_writer_end_object(writer);
+    }
+    json_writer_end_array(writer);
+    json_writer_end_object(writer);
+
+    fprintf(out, "%s\n", json_writer_get(writer));
+}
+
+static void startup_profile_write_summary(FILE *out)
+{
+    g_autoptr(GHashTable) entries = NULL;
+    g_autoptr(GPtrArray) sorted = NULL;
+    g_autoptr(GArray) stack = NULL;
+    StartupProfileEntry *entry;
+    GHashTableIter iter;
+    guint i;
+
+    /* Charge each event to its innermost enclosing event on the same thread */
+    stack = g_array_new(false, false, sizeof(StartupProfileEvent *));
+    for (i = 0; i < startup_profile_events->len; i++) {
+        StartupProfileEvent *ev = &g_array_index(startup_profile_events,
+                                                 StartupProfileEvent, i);
+
+        while (stack->len) {
+            StartupProfileEvent *top = g_array_index(stack,
+                                                     StartupProfileEvent *,
+                                                     stack->len - 1);
+            if (top->tid == ev->tid && ev->start < top->start + top->dur) {
+                top->children += ev->dur;
+                break;
+            }
+            g_array_set_size(stack, stack->len - 1);
+        }
+        g_array_append_val(stack, ev);
+    }
+
+    entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    for (i = 0; i < startup_profile_events->len; i++) {
+        StartupProfileEvent *ev = &g_array_index(startup_profile_events,
+                                                 StartupProfileEvent, i);
+        g_autofree char *key = g_strdup_printf("%s/%s", ev->cat, ev->name);
+
+        entry = g_hash_table_lookup(entries, key);
+        if (!entry) {
+            entry = g_new0(StartupProfileEntry, 1);
+            entry->cat = ev->cat;
+            entry->name = ev->name;
+            g_hash_table_insert(entries, g_steal_pointer(&key), entry);
+        }
+        entry->total += ev->dur;
+        entry->self += ev->dur - ev->children;
+        entry->count++;
+    }
+
+    sorted = g_ptr_array_new();
+    g_hash_table_iter_init(&iter, entries);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry)) {
+        g_ptr_array_add(sorted, entry);
+    }
+    g_ptr_array_sort(sorted, startup_profile_entry_cmp);
+
+    fprintf(out, "%10s %10s %6s  %-10s %s\n",
+            "self ms", "total ms", "count", "category", "name");
+    for (i = 0; i < sorted->len; i++) {
+        entry = g_ptr_array_index(sorted, i);
+        fprintf(out, "%10.3f %10.3f %6u  %-10s %s\n",
+                entry->self / 1e6, entry->total / 1e6, entry->count,
+                entry->cat, entry->name);
+    }
+}
+
+void startup_profile_finish(void)
+{
+    FILE *out = stderr;
+
+    if (!startup_profile_enabled) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&startup_profile_lock) {
+        startup_profile_enabled = false;
+    }
+
+    if (startup_profile_path) {
+        out = fopen(startup_profile_path, "w");
+        if (!out) {
+            error_report("Could not open startup profile '%s': %s",
+                         startup_profile_path, strerror(errno));
+            goto out;
+        }
+    }
+
+    g_array_sort(startup_profile_events, startup_profile_event_cmp);
+    if (startup_profile_format == STARTUP_PROFILE_CHROME) {
+        startup_profile_write_chrome(out);
+    } else {
+        startup_profile_write_summary(out);
+    }
+
+    if (out != stderr) {
+        fclose(out);
+    }
+out:
+    g_array_free(startup_profile_events, true);
+    startup_profile_events = NULL;
+    g_clear_pointer(&startup_profile_path, g_free);
+}